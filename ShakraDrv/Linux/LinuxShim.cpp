@@ -0,0 +1,951 @@
+/*
+Shakra Driver component for Linux
+This .cpp file contains a shim of the Win32 and WinMM APIs used by the driver, so that its sources can be built and tested under Linux.
+
+This file is only used by the harness in this folder, the driver itself still only runs under Windows.
+*/
+
+#ifdef __linux__
+
+#include "LinuxShim.hpp"
+#include <cerrno>
+#include <cwctype>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <sched.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+
+	SHAKRA_SHIM_VERBOSE picks what gets printed to stderr:
+	0 = Nothing
+	1 = The message boxes, the default, since every one of them would stop the app under Windows
+	2 = The message boxes and the debug strings (LOG())
+
+*/
+
+const GUID FOLDERID_ProgramFiles = { 0x905E63B6, 0xC1BF, 0x494E, { 0xB2, 0x9C, 0x65, 0xB7, 0x32, 0xD3, 0xD2, 0x1A } };
+const GUID FOLDERID_ProgramFilesX86 = { 0x7C5A40EF, 0xA0FB, 0x4BFC, { 0x87, 0x4A, 0xC0, 0xF2, 0xE0, 0xB9, 0xFA, 0x8E } };
+const GUID GUID_DEVCLASS_MEDIA = { 0x4D36E96C, 0xE325, 0x11CE, { 0xBF, 0xC1, 0x08, 0x00, 0x2B, 0xE1, 0x03, 0x18 } };
+
+static thread_local DWORD LastError = ERROR_SUCCESS;
+
+static int GetVerbosity() {
+	const char* Value = getenv("SHAKRA_SHIM_VERBOSE");
+	return Value ? atoi(Value) : 1;
+}
+
+static std::string Narrow(const wchar_t* Source) {
+	std::string Ret;
+
+	if (!Source)
+		return Ret;
+
+	// UTF-8, without caring about the locale
+	for (; *Source; Source++) {
+		unsigned int Char = (unsigned int)*Source;
+
+		if (Char < 0x80) Ret += (char)Char;
+		else if (Char < 0x800) {
+			Ret += (char)(0xC0 | (Char >> 6));
+			Ret += (char)(0x80 | (Char & 0x3F));
+		}
+		else if (Char < 0x10000) {
+			Ret += (char)(0xE0 | (Char >> 12));
+			Ret += (char)(0x80 | ((Char >> 6) & 0x3F));
+			Ret += (char)(0x80 | (Char & 0x3F));
+		}
+		else {
+			Ret += (char)(0xF0 | (Char >> 18));
+			Ret += (char)(0x80 | ((Char >> 12) & 0x3F));
+			Ret += (char)(0x80 | ((Char >> 6) & 0x3F));
+			Ret += (char)(0x80 | (Char & 0x3F));
+		}
+	}
+
+	return Ret;
+}
+
+static std::wstring Widen(const char* Source) {
+	std::wstring Ret;
+
+	// Only used for ASCII, the paths and the names the driver uses
+	for (; Source && *Source; Source++)
+		Ret += (wchar_t)(unsigned char)*Source;
+
+	return Ret;
+}
+
+const wchar_t* ShimWiden(const char* Source) {
+	static std::mutex Lock;
+	static std::unordered_map<const char*, std::wstring> Strings;
+
+	// The sources are literals, so the pointer is as good as the string
+	std::lock_guard<std::mutex> Guard(Lock);
+	auto It = Strings.find(Source);
+
+	if (It == Strings.end())
+		It = Strings.emplace(Source, Widen(Source)).first;
+
+	return It->second.c_str();
+}
+
+DWORD GetLastError() {
+	return LastError;
+}
+
+void SetLastError(DWORD Error) {
+	LastError = Error;
+}
+
+//
+// KERNEL OBJECTS
+//
+
+/*
+
+	A HANDLE points to a ShimHandle, which holds a reference to the object.
+	Named objects are also in a table, as long as a handle to them is open,
+	like under Windows.
+
+	Every wait goes through the same lock, and the waiters register themselves
+	on the objects they're waiting for, so that SetEvent() only wakes them.
+
+*/
+
+enum ShimKind { SHIM_EVENT, SHIM_MUTEX, SHIM_MAPPING };
+
+struct ShimWaiter {
+	std::condition_variable Wake;
+};
+
+struct ShimObject {
+	ShimKind Kind;
+	std::wstring Name;
+
+	// Events
+	bool ManualReset = false;
+	bool Signaled = false;
+	std::vector<ShimWaiter*> Waiters;
+
+	// Mappings
+	int Fd = -1;
+	size_t Size = 0;
+
+	ShimObject(ShimKind Kind) : Kind(Kind) {}
+	~ShimObject() { if (Fd >= 0) close(Fd); }
+};
+
+struct ShimHandle {
+	std::shared_ptr<ShimObject> Object;
+};
+
+static std::mutex ObjectLock;
+static std::map<std::wstring, std::weak_ptr<ShimObject>> NamedObjects;
+
+// Views and the size they were mapped with, for UnmapViewOfFile()
+static std::mutex ViewLock;
+static std::map<const void*, size_t> Views;
+
+static ShimObject* GetObject(HANDLE Handle, ShimKind Kind) {
+	if (!Handle || Handle == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	ShimObject* Object = ((ShimHandle*)Handle)->Object.get();
+	return Object->Kind == Kind ? Object : nullptr;
+}
+
+// Returns the named object if it exists, or creates it, ObjectLock has to be held
+static std::shared_ptr<ShimObject> FindOrCreate(ShimKind Kind, LPCWSTR Name, bool Create, bool* Existed) {
+	std::shared_ptr<ShimObject> Object;
+
+	*Existed = false;
+
+	if (Name && *Name) {
+		auto It = NamedObjects.find(Name);
+
+		if (It != NamedObjects.end() && (Object = It->second.lock())) {
+			// Same as Windows, a name can't be used by two kinds of objects
+			if (Object->Kind != Kind) {
+				SetLastError(ERROR_INVALID_HANDLE);
+				return nullptr;
+			}
+
+			*Existed = true;
+			SetLastError(ERROR_ALREADY_EXISTS);
+			return Object;
+		}
+	}
+
+	if (!Create) {
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return nullptr;
+	}
+
+	Object = std::make_shared<ShimObject>(Kind);
+
+	if (Name && *Name) {
+		Object->Name = Name;
+		NamedObjects[Name] = Object;
+	}
+
+	SetLastError(ERROR_SUCCESS);
+	return Object;
+}
+
+static HANDLE NewHandle(std::shared_ptr<ShimObject> Object) {
+	return Object ? (HANDLE)new ShimHandle{ Object } : nullptr;
+}
+
+BOOL CloseHandle(HANDLE Object) {
+	if (!Object || Object == INVALID_HANDLE_VALUE) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	ShimHandle* Handle = (ShimHandle*)Object;
+
+	// The last handle takes the name with it
+	if (Handle->Object.use_count() == 1 && !Handle->Object->Name.empty())
+		NamedObjects.erase(Handle->Object->Name);
+
+	delete Handle;
+	return TRUE;
+}
+
+HANDLE CreateEventW(void* Attributes, BOOL ManualReset, BOOL InitialState, LPCWSTR Name) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	bool Existed;
+
+	auto Object = FindOrCreate(SHIM_EVENT, Name, true, &Existed);
+
+	if (Object && !Existed) {
+		Object->ManualReset = ManualReset;
+		Object->Signaled = InitialState;
+	}
+
+	return NewHandle(Object);
+}
+
+HANDLE OpenEventW(DWORD Access, BOOL Inherit, LPCWSTR Name) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	bool Existed;
+
+	return NewHandle(FindOrCreate(SHIM_EVENT, Name, false, &Existed));
+}
+
+BOOL SetEvent(HANDLE Event) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	ShimObject* Object = GetObject(Event, SHIM_EVENT);
+
+	if (!Object) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	Object->Signaled = true;
+
+	for (ShimWaiter* Waiter : Object->Waiters)
+		Waiter->Wake.notify_one();
+
+	return TRUE;
+}
+
+HANDLE CreateMutexW(void* Attributes, BOOL InitialOwner, LPCWSTR Name) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	bool Existed;
+
+	// Only used to find out if the name is taken, nobody waits on them
+	return NewHandle(FindOrCreate(SHIM_MUTEX, Name, true, &Existed));
+}
+
+// ObjectLock has to be held
+static bool TryAcquire(ShimObject* Object) {
+	if (!Object->Signaled)
+		return false;
+
+	if (!Object->ManualReset)
+		Object->Signaled = false;
+
+	return true;
+}
+
+DWORD WaitForMultipleObjects(DWORD Count, const HANDLE* Objects, BOOL WaitAll, DWORD Timeout) {
+	auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(Timeout);
+	std::unique_lock<std::mutex> Guard(ObjectLock);
+	std::vector<ShimObject*> Events(Count);
+	ShimWaiter Waiter;
+
+	// The driver never waits for all of them
+	if (!Count || Count > MAXIMUM_WAIT_OBJECTS || WaitAll) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return WAIT_FAILED;
+	}
+
+	for (DWORD i = 0; i < Count; i++) {
+		if (!(Events[i] = GetObject(Objects[i], SHIM_EVENT))) {
+			SetLastError(ERROR_INVALID_HANDLE);
+			return WAIT_FAILED;
+		}
+	}
+
+	for (;;) {
+		for (DWORD i = 0; i < Count; i++) {
+			if (TryAcquire(Events[i]))
+				return WAIT_OBJECT_0 + i;
+		}
+
+		if (!Timeout || (Timeout != INFINITE && std::chrono::steady_clock::now() >= Deadline))
+			return WAIT_TIMEOUT;
+
+		for (ShimObject* Event : Events)
+			Event->Waiters.push_back(&Waiter);
+
+		if (Timeout == INFINITE) Waiter.Wake.wait(Guard);
+		else Waiter.Wake.wait_until(Guard, Deadline);
+
+		for (ShimObject* Event : Events)
+			Event->Waiters.erase(std::find(Event->Waiters.begin(), Event->Waiters.end(), &Waiter));
+	}
+}
+
+DWORD WaitForSingleObject(HANDLE Object, DWORD Timeout) {
+	return WaitForMultipleObjects(1, &Object, FALSE, Timeout);
+}
+
+HANDLE CreateFileMappingW(HANDLE File, LPSECURITY_ATTRIBUTES Attributes, DWORD Protect, DWORD SizeHigh, DWORD SizeLow, LPCWSTR Name) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	size_t Size = ((size_t)SizeHigh << 32) | SizeLow;
+	bool Existed;
+
+	// Only the page file backed ones
+	if (File != INVALID_HANDLE_VALUE || !Size) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return nullptr;
+	}
+
+	auto Object = FindOrCreate(SHIM_MAPPING, Name, true, &Existed);
+
+	if (!Object)
+		return nullptr;
+
+	if (!Existed) {
+		// Sparse, so the pages only take memory once they're touched, like SEC_RESERVE
+		Object->Fd = memfd_create("ShakraMapping", MFD_CLOEXEC);
+
+		if (Object->Fd < 0 || ftruncate(Object->Fd, (off_t)Size) != 0) {
+			NamedObjects.erase(Object->Name);
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return nullptr;
+		}
+
+		Object->Size = Size;
+	}
+
+	return NewHandle(Object);
+}
+
+HANDLE OpenFileMappingW(DWORD Access, BOOL Inherit, LPCWSTR Name) {
+	std::lock_guard<std::mutex> Guard(ObjectLock);
+	bool Existed;
+
+	return NewHandle(FindOrCreate(SHIM_MAPPING, Name, false, &Existed));
+}
+
+LPVOID MapViewOfFile(HANDLE Mapping, DWORD Access, DWORD OffsetHigh, DWORD OffsetLow, SIZE_T Size) {
+	ShimObject* Object;
+
+	{
+		std::lock_guard<std::mutex> Guard(ObjectLock);
+		Object = GetObject(Mapping, SHIM_MAPPING);
+	}
+
+	if (!Object || OffsetHigh || OffsetLow || Size > Object->Size) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return nullptr;
+	}
+
+	if (!Size)
+		Size = Object->Size;
+
+	void* View = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Object->Fd, 0);
+
+	if (View == MAP_FAILED) {
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> Guard(ViewLock);
+	Views[View] = Size;
+	return View;
+}
+
+BOOL UnmapViewOfFile(LPCVOID View) {
+	std::lock_guard<std::mutex> Guard(ViewLock);
+	auto It = Views.find(View);
+
+	if (It == Views.end()) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	munmap((void*)View, It->second);
+	Views.erase(It);
+	return TRUE;
+}
+
+LPVOID VirtualAlloc(LPVOID Address, SIZE_T Size, DWORD Type, DWORD Protect) {
+	// Committing the pages of a view, Linux does it by itself when they're touched
+	if (Address && (Type & MEM_COMMIT) && !(Type & MEM_RESERVE))
+		return Address;
+
+	// The driver only commits its views
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return nullptr;
+}
+
+DWORD DiscardVirtualMemory(PVOID Address, SIZE_T Size) {
+	// The pages stay in the memfd, but this process stops paying for them
+	return madvise(Address, Size, MADV_DONTNEED) ? ERROR_INVALID_PARAMETER : ERROR_SUCCESS;
+}
+
+void GetSystemInfo(SYSTEM_INFO* Info) {
+	memset(Info, 0, sizeof(SYSTEM_INFO));
+	Info->dwPageSize = (DWORD)sysconf(_SC_PAGESIZE);
+	Info->dwNumberOfProcessors = (DWORD)sysconf(_SC_NPROCESSORS_ONLN);
+	Info->dwAllocationGranularity = 65536;
+}
+
+//
+// THREAD POOL TIMERS
+//
+
+struct _TP_TIMER {
+	PTP_TIMER_CALLBACK Callback;
+	PVOID Context;
+
+	std::mutex Lock;
+	std::condition_variable Wake, Idle;
+	std::chrono::steady_clock::time_point Due;
+	DWORD Period = 0;
+	bool Armed = false;
+	bool Running = false;
+	bool Closing = false;
+	std::thread Worker;
+
+	void Loop() {
+		std::unique_lock<std::mutex> Guard(Lock);
+
+		while (!Closing) {
+			if (!Armed) {
+				Wake.wait(Guard);
+				continue;
+			}
+
+			if (std::chrono::steady_clock::now() < Due) {
+				Wake.wait_until(Guard, Due);
+				continue;
+			}
+
+			Armed = (Period != 0);
+			Due += std::chrono::milliseconds(Period);
+			Running = true;
+
+			Guard.unlock();
+			Callback(nullptr, Context, this);
+			Guard.lock();
+
+			Running = false;
+			Idle.notify_all();
+		}
+	}
+};
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON Environment) {
+	PTP_TIMER Timer = new _TP_TIMER;
+
+	Timer->Callback = Callback;
+	Timer->Context = Context;
+	Timer->Worker = std::thread(&_TP_TIMER::Loop, Timer);
+
+	return Timer;
+}
+
+void SetThreadpoolTimer(PTP_TIMER Timer, FILETIME* DueTime, DWORD Period, DWORD Window) {
+	std::lock_guard<std::mutex> Guard(Timer->Lock);
+
+	if (!DueTime) {
+		Timer->Armed = false;
+		return;
+	}
+
+	LONGLONG Due = (LONGLONG)(((ULONGLONG)DueTime->dwHighDateTime << 32) | DueTime->dwLowDateTime);
+
+	// Negative is relative, in 100ns units. The driver never uses absolute times, they fire right away
+	Timer->Due = std::chrono::steady_clock::now() + std::chrono::nanoseconds(Due < 0 ? -Due * 100 : 0);
+	Timer->Period = Period;
+	Timer->Armed = true;
+	Timer->Wake.notify_one();
+}
+
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer, BOOL CancelPending) {
+	std::unique_lock<std::mutex> Guard(Timer->Lock);
+
+	if (CancelPending)
+		Timer->Armed = false;
+
+	Timer->Idle.wait(Guard, [Timer] { return !Timer->Running; });
+}
+
+void CloseThreadpoolTimer(PTP_TIMER Timer) {
+	{
+		std::lock_guard<std::mutex> Guard(Timer->Lock);
+		Timer->Closing = true;
+		Timer->Wake.notify_one();
+	}
+
+	Timer->Worker.join();
+	delete Timer;
+}
+
+//
+// TIME
+//
+
+static const long long ShimFrequency = 10000000;
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* Count) {
+	timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	Count->QuadPart = (LONGLONG)Now.tv_sec * ShimFrequency + Now.tv_nsec / (1000000000 / ShimFrequency);
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency) {
+	Frequency->QuadPart = ShimFrequency;
+	return TRUE;
+}
+
+ULONGLONG GetTickCount64() {
+	timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (ULONGLONG)Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+}
+
+void Sleep(DWORD Ms) {
+	if (!Ms) {
+		sched_yield();
+		return;
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(Ms));
+}
+
+//
+// MODULES AND PROCESSES
+//
+
+BOOL DisableThreadLibraryCalls(HMODULE Module) {
+	return TRUE;
+}
+
+FARPROC GetProcAddress(HMODULE Module, LPCSTR Name) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return nullptr;
+}
+
+HMODULE GetModuleHandleW(LPCWSTR Name) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return nullptr;
+}
+
+DWORD GetModuleFileNameW(HMODULE Module, LPWSTR Target, DWORD Size) {
+	char Path[MAX_PATH] = { 0 };
+	ssize_t Len = readlink("/proc/self/exe", Path, sizeof(Path) - 1);
+
+	if (Len <= 0 || !Size) {
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return 0;
+	}
+
+	std::wstring Wide = Widen(Path);
+	wcsncpy(Target, Wide.c_str(), Size - 1);
+	Target[Size - 1] = 0;
+
+	return (DWORD)wcslen(Target);
+}
+
+HMODULE LoadLibraryW(LPCWSTR Path) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return nullptr;
+}
+
+BOOL FreeLibrary(HMODULE Module) {
+	return TRUE;
+}
+
+HANDLE GetCurrentProcess() {
+	return (HANDLE)(LONG_PTR)-1;
+}
+
+HANDLE GetCurrentThread() {
+	return (HANDLE)(LONG_PTR)-2;
+}
+
+DWORD GetCurrentProcessId() {
+	return (DWORD)getpid();
+}
+
+DWORD GetCurrentThreadId() {
+	return (DWORD)syscall(SYS_gettid);
+}
+
+HANDLE OpenProcess(DWORD Access, BOOL Inherit, DWORD PID) {
+	// The callers fall back to the heartbeat
+	SetLastError(ERROR_ACCESS_DENIED);
+	return nullptr;
+}
+
+UINT GetSystemWow64Directory(LPWSTR Target, UINT Size) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return 0;
+}
+
+BOOL SetThreadPriority(HANDLE Thread, int Priority) {
+	// Raising it needs privileges the harness doesn't have
+	return TRUE;
+}
+
+HANDLE CreateToolhelp32Snapshot(DWORD Flags, DWORD PID) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return INVALID_HANDLE_VALUE;
+}
+
+BOOL CreateProcessW(LPCWSTR App, LPWSTR CommandLine, LPSECURITY_ATTRIBUTES ProcessAttributes, LPSECURITY_ATTRIBUTES ThreadAttributes, BOOL Inherit, DWORD Flags, LPVOID Environment, LPCWSTR Directory, STARTUPINFOW* StartupInfo, PROCESS_INFORMATION* ProcessInfo) {
+	// The harness is the host, there's nothing to start
+	memset(ProcessInfo, 0, sizeof(PROCESS_INFORMATION));
+	SetLastError(ERROR_FILE_NOT_FOUND);
+	return FALSE;
+}
+
+HRESULT SHGetKnownFolderPath(REFKNOWNFOLDERID Folder, DWORD Flags, HANDLE Token, PWSTR* Path) {
+	static const wchar_t Dir[] = L"/opt";
+	*Path = (PWSTR)malloc(sizeof(Dir));
+
+	if (!*Path)
+		return E_FAIL;
+
+	memcpy(*Path, Dir, sizeof(Dir));
+	return S_OK;
+}
+
+void CoTaskMemFree(LPVOID Memory) {
+	free(Memory);
+}
+
+BOOL IsUserAnAdmin() {
+	// Registering the driver makes no sense here
+	return FALSE;
+}
+
+//
+// CONSOLE AND DEBUGGING
+//
+
+BOOL AttachConsole(DWORD PID) {
+	return TRUE;
+}
+
+BOOL AllocConsole() {
+	return FALSE;
+}
+
+DWORD GetEnvironmentVariableW(LPCWSTR Name, LPWSTR Target, DWORD Size) {
+	const char* Value = getenv(Narrow(Name).c_str());
+
+	if (!Value) {
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return 0;
+	}
+
+	std::wstring Wide = Widen(Value);
+
+	// Too small, the size it needs, with the terminator
+	if (Wide.size() + 1 > Size)
+		return (DWORD)Wide.size() + 1;
+
+	wcscpy(Target, Wide.c_str());
+	return (DWORD)Wide.size();
+}
+
+void OutputDebugStringW(LPCWSTR Message) {
+	if (GetVerbosity() >= 2)
+		fprintf(stderr, "[debug] %s\n", Narrow(Message).c_str());
+}
+
+HANDLE LocalFree(HANDLE Memory) {
+	free(Memory);
+	return nullptr;
+}
+
+DWORD FormatMessageW(DWORD Flags, LPCVOID Source, DWORD Id, DWORD Language, LPWSTR Target, DWORD Size, void* Args) {
+	wchar_t Message[64];
+	int Len = swprintf(Message, _countof(Message), L"Win32 error %u.", Id);
+
+	if (Len < 0)
+		return 0;
+
+	if (Flags & FORMAT_MESSAGE_ALLOCATE_BUFFER) {
+		LPWSTR Buf = (LPWSTR)malloc((Len + 1) * sizeof(wchar_t));
+
+		if (!Buf)
+			return 0;
+
+		wcscpy(Buf, Message);
+		*(LPWSTR*)Target = Buf;
+		return (DWORD)Len;
+	}
+
+	if ((DWORD)Len >= Size)
+		return 0;
+
+	wcscpy(Target, Message);
+	return (DWORD)Len;
+}
+
+int MessageBoxW(HWND Owner, LPCWSTR Text, LPCWSTR Caption, UINT Type) {
+	if (GetVerbosity() >= 1)
+		fprintf(stderr, "[%s] %s\n", Narrow(Caption).c_str(), Narrow(Text).c_str());
+
+	return IDOK;
+}
+
+int MessageBoxA(HWND Owner, LPCSTR Text, LPCSTR Caption, UINT Type) {
+	if (GetVerbosity() >= 1)
+		fprintf(stderr, "[%s] %s\n", Caption ? Caption : "", Text ? Text : "");
+
+	return IDOK;
+}
+
+BOOL PostThreadMessageW(DWORD Thread, UINT Message, WPARAM Param1, LPARAM Param2) {
+	// No message queues, the harness uses CALLBACK_FUNCTION and CALLBACK_EVENT
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return FALSE;
+}
+
+BOOL PostMessageW(HWND Window, UINT Message, WPARAM Param1, LPARAM Param2) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return FALSE;
+}
+
+//
+// SECURE CRT
+//
+
+int vswprintf_s(wchar_t* Target, size_t Size, const wchar_t* Format, va_list Args) {
+	std::wstring Converted;
+
+	if (!Target || !Size || !Format)
+		return -1;
+
+	// MSVC's %s and %c take wide arguments in the wide functions, and %S narrow ones, glibc's are the opposite
+	for (const wchar_t* Char = Format; *Char; Char++) {
+		Converted += *Char;
+
+		if (*Char != L'%')
+			continue;
+
+		if (Char[1] == L'%') {
+			Converted += *++Char;
+			continue;
+		}
+
+		while (Char[1] && wcschr(L"-+ #0123456789.*hlLzjt", Char[1]))
+			Converted += *++Char;
+
+		switch (Char[1]) {
+		case L's': case L'c':
+			Converted += L'l';
+			Converted += *++Char;
+			break;
+
+		case L'S': case L'C':
+			Converted += (wchar_t)towlower(*++Char);
+			break;
+		}
+	}
+
+	int Ret = vswprintf(Target, Size, Converted.c_str(), Args);
+
+	// Truncated, the real one would call the invalid parameter handler
+	if (Ret < 0)
+		Target[Size - 1] = 0;
+
+	return Ret;
+}
+
+int swprintf_s(wchar_t* Target, size_t Size, const wchar_t* Format, ...) {
+	va_list Args;
+	va_start(Args, Format);
+	int Ret = vswprintf_s(Target, Size, Format, Args);
+	va_end(Args);
+	return Ret;
+}
+
+int wcstombs_s(size_t* Converted, char* Target, size_t Size, const wchar_t* Source, size_t Count) {
+	std::string Narrowed = Narrow(Source);
+
+	if (Narrowed.size() > Count)
+		Narrowed.resize(Count);
+
+	if (!Target || Narrowed.size() + 1 > Size)
+		return ERANGE;
+
+	memcpy(Target, Narrowed.c_str(), Narrowed.size() + 1);
+
+	if (Converted)
+		*Converted = Narrowed.size() + 1;
+
+	return 0;
+}
+
+int wcsncpy_s(wchar_t* Target, size_t Size, const wchar_t* Source, size_t Count) {
+	size_t Len = wcsnlen(Source, Count);
+
+	if (!Target || Len + 1 > Size)
+		return ERANGE;
+
+	wmemcpy(Target, Source, Len);
+	Target[Len] = 0;
+	return 0;
+}
+
+int wcscat_s(wchar_t* Target, size_t Size, const wchar_t* Source) {
+	size_t Len = wcsnlen(Target, Size);
+
+	if (Len + wcslen(Source) + 1 > Size)
+		return ERANGE;
+
+	wcscpy(Target + Len, Source);
+	return 0;
+}
+
+int _stricmp(const char* A, const char* B) {
+	return strcasecmp(A, B);
+}
+
+int _wcsicmp(const wchar_t* A, const wchar_t* B) {
+	return wcscasecmp(A, B);
+}
+
+int fopen_s(FILE** File, const char* Path, const char* Mode) {
+	*File = fopen(Path, Mode);
+	return *File ? 0 : errno;
+}
+
+int _wfopen_s(FILE** File, const wchar_t* Path, const wchar_t* Mode) {
+	return fopen_s(File, Narrow(Path).c_str(), Narrow(Mode).c_str());
+}
+
+int freopen_s(FILE** File, const char* Path, const char* Mode, FILE* Stream) {
+	*File = freopen(Path, Mode, Stream);
+	return *File ? 0 : errno;
+}
+
+//
+// REGISTRY, ALWAYS EMPTY
+//
+
+LSTATUS RegCreateKeyExW(HKEY Key, LPCWSTR SubKey, DWORD Reserved, LPWSTR Class, DWORD Options, REGSAM Access, LPSECURITY_ATTRIBUTES Attributes, PHKEY Result, LPDWORD Disposition) {
+	return ERROR_ACCESS_DENIED;
+}
+
+LSTATUS RegOpenKeyExW(HKEY Key, LPCWSTR SubKey, DWORD Options, REGSAM Access, PHKEY Result) {
+	return ERROR_FILE_NOT_FOUND;
+}
+
+LSTATUS RegQueryValueExW(HKEY Key, LPCWSTR Name, LPDWORD Reserved, LPDWORD Type, LPBYTE Data, LPDWORD Size) {
+	return ERROR_FILE_NOT_FOUND;
+}
+
+LSTATUS RegSetValueExW(HKEY Key, LPCWSTR Name, DWORD Reserved, DWORD Type, const BYTE* Data, DWORD Size) {
+	return ERROR_ACCESS_DENIED;
+}
+
+LSTATUS RegEnumKeyExW(HKEY Key, DWORD Index, LPWSTR Name, LPDWORD NameSize, LPDWORD Reserved, LPWSTR Class, LPDWORD ClassSize, void* LastWrite) {
+	return ERROR_FILE_NOT_FOUND;
+}
+
+LSTATUS RegCloseKey(HKEY Key) {
+	return ERROR_SUCCESS;
+}
+
+LSTATUS RegDeleteValueW(HKEY Key, LPCWSTR Name) {
+	return ERROR_FILE_NOT_FOUND;
+}
+
+//
+// SETUPAPI, ALWAYS FAILS
+//
+
+HDEVINFO SetupDiGetClassDevs(const GUID* Class, LPCWSTR Enumerator, HWND Parent, DWORD Flags) {
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return INVALID_HANDLE_VALUE;
+}
+
+BOOL SetupDiEnumDeviceInfo(HDEVINFO Set, DWORD Index, PSP_DEVINFO_DATA Data) {
+	return FALSE;
+}
+
+BOOL SetupDiGetDeviceRegistryProperty(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Property, PDWORD Type, PBYTE Buffer, DWORD Size, PDWORD Required) {
+	return FALSE;
+}
+
+BOOL SetupDiCreateDeviceInfo(HDEVINFO Set, LPCWSTR Name, const GUID* Class, LPCWSTR Description, HWND Parent, DWORD Flags, PSP_DEVINFO_DATA Data) {
+	return FALSE;
+}
+
+BOOL SetupDiRegisterDeviceInfo(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Flags, void* Compare, void* Context, void* Duplicate) {
+	return FALSE;
+}
+
+BOOL SetupDiSetDeviceRegistryProperty(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Property, const BYTE* Buffer, DWORD Size) {
+	return FALSE;
+}
+
+HKEY SetupDiCreateDevRegKey(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Scope, DWORD Profile, DWORD Type, HANDLE Template, LPCWSTR Inf) {
+	return (HKEY)INVALID_HANDLE_VALUE;
+}
+
+BOOL SetupDiDestroyDeviceInfoList(HDEVINFO Set) {
+	return TRUE;
+}
+
+BOOL SetupDiRemoveDevice(HDEVINFO Set, PSP_DEVINFO_DATA Data) {
+	return FALSE;
+}
+
+//
+// MMDDK
+//
+
+LRESULT DefDriverProc(DWORD_PTR Identifier, HDRVR Driver, UINT Message, LPARAM Param1, LPARAM Param2) {
+	return 0;
+}
+
+#endif
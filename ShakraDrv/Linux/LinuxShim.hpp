@@ -0,0 +1,492 @@
+/*
+Shakra Driver component for Linux
+This .h file contains a shim of the Win32 and WinMM APIs used by the driver, so that its sources can be built and tested under Linux.
+
+This file is only used by the harness in this folder, the driver itself still only runs under Windows.
+*/
+
+#pragma once
+
+#ifndef LINUXSHIM_H
+
+#define LINUXSHIM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cwchar>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <type_traits>
+#include <pthread.h>
+
+/*
+
+	Only what the driver uses is here, and it's only as faithful as the driver needs:
+	- The named objects (file mappings, events, mutexes) live in this process,
+	  so the harness plays both the app and the host, each one on its own threads
+	- File mappings are memfds, every MapViewOfFile() is a new view of the same pages,
+	  and SEC_RESERVE memory is committed by Linux as it gets touched
+	- QueryPerformanceCounter() ticks at 10MHz, like on most Windows machines
+	- The registry is always empty, the device setup functions always fail,
+	  and ShakraHost never gets started, since the harness is the host
+	- MessageBox() prints to stderr and returns right away, see SHAKRA_SHIM_VERBOSE in LinuxShim.cpp
+
+	The types have the sizes they have under 64-bit Windows, except wchar_t,
+	which is 32-bit under Linux. Nothing that crosses the shim cares.
+
+*/
+
+#define WINAPI
+#define CALLBACK
+#define __stdcall
+#define __cdecl
+#define WINBASEAPI
+#define DECLSPEC_SELECTANY __attribute__((weak))
+#define EXTERN_C extern "C"
+#define _In_
+#define _Out_
+#define _Inout_
+#define VOID void
+#define CONST const
+#define FALSE 0
+#define TRUE 1
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define DLL_PROCESS_DETACH 0
+#define DLL_PROCESS_ATTACH 1
+#define DLL_THREAD_ATTACH 2
+#define DLL_THREAD_DETACH 3
+
+typedef uint32_t DWORD, *PDWORD, *LPDWORD;
+typedef uint16_t WORD, *PWORD, *LPWORD;
+typedef uint8_t BYTE, *PBYTE, *LPBYTE;
+typedef int BOOL, *PBOOL;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG, LONG64;
+typedef uint64_t ULONGLONG, DWORD64;
+typedef uintptr_t DWORD_PTR, UINT_PTR, ULONG_PTR, SIZE_T;
+typedef intptr_t LONG_PTR, LRESULT, LPARAM;
+typedef uintptr_t WPARAM;
+typedef int32_t HRESULT;
+typedef LONG LSTATUS;
+typedef void* PVOID, *LPVOID, *HANDLE;
+typedef const void* LPCVOID;
+typedef char CHAR, *LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t WCHAR, *LPWSTR, *PWSTR;
+typedef const wchar_t* LPCWSTR, *PCWSTR;
+typedef LPWSTR LPTSTR;
+typedef LPCWSTR LPCTSTR;
+typedef wchar_t TCHAR;
+typedef struct HINSTANCE__* HINSTANCE, *HMODULE;
+typedef struct HWND__* HWND;
+typedef struct HDRVR__* HDRVR;
+typedef struct HMIDI__* HMIDI;
+typedef struct HMIDIOUT__* HMIDIOUT;
+typedef struct HMIDIIN__* HMIDIIN;
+typedef struct HKEY__* HKEY, **PHKEY;
+typedef void* HDEVINFO;
+typedef void* FARPROC;
+typedef UINT MMRESULT;
+
+typedef union _LARGE_INTEGER { struct { DWORD LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER;
+
+typedef struct _GUID { uint32_t Data1; uint16_t Data2; uint16_t Data3; uint8_t Data4[8]; } GUID, KNOWNFOLDERID;
+typedef const GUID& REFKNOWNFOLDERID;
+typedef uint32_t DEVPROPID;
+typedef struct _DEVPROPKEY { GUID fmtid; DEVPROPID pid; } DEVPROPKEY;
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define S_OK 0
+#define E_FAIL ((HRESULT)0x80004005)
+
+// __FUNCTION__ isn't a literal under GCC, so it gets widened at runtime
+const wchar_t* ShimWiden(const char* Source);
+#define _T(x) ShimWiden(x)
+#define TEXT(x) L##x
+
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(d, l) memset((d), 0, (l))
+#define MAKEWORD(a, b) ((WORD)(((BYTE)(a)) | ((WORD)((BYTE)(b))) << 8))
+#define MAKELONG(a, b) ((LONG)(((WORD)(a)) | ((DWORD)((WORD)(b))) << 16))
+#define LOWORD(l) ((WORD)(((DWORD_PTR)(l)) & 0xffff))
+#define HIWORD(l) ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
+#define LOBYTE(w) ((BYTE)(((DWORD_PTR)(w)) & 0xff))
+#define HIBYTE(w) ((BYTE)((((DWORD_PTR)(w)) >> 8) & 0xff))
+#define MAKELANGID(p, s) ((((WORD)(s)) << 10) | (WORD)(p))
+#define LANG_NEUTRAL 0
+#define SUBLANG_DEFAULT 1
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+
+template <class A, class B> inline auto min(A a, B b) -> typename std::common_type<A, B>::type { return a < b ? a : b; }
+template <class A, class B> inline auto max(A a, B b) -> typename std::common_type<A, B>::type { return a > b ? a : b; }
+
+// Errors
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_ALREADY_EXISTS 183
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+#define MAXIMUM_WAIT_OBJECTS 64
+DWORD GetLastError();
+void SetLastError(DWORD Error);
+
+// Modules and processes
+BOOL DisableThreadLibraryCalls(HMODULE Module);
+FARPROC GetProcAddress(HMODULE Module, LPCSTR Name);
+HMODULE GetModuleHandleW(LPCWSTR Name);
+#define GetModuleHandle GetModuleHandleW
+DWORD GetModuleFileNameW(HMODULE Module, LPWSTR Target, DWORD Size);
+#define GetModuleFileName GetModuleFileNameW
+HMODULE LoadLibraryW(LPCWSTR Path);
+#define LoadLibrary LoadLibraryW
+BOOL FreeLibrary(HMODULE Module);
+HANDLE GetCurrentProcess();
+HANDLE GetCurrentThread();
+DWORD GetCurrentProcessId();
+DWORD GetCurrentThreadId();
+HANDLE OpenProcess(DWORD Access, BOOL Inherit, DWORD PID);
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+#define SYNCHRONIZE 0x00100000L
+UINT GetSystemWow64Directory(LPWSTR Target, UINT Size);
+BOOL SetThreadPriority(HANDLE Thread, int Priority);
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+#define THREAD_PRIORITY_HIGHEST 2
+
+// Synchronization
+void Sleep(DWORD Ms);
+BOOL CloseHandle(HANDLE Object);
+DWORD WaitForSingleObject(HANDLE Object, DWORD Timeout);
+DWORD WaitForMultipleObjects(DWORD Count, const HANDLE* Objects, BOOL WaitAll, DWORD Timeout);
+HANDLE CreateEventW(void* Attributes, BOOL ManualReset, BOOL InitialState, LPCWSTR Name);
+#define CreateEvent CreateEventW
+HANDLE OpenEventW(DWORD Access, BOOL Inherit, LPCWSTR Name);
+#define OpenEvent OpenEventW
+#define EVENT_ALL_ACCESS 0x1F0003
+#define EVENT_MODIFY_STATE 0x0002
+BOOL SetEvent(HANDLE Event);
+HANDLE CreateMutexW(void* Attributes, BOOL InitialOwner, LPCWSTR Name);
+
+// SRW locks are pthread ones, so they keep their static initializer
+typedef struct { pthread_rwlock_t Lock; } SRWLOCK, *PSRWLOCK;
+#define SRWLOCK_INIT { PTHREAD_RWLOCK_INITIALIZER }
+inline void AcquireSRWLockExclusive(PSRWLOCK Lock) { pthread_rwlock_wrlock(&Lock->Lock); }
+inline void ReleaseSRWLockExclusive(PSRWLOCK Lock) { pthread_rwlock_unlock(&Lock->Lock); }
+inline void AcquireSRWLockShared(PSRWLOCK Lock) { pthread_rwlock_rdlock(&Lock->Lock); }
+inline void ReleaseSRWLockShared(PSRWLOCK Lock) { pthread_rwlock_unlock(&Lock->Lock); }
+
+// Sequentially consistent, like the real ones
+inline LONG InterlockedIncrement(volatile LONG* Target) { return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(volatile LONG* Target) { return __atomic_sub_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(volatile LONG* Target, LONG Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(volatile LONG* Target, LONG Value) { return __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedOr(volatile LONG* Target, LONG Value) { return __atomic_fetch_or(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAnd(volatile LONG* Target, LONG Value) { return __atomic_fetch_and(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(volatile LONG* Target, LONG Value, LONG Comparand) {
+	__atomic_compare_exchange_n(Target, &Comparand, Value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+inline LONG64 InterlockedIncrement64(volatile LONG64* Target) { return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchange64(volatile LONG64* Target, LONG64 Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedCompareExchange64(volatile LONG64* Target, LONG64 Value, LONG64 Comparand) {
+	__atomic_compare_exchange_n(Target, &Comparand, Value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+inline PVOID InterlockedExchangePointer(PVOID volatile* Target, PVOID Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile* Target, PVOID Value, PVOID Comparand) {
+	__atomic_compare_exchange_n(Target, &Comparand, Value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+#ifdef __SANITIZE_THREAD__
+// ThreadSanitizer doesn't model the fences, a read-modify-write on a shared variable orders the same accesses as far as it can tell
+inline int ShimFenceSync = 0;
+inline void MemoryBarrier() { __atomic_fetch_add(&ShimFenceSync, 0, __ATOMIC_SEQ_CST); }
+#else
+inline void MemoryBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YieldProcessor() __builtin_ia32_pause()
+#else
+#define YieldProcessor() __asm__ __volatile__("yield")
+#endif
+
+// Thread pool timers, each one has its own thread
+typedef struct { DWORD dwLowDateTime; DWORD dwHighDateTime; } FILETIME, *PFILETIME;
+typedef struct _TP_TIMER* PTP_TIMER;
+typedef struct _TP_CALLBACK_INSTANCE* PTP_CALLBACK_INSTANCE;
+typedef struct _TP_CALLBACK_ENVIRON* PTP_CALLBACK_ENVIRON;
+typedef VOID (CALLBACK *PTP_TIMER_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer);
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON Environment);
+void SetThreadpoolTimer(PTP_TIMER Timer, FILETIME* DueTime, DWORD Period, DWORD Window);
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer, BOOL CancelPending);
+void CloseThreadpoolTimer(PTP_TIMER Timer);
+
+// Time
+BOOL QueryPerformanceCounter(LARGE_INTEGER* Count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency);
+ULONGLONG GetTickCount64();
+
+// Debugging
+void OutputDebugStringW(LPCWSTR Message);
+#define OutputDebugString OutputDebugStringW
+HANDLE LocalFree(HANDLE Memory);
+DWORD FormatMessageW(DWORD Flags, LPCVOID Source, DWORD Id, DWORD Language, LPWSTR Target, DWORD Size, void* Args);
+#define FORMAT_MESSAGE_FROM_SYSTEM 0x1000
+#define FORMAT_MESSAGE_IGNORE_INSERTS 0x200
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER 0x100
+
+typedef struct _SECURITY_ATTRIBUTES { DWORD nLength; LPVOID lpSecurityDescriptor; BOOL bInheritHandle; } SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+// Memory and file mappings
+#define PAGE_READWRITE 0x04
+#define SEC_COMMIT 0x8000000
+#define SEC_RESERVE 0x4000000
+#define FILE_MAP_ALL_ACCESS 0xF001F
+#define FILE_MAP_READ 0x0004
+#define FILE_MAP_WRITE 0x0002
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+HANDLE CreateFileMappingW(HANDLE File, LPSECURITY_ATTRIBUTES Attributes, DWORD Protect, DWORD SizeHigh, DWORD SizeLow, LPCWSTR Name);
+#define CreateFileMapping CreateFileMappingW
+HANDLE OpenFileMappingW(DWORD Access, BOOL Inherit, LPCWSTR Name);
+#define OpenFileMapping OpenFileMappingW
+LPVOID MapViewOfFile(HANDLE Mapping, DWORD Access, DWORD OffsetHigh, DWORD OffsetLow, SIZE_T Size);
+BOOL UnmapViewOfFile(LPCVOID View);
+LPVOID VirtualAlloc(LPVOID Address, SIZE_T Size, DWORD Type, DWORD Protect);
+DWORD DiscardVirtualMemory(PVOID Address, SIZE_T Size);
+
+typedef struct { WORD wProcessorArchitecture; WORD wReserved; DWORD dwPageSize; LPVOID lpMinimumApplicationAddress; LPVOID lpMaximumApplicationAddress; DWORD_PTR dwActiveProcessorMask; DWORD dwNumberOfProcessors; DWORD dwProcessorType; DWORD dwAllocationGranularity; WORD wProcessorLevel; WORD wProcessorRevision; } SYSTEM_INFO;
+void GetSystemInfo(SYSTEM_INFO* Info);
+
+// Security, nothing to protect from inside the same process
+#define SE_KERNEL_OBJECT 6
+#define DACL_SECURITY_INFORMATION 4
+#define PROTECTED_DACL_SECURITY_INFORMATION 0x80000000
+inline DWORD SetSecurityInfo(HANDLE, int, DWORD, void*, void*, void*, void*) { return ERROR_SUCCESS; }
+
+// Processes
+typedef struct tagPROCESSENTRY32 { DWORD dwSize; DWORD th32ProcessID; WCHAR szExeFile[MAX_PATH]; } PROCESSENTRY32;
+#define TH32CS_SNAPPROCESS 2
+HANDLE CreateToolhelp32Snapshot(DWORD Flags, DWORD PID);
+typedef struct _PROCESS_INFORMATION { HANDLE hProcess; HANDLE hThread; DWORD dwProcessId; DWORD dwThreadId; } PROCESS_INFORMATION;
+typedef struct _STARTUPINFOW { DWORD cb; } STARTUPINFOW, STARTUPINFO;
+#define CREATE_NEW_CONSOLE 0x10
+BOOL CreateProcessW(LPCWSTR App, LPWSTR CommandLine, LPSECURITY_ATTRIBUTES ProcessAttributes, LPSECURITY_ATTRIBUTES ThreadAttributes, BOOL Inherit, DWORD Flags, LPVOID Environment, LPCWSTR Directory, STARTUPINFOW* StartupInfo, PROCESS_INFORMATION* ProcessInfo);
+
+// Shell
+extern const GUID FOLDERID_ProgramFiles, FOLDERID_ProgramFilesX86;
+#define KF_FLAG_NO_ALIAS 0x1000
+HRESULT SHGetKnownFolderPath(REFKNOWNFOLDERID Folder, DWORD Flags, HANDLE Token, PWSTR* Path);
+void CoTaskMemFree(LPVOID Memory);
+BOOL IsUserAnAdmin();
+
+// Console
+#define ATTACH_PARENT_PROCESS ((DWORD)-1)
+BOOL AttachConsole(DWORD PID);
+BOOL AllocConsole();
+DWORD GetEnvironmentVariableW(LPCWSTR Name, LPWSTR Target, DWORD Size);
+
+// User
+#define MB_OK 0
+#define MB_ICONERROR 0x10
+#define MB_ICONWARNING 0x30
+#define MB_ICONINFORMATION 0x40
+#define MB_SYSTEMMODAL 0x1000
+#define IDOK 1
+int MessageBoxW(HWND Owner, LPCWSTR Text, LPCWSTR Caption, UINT Type);
+int MessageBoxA(HWND Owner, LPCSTR Text, LPCSTR Caption, UINT Type);
+#define MessageBox MessageBoxW
+BOOL PostThreadMessageW(DWORD Thread, UINT Message, WPARAM Param1, LPARAM Param2);
+#define PostThreadMessage PostThreadMessageW
+BOOL PostMessageW(HWND Window, UINT Message, WPARAM Param1, LPARAM Param2);
+#define PostMessage PostMessageW
+
+// Secure CRT, %s and %c take wide strings and characters, like MSVC's
+int vswprintf_s(wchar_t* Target, size_t Size, const wchar_t* Format, va_list Args);
+int swprintf_s(wchar_t* Target, size_t Size, const wchar_t* Format, ...);
+template <size_t N> int swprintf_s(wchar_t (&Target)[N], const wchar_t* Format, ...) {
+	va_list Args;
+	va_start(Args, Format);
+	int Ret = vswprintf_s(Target, N, Format, Args);
+	va_end(Args);
+	return Ret;
+}
+int wcstombs_s(size_t* Converted, char* Target, size_t Size, const wchar_t* Source, size_t Count);
+int wcsncpy_s(wchar_t* Target, size_t Size, const wchar_t* Source, size_t Count);
+template <size_t N> int wcsncpy_s(wchar_t (&Target)[N], const wchar_t* Source, size_t Count) { return wcsncpy_s(Target, N, Source, Count); }
+int wcscat_s(wchar_t* Target, size_t Size, const wchar_t* Source);
+int _stricmp(const char* A, const char* B);
+int _wcsicmp(const wchar_t* A, const wchar_t* B);
+int _wfopen_s(FILE** File, const wchar_t* Path, const wchar_t* Mode);
+int fopen_s(FILE** File, const char* Path, const char* Mode);
+int freopen_s(FILE** File, const char* Path, const char* Mode, FILE* Stream);
+
+// Registry, always empty
+#define HKEY_CURRENT_USER ((HKEY)(ULONG_PTR)((LONG)0x80000001))
+#define HKEY_LOCAL_MACHINE ((HKEY)(ULONG_PTR)((LONG)0x80000002))
+#define REG_OPTION_NON_VOLATILE 0
+#define KEY_ALL_ACCESS 0xF003F
+#define KEY_READ 0x20019
+#define KEY_WOW64_32KEY 0x0200
+#define REG_SZ 1
+#define REG_DWORD 4
+typedef DWORD REGSAM;
+LSTATUS RegCreateKeyExW(HKEY Key, LPCWSTR SubKey, DWORD Reserved, LPWSTR Class, DWORD Options, REGSAM Access, LPSECURITY_ATTRIBUTES Attributes, PHKEY Result, LPDWORD Disposition);
+#define RegCreateKeyEx RegCreateKeyExW
+LSTATUS RegOpenKeyExW(HKEY Key, LPCWSTR SubKey, DWORD Options, REGSAM Access, PHKEY Result);
+#define RegOpenKeyEx RegOpenKeyExW
+LSTATUS RegQueryValueExW(HKEY Key, LPCWSTR Name, LPDWORD Reserved, LPDWORD Type, LPBYTE Data, LPDWORD Size);
+LSTATUS RegSetValueExW(HKEY Key, LPCWSTR Name, DWORD Reserved, DWORD Type, const BYTE* Data, DWORD Size);
+#define RegSetValueEx RegSetValueExW
+LSTATUS RegEnumKeyExW(HKEY Key, DWORD Index, LPWSTR Name, LPDWORD NameSize, LPDWORD Reserved, LPWSTR Class, LPDWORD ClassSize, void* LastWrite);
+#define RegEnumKeyEx RegEnumKeyExW
+LSTATUS RegCloseKey(HKEY Key);
+LSTATUS RegDeleteValueW(HKEY Key, LPCWSTR Name);
+#define RegDeleteValue RegDeleteValueW
+
+// SetupAPI, always fails
+typedef struct _SP_DEVINFO_DATA { DWORD cbSize; GUID ClassGuid; DWORD DevInst; ULONG_PTR Reserved; } SP_DEVINFO_DATA, *PSP_DEVINFO_DATA;
+extern const GUID GUID_DEVCLASS_MEDIA;
+#define SPDRP_DEVICEDESC 0
+#define SPDRP_CONFIGFLAGS 0xA
+#define SPDRP_MFG 0xB
+#define DICD_GENERATE_ID 1
+#define DICS_FLAG_GLOBAL 1
+#define DIREG_DRV 2
+#define CONFIGFLAG_MANUAL_INSTALL 0x8
+#define CONFIGFLAG_NEEDS_FORCED_CONFIG 0x800
+HDEVINFO SetupDiGetClassDevs(const GUID* Class, LPCWSTR Enumerator, HWND Parent, DWORD Flags);
+BOOL SetupDiEnumDeviceInfo(HDEVINFO Set, DWORD Index, PSP_DEVINFO_DATA Data);
+BOOL SetupDiGetDeviceRegistryProperty(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Property, PDWORD Type, PBYTE Buffer, DWORD Size, PDWORD Required);
+BOOL SetupDiCreateDeviceInfo(HDEVINFO Set, LPCWSTR Name, const GUID* Class, LPCWSTR Description, HWND Parent, DWORD Flags, PSP_DEVINFO_DATA Data);
+BOOL SetupDiRegisterDeviceInfo(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Flags, void* Compare, void* Context, void* Duplicate);
+BOOL SetupDiSetDeviceRegistryProperty(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Property, const BYTE* Buffer, DWORD Size);
+HKEY SetupDiCreateDevRegKey(HDEVINFO Set, PSP_DEVINFO_DATA Data, DWORD Scope, DWORD Profile, DWORD Type, HANDLE Template, LPCWSTR Inf);
+BOOL SetupDiDestroyDeviceInfoList(HDEVINFO Set);
+BOOL SetupDiRemoveDevice(HDEVINFO Set, PSP_DEVINFO_DATA Data);
+
+// WinMM
+#define MAXPNAMELEN 32
+#define MMSYSERR_NOERROR 0
+#define MMSYSERR_ERROR 1
+#define MMSYSERR_BADDEVICEID 2
+#define MMSYSERR_NOTENABLED 3
+#define MMSYSERR_ALLOCATED 4
+#define MMSYSERR_INVALHANDLE 5
+#define MMSYSERR_NODRIVER 6
+#define MMSYSERR_NOMEM 7
+#define MMSYSERR_NOTSUPPORTED 8
+#define MMSYSERR_INVALFLAG 10
+#define MMSYSERR_INVALPARAM 11
+#define MIDIERR_UNPREPARED 64
+#define MIDIERR_STILLPLAYING 65
+#define MIDIERR_NOMAP 66
+#define MIDIERR_NOTREADY 67
+#define MIDIERR_NODEVICE 68
+#define MHDR_DONE 1
+#define MHDR_PREPARED 2
+#define MHDR_INQUEUE 4
+#define MOD_MIDIPORT 1
+#define MOD_SWSYNTH 7
+#define MIDICAPS_VOLUME 1
+#define MIDICAPS_LRVOLUME 2
+#define MIDICAPS_CACHE 4
+#define MIDICAPS_STREAM 8
+#define CALLBACK_TYPEMASK 0x00070000l
+#define CALLBACK_NULL 0
+#define CALLBACK_WINDOW 0x00010000l
+#define CALLBACK_TASK 0x00020000l
+#define CALLBACK_THREAD CALLBACK_TASK
+#define CALLBACK_FUNCTION 0x00030000l
+#define CALLBACK_EVENT 0x00050000l
+#define MIDI_IO_COOKED 0x00000002L
+#define MIDI_IO_STATUS 0x00000020L
+#define MOM_OPEN 0x3C7
+#define MOM_CLOSE 0x3C8
+#define MOM_DONE 0x3C9
+#define MIM_OPEN 0x3C1
+#define MIM_CLOSE 0x3C2
+#define MIM_DATA 0x3C3
+#define MIM_LONGDATA 0x3C4
+#define MIM_ERROR 0x3C5
+#define MIM_LONGERROR 0x3C6
+#define MIM_MOREDATA 0x3CC
+#define MIDIPATCHSIZE 128
+typedef WORD PATCHARRAY[MIDIPATCHSIZE];
+typedef WORD* LPPATCHARRAY;
+typedef WORD KEYARRAY[MIDIPATCHSIZE];
+typedef WORD* LPKEYARRAY;
+#define MIDI_CACHE_ALL 1
+#define MIDI_CACHE_BESTFIT 2
+#define MIDI_CACHE_QUERY 3
+#define MIDI_UNCACHE 4
+
+typedef struct midihdr_tag {
+	LPSTR lpData; DWORD dwBufferLength; DWORD dwBytesRecorded; DWORD_PTR dwUser; DWORD dwFlags;
+	struct midihdr_tag* lpNext; DWORD_PTR reserved; DWORD dwOffset; DWORD_PTR dwReserved[8];
+} MIDIHDR, *PMIDIHDR, *LPMIDIHDR;
+
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; CHAR szPname[MAXPNAMELEN]; WORD wTechnology; WORD wVoices; WORD wNotes; WORD wChannelMask; DWORD dwSupport; } MIDIOUTCAPSA, *LPMIDIOUTCAPSA;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; WCHAR szPname[MAXPNAMELEN]; WORD wTechnology; WORD wVoices; WORD wNotes; WORD wChannelMask; DWORD dwSupport; } MIDIOUTCAPSW, *LPMIDIOUTCAPSW;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; CHAR szPname[MAXPNAMELEN]; WORD wTechnology; WORD wVoices; WORD wNotes; WORD wChannelMask; DWORD dwSupport; GUID ManufacturerGuid; GUID ProductGuid; GUID NameGuid; } MIDIOUTCAPS2A, *LPMIDIOUTCAPS2A;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; WCHAR szPname[MAXPNAMELEN]; WORD wTechnology; WORD wVoices; WORD wNotes; WORD wChannelMask; DWORD dwSupport; GUID ManufacturerGuid; GUID ProductGuid; GUID NameGuid; } MIDIOUTCAPS2W, *LPMIDIOUTCAPS2W;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; CHAR szPname[MAXPNAMELEN]; DWORD dwSupport; } MIDIINCAPSA, *LPMIDIINCAPSA;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; WCHAR szPname[MAXPNAMELEN]; DWORD dwSupport; } MIDIINCAPSW, *LPMIDIINCAPSW;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; CHAR szPname[MAXPNAMELEN]; DWORD dwSupport; GUID ManufacturerGuid; GUID ProductGuid; GUID NameGuid; } MIDIINCAPS2A, *LPMIDIINCAPS2A;
+typedef struct { WORD wMid; WORD wPid; UINT vDriverVersion; WCHAR szPname[MAXPNAMELEN]; DWORD dwSupport; GUID ManufacturerGuid; GUID ProductGuid; GUID NameGuid; } MIDIINCAPS2W, *LPMIDIINCAPS2W;
+
+// mmddk
+#define DRV_LOAD 0x0001
+#define DRV_ENABLE 0x0002
+#define DRV_OPEN 0x0003
+#define DRV_CLOSE 0x0004
+#define DRV_DISABLE 0x0005
+#define DRV_FREE 0x0006
+#define DRV_CONFIGURE 0x0007
+#define DRV_QUERYCONFIGURE 0x0008
+#define DRV_INSTALL 0x0009
+#define DRV_REMOVE 0x000A
+#define DRV_RESERVED 0x0800
+#define DRVCNF_OK 0x0001
+#define DRV_QUERYDEVICEINTERFACE (DRV_RESERVED + 12)
+#define DRV_QUERYDEVICEINTERFACESIZE (DRV_RESERVED + 13)
+#define MODM_GETNUMDEVS 1
+#define MODM_GETDEVCAPS 2
+#define MODM_OPEN 3
+#define MODM_CLOSE 4
+#define MODM_PREPARE 5
+#define MODM_UNPREPARE 6
+#define MODM_DATA 7
+#define MODM_LONGDATA 8
+#define MODM_RESET 9
+#define MODM_GETVOLUME 10
+#define MODM_SETVOLUME 11
+#define MODM_CACHEPATCHES 12
+#define MODM_CACHEDRUMPATCHES 13
+#define MIDM_GETNUMDEVS 53
+#define MIDM_GETDEVCAPS 54
+#define MIDM_OPEN 55
+#define MIDM_CLOSE 56
+#define MIDM_PREPARE 57
+#define MIDM_UNPREPARE 58
+#define MIDM_ADDBUFFER 59
+#define MIDM_START 60
+#define MIDM_STOP 61
+#define MIDM_RESET 62
+typedef struct tMIDIOPENSTRMID { DWORD dwStreamID; UINT uDeviceID; } MIDIOPENSTRMID;
+typedef struct tMIDIOPENDESC { HMIDI hMidi; DWORD_PTR dwCallback; DWORD_PTR dwInstance; DWORD_PTR dnDevNode; DWORD cIds; MIDIOPENSTRMID rgIds[1]; } MIDIOPENDESC, *PMIDIOPENDESC, *LPMIDIOPENDESC;
+LRESULT DefDriverProc(DWORD_PTR Identifier, HDRVR Driver, UINT Message, LPARAM Param1, LPARAM Param2);
+
+#endif
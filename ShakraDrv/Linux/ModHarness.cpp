@@ -0,0 +1,1532 @@
+/*
+Shakra Driver component for Linux
+This .cpp file contains a harness that calls the driver's entry points the same way WinMM does,
+so that modMessage() and midMessage() can be profiled and checked under Linux.
+
+This file is only used by the harness in this folder, see the Makefile to build it.
+*/
+
+#ifdef __linux__
+
+#include "../WinEvDecoder.hpp"
+#include "../WinNetPipe.hpp"
+#include "../WinPipeExecutor.hpp"
+#include "../WinPipeMerger.hpp"
+#include "../WinSynthPipe.hpp"
+#include "../WinTransform.hpp"
+#include "../WinVars.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/*
+
+	What it does, in order:
+	1. DriverProc(), MODM_GETNUMDEVS, MODM_GETDEVCAPS and MIDM_GETDEVCAPS, like
+	   WinMM does when it loads the driver
+	2. The synth port, once per cycle:
+	   - The harness creates the pipe and reads it from a thread of its own,
+	     like ShakraHost would
+	   - MODM_OPEN with a CALLBACK_FUNCTION
+	   - Every app thread sends its events with MODM_DATA, and every so often
+	     a SysEx with MODM_PREPARE, MODM_LONGDATA and MODM_UNPREPARE
+	   - MODM_CLOSE, then the host checks that it got every event, in the order
+	     each thread sent them
+	3. The loopback cable, MIDM_OPEN and MIDM_START on the input device, MODM_OPEN
+	   on the loopback port, then one event at a time, a burst of them, and a few
+	   SysEx messages, which have to come back out of the input device as they went in
+
+	With -B, it runs the benchmarks listed after it instead of 2 and 3, or all
+	of them with -B all, see Benchmarks[] below. "make bench" does the latter.
+
+	The pipe has a single producer, the same as midiOutShortMsg() can only be called
+	by one thread at a time for a given handle, so the app threads take turns on
+	the handle. The time they spend waiting for it is reported on its own, it's
+	not part of the cost of modMessage().
+
+	All the named objects of the shim live in this process, so the host is just
+	another thread. MODM_OPEN names the pipe with rand(), so the harness seeds it
+	before MODM_OPEN, and creates the pipe with the name the driver is going to
+	pick, which ShakraHost gets on its command line on Windows.
+
+	Exits with 1 if anything doesn't match.
+
+*/
+
+#define HARNESS_MAX_THREADS		16		// One channel each
+#define HARNESS_HOST_BATCH		512
+#define HARNESS_DRAIN_TIMEOUT	2000	// ms the host gets to read what's left after MODM_CLOSE
+#define HARNESS_LOOP_TIMEOUT	1000	// ms an event gets to come out of the loopback cable
+#define HARNESS_LOOP_BUFFERS	4
+#define HARNESS_LOOP_BUFSIZE	256
+#define HARNESS_LOOP_SYSEX		8
+#define HARNESS_BENCH_EVENTS	1000000	// Events per measurement of the benchmarks that loop on their own
+#define HARNESS_BENCH_ROUND		1024	// Events the producers queue before the consumer side takes them
+#define HARNESS_XFORM_CHUNKS	64		// Different chunks the transform benchmark goes through
+
+// Not in any header of the driver, the .def file exports them on Windows
+unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAddress, DWORD_PTR Param1, DWORD_PTR Param2);
+unsigned int midMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAddress, DWORD_PTR Param1, DWORD_PTR Param2);
+LRESULT __stdcall DriverProc(DWORD DriverIdentifier, HDRVR DriverHandle, UINT Message, LONG Param1, LONG Param2);
+bool WINAPI SH_CP(const wchar_t* Pipe, int Size);
+bool WINAPI SH_NC(const char* Address);
+unsigned int WINAPI SH_NF(unsigned int Max);
+bool WINAPI SH_NX();
+
+typedef struct {
+	unsigned int Threads = 4;
+	unsigned int Events = 100000;		// Per thread and per cycle
+	unsigned int SysExEvery = 1000;		// 0 sends no SysEx
+	unsigned int SysExSize = 64;
+	unsigned int Cycles = 3;
+	unsigned int RingSize = 0;			// 0 leaves it to the driver
+	unsigned int PublishBatch = 0;
+	unsigned int PublishDelay = 0;		// us
+	unsigned int LoopEvents = 10000;	// 0 skips the loopback cable
+	unsigned int Seed = 0x5EED;
+	const char* Bench = nullptr;		// Comma separated, or "all"
+} Options;
+
+typedef struct {
+	const char* Name;
+	const char* What;
+	void (*Run)(const Options* Opts);
+} Benchmark;
+
+// What reached the other end, for the benchmarks that time one event at a time
+typedef struct {
+	std::atomic<unsigned int> Received{ 0 };
+	std::atomic<unsigned long long> LastAt{ 0 };
+} Arrivals;
+
+typedef struct {
+	std::atomic<unsigned int> Opened{ 0 };
+	std::atomic<unsigned int> Closed{ 0 };
+	std::atomic<unsigned int> Done{ 0 };
+} OutCallbacks;
+
+typedef struct {
+	unsigned int Index;
+	std::vector<unsigned int> ShortCost;
+	std::vector<unsigned int> LongCost;
+	std::vector<unsigned int> DoneLatency;
+	std::vector<unsigned int> HandleWait;
+	unsigned int SysExSent = 0;
+} AppThread;
+
+typedef struct {
+	std::atomic<bool> Stop{ false };
+	std::atomic<unsigned long long> ShortEvents{ 0 };
+	std::atomic<unsigned long long> LongEvents{ 0 };
+	unsigned int NextShort[16] = { 0 };
+	unsigned int NextLong[16] = { 0 };
+	unsigned int SysExSize = 0;
+} HostState;
+
+typedef struct {
+	std::atomic<unsigned int> Opened{ 0 };
+	std::atomic<unsigned int> Closed{ 0 };
+	std::atomic<unsigned int> Received{ 0 };
+	std::atomic<unsigned int> LongReceived{ 0 };
+	std::atomic<LPMIDIHDR> LastLong{ nullptr };
+	std::vector<std::atomic<unsigned long long>> SentAt;	// Written by the app thread, read by the callback
+	std::vector<unsigned int> Latency;
+} InCallbacks;
+
+static std::atomic<unsigned int> Failures{ 0 };
+static int DriverCookie = 0;
+static thread_local AppThread* CurrentApp = nullptr;
+
+static unsigned long long Now() {
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int Clamp(unsigned long long Ns) {
+	return (unsigned int)std::min<unsigned long long>(Ns, 0xFFFFFFFF);
+}
+
+static void Fail(const char* Format, ...) {
+	va_list Args;
+
+	va_start(Args, Format);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, Format, Args);
+	fprintf(stderr, "\n");
+	va_end(Args);
+
+	Failures++;
+}
+
+static void Expect(unsigned int Result, unsigned int Wanted, const char* What) {
+	if (Result != Wanted)
+		Fail("%s returned %u, expected %u", What, Result, Wanted);
+}
+
+static void Report(const char* Name, std::vector<unsigned int>& Samples) {
+	unsigned long long Sum = 0;
+
+	if (Samples.empty())
+		return;
+
+	std::sort(Samples.begin(), Samples.end());
+
+	for (unsigned int Sample : Samples)
+		Sum += Sample;
+
+	auto At = [&Samples](double Percentile) { return Samples[(size_t)(Percentile * (Samples.size() - 1))]; };
+
+	printf("  %-26s %9zu  mean %8.0f  p50 %7u  p99 %7u  p99.9 %8u  max %9u ns\n",
+		Name, Samples.size(), (double)Sum / Samples.size(), At(0.5), At(0.99), At(0.999), Samples.back());
+}
+
+static void Merge(std::vector<unsigned int>& Target, const std::vector<unsigned int>& Source) {
+	Target.insert(Target.end(), Source.begin(), Source.end());
+}
+
+static unsigned int ClockOverhead() {
+	unsigned long long Best = ~0ull;
+
+	// Every sample has two clock reads in it, this is how much they cost
+	for (int i = 0; i < 10000; i++) {
+		unsigned long long Start = Now();
+		Best = std::min(Best, Now() - Start);
+	}
+
+	return Clamp(Best);
+}
+
+// The 14-bit sequence number goes in the two data bytes, note on and note off in turns
+static DWORD MakeEvent(BYTE Channel, unsigned int Sequence) {
+	BYTE Status = (Sequence & 1) ? 0x80 : 0x90;
+	return Status | Channel | ((Sequence & 0x7F) << 8) | (((Sequence >> 7) & 0x7F) << 16);
+}
+
+static unsigned int EventSequence(DWORD Event) {
+	return ((Event >> 8) & 0x7F) | (((Event >> 16) & 0x7F) << 7);
+}
+
+// Non-commercial manufacturer ID, so that the driver never mistakes it for a reset
+static void MakeSysEx(BYTE* Data, unsigned int Size, BYTE Channel, unsigned int Sequence) {
+	Data[0] = 0xF0;
+	Data[1] = 0x7D;
+	Data[2] = Channel;
+	Data[3] = (Sequence >> 7) & 0x7F;
+	Data[4] = Sequence & 0x7F;
+
+	for (unsigned int i = 5; i < Size - 1; i++)
+		Data[i] = (BYTE)((i + Sequence) & 0x7F);
+
+	Data[Size - 1] = 0xF7;
+}
+
+static bool CheckSysEx(const BYTE* Data, unsigned int Size, BYTE Channel, unsigned int Sequence) {
+	std::vector<BYTE> Wanted(Size);
+
+	MakeSysEx(Wanted.data(), Size, Channel, Sequence);
+	return !memcmp(Data, Wanted.data(), Size);
+}
+
+// Same as GenerateID() in WinSynthPipe.cpp
+static std::wstring PipeName(unsigned int Seed) {
+	const char Charset[] =
+		"0123456789"
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		"abcdefghijklmnopqrstuvwxyz";
+	std::wstring Name;
+
+	srand(Seed);
+
+	for (int i = 0; i < 32; i++)
+		Name += (wchar_t)Charset[rand() % (sizeof(Charset) - 1)];
+
+	return Name;
+}
+
+static void CALLBACK OutCallback(HMIDIOUT Handle, DWORD Message, DWORD_PTR Instance, DWORD_PTR Param1, DWORD_PTR Param2) {
+	OutCallbacks* Target = (OutCallbacks*)Instance;
+
+	switch (Message) {
+	case MOM_OPEN:
+		Target->Opened++;
+		break;
+
+	case MOM_CLOSE:
+		Target->Closed++;
+		break;
+
+	case MOM_DONE:
+		// Synchronous, so it's on the thread that sent the SysEx
+		if (CurrentApp)
+			CurrentApp->DoneLatency.push_back(Clamp(Now() - ((LPMIDIHDR)Param1)->dwUser));
+
+		Target->Done++;
+		break;
+	}
+}
+
+static void CALLBACK InCallback(HMIDIIN Handle, UINT Message, DWORD_PTR Instance, DWORD_PTR Param1, DWORD_PTR Param2) {
+	InCallbacks* Target = (InCallbacks*)Instance;
+
+	switch (Message) {
+	case MIM_OPEN:
+		Target->Opened++;
+		break;
+
+	case MIM_CLOSE:
+		Target->Closed++;
+		break;
+
+	case MIM_DATA: {
+		unsigned int Index = Target->Received.load();
+
+		if (Index >= Target->SentAt.size()) {
+			Fail("The loopback cable delivered more events than it got");
+			break;
+		}
+
+		if ((DWORD)Param1 != MakeEvent(0, Index))
+			Fail("The loopback cable delivered 0x%06X, expected 0x%06X", (DWORD)Param1, MakeEvent(0, Index));
+
+		Target->Latency.push_back(Clamp(Now() - Target->SentAt[Index].load(std::memory_order_relaxed)));
+		Target->Received.store(Index + 1);
+		break;
+	}
+
+	case MIM_LONGDATA:
+		Target->LastLong.store((LPMIDIHDR)Param1);
+		Target->LongReceived++;
+		break;
+	}
+}
+
+static void HostLoop(WinDriver::SynthPipe* Host, HostState* State) {
+	DWORD Events[HARNESS_HOST_BATCH];
+
+	while (!State->Stop) {
+		unsigned int Count, Longs = 0, Length;
+		unsigned long long Timestamp;
+		const BYTE* Data;
+		DWORD Event;
+
+		Host->Heartbeat();
+		Count = Host->ParseShortEvents(Events, HARNESS_HOST_BATCH);
+
+		for (unsigned int i = 0; i < Count; i++) {
+			BYTE Channel = Events[i] & 0x0F;
+			unsigned int Sequence = EventSequence(Events[i]);
+
+			if (Events[i] != MakeEvent(Channel, State->NextShort[Channel])) {
+				Fail("The host got 0x%06X on channel %u, expected sequence %u", Events[i], Channel, State->NextShort[Channel]);
+				State->NextShort[Channel] = Sequence;
+			}
+
+			State->NextShort[Channel] = (State->NextShort[Channel] + 1) & 0x3FFF;
+		}
+
+		State->ShortEvents += Count;
+
+		while ((Length = Host->ParseLongEventRef(&Data)) > 0) {
+			BYTE Channel = (Length > 5) ? Data[2] & 0x0F : 0;
+
+			if (Length != State->SysExSize || !CheckSysEx(Data, Length, Channel, State->NextLong[Channel]))
+				Fail("The host got a SysEx of %u bytes that doesn't match what channel %u sent", Length, Channel);
+
+			State->NextLong[Channel]++;
+			Host->FreeLongEvent();
+			Longs++;
+		}
+
+		State->LongEvents += Longs;
+
+		if (Count || Longs)
+			continue;
+
+		// Arm first, then look, see the doorbell notes in WinPipeExecutor.hpp
+		Host->ArmDoorbell();
+
+		if (Host->PeekShortEvent(&Event, nullptr) || Host->PeekLongEvent(&Timestamp))
+			continue;
+
+		WaitForSingleObject(Host->GetDoorbell(), 10);
+	}
+}
+
+static void AppLoop(AppThread* App, const Options* Opts, std::mutex* HandleLock, DWORD_PTR DriverAddress) {
+	std::vector<BYTE> SysEx(Opts->SysExSize);
+	BYTE Channel = (BYTE)App->Index;
+
+	CurrentApp = App;
+
+	for (unsigned int i = 0; i < Opts->Events; i++) {
+		unsigned long long Waiting = Now(), Start, End;
+
+		HandleLock->lock();
+		Start = Now();
+		modMessage(0, MODM_DATA, DriverAddress, MakeEvent(Channel, i), 0);
+		End = Now();
+		HandleLock->unlock();
+
+		App->HandleWait.push_back(Clamp(Start - Waiting));
+		App->ShortCost.push_back(Clamp(End - Start));
+
+		if (!Opts->SysExEvery || (i % Opts->SysExEvery) != Opts->SysExEvery - 1)
+			continue;
+
+		MIDIHDR Header;
+
+		memset(&Header, 0, sizeof(Header));
+		MakeSysEx(SysEx.data(), Opts->SysExSize, Channel, App->SysExSent);
+		Header.lpData = (LPSTR)SysEx.data();
+		Header.dwBufferLength = Opts->SysExSize;
+
+		HandleLock->lock();
+		Expect(modMessage(0, MODM_PREPARE, DriverAddress, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_PREPARE");
+
+		Start = Now();
+		Header.dwUser = Start;
+		Expect(modMessage(0, MODM_LONGDATA, DriverAddress, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_LONGDATA");
+		End = Now();
+
+		Expect(modMessage(0, MODM_UNPREPARE, DriverAddress, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_UNPREPARE");
+		HandleLock->unlock();
+
+		if (!(Header.dwFlags & MHDR_DONE))
+			Fail("MODM_LONGDATA didn't mark the header as done");
+
+		App->LongCost.push_back(Clamp(End - Start));
+		App->SysExSent++;
+	}
+
+	CurrentApp = nullptr;
+}
+
+static void CheckEntryPoints() {
+	MIDIOUTCAPSW OutCaps;
+	MIDIINCAPSW InCaps;
+	HDRVR Handle = (HDRVR)&DriverCookie;
+
+	printf("Entry points\n");
+
+	if (!DriverProc(0, Handle, DRV_LOAD, 0, 0))
+		Fail("DRV_LOAD failed");
+
+	Expect((unsigned int)DriverProc(0, Handle, DRV_ENABLE, 0, 0), DRVCNF_OK, "DRV_ENABLE");
+	Expect((unsigned int)DriverProc(0, Handle, DRV_OPEN, 0, 0), DRVCNF_OK, "DRV_OPEN");
+
+	Expect(modMessage(0, MODM_GETNUMDEVS, 0, 0, 0), 2, "MODM_GETNUMDEVS");
+	Expect(midMessage(0, MIDM_GETNUMDEVS, 0, 0, 0), 1, "MIDM_GETNUMDEVS");
+
+	for (UINT Port = 0; Port <= LOOPBACK_PORT; Port++) {
+		memset(&OutCaps, 0, sizeof(OutCaps));
+		Expect(modMessage(Port, MODM_GETDEVCAPS, 0, (DWORD_PTR)&OutCaps, sizeof(OutCaps)), MMSYSERR_NOERROR, "MODM_GETDEVCAPS");
+		printf("  Output %u: %ls\n", Port, OutCaps.szPname);
+	}
+
+	memset(&InCaps, 0, sizeof(InCaps));
+	Expect(midMessage(0, MIDM_GETDEVCAPS, 0, (DWORD_PTR)&InCaps, sizeof(InCaps)), MMSYSERR_NOERROR, "MIDM_GETDEVCAPS");
+	printf("  Input 0: %ls\n", InCaps.szPname);
+}
+
+static void ReleaseEntryPoints() {
+	HDRVR Handle = (HDRVR)&DriverCookie;
+
+	Expect((unsigned int)DriverProc(0, Handle, DRV_CLOSE, 0, 0), DRVCNF_OK, "DRV_CLOSE");
+	Expect((unsigned int)DriverProc(0, Handle, DRV_DISABLE, 0, 0), DRVCNF_OK, "DRV_DISABLE");
+
+	if (!DriverProc(0, Handle, DRV_FREE, 0, 0))
+		Fail("DRV_FREE failed");
+}
+
+static void RunSynthPort(const Options* Opts) {
+	std::vector<unsigned int> ShortCost, LongCost, DoneLatency, HandleWait, OpenCost, CloseCost;
+	unsigned long long Events = 0, SendTime = 0;
+
+	printf("Synth port, %u cycles of %u threads, %u events each\n", Opts->Cycles, Opts->Threads, Opts->Events);
+
+	for (unsigned int Cycle = 0; Cycle < Opts->Cycles; Cycle++) {
+		unsigned int Seed = Opts->Seed + Cycle;
+		std::wstring Name = PipeName(Seed);
+		WinDriver::SynthPipe Host;
+		HostState State;
+		OutCallbacks Callbacks;
+		MIDIOPENDESC Desc;
+		DWORD_PTR DriverUser = 0;
+		unsigned long long Start;
+		unsigned int SysExSent = 0;
+
+		if (!Host.PrepareFileMappings(Name.c_str(), true, Opts->RingSize)) {
+			Fail("The host couldn't create the pipe");
+			return;
+		}
+
+		Host.SetHostStatus(HOST_STATUS_RUNNING);
+
+		// The default drops the events when the ring is full, the harness wants all of them
+		Host.SetBackPressure(BACKPRESSURE_BLOCK, 0);
+
+		if (Opts->PublishBatch)
+			Host.SetPublishBatching(Opts->PublishBatch, Opts->PublishDelay);
+
+		State.SysExSize = Opts->SysExSize;
+		std::thread Consumer(HostLoop, &Host, &State);
+
+		memset(&Desc, 0, sizeof(Desc));
+		Desc.hMidi = (HMIDI)&Desc;
+		Desc.dwCallback = (DWORD_PTR)OutCallback;
+		Desc.dwInstance = (DWORD_PTR)&Callbacks;
+
+		// MODM_OPEN picks the same name the host got
+		srand(Seed);
+
+		Start = Now();
+		unsigned int Result = modMessage(0, MODM_OPEN, (DWORD_PTR)&DriverUser, (DWORD_PTR)&Desc, CALLBACK_FUNCTION);
+		OpenCost.push_back(Clamp(Now() - Start));
+
+		if (Result != MMSYSERR_NOERROR) {
+			Fail("MODM_OPEN returned %u", Result);
+			State.Stop = true;
+			Consumer.join();
+			Host.ClosePipe();
+			return;
+		}
+
+		std::vector<AppThread> Apps(Opts->Threads);
+		std::vector<std::thread> Threads;
+		std::mutex HandleLock;
+
+		Start = Now();
+
+		for (unsigned int i = 0; i < Opts->Threads; i++) {
+			Apps[i].Index = i;
+			Apps[i].ShortCost.reserve(Opts->Events);
+			Apps[i].HandleWait.reserve(Opts->Events);
+			Threads.emplace_back(AppLoop, &Apps[i], Opts, &HandleLock, (DWORD_PTR)&DriverUser);
+		}
+
+		for (auto& Thread : Threads)
+			Thread.join();
+
+		SendTime += Now() - Start;
+
+		Start = Now();
+		Expect(modMessage(0, MODM_CLOSE, (DWORD_PTR)&DriverUser, 0, 0), MMSYSERR_NOERROR, "MODM_CLOSE");
+		CloseCost.push_back(Clamp(Now() - Start));
+
+		for (auto& App : Apps) {
+			Merge(ShortCost, App.ShortCost);
+			Merge(LongCost, App.LongCost);
+			Merge(DoneLatency, App.DoneLatency);
+			Merge(HandleWait, App.HandleWait);
+			SysExSent += App.SysExSent;
+		}
+
+		unsigned long long Wanted = (unsigned long long)Opts->Threads * Opts->Events;
+		unsigned long long Deadline = Now() + HARNESS_DRAIN_TIMEOUT * 1000000ull;
+
+		while ((State.ShortEvents < Wanted || State.LongEvents < SysExSent) && Now() < Deadline)
+			Sleep(1);
+
+		State.Stop = true;
+		Consumer.join();
+
+		Host.SetHostStatus(HOST_STATUS_OFFLINE);
+		Host.ClosePipe();
+
+		if (State.ShortEvents != Wanted)
+			Fail("Cycle %u: the host got %llu short events, the apps sent %llu", Cycle, State.ShortEvents.load(), Wanted);
+
+		if (State.LongEvents != SysExSent)
+			Fail("Cycle %u: the host got %llu SysEx messages, the apps sent %u", Cycle, State.LongEvents.load(), SysExSent);
+
+		if (Callbacks.Opened != 1 || Callbacks.Closed != 1 || Callbacks.Done != SysExSent)
+			Fail("Cycle %u: got %u MOM_OPEN, %u MOM_CLOSE and %u MOM_DONE, expected 1, 1 and %u",
+				Cycle, Callbacks.Opened.load(), Callbacks.Closed.load(), Callbacks.Done.load(), SysExSent);
+
+		Events += Wanted;
+	}
+
+	Report("MODM_DATA", ShortCost);
+	Report("MODM_LONGDATA", LongCost);
+	Report("MOM_DONE after LONGDATA", DoneLatency);
+	Report("Waiting for the handle", HandleWait);
+	Report("MODM_OPEN", OpenCost);
+	Report("MODM_CLOSE", CloseCost);
+
+	if (SendTime)
+		printf("  %.2f M events/s, with the threads taking turns\n", Events * 1000.0 / SendTime);
+}
+
+static void RunLoopback(const Options* Opts) {
+	std::vector<BYTE> Buffers(HARNESS_LOOP_BUFFERS * HARNESS_LOOP_BUFSIZE);
+	MIDIHDR InHeaders[HARNESS_LOOP_BUFFERS];
+	std::vector<unsigned int> SendCost, PingPong, Burst;
+	InCallbacks In;
+	OutCallbacks Out;
+	MIDIOPENDESC InDesc, OutDesc;
+	DWORD_PTR InUser = 0, OutUser = 0;
+	unsigned int BurstEvents = std::min(Opts->LoopEvents, 1000u);
+	unsigned int Total = Opts->LoopEvents + BurstEvents;
+
+	printf("Loopback cable, %u events one at a time, then %u at once\n", Opts->LoopEvents, BurstEvents);
+
+	In.SentAt = std::vector<std::atomic<unsigned long long>>(Total);
+	In.Latency.reserve(Total);
+
+	memset(&InDesc, 0, sizeof(InDesc));
+	InDesc.hMidi = (HMIDI)&InDesc;
+	InDesc.dwCallback = (DWORD_PTR)InCallback;
+	InDesc.dwInstance = (DWORD_PTR)&In;
+
+	if (midMessage(0, MIDM_OPEN, (DWORD_PTR)&InUser, (DWORD_PTR)&InDesc, CALLBACK_FUNCTION) != MMSYSERR_NOERROR) {
+		Fail("MIDM_OPEN failed");
+		return;
+	}
+
+	// WinMM prepares the input buffers itself
+	for (int i = 0; i < HARNESS_LOOP_BUFFERS; i++) {
+		memset(&InHeaders[i], 0, sizeof(MIDIHDR));
+		InHeaders[i].lpData = (LPSTR)&Buffers[i * HARNESS_LOOP_BUFSIZE];
+		InHeaders[i].dwBufferLength = HARNESS_LOOP_BUFSIZE;
+		InHeaders[i].dwFlags = MHDR_PREPARED;
+		Expect(midMessage(0, MIDM_ADDBUFFER, (DWORD_PTR)&InUser, (DWORD_PTR)&InHeaders[i], sizeof(MIDIHDR)), MMSYSERR_NOERROR, "MIDM_ADDBUFFER");
+	}
+
+	Expect(midMessage(0, MIDM_START, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_START");
+
+	memset(&OutDesc, 0, sizeof(OutDesc));
+	OutDesc.hMidi = (HMIDI)&OutDesc;
+	OutDesc.dwCallback = (DWORD_PTR)OutCallback;
+	OutDesc.dwInstance = (DWORD_PTR)&Out;
+	Expect(modMessage(LOOPBACK_PORT, MODM_OPEN, (DWORD_PTR)&OutUser, (DWORD_PTR)&OutDesc, CALLBACK_FUNCTION), MMSYSERR_NOERROR, "MODM_OPEN on the loopback port");
+
+	auto WaitFor = [](std::atomic<unsigned int>& Counter, unsigned int Wanted) {
+		unsigned long long Deadline = Now() + HARNESS_LOOP_TIMEOUT * 1000000ull;
+
+		while (Counter.load() < Wanted) {
+			if (Now() > Deadline)
+				return false;
+
+			std::this_thread::yield();
+		}
+
+		return true;
+	};
+
+	// One at a time, so it's the latency of a quiet cable, doorbell included
+	for (unsigned int i = 0; i < Opts->LoopEvents; i++) {
+		unsigned long long Start = Now();
+
+		In.SentAt[i].store(Start, std::memory_order_relaxed);
+		modMessage(LOOPBACK_PORT, MODM_DATA, (DWORD_PTR)&OutUser, MakeEvent(0, i), 0);
+		SendCost.push_back(Clamp(Now() - Start));
+
+		if (!WaitFor(In.Received, i + 1)) {
+			Fail("Event %u never came out of the loopback cable", i);
+			break;
+		}
+	}
+
+	for (unsigned int i = Opts->LoopEvents; i < Total; i++) {
+		In.SentAt[i].store(Now(), std::memory_order_relaxed);
+		modMessage(LOOPBACK_PORT, MODM_DATA, (DWORD_PTR)&OutUser, MakeEvent(0, i), 0);
+	}
+
+	if (!WaitFor(In.Received, Total))
+		Fail("The loopback cable delivered %u of %u events", In.Received.load(), Total);
+
+	for (unsigned int i = 0; i < In.Latency.size(); i++)
+		(i < Opts->LoopEvents ? PingPong : Burst).push_back(In.Latency[i]);
+
+	// The SysEx has to come out of the input buffers the same as it went in
+	for (unsigned int i = 0; i < HARNESS_LOOP_SYSEX; i++) {
+		BYTE SysEx[HARNESS_LOOP_BUFSIZE / 2];
+		MIDIHDR Header;
+
+		MakeSysEx(SysEx, sizeof(SysEx), 0, i);
+		memset(&Header, 0, sizeof(Header));
+		Header.lpData = (LPSTR)SysEx;
+		Header.dwBufferLength = sizeof(SysEx);
+
+		Expect(modMessage(LOOPBACK_PORT, MODM_PREPARE, (DWORD_PTR)&OutUser, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_PREPARE on the loopback port");
+		Expect(modMessage(LOOPBACK_PORT, MODM_LONGDATA, (DWORD_PTR)&OutUser, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_LONGDATA on the loopback port");
+		Expect(modMessage(LOOPBACK_PORT, MODM_UNPREPARE, (DWORD_PTR)&OutUser, (DWORD_PTR)&Header, sizeof(Header)), MMSYSERR_NOERROR, "MODM_UNPREPARE on the loopback port");
+
+		if (!WaitFor(In.LongReceived, i + 1)) {
+			Fail("SysEx %u never came out of the loopback cable", i);
+			break;
+		}
+
+		LPMIDIHDR Got = In.LastLong.load();
+
+		if (Got->dwBytesRecorded != sizeof(SysEx) || !CheckSysEx((const BYTE*)Got->lpData, sizeof(SysEx), 0, i))
+			Fail("SysEx %u came out of the loopback cable with %u bytes that don't match", i, Got->dwBytesRecorded);
+
+		// Back to the driver, like an app does once it's done with the buffer
+		Expect(midMessage(0, MIDM_ADDBUFFER, (DWORD_PTR)&InUser, (DWORD_PTR)Got, sizeof(MIDIHDR)), MMSYSERR_NOERROR, "MIDM_ADDBUFFER");
+	}
+
+	unsigned int Returned = In.LongReceived.load();
+
+	Expect(modMessage(LOOPBACK_PORT, MODM_CLOSE, (DWORD_PTR)&OutUser, 0, 0), MMSYSERR_NOERROR, "MODM_CLOSE on the loopback port");
+	Expect(midMessage(0, MIDM_STOP, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_STOP");
+	Expect(midMessage(0, MIDM_RESET, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_RESET");
+	Expect(midMessage(0, MIDM_CLOSE, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_CLOSE");
+
+	if (In.LongReceived - Returned != HARNESS_LOOP_BUFFERS)
+		Fail("MIDM_RESET gave back %u buffers, expected %u", In.LongReceived - Returned, HARNESS_LOOP_BUFFERS);
+
+	if (In.Opened != 1 || In.Closed != 1 || Out.Opened != 1 || Out.Closed != 1 || Out.Done != HARNESS_LOOP_SYSEX)
+		Fail("Got %u MIM_OPEN, %u MIM_CLOSE, %u MOM_OPEN, %u MOM_CLOSE and %u MOM_DONE on the loopback cable",
+			In.Opened.load(), In.Closed.load(), Out.Opened.load(), Out.Closed.load(), Out.Done.load());
+
+	Report("MODM_DATA", SendCost);
+	Report("Delivery, one at a time", PingPong);
+	Report("Delivery, in a burst", Burst);
+}
+
+static void CALLBACK ArrivalCallback(HMIDIIN Handle, UINT Message, DWORD_PTR Instance, DWORD_PTR Param1, DWORD_PTR Param2) {
+	Arrivals* Target = (Arrivals*)Instance;
+
+	if (Message != MIM_DATA)
+		return;
+
+	Target->LastAt.store(Now(), std::memory_order_relaxed);
+	Target->Received.fetch_add(1, std::memory_order_release);
+}
+
+static void ArrivalHost(WinDriver::SynthPipe* Host, std::atomic<bool>* Stop, Arrivals* Target) {
+	DWORD Events[HARNESS_HOST_BATCH];
+
+	// Same as ShakraHost, and HostLoop() above without the checks
+	while (!Stop->load()) {
+		DWORD Event;
+		unsigned int Count;
+
+		Host->Heartbeat();
+
+		if ((Count = Host->ParseShortEvents(Events, HARNESS_HOST_BATCH)) > 0) {
+			Target->LastAt.store(Now(), std::memory_order_relaxed);
+			Target->Received.fetch_add(Count, std::memory_order_release);
+			continue;
+		}
+
+		Host->ArmDoorbell();
+
+		if (Host->PeekShortEvent(&Event, nullptr))
+			continue;
+
+		WaitForSingleObject(Host->GetDoorbell(), 10);
+	}
+}
+
+// Sends one event at a time through Port, and waits for it to come out the other end
+static bool TimeArrivals(UINT Port, DWORD_PTR DriverAddress, Arrivals* Target, unsigned int Events, std::vector<unsigned int>& Latency) {
+	for (unsigned int i = 0; i < Events; i++) {
+		unsigned long long Start = Now(), Deadline = Start + HARNESS_LOOP_TIMEOUT * 1000000ull;
+
+		modMessage(Port, MODM_DATA, DriverAddress, MakeEvent(0, i), 0);
+
+		while (Target->Received.load(std::memory_order_acquire) <= i) {
+			if (Now() > Deadline) {
+				Fail("Event %u never reached the other end of port %u", i, Port);
+				return false;
+			}
+
+			std::this_thread::yield();
+		}
+
+		Latency.push_back(Clamp(Target->LastAt.load(std::memory_order_relaxed) - Start));
+	}
+
+	return true;
+}
+
+static void BenchRoundTrip(const Options* Opts) {
+	std::vector<unsigned int> HostPath, CablePath;
+	unsigned int Events = Opts->LoopEvents ? Opts->LoopEvents : 10000;
+
+	// The host path, an app on the synth port and a host thread reading the pipe
+	{
+		std::wstring Name = PipeName(Opts->Seed);
+		WinDriver::SynthPipe Host;
+		std::atomic<bool> Stop{ false };
+		Arrivals Got;
+		OutCallbacks Callbacks;
+		MIDIOPENDESC Desc;
+		DWORD_PTR DriverUser = 0;
+
+		if (!Host.PrepareFileMappings(Name.c_str(), true, Opts->RingSize)) {
+			Fail("The host couldn't create the pipe");
+			return;
+		}
+
+		Host.SetHostStatus(HOST_STATUS_RUNNING);
+		std::thread Consumer(ArrivalHost, &Host, &Stop, &Got);
+
+		memset(&Desc, 0, sizeof(Desc));
+		Desc.hMidi = (HMIDI)&Desc;
+		Desc.dwCallback = (DWORD_PTR)OutCallback;
+		Desc.dwInstance = (DWORD_PTR)&Callbacks;
+
+		srand(Opts->Seed);
+
+		if (modMessage(0, MODM_OPEN, (DWORD_PTR)&DriverUser, (DWORD_PTR)&Desc, CALLBACK_FUNCTION) == MMSYSERR_NOERROR) {
+			TimeArrivals(0, (DWORD_PTR)&DriverUser, &Got, Events, HostPath);
+			Expect(modMessage(0, MODM_CLOSE, (DWORD_PTR)&DriverUser, 0, 0), MMSYSERR_NOERROR, "MODM_CLOSE");
+		}
+		else Fail("MODM_OPEN failed");
+
+		Stop = true;
+		Consumer.join();
+
+		Host.SetHostStatus(HOST_STATUS_OFFLINE);
+		Host.ClosePipe();
+	}
+
+	// The loopback cable, the driver's own delivery thread reads the pipe
+	{
+		Arrivals Got;
+		OutCallbacks Callbacks;
+		MIDIOPENDESC InDesc, OutDesc;
+		DWORD_PTR InUser = 0, OutUser = 0;
+
+		memset(&InDesc, 0, sizeof(InDesc));
+		InDesc.hMidi = (HMIDI)&InDesc;
+		InDesc.dwCallback = (DWORD_PTR)ArrivalCallback;
+		InDesc.dwInstance = (DWORD_PTR)&Got;
+
+		memset(&OutDesc, 0, sizeof(OutDesc));
+		OutDesc.hMidi = (HMIDI)&OutDesc;
+		OutDesc.dwCallback = (DWORD_PTR)OutCallback;
+		OutDesc.dwInstance = (DWORD_PTR)&Callbacks;
+
+		if (midMessage(0, MIDM_OPEN, (DWORD_PTR)&InUser, (DWORD_PTR)&InDesc, CALLBACK_FUNCTION) != MMSYSERR_NOERROR) {
+			Fail("MIDM_OPEN failed");
+			return;
+		}
+
+		Expect(midMessage(0, MIDM_START, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_START");
+		Expect(modMessage(LOOPBACK_PORT, MODM_OPEN, (DWORD_PTR)&OutUser, (DWORD_PTR)&OutDesc, CALLBACK_FUNCTION), MMSYSERR_NOERROR, "MODM_OPEN on the loopback port");
+
+		TimeArrivals(LOOPBACK_PORT, (DWORD_PTR)&OutUser, &Got, Events, CablePath);
+
+		Expect(modMessage(LOOPBACK_PORT, MODM_CLOSE, (DWORD_PTR)&OutUser, 0, 0), MMSYSERR_NOERROR, "MODM_CLOSE on the loopback port");
+		Expect(midMessage(0, MIDM_STOP, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_STOP");
+		Expect(midMessage(0, MIDM_RESET, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_RESET");
+		Expect(midMessage(0, MIDM_CLOSE, (DWORD_PTR)&InUser, 0, 0), MMSYSERR_NOERROR, "MIDM_CLOSE");
+	}
+
+	Report("Synth port to the host", HostPath);
+	Report("Loopback port to MIM_DATA", CablePath);
+}
+
+static void BenchMerger(const Options* Opts) {
+	std::vector<DWORD> Target(HARNESS_BENCH_ROUND);
+
+	printf("  %-8s %12s %12s\n", "Sources", "ns/event", "M events/s");
+
+	// The producers fill the pipes in turns, so that the timestamps interleave like real apps
+	for (unsigned int Sources = 1; Sources <= MAX_MERGE_SOURCES; Sources <<= 1) {
+		WinDriver::PipeMerger Merger;
+		std::vector<WinDriver::SynthPipe> Apps(Sources);
+		unsigned long long Merged = 0, Spent = 0;
+		bool Ready = true;
+
+		for (unsigned int i = 0; i < Sources && Ready; i++) {
+			wchar_t Name[32];
+
+			swprintf(Name, 32, L"BenchMerge%u", i);
+			Ready = Merger.AddSource(Name, 0) >= 0 && Apps[i].PrepareFileMappings(Name, false, 0);
+		}
+
+		if (!Ready) {
+			Fail("Couldn't open %u merger sources", Sources);
+			return;
+		}
+
+		while (Merged < HARNESS_BENCH_EVENTS) {
+			unsigned int Queued = 0, Got = 0, Count;
+
+			for (unsigned int i = 0; i < HARNESS_BENCH_ROUND; i++)
+				Queued += Apps[i % Sources].SaveShortEvent(MakeEvent(i % Sources, i)) ? 1 : 0;
+
+			unsigned long long Start = Now();
+
+			while ((Count = Merger.Merge(Target.data(), HARNESS_BENCH_ROUND)) > 0)
+				Got += Count;
+
+			Spent += Now() - Start;
+
+			if (Got != Queued) {
+				Fail("The merger gave %u events out of %u with %u sources", Got, Queued, Sources);
+				break;
+			}
+
+			Merged += Got;
+		}
+
+		for (auto& App : Apps)
+			App.ClosePipe();
+
+		printf("  %-8u %12.1f %12.2f\n", Sources, (double)Spent / Merged, Merged * 1000.0 / Spent);
+	}
+}
+
+// ArrivalHost() as a coroutine, the pipe doesn't get a thread of its own
+static WinDriver::PipeTask ArrivalTask(WinDriver::PipeExecutor* Executor, WinDriver::SynthPipe* Host, Arrivals* Target) {
+	DWORD Events[HARNESS_HOST_BATCH];
+
+	for (;;) {
+		unsigned int Count = co_await Executor->NextBatch(Host, Events, HARNESS_HOST_BATCH);
+
+		if (Count) {
+			Target->LastAt.store(Now(), std::memory_order_relaxed);
+			Target->Received.fetch_add(Count, std::memory_order_release);
+		}
+	}
+}
+
+// One event at a time, and every so often a burst of them, Send(Index, Event, Last) queues one
+template <typename Sender>
+static bool TimeDelivery(Sender Send, const char* Where, Arrivals* Target, unsigned int Events, std::vector<unsigned int>& Latency, std::vector<unsigned int>& Burst) {
+	unsigned int Wanted = 0;
+
+	for (unsigned int i = 0; i < Events; i++) {
+		unsigned long long Start = Now(), Deadline = Start + HARNESS_LOOP_TIMEOUT * 1000000ull;
+		unsigned int Round = (i % 16 == 15) ? HARNESS_BENCH_ROUND : 1;
+		unsigned int Queued = 0;
+
+		for (unsigned int j = 0; j < Round; j++)
+			Queued += Send(i + j, MakeEvent(0, i), j == Round - 1) ? 1 : 0;
+
+		Wanted += Queued;
+
+		while (Target->Received.load(std::memory_order_acquire) < Wanted) {
+			if (Now() > Deadline) {
+				Fail("Round %u never reached the other end of %s", i, Where);
+				return false;
+			}
+
+			std::this_thread::yield();
+		}
+
+		(Round == 1 ? Latency : Burst).push_back(Clamp(Target->LastAt.load(std::memory_order_relaxed) - Start));
+	}
+
+	return true;
+}
+
+static void BenchExecutor(const Options* Opts) {
+	const unsigned int Counts[] = { 1, 8, 32, EXECUTOR_MAX_PIPES };
+	unsigned int Events = Opts->LoopEvents ? Opts->LoopEvents : 10000;
+
+	// The same pipes read by a single executor thread, then by a thread each like ShakraHost does
+	for (unsigned int Pipes : Counts) {
+		std::vector<WinDriver::SynthPipe> Hosts(Pipes), Apps(Pipes);
+		std::vector<unsigned int> Latency, Burst;
+		char Name[64];
+		bool Ready = true;
+
+		for (unsigned int i = 0; i < Pipes && Ready; i++) {
+			wchar_t PipeID[32];
+
+			swprintf(PipeID, 32, L"BenchExecutor%u", i);
+			Ready = Hosts[i].PrepareFileMappings(PipeID, true, Opts->RingSize) && Apps[i].PrepareFileMappings(PipeID, false, 0);
+		}
+
+		if (!Ready) {
+			Fail("Couldn't open %u pipes for the executor", Pipes);
+			return;
+		}
+
+		// Every pipe in turns, a burst gets spread over all of them
+		auto SendToPipes = [&Apps](unsigned int Index, DWORD Event, bool Last) { return Apps[Index % Apps.size()].SaveShortEvent(Event); };
+
+		{
+			WinDriver::PipeExecutor Executor;
+			Arrivals Got;
+
+			if (!Executor.Start(1)) {
+				Fail("The executor didn't start");
+				return;
+			}
+
+			for (auto& Host : Hosts)
+				ArrivalTask(&Executor, &Host, &Got);
+
+			TimeDelivery(SendToPipes, "the pipes", &Got, Events, Latency, Burst);
+			Executor.Stop();
+
+			snprintf(Name, sizeof(Name), "1 thread, %u pipes", Pipes);
+			Report(Name, Latency);
+			snprintf(Name, sizeof(Name), "  bursts of %u", HARNESS_BENCH_ROUND);
+			Report(Name, Burst);
+		}
+
+		Latency.clear();
+		Burst.clear();
+
+		{
+			std::vector<std::thread> Consumers;
+			std::atomic<bool> Stop{ false };
+			Arrivals Got;
+
+			for (auto& Host : Hosts)
+				Consumers.emplace_back(ArrivalHost, &Host, &Stop, &Got);
+
+			TimeDelivery(SendToPipes, "the pipes", &Got, Events, Latency, Burst);
+
+			Stop = true;
+
+			for (auto& Consumer : Consumers)
+				Consumer.join();
+
+			snprintf(Name, sizeof(Name), "A thread each, %u pipes", Pipes);
+			Report(Name, Latency);
+			snprintf(Name, sizeof(Name), "  bursts of %u", HARNESS_BENCH_ROUND);
+			Report(Name, Burst);
+		}
+
+		for (unsigned int i = 0; i < Pipes; i++) {
+			Apps[i].ClosePipe();
+			Hosts[i].ClosePipe();
+		}
+	}
+}
+
+// A producer and a consumer thread on a ring of the given algorithm, each with its own view of the mapping like the pipes
+template <typename Algo>
+static void BenchRing(const char* Name, const Options* Opts) {
+	typedef WinDriver::Ring<SE, MAX_SE_BUF, Algo> BenchRingType;
+	typedef typename BenchRingType::Storage BenchStorage;
+
+	BenchRingType Producer, Consumer;
+	std::vector<unsigned int> Latency;
+	std::atomic<bool> Stop{ false };
+	Arrivals Got;
+	unsigned int Events = Opts->LoopEvents ? Opts->LoopEvents : 10000;
+	unsigned long long Sent = 0;
+
+	HANDLE Mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(BenchStorage), NULL);
+	BenchStorage* Writer = Mapping ? (BenchStorage*)MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+	BenchStorage* Reader = Mapping ? (BenchStorage*)MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+
+	// The whole capacity for every algorithm, so that Lamport doesn't get to grow in the middle of it
+	if (!Writer || !Reader || !Producer.Attach(Writer, true, MAX_SE_BUF, MAX_SE_BUF) ||
+		!Consumer.Attach(Reader, false, MAX_SE_BUF, MAX_SE_BUF) || !Consumer.AttachConsumer()) {
+		Fail("Couldn't set up the %s ring", Name);
+
+		if (Writer) UnmapViewOfFile(Writer);
+		if (Reader) UnmapViewOfFile(Reader);
+		if (Mapping) CloseHandle(Mapping);
+		return;
+	}
+
+	// Same as ParseShortEvents(), reads until it's empty, then publishes its position once
+	std::thread Drain([&]() {
+		unsigned int Next = 0;
+
+		while (!Stop.load(std::memory_order_relaxed)) {
+			unsigned int Count = 0;
+			SE* Slot;
+
+			while ((Slot = Consumer.Peek()) != nullptr) {
+				if (Slot->Event != Next++) {
+					Fail("The %s ring gave event %u instead of %u", Name, Slot->Event, Next - 1);
+					Next = Slot->Event + 1;
+				}
+
+				Consumer.Advance();
+				Count++;
+			}
+
+			if (!Count) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			Consumer.Flush();
+			Got.LastAt.store(Now(), std::memory_order_relaxed);
+			Got.Received.fetch_add(Count, std::memory_order_release);
+		}
+	});
+
+	// One event at a time
+	for (unsigned int i = 0; i < Events; i++) {
+		unsigned long long Start = Now();
+		SE* Slot;
+
+		while ((Slot = Producer.Claim()) == nullptr)
+			std::this_thread::yield();
+
+		Slot->Event = (DWORD)Sent++;
+		Producer.Commit();
+
+		while (Got.Received.load(std::memory_order_acquire) < Sent)
+			std::this_thread::yield();
+
+		Latency.push_back(Clamp(Got.LastAt.load(std::memory_order_relaxed) - Start));
+	}
+
+	// Then as fast as the consumer lets it
+	unsigned long long Start = Now(), Full = 0;
+
+	for (unsigned int i = 0; i < HARNESS_BENCH_EVENTS; i++) {
+		SE* Slot;
+
+		while ((Slot = Producer.Claim()) == nullptr) {
+			Full++;
+			std::this_thread::yield();
+		}
+
+		Slot->Event = (DWORD)Sent++;
+		Producer.Commit();
+	}
+
+	while (Got.Received.load(std::memory_order_acquire) < Sent)
+		std::this_thread::yield();
+
+	unsigned long long Spent = Now() - Start;
+
+	Stop = true;
+	Drain.join();
+
+	Consumer.Detach();
+	Producer.Detach();
+	UnmapViewOfFile(Writer);
+	UnmapViewOfFile(Reader);
+	CloseHandle(Mapping);
+
+	std::sort(Latency.begin(), Latency.end());
+
+	printf("  %-16s %12.1f %12.2f %12llu %10u %10u\n", Name, (double)Spent / HARNESS_BENCH_EVENTS,
+		HARNESS_BENCH_EVENTS * 1000.0 / Spent, Full, Latency[Latency.size() / 2], Latency[(size_t)(0.99 * (Latency.size() - 1))]);
+}
+
+static void BenchRings(const Options* Opts) {
+	printf("  %-16s %12s %12s %12s %10s %10s\n", "Ring", "ns/event", "M events/s", "Full claims", "p50 ns", "p99 ns");
+
+	BenchRing<RingLamport>("RingLamport", Opts);
+	BenchRing<RingFastForward>("RingFastForward", Opts);
+	BenchRing<RingBQueue>("RingBQueue", Opts);
+	BenchRing<RingBroadcast>("RingBroadcast", Opts);
+}
+
+static void BenchDecoder(const Options* Opts) {
+	std::vector<DWORD> Events(MAX_DECODE_BATCH);
+	std::vector<BYTE> Out[2][4];
+
+	for (auto& Path : Out)
+		for (auto& Field : Path)
+			Field.resize(MAX_DECODE_BATCH);
+
+	printf("  %-16s %-8s %12s %12s\n", "Stream", "Path", "ns/event", "M events/s");
+
+	// Every event with its status byte, then three out of four leaning on the running status
+	for (unsigned int RunningEvery = 1; RunningEvery <= 4; RunningEvery += 3) {
+		srand(Opts->Seed);
+
+		for (unsigned int i = 0; i < MAX_DECODE_BATCH; i++) {
+			DWORD Event = MakeEvent(rand() % 16, rand());
+			Events[i] = (i % RunningEvery) ? (Event >> 8) : Event;
+		}
+
+		for (unsigned int Path = 0; Path < 2; Path++) {
+			WinDriver::EventDecoder Decoder;
+			unsigned long long Decoded = 0, Start = Now();
+
+			while (Decoded < HARNESS_BENCH_EVENTS) {
+				auto& Fields = Out[Path];
+
+				Decoder.ResetRunningStatus();
+				Decoded += Path ?
+					Decoder.DecodeNoSIMD(Events.data(), MAX_DECODE_BATCH, Fields[0].data(), Fields[1].data(), Fields[2].data(), Fields[3].data()) :
+					Decoder.Decode(Events.data(), MAX_DECODE_BATCH, Fields[0].data(), Fields[1].data(), Fields[2].data(), Fields[3].data());
+			}
+
+			unsigned long long Spent = Now() - Start;
+			printf("  %-16s %-8s %12.2f %12.1f\n", RunningEvery == 1 ? "Status bytes" : "Running status",
+				Path ? "Scalar" : "Decode()", (double)Spent / Decoded, Decoded * 1000.0 / Spent);
+		}
+
+		for (unsigned int Field = 0; Field < 4; Field++) {
+			if (Out[0][Field] != Out[1][Field])
+				Fail("Decode() and DecodeNoSIMD() don't agree on field %u", Field);
+		}
+	}
+}
+
+static void BenchTransform(const Options* Opts) {
+	const char* Names[] = { "Identity", "Sparse", "Dense" };
+	std::vector<DWORD> Source(XFORM_CHUNK * HARNESS_XFORM_CHUNKS), Events(XFORM_CHUNK);
+
+	// Notes on every channel, with a mod wheel or a volume CC every 16 events, like a sequencer playing back.
+	// More than one chunk, or the branch predictor learns it by heart and Apply() gets its branches for free
+	srand(Opts->Seed);
+
+	for (unsigned int i = 0; i < Source.size(); i++) {
+		BYTE Channel = rand() % 16;
+		DWORD CC = ((i / 16) & 1) ? 1 : 7;
+
+		Source[i] = (i % 16 == 15) ? (0xB0 | Channel | (CC << 8) | ((rand() & 0x7F) << 16)) : MakeEvent(Channel, rand());
+	}
+
+	printf("  %-10s %-12s %12s %12s %8s\n", "Rules", "Path", "ns/event", "M events/s", "Kept");
+
+	for (unsigned int Set = 0; Set < 3; Set++) {
+		WinDriver::EventTransform Transform;
+		TransformRules Rules;
+
+		WinDriver::EventTransform::GetIdentity(&Rules);
+		Rules.Enabled = 1;
+
+		// Sparse drops the mod wheel, which only a CC here and there has to go through the tables for
+		if (Set == 1)
+			Rules.CCMap[1] = XFORM_DROP;
+
+		// Dense touches every note, and a channel is muted
+		if (Set == 2) {
+			Rules.ChannelMask = 0x7FFF;
+			Rules.NoteLow = 12;
+			Rules.NoteHigh = 115;
+
+			for (int Ch = 0; Ch < 16; Ch++)
+				Rules.Transpose[Ch] = 12;
+
+			for (int i = 1; i < 128; i++)
+				Rules.VelocityCurve[i] = (BYTE)(64 + i / 2);
+		}
+
+		Transform.Compile(&Rules);
+
+		for (unsigned int Path = 0; Path < 2; Path++) {
+			unsigned long long Done = 0, Kept = 0, Start = Now();
+
+			// Both paths pay for the copy, ApplyBatch() works in place
+			while (Done < HARNESS_BENCH_EVENTS) {
+				BYTE RunningStatus = 0;
+
+				memcpy(Events.data(), &Source[(Done / XFORM_CHUNK) % HARNESS_XFORM_CHUNKS * XFORM_CHUNK], XFORM_CHUNK * sizeof(DWORD));
+
+				if (!Path)
+					Kept += Transform.ApplyBatch(Events.data(), XFORM_CHUNK, &RunningStatus);
+				else {
+					for (unsigned int i = 0; i < XFORM_CHUNK; i++)
+						Kept += Transform.Apply(&Events[i]) ? 1 : 0;
+				}
+
+				Done += XFORM_CHUNK;
+			}
+
+			unsigned long long Spent = Now() - Start;
+			printf("  %-10s %-12s %12.2f %12.1f %7.1f%%\n", Names[Set], Path ? "Apply()" : "ApplyBatch()",
+				(double)Spent / Done, Done * 1000.0 / Spent, Kept * 100.0 / Done);
+		}
+
+		// Both paths have to keep the same events, and change them the same way
+		std::vector<DWORD> Batch(Source), Single;
+		BYTE RunningStatus = 0;
+		unsigned int Packed = 0;
+
+		for (unsigned int i = 0; i < Batch.size(); i += XFORM_CHUNK) {
+			unsigned int Left = Transform.ApplyBatch(&Batch[i], XFORM_CHUNK, &RunningStatus);
+
+			memmove(&Batch[Packed], &Batch[i], Left * sizeof(DWORD));
+			Packed += Left;
+		}
+
+		Batch.resize(Packed);
+
+		for (DWORD Event : Source)
+			if (Transform.Apply(&Event)) Single.push_back(Event);
+
+		if (Batch != Single)
+			Fail("ApplyBatch() and Apply() don't agree with the %s rules", Names[Set]);
+	}
+}
+
+// Stands in for a render node, it reads what the producer sends until it hangs up
+static void StandInNode(WinDriver::NetPipe* Node, Arrivals* Target) {
+	NetEvent Events[HARNESS_HOST_BATCH];
+	unsigned int Count;
+
+	if (!Node->IsConnected() && !Node->Accept())
+		return;
+
+	while ((Count = Node->ParseEvents(Events, HARNESS_HOST_BATCH)) > 0) {
+		Target->LastAt.store(Now(), std::memory_order_relaxed);
+		Target->Received.fetch_add(Count, std::memory_order_release);
+	}
+}
+
+// A SysEx sent between two notes has to reach the node between them, SH_NF merges the two queues
+static void CheckForwardOrder(WinDriver::SynthPipe* App, WinDriver::NetPipe* Node) {
+	BYTE SysEx[16];
+	MIDIHDR Header;
+	NetEvent Events[4];
+	unsigned int Count = 0, Forwarded = 0;
+
+	MakeSysEx(SysEx, sizeof(SysEx), 0, 0);
+	memset(&Header, 0, sizeof(Header));
+	Header.lpData = (LPSTR)SysEx;
+	Header.dwBufferLength = sizeof(SysEx);
+
+	App->SaveShortEvent(MakeEvent(0, 0));
+
+	if (App->PrepareLongEvent(&Header) != MMSYSERR_NOERROR || App->SaveLongEvent(&Header) != MMSYSERR_NOERROR) {
+		Fail("Couldn't send the SysEx to the forwarded pipe");
+		return;
+	}
+
+	App->UnprepareLongEvent(&Header);
+	App->SaveShortEvent(MakeEvent(0, 1));
+	App->PublishShortEvents();
+
+	for (unsigned long long Deadline = Now() + HARNESS_LOOP_TIMEOUT * 1000000ull; Forwarded < 3 && Now() < Deadline;)
+		Forwarded += SH_NF(3 - Forwarded);
+
+	if (Forwarded < 3 || !Node->Accept()) {
+		Fail("SH_NF forwarded %u events out of 3", Forwarded);
+		return;
+	}
+
+	while (Count < 3 && Node->IsConnected())
+		Count += Node->ParseEvents(Events + Count, 3 - Count);
+
+	if (Count < 3 || Events[0].Length || Events[0].Event != MakeEvent(0, 0) ||
+		Events[1].Length != sizeof(SysEx) || !CheckSysEx(Events[1].Data, sizeof(SysEx), 0, 0) ||
+		Events[2].Length || Events[2].Event != MakeEvent(0, 1))
+		Fail("The node didn't get the SysEx between the two notes");
+}
+
+// The producer sends straight to the node, a burst is held back with More until its last event
+static void TimeSocket(const char* Address, unsigned int Events, std::vector<unsigned int>& Latency, std::vector<unsigned int>& Burst) {
+	WinDriver::NetPipe Node, Producer;
+	Arrivals Got;
+
+	if (!Node.Listen(Address)) {
+		Fail("The stand-in node couldn't listen on %s", Address);
+		return;
+	}
+
+	std::thread NodeThread(StandInNode, &Node, &Got);
+
+	if (Producer.Connect(Address)) {
+		auto SendToNode = [&Producer](unsigned int Index, DWORD Event, bool Last) {
+			return Producer.SaveShortEvent(Event, 0, !Last);
+		};
+
+		TimeDelivery(SendToNode, Address, &Got, Events, Latency, Burst);
+	}
+	else Fail("Couldn't connect to the stand-in node on %s", Address);
+
+	// The node stops once the producer hangs up
+	Producer.ClosePipe();
+	NodeThread.join();
+	Node.ClosePipe();
+}
+
+static void BenchNetPipe(const Options* Opts) {
+	unsigned int Events = Opts->LoopEvents ? Opts->LoopEvents : 10000;
+	std::vector<unsigned int> Latency, Burst;
+	char UnixAddress[64], TcpAddress[64], Name[64];
+
+	snprintf(UnixAddress, sizeof(UnixAddress), "unix:/tmp/ShakraBench%d.sock", (int)getpid());
+	snprintf(TcpAddress, sizeof(TcpAddress), "tcp:127.0.0.1:%d", 40000 + (int)(getpid() % 20000));
+	snprintf(Name, sizeof(Name), "  bursts of %u", HARNESS_BENCH_ROUND);
+
+	// The shared memory pipe, read by a host thread
+	{
+		WinDriver::SynthPipe Host, App;
+		std::atomic<bool> Stop{ false };
+		Arrivals Got;
+
+		if (!Host.PrepareFileMappings(L"BenchNetShm", true, Opts->RingSize) || !App.PrepareFileMappings(L"BenchNetShm", false, 0)) {
+			Fail("Couldn't open the shared memory pipe");
+			return;
+		}
+
+		std::thread Consumer(ArrivalHost, &Host, &Stop, &Got);
+
+		auto SendToPipe = [&App](unsigned int Index, DWORD Event, bool Last) { return App.SaveShortEvent(Event); };
+		TimeDelivery(SendToPipe, "the shared memory pipe", &Got, Events, Latency, Burst);
+
+		Stop = true;
+		Consumer.join();
+
+		App.ClosePipe();
+		Host.ClosePipe();
+
+		Report("Shared memory pipe", Latency);
+		Report(Name, Burst);
+	}
+
+	const char* Addresses[] = { UnixAddress, TcpAddress };
+
+	for (const char* Address : Addresses) {
+		Latency.clear();
+		Burst.clear();
+
+		TimeSocket(Address, Events, Latency, Burst);
+
+		Report(Address == UnixAddress ? "unix: socket" : "tcp: socket", Latency);
+		Report(Name, Burst);
+	}
+
+	// The whole way, an app on the driver's pipe, forwarded by SH_NF like ShakraHost would
+	{
+		WinDriver::NetPipe Node;
+		WinDriver::SynthPipe App;
+		std::atomic<bool> Stop{ false };
+		Arrivals Got;
+
+		Latency.clear();
+		Burst.clear();
+
+		if (!SH_CP(L"BenchNetForward", 0) || !App.PrepareFileMappings(L"BenchNetForward", false, 0) || !Node.Listen(UnixAddress)) {
+			Fail("Couldn't set up the pipe forwarded to the stand-in node");
+			return;
+		}
+
+		bool Connected = SH_NC(UnixAddress);
+
+		if (Connected)
+			CheckForwardOrder(&App, &Node);
+
+		std::thread NodeThread(StandInNode, &Node, &Got);
+
+		if (Connected) {
+			std::thread Forwarder([&Stop]() {
+				while (!Stop.load())
+					if (!SH_NF(HARNESS_HOST_BATCH)) std::this_thread::yield();
+			});
+
+			auto SendToPipe = [&App](unsigned int Index, DWORD Event, bool Last) { return App.SaveShortEvent(Event); };
+			TimeDelivery(SendToPipe, "the forwarded pipe", &Got, Events, Latency, Burst);
+
+			Stop = true;
+			Forwarder.join();
+		}
+		else Fail("SH_NC couldn't connect to the stand-in node");
+
+		SH_NX();
+		NodeThread.join();
+		Node.ClosePipe();
+		App.ClosePipe();
+
+		Report("Forwarded by SH_NF, unix:", Latency);
+		Report(Name, Burst);
+	}
+}
+
+static const Benchmark Benchmarks[] = {
+	{ "roundtrip", "One event at a time, through the host path and through the loopback cable", BenchRoundTrip },
+	{ "merger", "Cost of PipeMerger::Merge() per event, by number of pipes", BenchMerger },
+	{ "rings", "Every ring algorithm between two threads, whatever SE_RING_ALGO the build picked", BenchRings },
+	{ "decoder", "EventDecoder::Decode() against its scalar path, per event", BenchDecoder },
+	{ "transform", "EventTransform::ApplyBatch() against Apply() per event, with identity, sparse and dense rules", BenchTransform },
+	{ "netpipe", "One event at a time and in bursts, through the shared memory pipe against NetPipe's sockets", BenchNetPipe },
+	{ "executor", "Delivery through one PipeExecutor thread against a thread per pipe, by number of pipes", BenchExecutor },
+};
+
+static void RunBenchmarks(const Options* Opts) {
+	bool All = !strcmp(Opts->Bench, "all");
+	unsigned int Ran = 0;
+
+	for (const Benchmark& Bench : Benchmarks) {
+		const char* Found = strstr(Opts->Bench, Bench.Name);
+		size_t Length = strlen(Bench.Name);
+
+		// Whole names only
+		if (!All && (!Found || (Found != Opts->Bench && Found[-1] != ',') || (Found[Length] && Found[Length] != ',')))
+			continue;
+
+		printf("Benchmark %s: %s\n", Bench.Name, Bench.What);
+		Bench.Run(Opts);
+		Ran++;
+	}
+
+	if (!Ran)
+		Fail("No benchmark called %s", Opts->Bench);
+}
+
+static void Usage(const char* Name) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t Threads      App threads sending to the synth port, up to %u (4)\n"
+		"  -n Events       Events per thread and per cycle (100000)\n"
+		"  -x Every        One SysEx every this many events, 0 sends none (1000)\n"
+		"  -z Size         SysEx size in bytes (64)\n"
+		"  -c Cycles       MODM_OPEN and MODM_CLOSE cycles (3)\n"
+		"  -r Size         Short events ring size, 0 leaves it to the driver (0)\n"
+		"  -b Batch        Publish batching set by the host, 0 publishes every event (0)\n"
+		"  -d Delay        Publish delay in us, with -b (0)\n"
+		"  -l Events       Events sent through the loopback cable, 0 skips it (10000)\n"
+		"  -s Seed         Seed for the pipe names (0x5EED)\n"
+		"  -B Names        Runs these benchmarks instead, comma separated, or all\n"
+		"  -q              No message boxes from the driver on stderr\n",
+		Name, HARNESS_MAX_THREADS);
+
+	for (const Benchmark& Bench : Benchmarks)
+		fprintf(stderr, "    %-13s %s\n", Bench.Name, Bench.What);
+}
+
+int main(int argc, char** argv) {
+	Options Opts;
+	int Option;
+
+	while ((Option = getopt(argc, argv, "t:n:x:z:c:r:b:d:l:s:B:qh")) != -1) {
+		unsigned int Value = optarg ? (unsigned int)strtoul(optarg, nullptr, 0) : 0;
+
+		switch (Option) {
+		case 't': Opts.Threads = Value; break;
+		case 'n': Opts.Events = Value; break;
+		case 'x': Opts.SysExEvery = Value; break;
+		case 'z': Opts.SysExSize = Value; break;
+		case 'c': Opts.Cycles = Value; break;
+		case 'r': Opts.RingSize = Value; break;
+		case 'b': Opts.PublishBatch = Value; break;
+		case 'd': Opts.PublishDelay = Value; break;
+		case 'l': Opts.LoopEvents = Value; break;
+		case 's': Opts.Seed = Value; break;
+		case 'B': Opts.Bench = optarg; break;
+		case 'q': setenv("SHAKRA_SHIM_VERBOSE", "0", 1); break;
+		default: Usage(argv[0]); return 2;
+		}
+	}
+
+	if (!Opts.Threads || Opts.Threads > HARNESS_MAX_THREADS || Opts.SysExSize < 6 || Opts.SysExSize > MAX_LE_SIZE) {
+		Usage(argv[0]);
+		return 2;
+	}
+
+	printf("Clock overhead: %u ns per sample\n", ClockOverhead());
+
+	CheckEntryPoints();
+
+	if (Opts.Bench)
+		RunBenchmarks(&Opts);
+	else {
+		RunSynthPort(&Opts);
+
+		if (Opts.LoopEvents)
+			RunLoopback(&Opts);
+	}
+
+	ReleaseEntryPoints();
+
+	if (Failures) {
+		printf("%u checks failed\n", Failures.load());
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,3 @@
+#pragma once
+#include "LinuxShim.hpp"
+#include <x86intrin.h>
@@ -0,0 +1,16 @@
+#pragma once
+#include "LinuxShim.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET -1
+#define closesocket close
+typedef struct { int x; } WSADATA;
+inline int WSAStartup(WORD, WSADATA*) { return 0; }
+#ifndef MAKEWORD
+#define MAKEWORD(a,b) ((WORD)(((BYTE)(a))|(((WORD)((BYTE)(b)))<<8)))
+#endif
+inline BOOL DeleteFileA(const char* p) { return unlink(p) == 0; }
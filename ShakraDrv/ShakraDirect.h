@@ -0,0 +1,68 @@
+/*
+Shakra Driver direct producer API
+This .h file can be included by any C or C++ app that wants to send its events straight to Shakra.
+
+Link against the import library of shakra.dll, or load it with LoadLibrary and GetProcAddress.
+On Linux, link against libshakra.so, see Linux/Makefile.
+*/
+
+#pragma once
+
+#ifndef SHAKRADIRECT_H
+
+#define SHAKRADIRECT_H
+
+#include <windows.h>
+
+/*
+
+	Sending an event through midiOutShortMsg goes through WinMM's handle
+	validation and the driver's modMessage switch before it gets to the pipe.
+	These functions write the events straight into the pipe instead, like
+	KDMAPI's SendDirectData does for OmniMIDI.
+
+	The direct API gets its own pipe, so it can be used next to a WinMM handle
+	opened by the same app, but the two streams are not ordered between them.
+
+	ShakraInitialize() and ShakraTerminate() are reference counted.
+	The send functions can be called from one thread at a time, like midiOutShortMsg.
+	ShakraTerminate() can be called while a send is in progress on another thread,
+	it waits for the send to return, and the sends after it fail.
+
+	ShakraSendDirect: One short event, same format as midiOutShortMsg, returns false if it got dropped
+	ShakraSendDirectBatch: Count short events, published to the host all at once, returns how many got queued
+	ShakraSendDirectLong: A SysEx message, F0 and F7 included, copied before returning, returns an MMSYSERR_* code
+	ShakraSendDirectUMP: One Universal MIDI Packet, only works if the host created a UMP pipe
+
+	The bools are one byte wide, C callers should treat them as unsigned char.
+
+*/
+
+// The driver defines it empty before including this, so that its definitions get the same linkage
+#ifndef SHAKRA_API
+#ifdef __linux__
+#define SHAKRA_API
+#else
+#define SHAKRA_API __declspec(dllimport)
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#define SHAKRA_BOOL bool
+#else
+#define SHAKRA_BOOL unsigned char
+#endif
+
+SHAKRA_API SHAKRA_BOOL WINAPI ShakraInitialize(void);
+SHAKRA_API SHAKRA_BOOL WINAPI ShakraTerminate(void);
+SHAKRA_API SHAKRA_BOOL WINAPI ShakraSendDirect(DWORD Event);
+SHAKRA_API unsigned int WINAPI ShakraSendDirectBatch(const DWORD* Events, unsigned int Count);
+SHAKRA_API unsigned int WINAPI ShakraSendDirectLong(const BYTE* Data, DWORD Length);
+SHAKRA_API SHAKRA_BOOL WINAPI ShakraSendDirectUMP(const DWORD* Words);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
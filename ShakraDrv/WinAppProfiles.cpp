@@ -0,0 +1,165 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinAppProfiles.hpp"
+
+DWORD WinDriver::AppProfiles::HashKey(const std::wstring& Key) {
+	// FNV-1a, 0 is kept for the empty entries
+	DWORD Hash = 2166136261u;
+
+	for (wchar_t Char : Key) {
+		Hash ^= (DWORD)Char;
+		Hash *= 16777619u;
+	}
+
+	return Hash ? Hash : 1;
+}
+
+std::wstring WinDriver::AppProfiles::Normalize(const wchar_t* Key) {
+	std::wstring Ret(Key);
+
+	// Windows doesn't care about the case, neither do the profiles
+	for (wchar_t& Char : Ret) {
+		Char = towlower(Char);
+
+		if (Char == L'/')
+			Char = L'\\';
+	}
+
+	return Ret;
+}
+
+DWORD WinDriver::AppProfiles::ReadValue(HKEY Key, const wchar_t* Name, DWORD Default) {
+	DWORD Value = 0, Size = sizeof(DWORD), Type = 0;
+
+	if (RegQueryValueExW(Key, Name, NULL, &Type, (LPBYTE)&Value, &Size) != ERROR_SUCCESS || Type != REG_DWORD)
+		return Default;
+
+	return Value;
+}
+
+void WinDriver::AppProfiles::Insert(const std::wstring& Key, const AppProfile* Profile) {
+	DWORD Hash = HashKey(Key);
+	size_t Mask = Table.size() - 1;
+
+	for (size_t i = Hash & Mask; ; i = (i + 1) & Mask) {
+		ProfileEntry& Entry = Table[i];
+
+		// Two subkeys for the same app, the last one wins
+		if (!Entry.Hash || (Entry.Hash == Hash && Entry.Key == Key)) {
+			Entry.Hash = Hash;
+			Entry.Key = Key;
+			Entry.Profile = *Profile;
+			return;
+		}
+	}
+}
+
+const AppProfile* WinDriver::AppProfiles::Find(const std::wstring& Key) {
+	if (Table.empty())
+		return nullptr;
+
+	DWORD Hash = HashKey(Key);
+	size_t Mask = Table.size() - 1;
+
+	// The table is never full, so there's always an empty entry to stop at
+	for (size_t i = Hash & Mask; Table[i].Hash; i = (i + 1) & Mask) {
+		if (Table[i].Hash == Hash && Table[i].Key == Key)
+			return &Table[i].Profile;
+	}
+
+	return nullptr;
+}
+
+void WinDriver::AppProfiles::Load() {
+	std::vector<std::pair<std::wstring, AppProfile>> Found;
+	wchar_t SubKey[256], Path[MAX_PATH];
+	HKEY Root, Key;
+	size_t Size = PROFILE_MIN_TABLE;
+
+	Loaded = true;
+
+	// No profiles, every app gets the host's settings
+	if (RegOpenKeyExW(HKEY_CURRENT_USER, PROFILE_ROOT, 0, KEY_READ, &Root) != ERROR_SUCCESS)
+		return;
+
+	for (DWORD i = 0; ; i++) {
+		DWORD SubKeySize = _countof(SubKey), PathSize = sizeof(Path) - sizeof(wchar_t), Type = 0;
+		AppProfile Profile = APP_PROFILE_DEFAULT;
+
+		if (RegEnumKeyExW(Root, i, SubKey, &SubKeySize, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
+			break;
+
+		if (RegOpenKeyExW(Root, SubKey, 0, KEY_READ, &Key) != ERROR_SUCCESS)
+			continue;
+
+		ZeroMemory(Path, sizeof(Path));
+
+		if (RegQueryValueExW(Key, L"Path", NULL, &Type, (LPBYTE)Path, &PathSize) != ERROR_SUCCESS || Type != REG_SZ || !Path[0]) {
+			LOG(ProfileErr, L"A profile has no Path value, skipping it.");
+			RegCloseKey(Key);
+			continue;
+		}
+
+		if (ReadValue(Key, L"Block", 0)) Profile.Flags |= PROFILE_BLOCK;
+		if (ReadValue(Key, L"NoPriority", 0)) Profile.Flags |= PROFILE_NO_PRIORITY;
+		Profile.MaxPending = ReadValue(Key, L"MaxPending", 0);
+		Profile.BackPressure = ReadValue(Key, L"BackPressure", PROFILE_DEFAULT);
+		Profile.PublishBatch = ReadValue(Key, L"PublishBatch", PROFILE_DEFAULT);
+		Profile.PublishDelay = ReadValue(Key, L"PublishDelay", PROFILE_DEFAULT);
+		Profile.ShedAbove = ReadValue(Key, L"ShedAbove", 0);
+
+		Found.push_back({ Normalize(Path), Profile });
+		RegCloseKey(Key);
+	}
+
+	RegCloseKey(Root);
+
+	// At most half full, so the probes stay short
+	while (Size < Found.size() * 2)
+		Size <<= 1;
+
+	Table.resize(Size);
+
+	for (auto& Entry : Found)
+		Insert(Entry.first, &Entry.second);
+}
+
+void WinDriver::AppProfiles::Resolve(PAppProfile Target) {
+	static const AppProfile Default = APP_PROFILE_DEFAULT;
+	wchar_t Image[MAX_PATH] = { 0 };
+	const AppProfile* Profile = nullptr;
+
+	*Target = Default;
+
+	if (!GetModuleFileNameW(NULL, Image, MAX_PATH)) {
+		NERROR(ProfileErr, nullptr, false);
+		return;
+	}
+
+	// Opening the driver is rare enough for the lock, the hot path only sees the copy
+	AcquireSRWLockExclusive(&TableLock);
+
+	if (!Loaded)
+		Load();
+
+	std::wstring Path = Normalize(Image);
+	size_t Slash = Path.find_last_of(L'\\');
+
+	// The full path is more specific than the image name
+	if (!(Profile = Find(Path)) && Slash != std::wstring::npos)
+		Profile = Find(Path.substr(Slash + 1));
+
+	if (Profile)
+		*Target = *Profile;
+
+	ReleaseSRWLockExclusive(&TableLock);
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINAPPPROFILES_H
+
+#define WINAPPPROFILES_H
+
+#include "WinError.hpp"
+#include <windows.h>
+#include <cwctype>
+#include <string>
+#include <vector>
+
+/*
+
+	Per-app profiles, so that a player and a DAW on the same machine can get
+	opposite trade-offs between latency and throughput.
+
+	The profiles live in HKCU\Software\Shakra\Profiles, one subkey per app,
+	the name of the subkey doesn't matter:
+	Path = REG_SZ, the image name (player.exe) or the full path of the executable,
+	       the full path wins if both match
+	Block = Non-zero refuses to open the driver for the app
+	NoPriority = Non-zero sends everything through the normal lane, in the exact order it was sent
+	MaxPending = Events the app can have queued, overrides the host's
+	BackPressure = What to do when the ring is full, one of the BACKPRESSURE_* values
+	PublishBatch, PublishDelay = Same as the control page, see the publish batching notes in WinSynthPipe.hpp
+	ShedAbove = Once this many events are queued, the app's new notes get dropped,
+	            the note offs and the controllers still go through, so nothing gets stuck
+
+	A missing value leaves the setting to the host.
+
+	The registry is read the first time an app opens the driver, and compiled
+	into an open addressing table keyed by the lowercase name. From then on,
+	MODM_OPEN only does two lookups, and the result is copied into the pipe,
+	so SaveShortEvent() reads plain fields and never goes near the table.
+	Changes to the registry apply to the apps started after them.
+
+	The ring size itself is picked by the host when it creates the pipe, so
+	the per-app "size" is MaxPending, how much of the ring the app can fill.
+
+*/
+
+#define PROFILE_DEFAULT			0xFFFFFFFF		// Leaves the setting to the host
+#define PROFILE_BLOCK			0x1
+#define PROFILE_NO_PRIORITY		0x2
+
+#define PROFILE_ROOT			L"Software\\Shakra\\Profiles"
+#define PROFILE_MIN_TABLE		16
+
+typedef struct {
+	DWORD Flags;
+	DWORD MaxPending;		// 0 leaves it to the host
+	DWORD BackPressure;
+	DWORD PublishBatch;
+	DWORD PublishDelay;
+	DWORD ShedAbove;		// 0 never sheds
+} AppProfile, *PAppProfile;
+
+#define APP_PROFILE_DEFAULT		{ 0, 0, PROFILE_DEFAULT, PROFILE_DEFAULT, PROFILE_DEFAULT, 0 }
+
+namespace WinDriver {
+	class AppProfiles {
+	private:
+		typedef struct {
+			DWORD Hash;			// 0 marks an empty entry
+			std::wstring Key;
+			AppProfile Profile;
+		} ProfileEntry;
+
+		ErrorSystem::WinErr ProfileErr;
+
+		SRWLOCK TableLock = SRWLOCK_INIT;
+		std::vector<ProfileEntry> Table;
+		bool Loaded = false;
+
+		static DWORD HashKey(const std::wstring& Key);
+		static std::wstring Normalize(const wchar_t* Key);
+		static DWORD ReadValue(HKEY Key, const wchar_t* Name, DWORD Default);
+		void Insert(const std::wstring& Key, const AppProfile* Profile);
+		const AppProfile* Find(const std::wstring& Key);
+		void Load();
+
+	public:
+		// The profile of the current process, or the default one
+		void Resolve(PAppProfile Target);
+	};
+}
+
+#endif
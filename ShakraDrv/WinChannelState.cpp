@@ -0,0 +1,314 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinChannelState.hpp"
+
+// Bend range (2 semitones), fine tuning (center), coarse tuning (center), tuning program, tuning bank, modulation depth (50 cents)
+static const WORD DefaultRPN[CHS_RPNS] = { 0x0100, 0x2000, 0x2000, 0x0000, 0x0000, 0x0040 };
+
+bool WinDriver::ChannelShadow::OpenShadow(const wchar_t* Name, bool Create) {
+	if (Page) {
+		LOG(ShadowErr, L"The channel state shadow is already open.");
+		return true;
+	}
+
+	PPage =
+		Create ?
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(ChsPage), Name) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, Name);
+
+	if (!PPage) {
+		NERROR(ShadowErr, nullptr, false);
+		return false;
+	}
+
+	// A host that restarts gets the shadow the apps kept alive, which is the whole point of it
+	bool Existed = (GetLastError() == ERROR_ALREADY_EXISTS);
+
+	if (Create)
+		SetSecurityInfo(PPage, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	Page = (PChsPage)MapViewOfFile(PPage, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!Page) {
+		NERROR(ShadowErr, nullptr, false);
+		CloseHandle(PPage);
+		PPage = nullptr;
+		return false;
+	}
+
+	// Nothing got played yet, so every channel is at its defaults
+	if (Create && !Existed) {
+		LONG Locked = LockPage();
+		for (int i = 0; i < CHS_CHANNELS; i++)
+			ResetChannel(&Page->State.Channels[i]);
+		UnlockPage(Locked);
+	}
+
+	return true;
+}
+
+bool WinDriver::ChannelShadow::CloseShadow() {
+	if (Page) {
+		UnmapViewOfFile(Page);
+		Page = nullptr;
+	}
+
+	if (PPage) {
+		CloseHandle(PPage);
+		PPage = nullptr;
+	}
+
+	return true;
+}
+
+LONG WinDriver::ChannelShadow::LockPage() {
+	// Wait for the other writer to be done, then take the odd value
+	return SeqLock::Lock(&Page->Seq);
+}
+
+void WinDriver::ChannelShadow::UnlockPage(LONG Locked) {
+	if (!SeqLock::Unlock(&Page->Seq, Locked))
+		LOG(ShadowErr, L"The channel shadow got taken over by another writer while this one was stalled.");
+}
+
+BYTE WinDriver::ChannelShadow::GetDefaultCC(BYTE CC) {
+	switch (CC) {
+	case 7:
+		return 100;
+
+	case 8:
+	case 10:
+		return 64;
+
+	case 11:
+		return 127;
+
+	// The RPN and NRPN numbers start out null
+	case 98:
+	case 99:
+	case 100:
+	case 101:
+		return 127;
+	}
+
+	// Sound controllers, 64 means no change
+	if (CC >= 71 && CC <= 79)
+		return 64;
+
+	return 0;
+}
+
+void WinDriver::ChannelShadow::ResetChannel(PChsChannel Channel) {
+	memset(Channel, 0, sizeof(ChsChannel));
+
+	for (int i = 0; i < 128; i++)
+		Channel->CC[i] = GetDefaultCC((BYTE)i);
+
+	memcpy(Channel->RPN, DefaultRPN, sizeof(DefaultRPN));
+	Channel->PitchBend = 0x2000;
+	Channel->Param = CHS_PARAM_NONE;
+}
+
+void WinDriver::ChannelShadow::ResetControllers(PChsChannel Channel) {
+	// RP-015, program, volume, pan and the parameters stay as they are
+	Channel->Pressure = 0;
+	Channel->PitchBend = 0x2000;
+	Channel->CC[1] = 0;
+	Channel->CC[11] = 127;
+
+	for (int i = 64; i <= 67; i++)
+		Channel->CC[i] = 0;
+
+	for (int i = 98; i <= 101; i++)
+		Channel->CC[i] = 127;
+
+	Channel->Param = CHS_PARAM_NONE;
+}
+
+void WinDriver::ChannelShadow::ApplyCC(PChsChannel Channel, BYTE CC, BYTE Value) {
+	if (CC == 121) {
+		ResetControllers(Channel);
+		return;
+	}
+
+	// Increments and the channel mode messages act once, there's no value to keep
+	if (CC == 96 || CC == 97 || CC >= 120)
+		return;
+
+	Channel->CC[CC] = Value;
+
+	switch (CC) {
+	case 6:
+	case 38:
+		// Only the registered parameters mean the same thing on every synth
+		if (Channel->Param == CHS_PARAM_RPN && !Channel->CC[101] && Channel->CC[100] < CHS_RPNS) {
+			WORD* Target = &Channel->RPN[Channel->CC[100]];
+			*Target = (CC == 6) ? (WORD)((Value << 7) | (*Target & 0x7F)) : (WORD)((*Target & 0x3F80) | Value);
+		}
+		break;
+
+	case 98:
+	case 99:
+		Channel->Param = (Channel->CC[99] == 127 && Channel->CC[98] == 127) ? CHS_PARAM_NONE : CHS_PARAM_NRPN;
+		break;
+
+	case 100:
+	case 101:
+		Channel->Param = (Channel->CC[101] == 127 && Channel->CC[100] == 127) ? CHS_PARAM_NONE : CHS_PARAM_RPN;
+		break;
+	}
+}
+
+void WinDriver::ChannelShadow::Update(DWORD Event) {
+	BYTE Status = Event & 0xFF;
+	BYTE Data1 = (Event >> 8) & 0x7F;
+	BYTE Data2 = (Event >> 16) & 0x7F;
+
+	if (!Page)
+		return;
+
+	if (Status == 0xFF) {
+		Reset();
+		return;
+	}
+
+	// Notes, poly pressure and the system messages don't change the channel
+	if (Status < 0xB0 || Status >= 0xF0)
+		return;
+
+	PChsChannel Channel = &Page->State.Channels[Status & 0x0F];
+
+	// Same value as before, no need to make the readers retry
+	switch (Status & 0xF0) {
+	case 0xB0:
+		if (Channel->CC[Data1] == Data2 && Data1 != 6 && Data1 != 38 && (Data1 < 96 || Data1 > 101) && Data1 < 120)
+			return;
+		break;
+
+	case 0xC0:
+		if (Channel->Program == Data1)
+			return;
+		break;
+
+	case 0xD0:
+		if (Channel->Pressure == Data1)
+			return;
+		break;
+
+	case 0xE0:
+		if (Channel->PitchBend == (Data1 | (Data2 << 7)))
+			return;
+		break;
+	}
+
+	LONG Locked = LockPage();
+
+	switch (Status & 0xF0) {
+	case 0xB0:
+		ApplyCC(Channel, Data1, Data2);
+		break;
+
+	case 0xC0:
+		Channel->Program = Data1;
+		break;
+
+	case 0xD0:
+		Channel->Pressure = Data1;
+		break;
+
+	case 0xE0:
+		Channel->PitchBend = Data1 | (Data2 << 7);
+		break;
+	}
+
+	UnlockPage(Locked);
+}
+
+void WinDriver::ChannelShadow::Reset() {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+
+	for (int i = 0; i < CHS_CHANNELS; i++)
+		ResetChannel(&Page->State.Channels[i]);
+
+	Page->State.Resets++;
+	UnlockPage(Locked);
+}
+
+bool WinDriver::ChannelShadow::ReadSnapshot(PChsState Target) {
+	if (!Page)
+		return false;
+
+	return SeqLock::Read(&Page->Seq, &Page->State, Target);
+}
+
+unsigned int WinDriver::ChannelShadow::BuildSyncEvents(const ChsState* Source, DWORD* Events, unsigned int Max) {
+	unsigned int Count = 0;
+
+	auto Push = [&](DWORD Event) {
+		if (Count < Max)
+			Events[Count++] = Event;
+	};
+
+	for (DWORD Ch = 0; Ch < CHS_CHANNELS; Ch++) {
+		const ChsChannel* Channel = &Source->Channels[Ch];
+		DWORD CC = 0xB0 | Ch;
+		bool SentRPN = false;
+
+		// The bank only takes effect with the next program change
+		if (Channel->CC[0] || Channel->CC[32] || Channel->Program) {
+			Push(CC | (0 << 8) | (Channel->CC[0] << 16));
+			Push(CC | (32 << 8) | (Channel->CC[32] << 16));
+			Push((0xC0 | Ch) | (Channel->Program << 8));
+		}
+
+		for (DWORD i = 1; i < 120; i++) {
+			// Sent below, or they'd change the parameters on their own
+			if (i == 32 || i == 6 || i == 38 || (i >= 96 && i <= 101))
+				continue;
+
+			if (Channel->CC[i] != GetDefaultCC((BYTE)i))
+				Push(CC | (i << 8) | (Channel->CC[i] << 16));
+		}
+
+		for (DWORD i = 0; i < CHS_RPNS; i++) {
+			if (Channel->RPN[i] == DefaultRPN[i])
+				continue;
+
+			Push(CC | (101 << 8));
+			Push(CC | (100 << 8) | (i << 16));
+			Push(CC | (6 << 8) | ((Channel->RPN[i] >> 7) << 16));
+			Push(CC | (38 << 8) | ((Channel->RPN[i] & 0x7F) << 16));
+			SentRPN = true;
+		}
+
+		// Leave data entry pointing where the app left it
+		if (Channel->Param == CHS_PARAM_NRPN) {
+			Push(CC | (99 << 8) | (Channel->CC[99] << 16));
+			Push(CC | (98 << 8) | (Channel->CC[98] << 16));
+		}
+		else if (Channel->Param == CHS_PARAM_RPN || SentRPN) {
+			Push(CC | (101 << 8) | (Channel->CC[101] << 16));
+			Push(CC | (100 << 8) | (Channel->CC[100] << 16));
+		}
+
+		if (Channel->Pressure)
+			Push((0xD0 | Ch) | (Channel->Pressure << 8));
+
+		if (Channel->PitchBend != 0x2000)
+			Push((0xE0 | Ch) | ((Channel->PitchBend & 0x7F) << 8) | ((Channel->PitchBend >> 7) << 16));
+	}
+
+	return Count;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINCHANNELSTATE_H
+
+#define WINCHANNELSTATE_H
+
+#include "WinError.hpp"
+#include "WinSeqLock.hpp"
+#include <windows.h>
+#include <AclAPI.h>
+
+/*
+
+	The channel state shadow keeps track of what every channel is set to, so
+	that a host attaching in the middle of a song can catch up with one read,
+	instead of playing the wrong instruments until the song resets.
+
+	The apps update it in SaveShortEvent(), before the event gets published,
+	so whatever a host reads from the ring after taking a snapshot is either
+	in the snapshot already or newer than it. Playing those events again is
+	harmless, they only set the same values again.
+
+	Same sequence lock as the control page, see WinSeqLock.hpp. Every app with
+	the pipe open is a writer, and any of them can get killed while it holds the
+	lock, so nobody waits on it for more than SEQLOCK_TIMEOUT ms.
+	Notes don't change the state, so they never get here, and the events that
+	set a value the channel already has skip the lock.
+
+	Per channel:
+	Program = Last program change
+	Pressure = Last channel pressure
+	PitchBend = 14-bit, 0x2000 is the center
+	CC = Last value of every control change, bank select and the RPN/NRPN numbers included
+	RPN = 14-bit values of the first CHS_RPNS registered parameters, set through data entry
+	Param = Where data entry goes to, one of the CHS_PARAM_* values
+
+	Reset All Controllers resets what RP-015 says it resets.
+	System Reset and the reset SysEx messages bring everything back to the defaults.
+
+*/
+
+#define CHS_CHANNELS			16
+#define CHS_RPNS				6		// Bend range, fine and coarse tuning, tuning program and bank, modulation depth
+#define CHS_MAX_SYNC_EVENTS		4096	// Worst case of BuildSyncEvents(), with every channel off its defaults
+
+#define CHS_PARAM_NONE			0
+#define CHS_PARAM_RPN			1
+#define CHS_PARAM_NRPN			2
+
+typedef struct {
+	BYTE CC[128];
+	WORD RPN[CHS_RPNS];
+	WORD PitchBend;
+	BYTE Program;
+	BYTE Pressure;
+	BYTE Param;
+	BYTE Reserved;
+} ChannelShadowState, ChsChannel, *PChsChannel;
+
+typedef struct {
+	DWORD Resets;		// Bumped every time all the channels go back to the defaults
+	ChsChannel Channels[CHS_CHANNELS];
+} ChannelShadowSnapshot, ChsState, *PChsState;
+
+typedef struct {
+	volatile LONG Seq;
+	ChsState State;
+} ChannelShadowPage, ChsPage, *PChsPage;
+
+namespace WinDriver {
+	class ChannelShadow {
+	private:
+		ErrorSystem::WinErr ShadowErr;
+
+		HANDLE PPage = nullptr;
+		PChsPage Page = nullptr;
+
+		LONG LockPage();
+		void UnlockPage(LONG Locked);
+
+		static BYTE GetDefaultCC(BYTE CC);
+		static void ResetChannel(PChsChannel Channel);
+		static void ResetControllers(PChsChannel Channel);
+		static void ApplyCC(PChsChannel Channel, BYTE CC, BYTE Value);
+
+	public:
+		bool OpenShadow(const wchar_t* Name, bool Create);
+		bool CloseShadow();
+		bool IsOpen() { return Page != nullptr; }
+
+		// Producer side, Event needs its status byte
+		void Update(DWORD Event);
+		void Reset();
+
+		// Returns a consistent copy of all the channels, false if the shadow is not open,
+		// or if a writer held it for too long
+		bool ReadSnapshot(PChsState Target);
+
+		// The events that bring a synth fresh out of a reset to the state in Source,
+		// returns how many got written, up to Max
+		static unsigned int BuildSyncEvents(const ChsState* Source, DWORD* Events, unsigned int Max);
+	};
+}
+
+#endif
@@ -0,0 +1,294 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinControl.hpp"
+
+bool WinDriver::ControlPage::OpenControl(const wchar_t* Name, bool Create) {
+	if (Page) {
+		LOG(ControlErr, L"The control page is already open.");
+		return true;
+	}
+
+	PPage =
+		Create ?
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(CtlPage), Name) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, Name);
+
+	if (!PPage) {
+		NERROR(ControlErr, nullptr, false);
+		return false;
+	}
+
+	if (Create)
+		SetSecurityInfo(PPage, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	Page = (PCtlPage)MapViewOfFile(PPage, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!Page) {
+		NERROR(ControlErr, nullptr, false);
+		CloseHandle(PPage);
+		PPage = nullptr;
+		return false;
+	}
+
+	// Full volume until someone says otherwise, and no CC gets priority, see WinSynthPipe.hpp
+	if (Create) {
+		LONG Locked = LockPage();
+		Page->State.Volume = 0xFFFFFFFF;
+		EventTransform::GetIdentity(&Page->State.Transform);
+		UnlockPage(Locked);
+	}
+
+	return true;
+}
+
+bool WinDriver::ControlPage::CloseControl() {
+	if (Page) {
+		UnmapViewOfFile(Page);
+		Page = nullptr;
+	}
+
+	if (PPage) {
+		CloseHandle(PPage);
+		PPage = nullptr;
+	}
+
+	return true;
+}
+
+LONG WinDriver::ControlPage::LockPage() {
+	// Wait for the other writer to be done, then take the odd value
+	return SeqLock::Lock(&Page->Seq);
+}
+
+void WinDriver::ControlPage::UnlockPage(LONG Locked) {
+	if (!SeqLock::Unlock(&Page->Seq, Locked))
+		LOG(ControlErr, L"The control page got taken over by another writer while this one was stalled.");
+}
+
+bool WinDriver::ControlPage::ReadState(PCtlState Target) {
+	if (!Page)
+		return false;
+
+	return SeqLock::Read(&Page->Seq, &Page->State, Target);
+}
+
+void WinDriver::ControlPage::SetVolume(DWORD Volume) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.Volume = Volume;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetMute(bool Mute) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.Mute = Mute ? 1 : 0;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::RequestReset() {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.ResetRequests++;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetHostStatus(DWORD Status) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.HostStatus = Status;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetBackPressure(DWORD Mode, DWORD MaxPending) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.BackPressure = Mode;
+	Page->State.MaxPending = MaxPending;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetPriorityCCs(const DWORD* Mask) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	memcpy(Page->State.PriorityCCs, Mask, sizeof(Page->State.PriorityCCs));
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetPublishBatching(DWORD Batch, DWORD Delay) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.PublishBatch = Batch;
+	Page->State.PublishDelay = Delay;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetUMPProtocol(DWORD Protocol) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	Page->State.UMPProtocol = Protocol;
+	UnlockPage(Locked);
+}
+
+void WinDriver::ControlPage::SetTransform(const TransformRules* Rules) {
+	if (!Page)
+		return;
+
+	LONG Locked = LockPage();
+	memcpy(&Page->State.Transform, Rules, sizeof(TransformRules));
+	UnlockPage(Locked);
+}
+
+bool WinDriver::ControlPage::HasChanged(LONG* LastSeq) {
+	if (!Page)
+		return false;
+
+	LONG Seq = Page->Seq;
+
+	// Someone's writing to it, check again later
+	if ((Seq & 1) || Seq == *LastSeq)
+		return false;
+
+	*LastSeq = Seq;
+	return true;
+}
+
+LONG64 WinDriver::ControlPage::GetTicks() {
+	LARGE_INTEGER Now;
+
+	QueryPerformanceCounter(&Now);
+	return Now.QuadPart;
+}
+
+LONG64 WinDriver::ControlPage::TicksToUs(LONG64 Ticks) {
+	static LONG64 Frequency = 0;
+
+	if (!Frequency) {
+		LARGE_INTEGER Freq;
+		QueryPerformanceFrequency(&Freq);
+		Frequency = Freq.QuadPart;
+	}
+
+	return (Ticks / Frequency) * 1000000 + (Ticks % Frequency) * 1000000 / Frequency;
+}
+
+void WinDriver::ControlPage::ClaimOwner(LONG Cursor, LONG PriorityCursor) {
+	if (!Page)
+		return;
+
+	Page->Host.OwnerCursor = Cursor;
+	Page->Host.OwnerPriorityCursor = PriorityCursor;
+	InterlockedExchange64(&Page->Host.Heartbeat, GetTicks());
+	InterlockedExchange(&Page->Host.OwnerPID, (LONG)GetCurrentProcessId());
+}
+
+bool WinDriver::ControlPage::Beat() {
+	if (!Page)
+		return false;
+
+	// A standby took over, the ring isn't ours anymore
+	if (Page->Host.OwnerPID != (LONG)GetCurrentProcessId())
+		return false;
+
+	InterlockedExchange64(&Page->Host.Heartbeat, GetTicks());
+	return true;
+}
+
+bool WinDriver::ControlPage::RegisterStandby() {
+	if (!Page)
+		return false;
+
+	// Only one standby at a time, otherwise they'd race for the same cursor
+	return InterlockedCompareExchange(&Page->Host.StandbyPID, (LONG)GetCurrentProcessId(), 0) == 0;
+}
+
+bool WinDriver::ControlPage::IsOwnerAlive() {
+	if (!Page || !Page->Host.OwnerPID)
+		return false;
+
+	return TicksToUs(GetTicks() - Page->Host.Heartbeat) < HOST_HEARTBEAT_TIMEOUT * 1000;
+}
+
+LONG WinDriver::ControlPage::GetOwnerPID() {
+	return Page ? Page->Host.OwnerPID : 0;
+}
+
+bool WinDriver::ControlPage::TakeOver(LONG DeadPID, LONG* Cursor, LONG* PriorityCursor) {
+	LONG64 LastBeat;
+
+	if (!Page)
+		return false;
+
+	LastBeat = Page->Host.Heartbeat;
+
+	// Whoever swaps the PID first owns the ring
+	if (InterlockedCompareExchange(&Page->Host.OwnerPID, (LONG)GetCurrentProcessId(), DeadPID) != DeadPID)
+		return false;
+
+	*Cursor = Page->Host.OwnerCursor;
+	*PriorityCursor = Page->Host.OwnerPriorityCursor;
+
+	InterlockedExchange64(&Page->Host.HandoverTime, TicksToUs(GetTicks() - LastBeat));
+	InterlockedExchange64(&Page->Host.Heartbeat, GetTicks());
+	InterlockedIncrement(&Page->Host.Takeovers);
+	InterlockedCompareExchange(&Page->Host.StandbyPID, 0, (LONG)GetCurrentProcessId());
+
+	SetHostStatus(HOST_STATUS_RUNNING);
+	return true;
+}
+
+bool WinDriver::ControlPage::ReadLiveness(PHostLiveness Target) {
+	if (!Page)
+		return false;
+
+	Target->OwnerPID = Page->Host.OwnerPID;
+	Target->StandbyPID = Page->Host.StandbyPID;
+	Target->OwnerCursor = Page->Host.OwnerCursor;
+	Target->OwnerPriorityCursor = Page->Host.OwnerPriorityCursor;
+	Target->Takeovers = Page->Host.Takeovers;
+	Target->Heartbeat = Page->Host.Heartbeat;
+	Target->HandoverTime = Page->Host.HandoverTime;
+
+	return true;
+}
+
+void WinDriver::ControlPage::ArmDoorbell() {
+	if (!Page)
+		return;
+
+	// Interlocked, so that the flag is visible before the consumer looks at the ring again
+	InterlockedExchange(&Page->Waiting, 1);
+}
+
+bool WinDriver::ControlPage::TakeWaiter() {
+	if (!Page)
+		return false;
+
+	// No exchange while nobody's sleeping, the line stays shared with the consumer
+	return Page->Waiting && InterlockedExchange(&Page->Waiting, 0);
+}
+
+#endif
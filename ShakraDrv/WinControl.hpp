@@ -0,0 +1,167 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINCONTROL_H
+
+#define WINCONTROL_H
+
+#include "WinError.hpp"
+#include "WinSeqLock.hpp"
+#include "WinVars.hpp"
+#include "WinTransform.hpp"
+#include <windows.h>
+#include <AclAPI.h>
+
+/*
+
+	The control page carries the state that doesn't belong in the event
+	buffers, so that it never has to wait behind a full backlog of events.
+
+	It's protected by a sequence lock, see WinSeqLock.hpp. Both the driver and
+	the host write to it, and an app can get killed while it holds the lock, so
+	nobody waits on it for more than SEQLOCK_TIMEOUT ms.
+
+	Volume = Same format as MODM_SETVOLUME, low word is left, high word is right
+	Mute = Non-zero if the host has to output silence
+	ResetRequests = Bumped on every reset request, the host compares it to the last value it saw
+	HostStatus = One of the HOST_STATUS_* values, written by the host
+	BackPressure = What the driver does when the ring is full, one of the BACKPRESSURE_* values
+	MaxPending = Events the host allows to be queued at once, 0 means the whole ring
+	PriorityCCs = Bitmask of the control changes that go through the priority lane, bit N is CC N
+	PublishBatch = Events the driver stages before publishing them to the host, 0 or 1 publishes every event
+	PublishDelay = Microseconds a staged event can wait before it gets published anyway
+	UMPProtocol = What the driver turns the short events into on UMP pipes, one of the UMP_PROTOCOL_* values
+	Transform = Rules the driver applies to the short events before queueing them, see WinTransform.hpp
+
+	The liveness fields live outside of the sequence lock, since the heartbeat
+	changes all the time and would keep waking up HasChanged() for nothing.
+
+	OwnerPID = Process reading the events, 0 if nobody claimed them yet
+	StandbyPID = Process waiting to take over if the owner dies, 0 if there's none
+	OwnerCursor = Consumer slot of the owner on broadcast rings, -1 on the other ones
+	OwnerPriorityCursor = Same as above, for the priority lane
+	Takeovers = How many times a standby took over
+	Heartbeat = QPC ticks of the owner's last beat
+	HandoverTime = Microseconds between the last beat of the dead owner and the standby taking over
+
+	Waiting = Non-zero while a consumer is about to sleep on the pipe's doorbell, the
+	producer clears it and rings the doorbell after publishing, see WinPipeExecutor.hpp
+
+	The standby waits on the owner's process handle, so a crash gets noticed right
+	away, and the heartbeat catches the owners that are alive but stuck.
+	It resumes from the last read position the owner committed, so nothing the app
+	sent gets lost, at worst the batch the owner was in the middle of gets played twice.
+
+	An owner that was only stalled might come back after the takeover. It checks
+	OwnerPID before reading a batch and before committing its position, and
+	stops reading once the PID isn't its own, so two consumers never move the
+	same read heads.
+
+*/
+
+#define HOST_STATUS_OFFLINE		0
+#define HOST_STATUS_RUNNING		1
+#define HOST_STATUS_STOPPING	2
+#define HOST_STATUS_DEAD		3	// Set by the driver when the heartbeat stops
+
+#define HOST_HEARTBEAT_TIMEOUT	50	// The owner is considered dead after this many ms without a beat
+#define HOST_CHECK_INTERVAL		10	// How often the driver and the standby look at the heartbeat, in ms
+
+#define BACKPRESSURE_DROP		0	// Drop the event right away
+#define BACKPRESSURE_BLOCK		1	// Wait for the host, up to BACKPRESSURE_TIMEOUT ms
+#define BACKPRESSURE_TIMEOUT	100
+
+#define PUBLISH_DEF_DELAY		1000	// Microseconds, used when the batching is on but no delay was set
+
+typedef struct {
+	DWORD Volume;
+	DWORD Mute;
+	DWORD ResetRequests;
+	DWORD HostStatus;
+	DWORD BackPressure;
+	DWORD MaxPending;
+	DWORD PriorityCCs[4];
+	DWORD PublishBatch;
+	DWORD PublishDelay;
+	DWORD UMPProtocol;
+	TransformRules Transform;
+} ControlState, CtlState, *PCtlState;
+
+typedef struct {
+	volatile LONG OwnerPID;
+	volatile LONG StandbyPID;
+	volatile LONG OwnerCursor;
+	volatile LONG OwnerPriorityCursor;
+	volatile LONG Takeovers;
+	volatile LONG64 Heartbeat;
+	volatile LONG64 HandoverTime;
+} HostLiveness, *PHostLiveness;
+
+typedef struct {
+	volatile LONG Seq;
+	CtlState State;
+	HostLiveness Host;
+	volatile LONG Waiting;
+} ControlPageData, CtlPage, *PCtlPage;
+
+namespace WinDriver {
+	class ControlPage {
+	private:
+		ErrorSystem::WinErr ControlErr;
+
+		HANDLE PPage = nullptr;
+		PCtlPage Page = nullptr;
+
+		LONG LockPage();
+		void UnlockPage(LONG Locked);
+
+		static LONG64 GetTicks();
+		static LONG64 TicksToUs(LONG64 Ticks);
+
+	public:
+		bool OpenControl(const wchar_t* Name, bool Create);
+		bool CloseControl();
+
+		// Returns a consistent copy of the whole page, false if it's not open,
+		// or if a writer held it for too long, Target is left as it was then
+		bool ReadState(PCtlState Target);
+
+		void SetVolume(DWORD Volume);
+		void SetMute(bool Mute);
+		void RequestReset();
+		void SetHostStatus(DWORD Status);
+		void SetBackPressure(DWORD Mode, DWORD MaxPending);
+		void SetPriorityCCs(const DWORD* Mask);
+		void SetPublishBatching(DWORD Batch, DWORD Delay);
+		void SetUMPProtocol(DWORD Protocol);
+		void SetTransform(const TransformRules* Rules);
+
+		// Cheap check for the hot path, true if the page changed since LastSeq
+		bool HasChanged(LONG* LastSeq);
+
+		// Owner side, Beat() returns false if a standby took over in the meantime
+		void ClaimOwner(LONG Cursor, LONG PriorityCursor);
+		bool Beat();
+
+		// Standby side
+		bool RegisterStandby();
+		bool IsOwnerAlive();
+		LONG GetOwnerPID();
+		bool TakeOver(LONG DeadPID, LONG* Cursor, LONG* PriorityCursor);
+
+		bool ReadLiveness(PHostLiveness Target);
+
+		// Doorbell, the consumer arms it before its last look at the ring, the producer
+		// takes it after publishing, true means there's a consumer to wake up
+		void ArmDoorbell();
+		bool TakeWaiter();
+	};
+}
+
+#endif
@@ -81,6 +81,7 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 	MIDIOUTCAPS2A Caps2A;
 	MIDIOUTCAPS2W Caps2W;
 	size_t WCSTSRetVal;
+	unsigned short Tech = this->Technology;
 
 	// Why would this happen? Stupid MIDI app dev smh
 	if (CapsPointer == nullptr)
@@ -94,7 +95,12 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 		return MMSYSERR_INVALPARAM;
 	}
 
-	swprintf_s(DevName, MAXPNAMELEN, this->TemplateName, DeviceIdentifier);
+	// The loopback port is a cable to the input device, not a synth
+	if (DeviceIdentifier == LOOPBACK_PORT) {
+		wcsncpy_s(DevName, this->LoopbackName, MAXPNAMELEN);
+		Tech = MOD_MIDIPORT;
+	}
+	else swprintf_s(DevName, MAXPNAMELEN, this->TemplateName, DeviceIdentifier);
 
 	// I have to support all this s**t or else it won't work in some apps smh
 	switch (CapsSize) {
@@ -104,7 +110,7 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 		CapsA.wChannelMask = 0xFFFF;
 		CapsA.wMid = this->ManufacturerID;
 		CapsA.wPid = this->ProductID;
-		CapsA.wTechnology = this->Technology;
+		CapsA.wTechnology = Tech;
 		CapsA.wNotes = 65535;
 		CapsA.wVoices = 65535;
 		CapsA.vDriverVersion = MAKEWORD(6, 2);
@@ -117,7 +123,7 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 		CapsW.wChannelMask = 0xFFFF;
 		CapsW.wMid = this->ManufacturerID;
 		CapsW.wPid = this->ProductID;
-		CapsW.wTechnology = this->Technology;
+		CapsW.wTechnology = Tech;
 		CapsW.wNotes = 65535;
 		CapsW.wVoices = 65535;
 		CapsW.vDriverVersion = MAKEWORD(6, 2);
@@ -130,7 +136,7 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 		Caps2A.wChannelMask = 0xFFFF;
 		Caps2A.wMid = this->ManufacturerID;
 		Caps2A.wPid = this->ProductID;
-		Caps2A.wTechnology = this->Technology;
+		Caps2A.wTechnology = Tech;
 		Caps2A.wNotes = 65535;
 		Caps2A.wVoices = 65535;
 		Caps2A.vDriverVersion = MAKEWORD(6, 2);
@@ -143,7 +149,7 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 		Caps2W.wChannelMask = 0xFFFF;
 		Caps2W.wMid = this->ManufacturerID;
 		Caps2W.wPid = this->ProductID;
-		Caps2W.wTechnology = this->Technology;
+		Caps2W.wTechnology = Tech;
 		Caps2W.wNotes = 65535;
 		Caps2W.wVoices = 65535;
 		Caps2W.vDriverVersion = MAKEWORD(6, 2);
@@ -155,6 +161,62 @@ unsigned long WinDriver::DriverMask::GiveCaps(UINT DeviceIdentifier, PVOID CapsP
 	return MMSYSERR_NOERROR;
 }
 
+unsigned long WinDriver::DriverMask::GiveInputCaps(UINT DeviceIdentifier, PVOID CapsPointer, DWORD CapsSize) {
+	MIDIINCAPSA CapsA = { 0 };
+	MIDIINCAPSW CapsW = { 0 };
+	MIDIINCAPS2A Caps2A = { 0 };
+	MIDIINCAPS2W Caps2W = { 0 };
+	size_t WCSTSRetVal;
+
+	if (CapsPointer == nullptr)
+	{
+		NERROR(MaskErr, L"A null pointer has been passed to the function. The driver can't share its info with the application.", false);
+		return MMSYSERR_INVALPARAM;
+	}
+
+	// There's only one input device, the other end of the loopback port
+	switch (CapsSize) {
+	case (sizeof(MIDIINCAPSA)):
+		wcstombs_s(&WCSTSRetVal, CapsA.szPname, sizeof(CapsA.szPname), this->LoopbackName, MAXPNAMELEN);
+		CapsA.wMid = this->ManufacturerID;
+		CapsA.wPid = this->ProductID;
+		CapsA.vDriverVersion = MAKEWORD(6, 2);
+		memcpy((LPMIDIINCAPSA)CapsPointer, &CapsA, min(CapsSize, sizeof(CapsA)));
+		break;
+
+	case (sizeof(MIDIINCAPSW)):
+		wcsncpy_s(CapsW.szPname, this->LoopbackName, MAXPNAMELEN);
+		CapsW.wMid = this->ManufacturerID;
+		CapsW.wPid = this->ProductID;
+		CapsW.vDriverVersion = MAKEWORD(6, 2);
+		memcpy((LPMIDIINCAPSW)CapsPointer, &CapsW, min(CapsSize, sizeof(CapsW)));
+		break;
+
+	case (sizeof(MIDIINCAPS2A)):
+		wcstombs_s(&WCSTSRetVal, Caps2A.szPname, sizeof(Caps2A.szPname), this->LoopbackName, MAXPNAMELEN);
+		Caps2A.wMid = this->ManufacturerID;
+		Caps2A.wPid = this->ProductID;
+		Caps2A.vDriverVersion = MAKEWORD(6, 2);
+		memcpy((LPMIDIINCAPS2A)CapsPointer, &Caps2A, min(CapsSize, sizeof(Caps2A)));
+		break;
+
+	case (sizeof(MIDIINCAPS2W)):
+		wcsncpy_s(Caps2W.szPname, this->LoopbackName, MAXPNAMELEN);
+		Caps2W.wMid = this->ManufacturerID;
+		Caps2W.wPid = this->ProductID;
+		Caps2W.vDriverVersion = MAKEWORD(6, 2);
+		memcpy((LPMIDIINCAPS2W)CapsPointer, &Caps2W, min(CapsSize, sizeof(Caps2W)));
+		break;
+
+	default:
+		NERROR(MaskErr, L"CapsSize doesn't match any of the MIDIINCAPS structs.", false);
+		return MMSYSERR_INVALPARAM;
+	}
+
+	LOG(MaskErr, L"Input caps have been shared with the app.");
+	return MMSYSERR_NOERROR;
+}
+
 bool WinDriver::DriverCallback::PrepareCallbackFunction(MIDIOPENDESC* OpInfStruct, DWORD CallbackMode) {
 	// Save the pointer's address to memory
 	this->WMMHandle = OpInfStruct->hMidi;
@@ -186,7 +248,7 @@ bool WinDriver::DriverCallback::ClearCallbackFunction() {
 	return true;
 }
 
-void WinDriver::DriverCallback::CallbackFunction(DWORD Message, DWORD Arg1, DWORD Arg2) {
+void WinDriver::DriverCallback::CallbackFunction(DWORD Message, DWORD_PTR Arg1, DWORD_PTR Arg2) {
 	WMMC Callback = nullptr;
 	int ReturnMessage = 0;
 
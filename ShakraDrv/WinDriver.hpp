@@ -16,6 +16,7 @@ This file is useful only if you want to compile the driver under Windows, it's n
 #include <mmddk.h>
 #include <assert.h>
 #include "WinError.hpp"
+#include "WinVars.hpp"
 
 using namespace std;
 
@@ -41,6 +42,7 @@ namespace WinDriver {
 	class DriverMask {
 	private:
 		const wchar_t* TemplateName = L"Shakra Driver (Port %d)\0";
+		const wchar_t* LoopbackName = L"Shakra Loopback\0";
 
 		unsigned short ManufacturerID = 0xFFFF;
 		unsigned short ProductID = 0xFFFF;
@@ -53,6 +55,7 @@ namespace WinDriver {
 		// Change settings
 		bool ChangeSettings(short, short, short, short);
 		unsigned long GiveCaps(UINT, PVOID, DWORD);
+		unsigned long GiveInputCaps(UINT, PVOID, DWORD);
 	};
 
 	class DriverCallback {
@@ -69,7 +72,7 @@ namespace WinDriver {
 		// Callbacks
 		bool PrepareCallbackFunction(MIDIOPENDESC*, DWORD);
 		bool ClearCallbackFunction();
-		void CallbackFunction(DWORD, DWORD, DWORD);
+		void CallbackFunction(DWORD, DWORD_PTR, DWORD_PTR);
 
 	};
 
@@ -92,11 +95,6 @@ namespace WinDriver {
 		bool CloseDriver();
 
 	};
-
-	class Blacklist {
-	private:
-
-	};
 }
 
 #endif
\ No newline at end of file
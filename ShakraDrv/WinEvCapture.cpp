@@ -0,0 +1,423 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinEvCapture.hpp"
+
+// Used by ConvertSMF to sort the events of all the tracks
+typedef struct {
+	unsigned long long Tick;
+	DWORD Event;
+	DWORD Offset;	// Offset of the long data in LongData
+	DWORD Len;		// 0 for short events
+} SMFEvent;
+
+typedef struct {
+	unsigned long long Tick;
+	DWORD Tempo;	// Microseconds per quarter note
+} SMFTempo;
+
+static bool ReadVLQ(const std::vector<BYTE>& Buf, size_t& Pos, size_t End, DWORD* Value) {
+	DWORD Val = 0;
+
+	// VLQs in SMFs are 4 bytes long at most
+	for (int i = 0; i < 4; i++) {
+		if (Pos >= End)
+			return false;
+
+		BYTE B = Buf[Pos++];
+		Val = (Val << 7) | (B & 0x7F);
+
+		if (!(B & 0x80)) {
+			*Value = Val;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static DWORD ReadBE(const std::vector<BYTE>& Buf, size_t Pos, int Bytes) {
+	DWORD Val = 0;
+
+	for (int i = 0; i < Bytes; i++)
+		Val = (Val << 8) | Buf[Pos + i];
+
+	return Val;
+}
+
+static bool ReadWholeFile(const wchar_t* Path, std::vector<BYTE>& Target) {
+	FILE* File = nullptr;
+	long Size = 0;
+
+	if (_wfopen_s(&File, Path, L"rb") || !File)
+		return false;
+
+	fseek(File, 0, SEEK_END);
+	Size = ftell(File);
+	fseek(File, 0, SEEK_SET);
+
+	if (Size < 0) {
+		fclose(File);
+		return false;
+	}
+
+	Target.resize((size_t)Size);
+	bool Success = (fread(Target.data(), 1, Target.size(), File) == Target.size());
+	fclose(File);
+
+	return Success;
+}
+
+bool WinDriver::EventCapture::OpenCapture(const wchar_t* Path) {
+	CaptureHeader Header;
+	std::vector<BYTE> File;
+
+	CloseCapture();
+
+	if (!ReadWholeFile(Path, File)) {
+		NERROR(CapErr, L"Failed to read the capture file.", false);
+		return false;
+	}
+
+	if (File.size() < sizeof(Header)) {
+		NERROR(CapErr, L"The capture file is too small to be valid.", false);
+		return false;
+	}
+
+	memcpy(&Header, File.data(), sizeof(Header));
+	if (Header.Magic != CAPTURE_MAGIC || Header.Version != CAPTURE_VERSION) {
+		NERROR(CapErr, L"The file is not a valid Shakra capture, or it has been made by an unsupported version.", false);
+		return false;
+	}
+
+	Data.assign(File.begin() + sizeof(Header), File.end());
+
+	// Walk the records once to check their bounds, and to get the length of the capture
+	for (size_t Pos = 0; Pos < Data.size(); ) {
+		CaptureRecord Rec;
+
+		if (Data.size() - Pos < sizeof(Rec)) {
+			NERROR(CapErr, L"The capture file has been truncated.", false);
+			Data.clear();
+			return false;
+		}
+
+		memcpy(&Rec, &Data[Pos], sizeof(Rec));
+		Pos += sizeof(Rec) + Rec.Length;
+
+		if (Pos > Data.size() || Rec.Length > MAX_LE_SIZE) {
+			NERROR(CapErr, L"The capture file contains a corrupted long event.", false);
+			Data.clear();
+			return false;
+		}
+
+		Length = Rec.Timestamp;
+	}
+
+	LOG(CapErr, L"Capture loaded.");
+	return true;
+}
+
+bool WinDriver::EventCapture::CloseCapture() {
+	Data.clear();
+	Data.shrink_to_fit();
+	DataPos = 0;
+	Length = 0;
+
+	return true;
+}
+
+unsigned int WinDriver::EventCapture::FeedCapture(SynthPipe* Target, unsigned long long Timestamp) {
+	unsigned int Fed = 0;
+
+	if (!Target)
+		return 0;
+
+	while (DataPos < Data.size()) {
+		CaptureRecord Rec;
+		memcpy(&Rec, &Data[DataPos], sizeof(Rec));
+
+		// Not there yet
+		if (Rec.Timestamp >= Timestamp)
+			break;
+
+		if (!Rec.Length) {
+			// Buffer is full, let the consumer catch up before feeding more
+			if (!Target->SaveShortEvent(Rec.Event))
+				break;
+		}
+		else {
+			MIDIHDR Hdr;
+
+			if (!Target->CanSaveLongEvent())
+				break;
+
+			memset(&Hdr, 0, sizeof(Hdr));
+			Hdr.lpData = (LPSTR)&Data[DataPos + sizeof(Rec)];
+			Hdr.dwBufferLength = Rec.Length;
+			Hdr.dwBytesRecorded = Rec.Length;
+			Hdr.dwFlags = MHDR_PREPARED;
+
+			Target->SaveLongEvent(&Hdr);
+		}
+
+		DataPos += sizeof(Rec) + Rec.Length;
+		Fed++;
+	}
+
+	return Fed;
+}
+
+unsigned long long WinDriver::EventCapture::GetCaptureLength() {
+	return Length;
+}
+
+bool WinDriver::EventCapture::IsCaptureDone() {
+	return (DataPos >= Data.size());
+}
+
+unsigned long long WinDriver::EventCapture::GetRecordTime() {
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+
+	unsigned long long Ticks = (unsigned long long)(Now.QuadPart - RecStart.QuadPart);
+	return (Ticks / RecFreq.QuadPart) * 1000000 + ((Ticks % RecFreq.QuadPart) * 1000000) / RecFreq.QuadPart;
+}
+
+void WinDriver::EventCapture::WriteRecord(unsigned long long Timestamp, DWORD Event, const BYTE* Long, DWORD Len) {
+	CaptureRecord Rec;
+
+	Rec.Timestamp = Timestamp;
+	Rec.Length = Len;
+	Rec.Event = Event;
+
+	fwrite(&Rec, sizeof(Rec), 1, RecFile);
+	if (Len) fwrite(Long, 1, Len, RecFile);
+
+	RecCount++;
+}
+
+bool WinDriver::EventCapture::StartRecording(const wchar_t* Path) {
+	CaptureHeader Header = { CAPTURE_MAGIC, CAPTURE_VERSION, 0, 0 };
+
+	if (RecFile) {
+		LOG(CapErr, L"A recording is already in progress.");
+		return false;
+	}
+
+	if (_wfopen_s(&RecFile, Path, L"wb") || !RecFile) {
+		NERROR(CapErr, L"Failed to create the capture file.", false);
+		RecFile = nullptr;
+		return false;
+	}
+
+	// The header gets rewritten by StopRecording, once we know how many events we got
+	fwrite(&Header, sizeof(Header), 1, RecFile);
+
+	RecCount = 0;
+	QueryPerformanceFrequency(&RecFreq);
+	QueryPerformanceCounter(&RecStart);
+
+	return true;
+}
+
+bool WinDriver::EventCapture::StopRecording() {
+	CaptureHeader Header = { CAPTURE_MAGIC, CAPTURE_VERSION, 0, 0 };
+
+	if (!RecFile)
+		return true;
+
+	Header.EventsCount = RecCount;
+	fseek(RecFile, 0, SEEK_SET);
+	fwrite(&Header, sizeof(Header), 1, RecFile);
+	fclose(RecFile);
+
+	RecFile = nullptr;
+	return true;
+}
+
+void WinDriver::EventCapture::RecordShortEvent(unsigned int Event) {
+	if (RecFile)
+		WriteRecord(GetRecordTime(), Event, nullptr, 0);
+}
+
+void WinDriver::EventCapture::RecordLongEvent(const BYTE* Event, unsigned int Len) {
+	if (RecFile && Len)
+		WriteRecord(GetRecordTime(), 0, Event, Len);
+}
+
+bool WinDriver::EventCapture::ConvertSMF(const wchar_t* SMFPath, const wchar_t* Path) {
+	std::vector<BYTE> SMF;
+	std::vector<BYTE> LongData;
+	std::vector<SMFEvent> Events;
+	std::vector<SMFTempo> Tempos;
+	CaptureHeader Header = { CAPTURE_MAGIC, CAPTURE_VERSION, 0, 0 };
+	FILE* Out = nullptr;
+	size_t Pos = 0;
+	DWORD Division = 0, Tracks = 0;
+
+	if (!ReadWholeFile(SMFPath, SMF) || SMF.size() < 14 || memcmp(SMF.data(), "MThd", 4)) {
+		NERROR(CapErr, L"The file is not a valid Standard MIDI File.", false);
+		return false;
+	}
+
+	Tracks = ReadBE(SMF, 10, 2);
+	Division = ReadBE(SMF, 12, 2);
+	Pos = 8 + ReadBE(SMF, 4, 4);
+
+	if (!Division) {
+		NERROR(CapErr, L"The Standard MIDI File has an invalid time division.", false);
+		return false;
+	}
+
+	for (DWORD Track = 0; Track < Tracks && Pos + 8 <= SMF.size(); Track++) {
+		DWORD ChunkLen = ReadBE(SMF, Pos + 4, 4);
+		bool IsTrack = !memcmp(&SMF[Pos], "MTrk", 4);
+		size_t End = Pos + 8 + ChunkLen;
+		unsigned long long Tick = 0;
+		BYTE RunningStatus = 0;
+
+		Pos += 8;
+		if (End > SMF.size()) End = SMF.size();
+
+		// Skip unknown chunks, as the spec requires
+		if (!IsTrack) {
+			Pos = End;
+			Track--;
+			continue;
+		}
+
+		while (Pos < End) {
+			DWORD Delta = 0;
+			BYTE Status = 0;
+
+			if (!ReadVLQ(SMF, Pos, End, &Delta) || Pos >= End)
+				break;
+
+			Tick += Delta;
+			Status = SMF[Pos];
+
+			if (Status & 0x80) Pos++;
+			else if (RunningStatus) Status = RunningStatus;
+			else break;
+
+			if (Status == 0xFF) {
+				DWORD MetaLen = 0;
+				BYTE Type = 0;
+
+				if (Pos >= End) break;
+				Type = SMF[Pos++];
+
+				if (!ReadVLQ(SMF, Pos, End, &MetaLen) || Pos + MetaLen > End)
+					break;
+
+				// Set tempo, the only meta event we care about
+				if (Type == 0x51 && MetaLen == 3)
+					Tempos.push_back({ Tick, ReadBE(SMF, Pos, 3) });
+
+				Pos += MetaLen;
+
+				// End of track
+				if (Type == 0x2F)
+					break;
+			}
+			else if (Status == 0xF0 || Status == 0xF7) {
+				DWORD SysExLen = 0;
+
+				if (!ReadVLQ(SMF, Pos, End, &SysExLen) || Pos + SysExLen > End)
+					break;
+
+				// F0 events miss their status byte in the file, F7 ones are sent as they are
+				DWORD Offset = (DWORD)LongData.size();
+				if (Status == 0xF0) LongData.push_back(0xF0);
+				LongData.insert(LongData.end(), SMF.begin() + Pos, SMF.begin() + Pos + SysExLen);
+
+				DWORD Len = (DWORD)LongData.size() - Offset;
+				if (Len && Len <= MAX_LE_SIZE)
+					Events.push_back({ Tick, 0, Offset, Len });
+
+				Pos += SysExLen;
+				RunningStatus = 0;
+			}
+			else {
+				// Channel messages, 0xC0 and 0xD0 only have one parameter
+				int Params = ((Status & 0xE0) == 0xC0) ? 1 : 2;
+				DWORD Event = Status;
+
+				if (Pos + Params > End)
+					break;
+
+				Event |= SMF[Pos++] << 8;
+				if (Params == 2) Event |= SMF[Pos++] << 16;
+
+				Events.push_back({ Tick, Event, 0, 0 });
+				RunningStatus = Status;
+			}
+		}
+
+		Pos = End;
+	}
+
+	// Merge the tracks, events on the same tick keep their track order
+	std::stable_sort(Events.begin(), Events.end(), [](const SMFEvent& A, const SMFEvent& B) { return A.Tick < B.Tick; });
+	std::stable_sort(Tempos.begin(), Tempos.end(), [](const SMFTempo& A, const SMFTempo& B) { return A.Tick < B.Tick; });
+
+	if (_wfopen_s(&Out, Path, L"wb") || !Out) {
+		NERROR(CapErr, L"Failed to create the capture file.", false);
+		return false;
+	}
+
+	Header.EventsCount = (DWORD)Events.size();
+	fwrite(&Header, sizeof(Header), 1, Out);
+
+	// Convert the ticks to microseconds, using only integers
+	unsigned long long BaseTick = 0, BaseTime = 0;
+	DWORD Tempo = 500000;
+	size_t NextTempo = 0;
+
+	for (const SMFEvent& Ev : Events) {
+		CaptureRecord Rec;
+		unsigned long long Dividend = 0, Divisor = 0;
+
+		while (NextTempo < Tempos.size() && Tempos[NextTempo].Tick <= Ev.Tick) {
+			if (!(Division & 0x8000))
+				BaseTime += ((Tempos[NextTempo].Tick - BaseTick) * Tempo) / Division;
+
+			BaseTick = Tempos[NextTempo].Tick;
+			Tempo = Tempos[NextTempo].Tempo;
+			NextTempo++;
+		}
+
+		if (Division & 0x8000) {
+			// SMPTE time division, tempo doesn't matter here
+			int FPS = -(signed char)(Division >> 8);
+			unsigned long long TPF = Division & 0xFF;
+
+			// 29 means 29.97 FPS (drop frame)
+			Dividend = (FPS == 29) ? 100000000ULL : 1000000ULL;
+			Divisor = (FPS == 29) ? 2997ULL * TPF : (unsigned long long)FPS * TPF;
+
+			Rec.Timestamp = (Ev.Tick * Dividend) / (Divisor ? Divisor : 1);
+		}
+		else Rec.Timestamp = BaseTime + ((Ev.Tick - BaseTick) * Tempo) / Division;
+
+		Rec.Length = Ev.Len;
+		Rec.Event = Ev.Event;
+
+		fwrite(&Rec, sizeof(Rec), 1, Out);
+		if (Ev.Len) fwrite(&LongData[Ev.Offset], 1, Ev.Len, Out);
+	}
+
+	fclose(Out);
+
+	LOG(CapErr, L"Standard MIDI File converted.");
+	return true;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINEVCAPTURE_H
+
+#define WINEVCAPTURE_H
+
+#include "WinError.hpp"
+#include "WinSynthPipe.hpp"
+#include <windows.h>
+#include <vector>
+
+/*
+
+	Capture files are a flat list of timestamped events, sorted by time.
+	They can be recorded from a live SynthPipe, or converted from a
+	Standard MIDI File, and then fed back into a SynthPipe offline.
+
+	Timestamps are stored in microseconds, so that an offline renderer
+	can convert them to sample frames with integer math only.
+	That's what keeps the output bit-identical between runs.
+
+*/
+
+#define CAPTURE_MAGIC		0x434B4853	// "SHKC"
+#define CAPTURE_VERSION		1
+
+typedef struct {
+	DWORD Magic;			// Always CAPTURE_MAGIC
+	DWORD Version;			// Always CAPTURE_VERSION
+	DWORD EventsCount;		// How many records follow the header
+	DWORD Reserved;
+} CaptureHeader, CapHdr, *PCapHdr;
+
+typedef struct {
+	unsigned long long Timestamp;	// Microseconds from the start of the capture
+	DWORD Length;					// 0 for short events, otherwise the size of the long event that follows the record
+	DWORD Event;					// The short event (unused for long events)
+} CaptureRecord, CapRec, *PCapRec;
+
+namespace WinDriver {
+	class EventCapture {
+	private:
+		ErrorSystem::WinErr CapErr;
+
+		// Loaded capture, records and long data are stored back to back
+		std::vector<BYTE> Data;
+		size_t DataPos = 0;
+		unsigned long long Length = 0;
+
+		// Recording
+		FILE* RecFile = nullptr;
+		DWORD RecCount = 0;
+		LARGE_INTEGER RecStart = { 0 };
+		LARGE_INTEGER RecFreq = { 0 };
+
+		unsigned long long GetRecordTime();
+		void WriteRecord(unsigned long long Timestamp, DWORD Event, const BYTE* Long, DWORD Len);
+
+	public:
+		// Playback
+		bool OpenCapture(const wchar_t* Path);
+		bool CloseCapture();
+		unsigned int FeedCapture(SynthPipe* Target, unsigned long long Timestamp);
+		unsigned long long GetCaptureLength();
+		bool IsCaptureDone();
+
+		// Recording
+		bool StartRecording(const wchar_t* Path);
+		bool StopRecording();
+		void RecordShortEvent(unsigned int Event);
+		void RecordLongEvent(const BYTE* Event, unsigned int Len);
+
+		// Conversion
+		bool ConvertSMF(const wchar_t* SMFPath, const wchar_t* Path);
+	};
+}
+
+#endif
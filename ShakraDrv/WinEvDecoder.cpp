@@ -0,0 +1,120 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinEvDecoder.hpp"
+
+unsigned int WinDriver::EventDecoder::DecodeScalar(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2) {
+	for (unsigned int i = 0; i < Count; i++) {
+		DWORD Event = Events[i];
+		BYTE First = Event & 0xFF;
+
+		if (First & 0x80) {
+			// Realtime messages don't touch the running status, system common ones clear it
+			if (First < 0xF0) RunningStatus = First;
+			else if (First < 0xF8) RunningStatus = 0;
+
+			Status[i] = First;
+			Event >>= 8;
+		}
+		else Status[i] = RunningStatus;
+
+		Channel[i] = Status[i] & 0x0F;
+		Data1[i] = Event & 0xFF;
+		Data2[i] = (Event >> 8) & 0xFF;
+	}
+
+	return Count;
+}
+
+#ifdef DECODER_SSE2
+static inline __m128i Blend(__m128i Mask, __m128i A, __m128i B) {
+	// A where Mask is set, B everywhere else
+	return _mm_or_si128(_mm_and_si128(Mask, A), _mm_andnot_si128(Mask, B));
+}
+
+static inline void DecodeLanes(__m128i Raw, __m128i& Carry, __m128i& Status, __m128i& Data1, __m128i& Data2) {
+	const __m128i ByteMask = _mm_set1_epi32(0xFF);
+
+	__m128i First = _mm_and_si128(Raw, ByteMask);
+	__m128i IsStatus = _mm_cmpgt_epi32(First, _mm_set1_epi32(0x7F));
+
+	// Lanes that change the running status (0x80-0xF7), and the value they change it to
+	__m128i Setter = _mm_and_si128(IsStatus, _mm_cmplt_epi32(First, _mm_set1_epi32(0xF8)));
+	__m128i Value = _mm_and_si128(Setter, _mm_and_si128(First, _mm_cmplt_epi32(First, _mm_set1_epi32(0xF0))));
+
+	// Prefix scan in two steps, every lane ends up with the value of the closest setter on its left
+	Value = Blend(Setter, Value, _mm_slli_si128(Value, 4));
+	Setter = _mm_or_si128(Setter, _mm_slli_si128(Setter, 4));
+	Value = Blend(Setter, Value, _mm_slli_si128(Value, 8));
+	Setter = _mm_or_si128(Setter, _mm_slli_si128(Setter, 8));
+
+	// Lanes with no setter on their left inherit the running status from the previous group
+	Value = Blend(Setter, Value, Carry);
+	Carry = _mm_shuffle_epi32(Value, _MM_SHUFFLE(3, 3, 3, 3));
+
+	// Events with a status byte report it as is, and their params start one byte later
+	Status = Blend(IsStatus, First, Value);
+
+	__m128i Params = Blend(IsStatus, _mm_srli_epi32(Raw, 8), Raw);
+	Data1 = _mm_and_si128(Params, ByteMask);
+	Data2 = _mm_and_si128(_mm_srli_epi32(Params, 8), ByteMask);
+}
+
+static inline __m128i PackLanes(__m128i A, __m128i B, __m128i C, __m128i D) {
+	// All the lanes are in the 0-255 range, so saturation never kicks in
+	return _mm_packus_epi16(_mm_packs_epi32(A, B), _mm_packs_epi32(C, D));
+}
+
+unsigned int WinDriver::EventDecoder::DecodeSSE2(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2) {
+	const __m128i ChannelMask = _mm_set1_epi8(0x0F);
+	__m128i Carry = _mm_set1_epi32(RunningStatus);
+	unsigned int i = 0;
+
+	// 16 events per round, so that each array gets a full 128-bit store
+	for (; i + 16 <= Count; i += 16) {
+		__m128i S[4], D1[4], D2[4];
+
+		for (int j = 0; j < 4; j++)
+			DecodeLanes(_mm_loadu_si128((const __m128i*)(Events + i + (j * 4))), Carry, S[j], D1[j], D2[j]);
+
+		__m128i PS = PackLanes(S[0], S[1], S[2], S[3]);
+
+		_mm_storeu_si128((__m128i*)(Status + i), PS);
+		_mm_storeu_si128((__m128i*)(Channel + i), _mm_and_si128(PS, ChannelMask));
+		_mm_storeu_si128((__m128i*)(Data1 + i), PackLanes(D1[0], D1[1], D1[2], D1[3]));
+		_mm_storeu_si128((__m128i*)(Data2 + i), PackLanes(D2[0], D2[1], D2[2], D2[3]));
+	}
+
+	RunningStatus = (BYTE)_mm_cvtsi128_si32(Carry);
+
+	// Leftovers
+	if (i < Count)
+		DecodeScalar(Events + i, Count - i, Status + i, Channel + i, Data1 + i, Data2 + i);
+
+	return Count;
+}
+#endif
+
+unsigned int WinDriver::EventDecoder::Decode(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2) {
+#ifdef DECODER_SSE2
+	return DecodeSSE2(Events, Count, Status, Channel, Data1, Data2);
+#else
+	return DecodeScalar(Events, Count, Status, Channel, Data1, Data2);
+#endif
+}
+
+unsigned int WinDriver::EventDecoder::DecodeNoSIMD(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2) {
+	return DecodeScalar(Events, Count, Status, Channel, Data1, Data2);
+}
+
+void WinDriver::EventDecoder::ResetRunningStatus() {
+	RunningStatus = 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINEVDECODER_H
+
+#define WINEVDECODER_H
+
+#include <windows.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DECODER_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+
+	The decoder turns a batch of raw short events into four separate arrays
+	(status, channel, first param and second param), which is what the
+	consumers actually need.
+
+	Running status is handled the way the MIDI spec wants it:
+	- 0x80 to 0xEF set the running status
+	- 0xF0 to 0xF7 clear it
+	- 0xF8 to 0xFF (realtime) leave it alone
+
+	Events with no status byte and no running status get a status of 0,
+	and the consumer is supposed to skip them.
+
+*/
+
+#define MAX_DECODE_BATCH	4096
+
+namespace WinDriver {
+	class EventDecoder {
+	private:
+		BYTE RunningStatus = 0;
+
+		unsigned int DecodeScalar(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2);
+#ifdef DECODER_SSE2
+		unsigned int DecodeSSE2(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2);
+#endif
+
+	public:
+		// Uses the vectorized path if available, the scalar one otherwise
+		unsigned int Decode(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2);
+		unsigned int DecodeNoSIMD(const DWORD* Events, unsigned int Count, BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2);
+		void ResetRunningStatus();
+	};
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinJitterBuffer.hpp"
+
+static_assert(!(JITTER_MAX_QUEUE & (JITTER_MAX_QUEUE - 1)), "JITTER_MAX_QUEUE has to be a power of two.");
+
+bool WinDriver::JitterBuffer::Start(SynthPipe* Pipe, DWORD SampleRate, DWORD MinLatencyMs, DWORD MaxLatencyMs) {
+	LARGE_INTEGER Freq;
+
+	if (!Pipe || !SampleRate) {
+		NERROR(JitterErr, L"The jitter buffer needs a pipe and a sample rate.", false);
+		return false;
+	}
+
+	try {
+		Queue.resize(JITTER_MAX_QUEUE);
+	}
+	catch (std::bad_alloc&) {
+		NERROR(JitterErr, L"Failed to allocate the jitter buffer.", false);
+		return false;
+	}
+
+	if (MaxLatencyMs < MinLatencyMs)
+		MaxLatencyMs = MinLatencyMs;
+
+	QueryPerformanceFrequency(&Freq);
+	Frequency = Freq.QuadPart;
+
+	Source = Pipe;
+	Rate = SampleRate;
+	MinLatency = (long long)MinLatencyMs * Frequency / 1000;
+	MaxLatency = (long long)MaxLatencyMs * Frequency / 1000;
+	Target = MinLatency;
+
+	QueueHead = QueueTail = 0;
+	Anchor = 0;
+	FramePos = 0;
+	SharedAnchor = 0;
+	Jitter16 = 0;
+	HasTransit = false;
+	InPanic = false;
+	LateEvents = 0;
+
+	return true;
+}
+
+bool WinDriver::JitterBuffer::StartShared(SynthPipe* Pipe) {
+	RouteClock Clock;
+
+	if (!Pipe || !Pipe->ReadRouteClock(&Clock) || !Clock.Anchor) {
+		NERROR(JitterErr, L"The pipe has no shared clock, its owner has to start it first.", false);
+		return false;
+	}
+
+	// An adaptive delay would drift apart from one host to the other
+	if (!Start(Pipe, Clock.SampleRate, Clock.LatencyMs, Clock.LatencyMs))
+		return false;
+
+	SharedAnchor = Clock.Anchor;
+	return true;
+}
+
+void WinDriver::JitterBuffer::Stop() {
+	Source = nullptr;
+	QueueHead = QueueTail = 0;
+	Anchor = 0;
+	SharedAnchor = 0;
+}
+
+long long WinDriver::JitterBuffer::FramesToTicks(unsigned long long Frames) {
+	// Split, so that it doesn't overflow after a few days of audio
+	return (long long)((Frames / Rate) * Frequency + (Frames % Rate) * Frequency / Rate);
+}
+
+unsigned long long WinDriver::JitterBuffer::TicksToFrames(long long Ticks) {
+	if (Ticks <= 0)
+		return 0;
+
+	return (unsigned long long)((Ticks / Frequency) * Rate + (Ticks % Frequency) * Rate / Frequency);
+}
+
+long long WinDriver::JitterBuffer::GetDesired() {
+	long long Desired = MinLatency + JITTER_DEPTH * (Jitter16 >> 4);
+	return (Desired > MaxLatency) ? MaxLatency : Desired;
+}
+
+void WinDriver::JitterBuffer::Adapt(long long Transit) {
+	// RFC 3550, with the estimate kept 16 times bigger so that it can stay an integer
+	if (HasTransit) {
+		long long D = Transit - LastTransit;
+		if (D < 0) D = -D;
+
+		Jitter16 += D - ((Jitter16 + 8) >> 4);
+	}
+
+	LastTransit = Transit;
+	HasTransit = true;
+
+	// Grow right away, late events are worse than a bit more latency
+	long long Desired = GetDesired();
+	if (Desired > Target)
+		Target = Desired;
+}
+
+void WinDriver::JitterBuffer::Drain(long long Now) {
+	DWORD Event;
+	unsigned long long Timestamp;
+
+	SHAKRA_TRACE(TRACE_WAKE, 0);
+
+	while (QueueTail - QueueHead < JITTER_MAX_QUEUE && Source->PeekShortEvent(&Event, &Timestamp)) {
+		Source->PopShortEvent();
+
+		// Only the panic events have no timestamp, the stream got reset
+		// and the events still waiting in here are stale
+		if (!Timestamp) {
+			if (!InPanic)
+				QueueTail = QueueHead;
+
+			InPanic = true;
+		}
+		else InPanic = false;
+
+		PJitterEvent Slot = &Queue[QueueTail & (JITTER_MAX_QUEUE - 1)];
+		Slot->Event = Event;
+
+		if (Timestamp) {
+			Adapt(Now - (long long)Timestamp);
+			Slot->Playout = (long long)Timestamp + Target;
+		}
+		else Slot->Playout = 0;
+
+		QueueTail++;
+	}
+
+	Source->FlushShortEvents();
+}
+
+unsigned int WinDriver::JitterBuffer::Pull(DWORD* Events, DWORD* Offsets, unsigned int Max, unsigned int Frames) {
+	LARGE_INTEGER Now;
+	unsigned int Count = 0;
+	DWORD LastOffset = 0;
+	long long Lateness = 0;
+
+	if (!Source || !Frames)
+		return 0;
+
+	QueryPerformanceCounter(&Now);
+
+	// The first block starts now, the next ones right after it.
+	// On a shared clock, it starts wherever the clock is at
+	if (!Anchor) {
+		Anchor = SharedAnchor ? SharedAnchor : Now.QuadPart;
+		FramePos = TicksToFrames(Now.QuadPart - Anchor);
+	}
+
+	long long BlockStart = Anchor + FramesToTicks(FramePos);
+
+	// The host stalled, or rendered way ahead of time, start the clock again from here
+	long long Drift = Now.QuadPart - BlockStart;
+	long long Resync = MaxLatency + JITTER_RESYNC * Frequency / 1000;
+
+	if (Drift > Resync || Drift < -Resync) {
+		LOG(JitterErr, L"The audio clock drifted too far from real time, anchoring it again.");
+
+		// The other hosts are still on the shared clock, only this one moves
+		if (SharedAnchor) FramePos = TicksToFrames(Now.QuadPart - Anchor);
+		else Anchor = Now.QuadPart - FramesToTicks(FramePos);
+
+		BlockStart = Anchor + FramesToTicks(FramePos);
+	}
+
+	long long BlockEnd = Anchor + FramesToTicks(FramePos + Frames);
+
+	Drain(Now.QuadPart);
+
+	while (Count < Max && QueueHead != QueueTail) {
+		PJitterEvent Ev = &Queue[QueueHead & (JITTER_MAX_QUEUE - 1)];
+		DWORD Offset = 0;
+
+		if (Ev->Playout >= BlockEnd)
+			break;
+
+		if (Ev->Playout && Ev->Playout < BlockStart) {
+			// Too late already, play it now, the next ones get more room once the block is done
+			LateEvents++;
+
+			if (BlockStart - Ev->Playout > Lateness)
+				Lateness = BlockStart - Ev->Playout;
+		}
+		else if (Ev->Playout)
+			Offset = (DWORD)((Ev->Playout - BlockStart) * Rate / Frequency);
+
+		// Never go back in time, the order matters more than the exact frame
+		if (Offset < LastOffset) Offset = LastOffset;
+		if (Offset >= Frames) Offset = Frames - 1;
+		LastOffset = Offset;
+
+		Events[Count] = Ev->Event;
+		Offsets[Count] = Offset;
+		Count++;
+		QueueHead++;
+	}
+
+	// Enough room for the latest event of the block, a burst of late events is still a single delay
+	if (Lateness) {
+		Target += Lateness;
+		if (Target > MaxLatency) Target = MaxLatency;
+	}
+
+	// Shrink slowly, so that a short calm moment doesn't bring the late events back
+	long long Desired = GetDesired();
+	if (Desired < Target)
+		Target -= (Target - Desired + 63) / 64;
+
+	FramePos += Frames;
+	return Count;
+}
+
+bool WinDriver::JitterBuffer::IsLongEventDue(unsigned int Frames) {
+	unsigned long long Timestamp;
+
+	if (!Source || !Source->PeekLongEvent(&Timestamp))
+		return false;
+
+	if (!Anchor)
+		return true;
+
+	return (long long)Timestamp + Target < Anchor + FramesToTicks(FramePos + Frames);
+}
+
+void WinDriver::JitterBuffer::GetStats(PJitterStats Stats) {
+	if (!Frequency) {
+		memset(Stats, 0, sizeof(JitterStats));
+		return;
+	}
+
+	Stats->Delay = (DWORD)(Target * 1000000 / Frequency);
+	Stats->Jitter = (DWORD)((Jitter16 >> 4) * 1000000 / Frequency);
+	Stats->LateEvents = LateEvents;
+	Stats->Queued = QueueTail - QueueHead;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINJITTERBUFFER_H
+
+#define WINJITTERBUFFER_H
+
+#include "WinError.hpp"
+#include "WinSynthPipe.hpp"
+#include <windows.h>
+#include <vector>
+
+/*
+
+	Playout buffer for the short events, sitting between the pipe and the synth.
+
+	Playing the events as soon as the host drains them turns the scheduling
+	jitter of the app (and of the host's polling loop) into timing jitter.
+	Instead, every event gets played at its QPC timestamp plus a fixed delay,
+	at the exact audio frame that matches that time.
+
+	The host calls Pull() once per audio block, with the size of the block.
+	The blocks are laid back to back from the first call, so the frame offsets
+	follow the audio clock and not the time the host happened to wake up at.
+	If the host falls too far behind or ahead of real time, the clock is
+	anchored again.
+
+	The delay adapts to the jitter seen between the apps and the host, estimated
+	like RFC 3550 does it: J += (|D(i-1, i)| - J) / 16, where D is how much the
+	transit time (arrival minus timestamp) changed between two events.
+	- Target delay = MinLatency + JITTER_DEPTH * J, capped at MaxLatency
+	- It grows right away when the jitter gets worse, or when an event is late,
+	  and shrinks slowly (1/64 of the difference per block) when it gets better
+	- MinLatency == MaxLatency gives a fixed delay
+
+	The events always come out in the order they went in, so a shrinking delay
+	can bunch some events together but never swap them.
+	Late events (whose time was already past when their block got pulled) are
+	played at offset 0, and counted.
+
+	Long events don't go through the buffer, but IsLongEventDue() tells the
+	host when the next one is due, so that it stays in order with the notes.
+
+	When a pipe is rendered by more than one host (see WinRouting.hpp), they all
+	start their buffers with StartShared(), on the clock the owner put in the
+	routing table: the blocks are laid from its anchor instead of the first Pull(),
+	and every host uses the same fixed delay, so they all play an event at the
+	same time. A host that drifts too far moves its own position on the clock,
+	the anchor stays where it is.
+
+*/
+
+#define JITTER_DEPTH			4
+#define JITTER_MAX_QUEUE		65536	// Has to be a power of two
+#define JITTER_DEF_MIN_LATENCY	2		// ms
+#define JITTER_DEF_MAX_LATENCY	50		// ms
+#define JITTER_RESYNC			200		// ms the audio clock can drift on top of the max latency
+
+typedef struct {
+	DWORD Delay;		// Current target delay, in microseconds
+	DWORD Jitter;		// Jitter estimate, in microseconds
+	DWORD LateEvents;	// Events played after their time, since the buffer got started
+	DWORD Queued;		// Events waiting in the buffer
+} JitterStats, *PJitterStats;
+
+typedef struct {
+	DWORD Event;
+	long long Playout;	// QPC ticks, 0 to play it right away
+} JitterEvent, *PJitterEvent;
+
+namespace WinDriver {
+	class JitterBuffer {
+	private:
+		ErrorSystem::WinErr JitterErr;
+
+		SynthPipe* Source = nullptr;
+
+		// FIFO of the events waiting for their block
+		std::vector<JitterEvent> Queue;
+		DWORD QueueHead = 0;
+		DWORD QueueTail = 0;
+
+		// Audio clock
+		DWORD Rate = 48000;
+		long long Frequency = 0;
+		long long Anchor = 0;
+		unsigned long long FramePos = 0;
+		long long SharedAnchor = 0;		// 0 if the clock starts at the first Pull()
+
+		// Latency, all in QPC ticks
+		long long MinLatency = 0;
+		long long MaxLatency = 0;
+		long long Target = 0;
+		long long Jitter16 = 0;		// Jitter estimate, times 16
+		long long LastTransit = 0;
+		bool HasTransit = false;
+
+		DWORD LateEvents = 0;
+		bool InPanic = false;
+
+		long long FramesToTicks(unsigned long long Frames);
+		unsigned long long TicksToFrames(long long Ticks);
+		long long GetDesired();
+		void Drain(long long Now);
+		void Adapt(long long Transit);
+
+	public:
+		// Latencies in ms, the rate in Hz
+		bool Start(SynthPipe* Pipe, DWORD SampleRate, DWORD MinLatencyMs, DWORD MaxLatencyMs);
+
+		// Same as above, with the rate and the delay of the pipe's shared clock
+		bool StartShared(SynthPipe* Pipe);
+		void Stop();
+
+		// Fills Events with the events to play in the next block of Frames frames,
+		// and Offsets with the frame (from 0 to Frames - 1) each one has to be played at.
+		// Every call moves to the next block, so Max has to fit a whole block,
+		// the events that don't fit get played late in the next one
+		unsigned int Pull(DWORD* Events, DWORD* Offsets, unsigned int Max, unsigned int Frames);
+
+		// True if the next long event has to be played in the block that's about to be pulled
+		bool IsLongEventDue(unsigned int Frames);
+
+		void GetStats(PJitterStats Stats);
+	};
+}
+
+#endif
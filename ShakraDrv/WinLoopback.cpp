@@ -0,0 +1,305 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinLoopback.hpp"
+
+void WinDriver::LoopbackOutput::Open() {
+	LastAttempt = 0;
+
+	// It's fine if the input device isn't there yet
+	Connect();
+}
+
+void WinDriver::LoopbackOutput::Close() {
+	if (Pipe.IsOpen())
+		Pipe.ClosePipe();
+}
+
+bool WinDriver::LoopbackOutput::Connect() {
+	if (Pipe.IsOpen()) {
+		if (!Pipe.IsHostGone())
+			return true;
+
+		// The next input device is going to create a new pipe
+		LOG(LoopErr, L"The loopback input device went away, the events are going to be dropped until it's back.");
+		Pipe.ClosePipe();
+	}
+
+	if (LastAttempt && GetTickCount64() - LastAttempt < LOOPBACK_RETRY_INTERVAL)
+		return false;
+
+	LastAttempt = GetTickCount64();
+	return Pipe.ConnectPipe(LOOPBACK_PIPE);
+}
+
+bool WinDriver::LoopbackOutput::SendShortEvent(DWORD Event) {
+	if (!Connect())
+		return false;
+
+	return Pipe.SaveShortEvent(Event);
+}
+
+unsigned int WinDriver::LoopbackOutput::SendLongEvent(LPMIDIHDR Header) {
+	if (!(Header->dwFlags & MHDR_PREPARED))
+		return MIDIERR_UNPREPARED;
+
+	// SaveLongEvent() waits for a free slot, an app can't be stuck on a cable nobody's reading
+	if (!Connect() || !Pipe.CanSaveLongEvent()) {
+		Header->dwFlags |= MHDR_DONE;
+		return MMSYSERR_NOERROR;
+	}
+
+	return Pipe.SaveLongEvent(Header);
+}
+
+void WinDriver::LoopbackOutput::Reset() {
+	if (!Pipe.IsOpen())
+		return;
+
+	// Same as the synth, the input device gets the panic events instead of what was still queued
+	Pipe.ResetStream();
+}
+
+unsigned int WinDriver::LoopbackInput::Open(LPMIDIOPENDESC Desc, DWORD Flags) {
+	if (Delivery.joinable())
+		return MMSYSERR_ALLOCATED;
+
+	// The pipe has a single consumer, so a single app can listen to it
+	Owner = CreateMutexW(NULL, FALSE, LOOPBACK_OWNER);
+
+	if (!Owner) {
+		NERROR(LoopErr, nullptr, false);
+		return MMSYSERR_ERROR;
+	}
+
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		LOG(LoopErr, L"The loopback input device is already open in another app.");
+		CloseHandle(Owner);
+		Owner = nullptr;
+		return MMSYSERR_ALLOCATED;
+	}
+
+	if (!Callback.PrepareCallbackFunction(Desc, Flags)) {
+		CloseHandle(Owner);
+		Owner = nullptr;
+		return MMSYSERR_INVALPARAM;
+	}
+
+	// The input device is the host of the loopback pipe
+	if (!Pipe.PrepareFileMappings(LOOPBACK_PIPE, true, 0)) {
+		NERROR(LoopErr, L"Failed to create the loopback pipe.", false);
+		Pipe.ClosePipe();
+		Callback.ClearCallbackFunction();
+		CloseHandle(Owner);
+		Owner = nullptr;
+		return MMSYSERR_ERROR;
+	}
+
+	Pipe.SetHostStatus(HOST_STATUS_RUNNING);
+
+	QueryPerformanceFrequency(&Frequency);
+	Started.store(false, std::memory_order_relaxed);
+	Stopping.store(false, std::memory_order_relaxed);
+	Delivery = std::thread(&LoopbackInput::DeliveryLoop, this);
+
+	Callback.CallbackFunction(MIM_OPEN, 0, 0);
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::LoopbackInput::Close() {
+	bool Pending;
+
+	if (!Delivery.joinable())
+		return MMSYSERR_INVALHANDLE;
+
+	AcquireSRWLockShared(&BufferLock);
+	Pending = !Buffers.empty();
+	ReleaseSRWLockShared(&BufferLock);
+
+	// Same as any other input device, the app has to reset it first
+	if (Pending)
+		return MIDIERR_STILLPLAYING;
+
+	Started.store(false, std::memory_order_release);
+	Stopping.store(true, std::memory_order_release);
+	Delivery.join();
+	Stopping.store(false, std::memory_order_relaxed);
+
+	// The output ports notice it through the heartbeat
+	Pipe.SetHostStatus(HOST_STATUS_OFFLINE);
+	Pipe.ClosePipe();
+
+	CloseHandle(Owner);
+	Owner = nullptr;
+
+	Callback.CallbackFunction(MIM_CLOSE, 0, 0);
+	Callback.ClearCallbackFunction();
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::LoopbackInput::AddBuffer(LPMIDIHDR Header, DWORD Size) {
+	if (!Header || Size < sizeof(MIDIHDR) || !Header->lpData)
+		return MMSYSERR_INVALPARAM;
+
+	if (!(Header->dwFlags & MHDR_PREPARED))
+		return MIDIERR_UNPREPARED;
+
+	if (Header->dwFlags & MHDR_INQUEUE)
+		return MIDIERR_STILLPLAYING;
+
+	Header->dwBytesRecorded = 0;
+	Header->dwFlags &= ~MHDR_DONE;
+	Header->dwFlags |= MHDR_INQUEUE;
+
+	AcquireSRWLockExclusive(&BufferLock);
+	Buffers.push_back(Header);
+	ReleaseSRWLockExclusive(&BufferLock);
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::LoopbackInput::Start() {
+	LARGE_INTEGER Now;
+
+	QueryPerformanceCounter(&Now);
+	StartTime.store(Now.QuadPart, std::memory_order_relaxed);
+	Started.store(true, std::memory_order_release);
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::LoopbackInput::Stop() {
+	// A SysEx is never left halfway through a buffer, so there's nothing to give back
+	Started.store(false, std::memory_order_release);
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::LoopbackInput::Reset() {
+	Started.store(false, std::memory_order_release);
+	ReturnBuffers();
+
+	return MMSYSERR_NOERROR;
+}
+
+void WinDriver::LoopbackInput::ReturnBuffers() {
+	std::deque<LPMIDIHDR> Done;
+
+	AcquireSRWLockExclusive(&BufferLock);
+	Done.swap(Buffers);
+	ReleaseSRWLockExclusive(&BufferLock);
+
+	for (LPMIDIHDR Header : Done) {
+		Header->dwFlags &= ~MHDR_INQUEUE;
+		Header->dwFlags |= MHDR_DONE;
+		Callback.CallbackFunction(MIM_LONGDATA, (DWORD_PTR)Header, 0);
+	}
+}
+
+DWORD WinDriver::LoopbackInput::GetTimestamp(unsigned long long Ticks) {
+	unsigned long long Start = (unsigned long long)StartTime.load(std::memory_order_relaxed);
+	LARGE_INTEGER Now;
+
+	// The panic events don't have a timestamp of their own
+	if (!Ticks) {
+		QueryPerformanceCounter(&Now);
+		Ticks = Now.QuadPart;
+	}
+
+	// Sent before MIDM_START, but delivered after it
+	if (Ticks <= Start)
+		return 0;
+
+	return (DWORD)((Ticks - Start) * 1000 / Frequency.QuadPart);
+}
+
+void WinDriver::LoopbackInput::DeliverLongEvent(const BYTE* Data, unsigned int Length, DWORD Timestamp) {
+	unsigned int Offset = 0;
+
+	while (Offset < Length) {
+		LPMIDIHDR Header;
+
+		AcquireSRWLockExclusive(&BufferLock);
+
+		if (Buffers.empty()) {
+			ReleaseSRWLockExclusive(&BufferLock);
+			LOG(LoopErr, L"No input buffers left for the SysEx, the rest of it got dropped.");
+			return;
+		}
+
+		Header = Buffers.front();
+		Buffers.pop_front();
+		ReleaseSRWLockExclusive(&BufferLock);
+
+		DWORD Chunk = min((DWORD)(Length - Offset), Header->dwBufferLength);
+
+		memcpy(Header->lpData, Data + Offset, Chunk);
+		Header->dwBytesRecorded = Chunk;
+		Header->dwFlags &= ~MHDR_INQUEUE;
+		Header->dwFlags |= MHDR_DONE;
+
+		Callback.CallbackFunction(MIM_LONGDATA, (DWORD_PTR)Header, Timestamp);
+		Offset += Chunk;
+	}
+}
+
+void WinDriver::LoopbackInput::DeliveryLoop() {
+	// The whole point of the cable is latency
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+	while (!Stopping.load(std::memory_order_acquire)) {
+		unsigned long long ShortTime = 0, LongTime = 0;
+		unsigned int Delivered = 0;
+		DWORD Event = 0;
+
+		Pipe.Heartbeat();
+
+		for (; Delivered < LOOPBACK_BATCH; Delivered++) {
+			bool HasShort = Pipe.PeekShortEvent(&Event, &ShortTime);
+			bool HasLong = Pipe.PeekLongEvent(&LongTime);
+
+			if (!HasShort && !HasLong)
+				break;
+
+			// Same order the app sent them in, like the merger does between pipes.
+			// Whatever comes before MIDM_START, or after MIDM_STOP, is thrown away
+			if (HasLong && (!HasShort || LongTime <= ShortTime)) {
+				const BYTE* Data = nullptr;
+				unsigned int Length = Pipe.ParseLongEventRef(&Data);
+
+				if (Started.load(std::memory_order_acquire) && Length)
+					DeliverLongEvent(Data, Length, GetTimestamp(LongTime));
+
+				Pipe.FreeLongEvent();
+				continue;
+			}
+
+			Pipe.PopShortEvent();
+
+			if (Started.load(std::memory_order_acquire))
+				Callback.CallbackFunction(MIM_DATA, Event, GetTimestamp(ShortTime));
+		}
+
+		if (Delivered) {
+			Pipe.FlushShortEvents();
+			continue;
+		}
+
+		// Arm first, then look, see the doorbell notes in WinPipeExecutor.hpp
+		Pipe.ArmDoorbell();
+
+		if (Pipe.PeekShortEvent(&Event, nullptr) || Pipe.PeekLongEvent(&LongTime))
+			continue;
+
+		WaitForSingleObject(Pipe.GetDoorbell(), LOOPBACK_POLL_INTERVAL);
+	}
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINLOOPBACK_H
+
+#define WINLOOPBACK_H
+
+#include "WinError.hpp"
+#include "WinDriver.hpp"
+#include "WinSynthPipe.hpp"
+#include <windows.h>
+#include <mmddk.h>
+#include <atomic>
+#include <deque>
+#include <thread>
+
+/*
+
+	Loopback cable, what an app sends to the "Shakra Loopback" output port
+	comes out of the "Shakra Loopback" input device of another app.
+
+	It's the same pipe the synth uses, but with no ShakraHost on the other end:
+	- The input device owns the pipe, it creates it on MIDM_OPEN and reads it
+	  from a delivery thread, which also keeps the heartbeat going
+	- The output port is a producer like any other app, it connects to the pipe
+	  when the input device is there, and drops the events when it's not,
+	  like a cable with nothing plugged in. It looks for the input device again
+	  every LOOPBACK_RETRY_INTERVAL ms, so the two can be opened in any order
+
+	The delivery thread parks on the pipe's doorbell (see WinPipeExecutor.hpp)
+	when the cable is quiet, so an event gets to the other app as soon as it's
+	published, without a polling interval in between.
+
+	Short events become MIM_DATA, SysEx becomes MIM_LONGDATA, in the order the
+	app sent them. The timestamps are in ms since MIDM_START, taken from when the
+	app sent the event, not from when it got delivered.
+	A SysEx goes to the buffers added with MIDM_ADDBUFFER, split across more than
+	one if it doesn't fit. If there are no buffers left, the rest of it is dropped.
+
+	Only one app at a time can have the input device open.
+
+*/
+
+#define LOOPBACK_PIPE			L"Loopback"
+#define LOOPBACK_OWNER			L"Local\\ShakraLoopbackIn"
+#define LOOPBACK_BATCH			256		// Events delivered before the next heartbeat
+#define LOOPBACK_POLL_INTERVAL	10		// ms, the heartbeat needs the thread to wake up now and then
+#define LOOPBACK_RETRY_INTERVAL	250		// ms between two attempts to find the input device
+
+namespace WinDriver {
+	class LoopbackOutput {
+	private:
+		ErrorSystem::WinErr LoopErr;
+
+		SynthPipe Pipe;
+		ULONGLONG LastAttempt = 0;
+
+		bool Connect();
+
+	public:
+		void Open();
+		void Close();
+
+		bool SendShortEvent(DWORD Event);
+		unsigned int SendLongEvent(LPMIDIHDR Header);
+		unsigned int PrepareLongEvent(LPMIDIHDR Header) { return Pipe.PrepareLongEvent(Header); }
+		unsigned int UnprepareLongEvent(LPMIDIHDR Header) { return Pipe.UnprepareLongEvent(Header); }
+		void Reset();
+	};
+
+	class LoopbackInput {
+	private:
+		ErrorSystem::WinErr LoopErr;
+
+		SynthPipe Pipe;
+		DriverCallback Callback;
+		HANDLE Owner = nullptr;
+
+		// Set by the app's thread, read by the delivery thread. StartTime is stored before Started,
+		// so once the delivery thread sees Started, it sees the StartTime that goes with it
+		std::thread Delivery;
+		std::atomic<bool> Stopping{ false };
+		std::atomic<bool> Started{ false };
+		std::atomic<LONGLONG> StartTime{ 0 };
+		LARGE_INTEGER Frequency = { 0 };
+
+		SRWLOCK BufferLock = SRWLOCK_INIT;
+		std::deque<LPMIDIHDR> Buffers;		// Protected by BufferLock
+
+		void DeliveryLoop();
+		void DeliverLongEvent(const BYTE* Data, unsigned int Length, DWORD Timestamp);
+		DWORD GetTimestamp(unsigned long long Ticks);
+		void ReturnBuffers();
+
+	public:
+		unsigned int Open(LPMIDIOPENDESC Desc, DWORD Flags);
+		unsigned int Close();
+		unsigned int AddBuffer(LPMIDIHDR Header, DWORD Size);
+		unsigned int Start();
+		unsigned int Stop();
+		unsigned int Reset();
+	};
+}
+
+#endif
@@ -9,13 +9,33 @@ This file is useful only if you want to compile the driver under Windows, it's n
 
 #include "WinMain.hpp"
 
+// The direct API gets C linkage from the header, the .def file exports it on Windows
+#define SHAKRA_API
+#include "ShakraDirect.h"
+
 // Win32 components
 static WinDriver::DriverComponent DriverComponent;
 static WinDriver::DriverCallback DriverAppCallback;
 static WinDriver::DriverMask DriverMask;
+static WinDriver::DriverCallback LoopbackCallback;
+static WinDriver::AppProfiles ProfileSys;
 
 // Synth components
 static WinDriver::SynthPipe SynthSys;
+static WinDriver::EventCapture CaptureSys;
+static WinDriver::EventDecoder DecoderSys;
+static WinDriver::PipeMerger MergerSys;
+static WinDriver::SynthPipe TapSys;
+static WinDriver::JitterBuffer JitterSys;
+static WinDriver::SynthPipe DirectSys;
+static WinDriver::NetPipe NetSys;
+static SRWLOCK DirectLock = SRWLOCK_INIT;
+static LONG DirectRefs = 0;
+static DWORD DecoderBuf[MAX_DECODE_BATCH];
+
+// Loopback cable, see WinLoopback.hpp
+static WinDriver::LoopbackOutput LoopbackOut;
+static WinDriver::LoopbackInput LoopbackIn;
 
 // Error handler
 static ErrorSystem::WinErr DrvErr;
@@ -462,9 +482,73 @@ LRESULT __stdcall DriverProc(DWORD DriverIdentifier, HDRVR DriverHandle, UINT Me
 	return DefDriverProc(DriverIdentifier, DriverHandle, Message, Param1, Param2);
 }
 
+static unsigned int loopbackMessage(UINT Message, DWORD_PTR DriverAddress, DWORD_PTR Param1, DWORD_PTR Param2) {
+	unsigned int modM = MMSYSERR_NOERROR;
+
+	switch (Message) {
+	case MODM_DATA:
+		LoopbackOut.SendShortEvent((DWORD)Param1);
+		return MMSYSERR_NOERROR;
+
+	case MODM_LONGDATA:
+		modM = LoopbackOut.SendLongEvent((MIDIHDR*)Param1);
+		LoopbackCallback.CallbackFunction(MOM_DONE, Param1, 0);
+		return modM;
+
+	case MODM_PREPARE:
+		return LoopbackOut.PrepareLongEvent((MIDIHDR*)Param1);
+
+	case MODM_UNPREPARE:
+		return LoopbackOut.UnprepareLongEvent((MIDIHDR*)Param1);
+
+	case MODM_RESET:
+		LoopbackOut.Reset();
+		return MMSYSERR_NOERROR;
+
+	case MODM_OPEN:
+		if (!DriverComponent.OpenDriver((LPMIDIOPENDESC)Param1, (DWORD)Param2, DriverAddress)) {
+			NERROR(DrvErr, L"Failed to open the loopback port.", false);
+			return MIDIERR_NOTREADY;
+		}
+
+		// Never fails, the input device can show up later
+		LoopbackOut.Open();
+
+		LoopbackCallback.PrepareCallbackFunction((LPMIDIOPENDESC)Param1, (DWORD)Param2);
+		LoopbackCallback.CallbackFunction(MOM_OPEN, 0, 0);
+		return MMSYSERR_NOERROR;
+
+	case MODM_CLOSE:
+		LoopbackOut.Close();
+		LoopbackCallback.CallbackFunction(MOM_CLOSE, NULL, NULL);
+		LoopbackCallback.ClearCallbackFunction();
+		return MMSYSERR_NOERROR;
+
+	case MODM_GETDEVCAPS:
+		return DriverMask.GiveCaps(LOOPBACK_PORT, (PVOID)Param1, (DWORD)Param2);
+
+	case MODM_GETVOLUME:
+	case MODM_SETVOLUME:
+		return MMSYSERR_NOTSUPPORTED;
+
+	case MODM_CACHEPATCHES:
+	case MODM_CACHEDRUMPATCHES:
+	case DRV_QUERYDEVICEINTERFACESIZE:
+	case DRV_QUERYDEVICEINTERFACE:
+		return MMSYSERR_NOERROR;
+
+	default:
+		return MMSYSERR_ERROR;
+	}
+}
+
 unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAddress, DWORD_PTR Param1, DWORD_PTR Param2) {
 	unsigned int modM = MMSYSERR_NOERROR;
 
+	// The loopback port doesn't go to the synth
+	if (DeviceIdentifier == LOOPBACK_PORT && Message != MODM_GETNUMDEVS)
+		return loopbackMessage(Message, DriverAddress, Param1, Param2);
+
 	switch (Message) {
 	case MODM_DATA:
 		SynthSys.SaveShortEvent((DWORD)Param1);
@@ -484,13 +568,34 @@ unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAdd
 		return modM;
 
 	case MODM_RESET:
+		// Everything that's still queued gets skipped by the host, no need to wait for it
+		SynthSys.ResetStream();
+		SynthSys.RequestReset();
 		return MMSYSERR_NOERROR;
 
 	case MODM_GETVOLUME:
+		if (!Param1)
+			return MMSYSERR_INVALPARAM;
+
+		*(LPDWORD)Param1 = SynthSys.GetVolume();
+		return MMSYSERR_NOERROR;
+
 	case MODM_SETVOLUME:
+		// Goes straight to the control page, the host picks it up on its next block
+		SynthSys.SetVolume((DWORD)Param1);
 		return MMSYSERR_NOERROR;
 
-	case MODM_OPEN:
+	case MODM_OPEN: {
+		AppProfile Profile;
+
+		// Resolved once, the pipe keeps a copy of it
+		ProfileSys.Resolve(&Profile);
+
+		if (Profile.Flags & PROFILE_BLOCK) {
+			LOG(DrvErr, L"The app is blocked by its profile.");
+			return MMSYSERR_NOTENABLED;
+		}
+
 		// Open the driver, and if everything goes fine, inform the app through a callback
 		if (DriverComponent.OpenDriver((LPMIDIOPENDESC)Param1, (DWORD)Param2, DriverAddress)) {
 			// Driver is busy in MODM_OPEN, reject any other MODM_OPEN/MODM_CLOSE call for the time being
@@ -503,6 +608,11 @@ unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAdd
 				return MMSYSERR_ERROR;
 			}
 
+			SynthSys.SetProfile(&Profile);
+
+			// Only does something in the builds with the trace points
+			WinDriver::Trace::StartFromEnvironment();
+
 			DriverAppCallback.PrepareCallbackFunction((LPMIDIOPENDESC)Param1, (DWORD)Param2);
 			DriverAppCallback.CallbackFunction(MOM_OPEN, 0, 0);
 
@@ -513,6 +623,7 @@ unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAdd
 		// Something went wrong, the driver failed to open
 		NERROR(DrvErr, L"Failed to open driver.", false);
 		return MIDIERR_NOTREADY;
+	}
 
 	case MODM_CLOSE:
 		// The driver isn't done opening the stream
@@ -522,19 +633,71 @@ unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAdd
 		}
 
 		SynthSys.ClosePipe();
+		WinDriver::Trace::Stop();
 		DriverAppCallback.CallbackFunction(MOM_CLOSE, NULL, NULL);
 		DriverAppCallback.ClearCallbackFunction();
 
 		return MMSYSERR_NOERROR;
 
 	case MODM_GETNUMDEVS:
-		return 0x1;
+		// The synth and the loopback port
+		return 0x2;
 
 	case MODM_GETDEVCAPS:
 		return DriverMask.GiveCaps(DeviceIdentifier, (PVOID)Param1, (DWORD)Param2);
 
+	// The bank (or the drum kit) is in the high word, the flags in the low one
 	case MODM_CACHEPATCHES:
+		return SynthSys.CachePatches(HIWORD(Param2), (WORD*)Param1, LOWORD(Param2));
+
 	case MODM_CACHEDRUMPATCHES:
+		return SynthSys.CacheDrumPatches(HIWORD(Param2), (WORD*)Param1, LOWORD(Param2));
+
+	case DRV_QUERYDEVICEINTERFACESIZE:
+	case DRV_QUERYDEVICEINTERFACE:
+		return MMSYSERR_NOERROR;
+
+	default:
+		return MMSYSERR_ERROR;
+	}
+}
+
+unsigned int midMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAddress, DWORD_PTR Param1, DWORD_PTR Param2) {
+	switch (Message) {
+	case MIDM_OPEN:
+		if (!DriverComponent.OpenDriver((LPMIDIOPENDESC)Param1, (DWORD)Param2, DriverAddress)) {
+			NERROR(DrvErr, L"Failed to open the loopback input device.", false);
+			return MIDIERR_NOTREADY;
+		}
+
+		return LoopbackIn.Open((LPMIDIOPENDESC)Param1, (DWORD)Param2);
+
+	case MIDM_CLOSE:
+		return LoopbackIn.Close();
+
+	case MIDM_ADDBUFFER:
+		return LoopbackIn.AddBuffer((LPMIDIHDR)Param1, (DWORD)Param2);
+
+	case MIDM_START:
+		return LoopbackIn.Start();
+
+	case MIDM_STOP:
+		return LoopbackIn.Stop();
+
+	case MIDM_RESET:
+		return LoopbackIn.Reset();
+
+	case MIDM_PREPARE:
+	case MIDM_UNPREPARE:
+		// WinMM prepares the buffers itself
+		return MMSYSERR_NOTSUPPORTED;
+
+	case MIDM_GETNUMDEVS:
+		return 0x1;
+
+	case MIDM_GETDEVCAPS:
+		return DriverMask.GiveInputCaps(DeviceIdentifier, (PVOID)Param1, (DWORD)Param2);
+
 	case DRV_QUERYDEVICEINTERFACESIZE:
 	case DRV_QUERYDEVICEINTERFACE:
 		return MMSYSERR_NOERROR;
@@ -544,6 +707,118 @@ unsigned int modMessage(UINT DeviceIdentifier, UINT Message, DWORD_PTR DriverAdd
 	}
 }
 
+//
+// DIRECT PRODUCER API, USED BY THE APPS, SEE ShakraDirect.h
+//
+
+bool WINAPI ShakraInitialize() {
+	bool Ret = true;
+
+	AcquireSRWLockExclusive(&DirectLock);
+
+	// Its own pipe, so it doesn't get in the way of the WinMM side of the same app
+	if (!DirectRefs) {
+		AppProfile Profile;
+
+		// Same profile as the WinMM side
+		ProfileSys.Resolve(&Profile);
+
+		if (Profile.Flags & PROFILE_BLOCK) {
+			ReleaseSRWLockExclusive(&DirectLock);
+			LOG(DrvErr, L"The app is blocked by its profile.");
+			return false;
+		}
+
+		Ret = DirectSys.PrepareFileMappings(0, false, 0);
+
+		if (Ret) {
+			DirectSys.SetProfile(&Profile);
+			WinDriver::Trace::StartFromEnvironment();
+		}
+		else NERROR(DrvErr, L"Failed to open the direct API's pipe.", false);
+	}
+
+	if (Ret)
+		DirectRefs++;
+
+	ReleaseSRWLockExclusive(&DirectLock);
+	return Ret;
+}
+
+bool WINAPI ShakraTerminate() {
+	AcquireSRWLockExclusive(&DirectLock);
+
+	if (!DirectRefs) {
+		ReleaseSRWLockExclusive(&DirectLock);
+		LOG(DrvErr, L"ShakraTerminate() called without a ShakraInitialize().");
+		return false;
+	}
+
+	if (!--DirectRefs) {
+		DirectSys.ClosePipe();
+		WinDriver::Trace::Stop();
+	}
+
+	ReleaseSRWLockExclusive(&DirectLock);
+	return true;
+}
+
+// The sends hold DirectLock shared, so that ShakraTerminate() can't close the pipe under them
+bool WINAPI ShakraSendDirect(DWORD Event) {
+	AcquireSRWLockShared(&DirectLock);
+	bool Ret = DirectRefs && DirectSys.SaveShortEvent(Event);
+	ReleaseSRWLockShared(&DirectLock);
+
+	return Ret;
+}
+
+unsigned int WINAPI ShakraSendDirectBatch(const DWORD* Events, unsigned int Count) {
+	unsigned int Ret = 0;
+
+	if (!Events)
+		return 0;
+
+	AcquireSRWLockShared(&DirectLock);
+	if (DirectRefs) Ret = DirectSys.SaveShortEvents(Events, Count);
+	ReleaseSRWLockShared(&DirectLock);
+
+	return Ret;
+}
+
+unsigned int WINAPI ShakraSendDirectLong(const BYTE* Data, DWORD Length) {
+	MIDIHDR Header = { 0 };
+	unsigned int Ret;
+
+	if (!Data || !Length)
+		return MMSYSERR_INVALPARAM;
+
+	// SaveLongEvent() copies the data, so the header can live on the stack
+	Header.lpData = (LPSTR)Data;
+	Header.dwBufferLength = Length;
+	Header.dwBytesRecorded = Length;
+
+	AcquireSRWLockShared(&DirectLock);
+
+	if (!DirectRefs)
+		Ret = MIDIERR_NOTREADY;
+	else if ((Ret = DirectSys.PrepareLongEvent(&Header)) == MMSYSERR_NOERROR)
+		Ret = DirectSys.SaveLongEvent(&Header);
+
+	ReleaseSRWLockShared(&DirectLock);
+	return Ret;
+}
+
+bool WINAPI ShakraSendDirectUMP(const DWORD* Words) {
+	if (!Words)
+		return false;
+
+	AcquireSRWLockShared(&DirectLock);
+	bool Ret = DirectRefs && DirectSys.SaveUMPPacket(Words);
+	ReleaseSRWLockShared(&DirectLock);
+
+	return Ret;
+}
+
 //
 // USED INTERNALLY BY SHAKRA HOST
 //
@@ -552,6 +827,10 @@ bool WINAPI SH_CP(const wchar_t* Pipe, int Size) {
 	return SynthSys.PrepareFileMappings(Pipe, true, Size);
 }
 
+bool WINAPI SH_CPM(const wchar_t* Pipe, int Size, DWORD Mode) {
+	return SynthSys.PrepareFileMappings(Pipe, true, Size, Mode);
+}
+
 unsigned int WINAPI SH_PSE() {
 	return SynthSys.ParseShortEvent();
 }
@@ -560,6 +839,14 @@ unsigned int WINAPI SH_PLE(BYTE* PEvent) {
 	return SynthSys.ParseLongEvent(PEvent);
 }
 
+unsigned int WINAPI SH_PLER(const BYTE** PEvent) {
+	return SynthSys.ParseLongEventRef(PEvent);
+}
+
+bool WINAPI SH_FLE() {
+	return SynthSys.FreeLongEvent();
+}
+
 void WINAPI SH_RRHIN() {
 	SynthSys.ResetReadHeadsIfNeeded();
 }
@@ -574,4 +861,306 @@ int WINAPI SH_GWHP() {
 
 bool WINAPI SH_BC() {
 	return SynthSys.PerformBufferCheck();
+}
+
+unsigned int WINAPI SH_PSEB(BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2, unsigned int Max) {
+	unsigned int Count = SynthSys.ParseShortEvents(DecoderBuf, min(Max, (unsigned int)MAX_DECODE_BATCH));
+	return DecoderSys.Decode(DecoderBuf, Count, Status, Channel, Data1, Data2);
+}
+
+unsigned int WINAPI SH_PUP(DWORD* Words, unsigned int MaxWords) {
+	return SynthSys.ParseUMPPackets(Words, MaxWords);
+}
+
+bool WINAPI SH_RCS(PCtlState State) {
+	return SynthSys.ReadControl(State);
+}
+
+bool WINAPI SH_RCH(PChsState State) {
+	return SynthSys.ReadChannelState(State);
+}
+
+unsigned int WINAPI SH_CSE(DWORD* Events, unsigned int Max) {
+	return SynthSys.BuildSyncEvents(Events, Max);
+}
+
+LONG WINAPI SH_PHC() {
+	return SynthSys.GetPatchHintChanges();
+}
+
+bool WINAPI SH_RPH(PPchState Hints) {
+	return SynthSys.ReadPatchHints(Hints);
+}
+
+void WINAPI SH_SHS(DWORD Status) {
+	SynthSys.SetHostStatus(Status);
+}
+
+void WINAPI SH_SMU(bool Mute) {
+	SynthSys.SetMute(Mute);
+}
+
+void WINAPI SH_SBP(LONG Policy) {
+	SynthSys.SetBroadcastPolicy(Policy);
+}
+
+void WINAPI SH_SPC(const DWORD* Mask) {
+	SynthSys.SetPriorityCCs(Mask);
+}
+
+void WINAPI SH_SPB(DWORD Batch, DWORD Delay) {
+	SynthSys.SetPublishBatching(Batch, Delay);
+}
+
+void WINAPI SH_STR(const TransformRules* Rules) {
+	SynthSys.SetTransform(Rules);
+}
+
+//
+// JITTER BUFFER, USED BY SHAKRA HOST
+//
+
+bool WINAPI SH_JBS(DWORD SampleRate, DWORD MinLatencyMs, DWORD MaxLatencyMs) {
+	return JitterSys.Start(&SynthSys, SampleRate, MinLatencyMs, MaxLatencyMs);
+}
+
+void WINAPI SH_JBX() {
+	JitterSys.Stop();
+}
+
+unsigned int WINAPI SH_JBP(BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2, DWORD* Offsets, unsigned int Max, unsigned int Frames) {
+	unsigned int Count = JitterSys.Pull(DecoderBuf, Offsets, min(Max, (unsigned int)MAX_DECODE_BATCH), Frames);
+	return DecoderSys.Decode(DecoderBuf, Count, Status, Channel, Data1, Data2);
+}
+
+bool WINAPI SH_JBL(unsigned int Frames) {
+	return JitterSys.IsLongEventDue(Frames);
+}
+
+void WINAPI SH_JBG(PJitterStats Stats) {
+	JitterSys.GetStats(Stats);
+}
+
+//
+// TRACING, USED BY SHAKRA HOST
+//
+
+bool WINAPI SH_TRS(const wchar_t* Path, DWORD Format) {
+	return WinDriver::Trace::Start(Path, Format);
+}
+
+void WINAPI SH_TRX() {
+	WinDriver::Trace::Stop();
+}
+
+// Marks the events dequeued by this thread as handed to the synth
+void WINAPI SH_TRD() {
+	SHAKRA_TRACE(TRACE_DISPATCH, WinDriver::Trace::GetLastDequeued());
+}
+
+//
+// TAPS, USED BY MONITORING TOOLS
+//
+
+bool WINAPI SH_TO(const wchar_t* Pipe) {
+	return TapSys.OpenTap(Pipe);
+}
+
+unsigned int WINAPI SH_TR(DWORD* Events, unsigned int Max) {
+	return TapSys.ParseShortEvents(Events, Max);
+}
+
+bool WINAPI SH_TC() {
+	return TapSys.ClosePipe();
+}
+
+//
+// FAILOVER, USED BY SHAKRA HOST
+//
+
+bool WINAPI SH_OSB(const wchar_t* Pipe) {
+	return SynthSys.OpenStandby(Pipe);
+}
+
+bool WINAPI SH_WFT(DWORD Timeout) {
+	return SynthSys.WaitForTakeOver(Timeout);
+}
+
+bool WINAPI SH_HB() {
+	return SynthSys.Heartbeat();
+}
+
+bool WINAPI SH_RHL(PHostLiveness Liveness) {
+	return SynthSys.ReadLiveness(Liveness);
+}
+
+//
+// ROUTING, USED BY SHAKRA HOST
+// The routed hosts open their route instead of the pipe, then read it like the owner does,
+// and beat through SH_HB like the owner, or the producer gives their events back to it
+//
+
+bool WINAPI SH_SRT(const RouteRules* Rules) {
+	return SynthSys.SetRoutes(Rules);
+}
+
+bool WINAPI SH_ORT(const wchar_t* Pipe, BYTE Route, int Size) {
+	return SynthSys.OpenRoute(Pipe, Route, Size);
+}
+
+bool WINAPI SH_SRK(DWORD SampleRate, DWORD LatencyMs) {
+	return SynthSys.SetRouteClock(SampleRate, LatencyMs);
+}
+
+bool WINAPI SH_RRK(PRouteClock Clock) {
+	return SynthSys.ReadRouteClock(Clock);
+}
+
+bool WINAPI SH_JBC() {
+	return JitterSys.StartShared(&SynthSys);
+}
+
+//
+// MULTIPLE PIPES, USED BY SHAKRA HOST
+//
+
+int WINAPI SH_MA(const wchar_t* Pipe, int Size) {
+	return MergerSys.AddSource(Pipe, Size);
+}
+
+bool WINAPI SH_MD(int Source) {
+	return MergerSys.RemoveSource(Source);
+}
+
+void WINAPI SH_MF(unsigned int MaxPerSource) {
+	MergerSys.SetFairness(MaxPerSource);
+}
+
+bool WINAPI SH_MBP(int Source, DWORD Mode, DWORD MaxPending) {
+	return MergerSys.SetBackPressure(Source, Mode, MaxPending);
+}
+
+unsigned int WINAPI SH_MB(BYTE* Status, BYTE* Channel, BYTE* Data1, BYTE* Data2, unsigned int Max) {
+	// The merger already resolved the running status of each pipe
+	unsigned int Count = MergerSys.Merge(DecoderBuf, min(Max, (unsigned int)MAX_DECODE_BATCH));
+	return DecoderSys.Decode(DecoderBuf, Count, Status, Channel, Data1, Data2);
+}
+
+unsigned int WINAPI SH_MLR(const BYTE** PEvent) {
+	return MergerSys.ParseLongEventRef(PEvent);
+}
+
+bool WINAPI SH_MLF() {
+	return MergerSys.FreeLongEvent();
+}
+
+//
+// OFFLINE RENDERING, USED BY SHAKRA HOST
+//
+
+bool WINAPI SH_OCF(const wchar_t* Path) {
+	return CaptureSys.OpenCapture(Path);
+}
+
+bool WINAPI SH_CCF() {
+	return CaptureSys.CloseCapture();
+}
+
+unsigned int WINAPI SH_FCE(unsigned long long Timestamp) {
+	return CaptureSys.FeedCapture(&SynthSys, Timestamp);
+}
+
+unsigned long long WINAPI SH_GCL() {
+	return CaptureSys.GetCaptureLength();
+}
+
+bool WINAPI SH_ICD() {
+	return CaptureSys.IsCaptureDone();
+}
+
+bool WINAPI SH_CSMF(const wchar_t* SMFPath, const wchar_t* Path) {
+	return CaptureSys.ConvertSMF(SMFPath, Path);
+}
+
+bool WINAPI SH_SCR(const wchar_t* Path) {
+	if (!CaptureSys.StartRecording(Path))
+		return false;
+
+	SynthSys.SetRecorder(&CaptureSys);
+	return true;
+}
+
+bool WINAPI SH_ECR() {
+	SynthSys.SetRecorder(nullptr);
+	return CaptureSys.StopRecording();
+}
+
+//
+// REMOTE RENDER NODES, USED BY SHAKRA HOST
+// The host connects to the node, then forwards its pipe to it through SH_NF instead of rendering it,
+// the node listens with SH_NL and reads the events with SH_NP, see WinNetPipe.hpp
+//
+
+bool WINAPI SH_NC(const char* Address) {
+	return NetSys.Connect(Address);
+}
+
+// Both queues merged by their timestamps, so that a SysEx reaches the node between the notes the app sent it between,
+// with the QPC timestamps the apps gave them turned into microseconds
+unsigned int WINAPI SH_NF(unsigned int Max) {
+	LARGE_INTEGER Freq;
+	unsigned long long ShortTime, LongTime;
+	const BYTE* Data;
+	DWORD Event, Length;
+	unsigned int Count = 0;
+
+	if (!NetSys.IsConnected())
+		return 0;
+
+	QueryPerformanceFrequency(&Freq);
+
+	auto ToMicroseconds = [&Freq](unsigned long long Ticks) {
+		return (Ticks / Freq.QuadPart) * 1000000 + (Ticks % Freq.QuadPart) * 1000000 / Freq.QuadPart;
+	};
+
+	bool HasShort = SynthSys.PeekShortEvent(&Event, &ShortTime);
+	bool HasLong = SynthSys.PeekLongEvent(&LongTime);
+
+	while (Count < Max && (HasShort || HasLong)) {
+		// On a tie the SysEx goes first, a reset usually comes before the events that rely on it
+		if (HasLong && (!HasShort || LongTime <= ShortTime)) {
+			if ((Length = SynthSys.ParseLongEventRef(&Data)) > 0)
+				NetSys.SaveLongEvent(Data, Length, ToMicroseconds(LongTime), true);
+
+			SynthSys.FreeLongEvent();
+			HasLong = SynthSys.PeekLongEvent(&LongTime);
+		}
+		else {
+			SynthSys.PopShortEvent();
+			NetSys.SaveShortEvent(Event, ToMicroseconds(ShortTime), true);
+			HasShort = SynthSys.PeekShortEvent(&Event, &ShortTime);
+		}
+
+		Count++;
+	}
+
+	// The node already has them, there's nothing to throw away anymore
+	SynthSys.FlushShortEvents();
+
+	// Everything that got drained goes out in a single frame, nothing waits for the next call
+	NetSys.Flush();
+	return Count;
+}
+
+// Waits for the host to connect
+bool WINAPI SH_NL(const char* Address) {
+	return NetSys.Listen(Address) && NetSys.Accept();
+}
+
+unsigned int WINAPI SH_NP(PNetEvent Events, unsigned int Max) {
+	return NetSys.ParseEvents(Events, Max);
+}
+
+bool WINAPI SH_NX() {
+	return NetSys.ClosePipe();
 }
\ No newline at end of file
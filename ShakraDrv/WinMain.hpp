@@ -8,9 +8,16 @@ This file is useful only if you want to compile the driver under Windows, it's n
 
 #pragma once
 
+// First, Winsock 2 has to come before windows.h, see WinNetPipe.hpp
+#include "WinNetPipe.hpp"
 #include "WinError.hpp"
 #include "WinDriver.hpp"
 #include "WinSynthPipe.hpp"
+#include "WinEvCapture.hpp"
+#include "WinEvDecoder.hpp"
+#include "WinPipeMerger.hpp"
+#include "WinJitterBuffer.hpp"
+#include "WinLoopback.hpp"
 #include "WinVars.hpp"
 #include <devguid.h>
 #include <newdev.h>
@@ -0,0 +1,406 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+Unlike the other components, the socket transport also builds on Linux, so that render nodes can run there.
+*/
+
+#include "WinNetPipe.hpp"
+#include <chrono>
+
+#ifdef _WIN32
+#include <afunix.h>
+#define NET_CLOSE(x)	closesocket(x)
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define NET_CLOSE(x)	close(x)
+#endif
+
+// A consumer that's gone would raise SIGPIPE on Linux, which kills the process, Winsock never raises it
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0
+#endif
+
+WinDriver::NetPipe::~NetPipe() {
+	ClosePipe();
+}
+
+bool WinDriver::NetPipe::StartupSockets() {
+#ifdef _WIN32
+	static bool Ready = false;
+	WSADATA WSAData;
+
+	if (!Ready)
+		Ready = (WSAStartup(MAKEWORD(2, 2), &WSAData) == 0);
+
+	return Ready;
+#else
+	return true;
+#endif
+}
+
+unsigned long long WinDriver::NetPipe::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+NetSocket WinDriver::NetPipe::OpenSocket(const char* Address, bool Server) {
+	NetSocket Socket = NET_INVALID_SOCKET;
+
+	if (!StartupSockets()) {
+		NERROR(NetErr, L"Failed to initialize the sockets.", false);
+		return NET_INVALID_SOCKET;
+	}
+
+	if (!strncmp(Address, "unix:", 5)) {
+		sockaddr_un Addr;
+
+		memset(&Addr, 0, sizeof(Addr));
+		Addr.sun_family = AF_UNIX;
+		strncpy(Addr.sun_path, Address + 5, sizeof(Addr.sun_path) - 1);
+
+		Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (Socket == NET_INVALID_SOCKET) {
+			NERROR(NetErr, L"Failed to create the Unix domain socket.", false);
+			return NET_INVALID_SOCKET;
+		}
+
+		if (Server) {
+			// A stale socket file from a previous run would make bind() fail
+#ifdef _WIN32
+			DeleteFileA(Addr.sun_path);
+#else
+			unlink(Addr.sun_path);
+#endif
+			strncpy(UnixPath, Addr.sun_path, sizeof(UnixPath) - 1);
+
+			if (bind(Socket, (sockaddr*)&Addr, sizeof(Addr)) || listen(Socket, 1)) {
+				NERROR(NetErr, L"Failed to listen on the Unix domain socket.", false);
+				NET_CLOSE(Socket);
+				return NET_INVALID_SOCKET;
+			}
+		}
+		else if (connect(Socket, (sockaddr*)&Addr, sizeof(Addr))) {
+			NERROR(NetErr, L"Failed to connect to the Unix domain socket.", false);
+			NET_CLOSE(Socket);
+			return NET_INVALID_SOCKET;
+		}
+
+		return Socket;
+	}
+
+	if (!strncmp(Address, "tcp:", 4)) {
+		char Host[NET_MAX_ADDRESS] = { 0 };
+		const char* Port = strrchr(Address + 4, ':');
+		addrinfo Hints, *Result = nullptr;
+		int NoDelay = 1, Reuse = 1;
+
+		if (!Port || (size_t)(Port - (Address + 4)) >= sizeof(Host)) {
+			NERROR(NetErr, L"The TCP address has to be in the \"tcp:host:port\" format.", false);
+			return NET_INVALID_SOCKET;
+		}
+
+		memcpy(Host, Address + 4, Port - (Address + 4));
+
+		memset(&Hints, 0, sizeof(Hints));
+		Hints.ai_family = AF_UNSPEC;
+		Hints.ai_socktype = SOCK_STREAM;
+		Hints.ai_flags = Server ? AI_PASSIVE : 0;
+
+		if (getaddrinfo(Host, Port + 1, &Hints, &Result) || !Result) {
+			NERROR(NetErr, L"Failed to resolve the TCP address.", false);
+			return NET_INVALID_SOCKET;
+		}
+
+		Socket = socket(Result->ai_family, Result->ai_socktype, Result->ai_protocol);
+		if (Socket == NET_INVALID_SOCKET) {
+			NERROR(NetErr, L"Failed to create the TCP socket.", false);
+			freeaddrinfo(Result);
+			return NET_INVALID_SOCKET;
+		}
+
+		// The frames are already batched, Nagle would only add latency on top
+		setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&NoDelay, sizeof(NoDelay));
+
+		if (Server) {
+			setsockopt(Socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&Reuse, sizeof(Reuse));
+
+			if (bind(Socket, Result->ai_addr, (int)Result->ai_addrlen) || listen(Socket, 1)) {
+				NERROR(NetErr, L"Failed to listen on the TCP socket.", false);
+				NET_CLOSE(Socket);
+				Socket = NET_INVALID_SOCKET;
+			}
+		}
+		else if (connect(Socket, Result->ai_addr, (int)Result->ai_addrlen)) {
+			NERROR(NetErr, L"Failed to connect to the TCP socket.", false);
+			NET_CLOSE(Socket);
+			Socket = NET_INVALID_SOCKET;
+		}
+
+		freeaddrinfo(Result);
+		return Socket;
+	}
+
+	NERROR(NetErr, L"Unknown address type, use \"unix:\" or \"tcp:\".", false);
+	return NET_INVALID_SOCKET;
+}
+
+bool WinDriver::NetPipe::SendAll(const BYTE* Data, size_t Len) {
+	while (Len > 0) {
+		int Sent = send(Peer, (const char*)Data, (int)Len, MSG_NOSIGNAL);
+
+		if (Sent <= 0)
+			return false;
+
+		Data += Sent;
+		Len -= Sent;
+	}
+
+	return true;
+}
+
+bool WinDriver::NetPipe::RecvAll(BYTE* Data, size_t Len) {
+	while (Len > 0) {
+		int Read = recv(Peer, (char*)Data, (int)Len, 0);
+
+		if (Read <= 0)
+			return false;
+
+		Data += Read;
+		Len -= Read;
+	}
+
+	return true;
+}
+
+bool WinDriver::NetPipe::Listen(const char* Address) {
+	if (Listener != NET_INVALID_SOCKET || Peer != NET_INVALID_SOCKET) {
+		LOG(NetErr, L"The pipe is already open.");
+		return false;
+	}
+
+	Listener = OpenSocket(Address, true);
+	return Listener != NET_INVALID_SOCKET;
+}
+
+bool WinDriver::NetPipe::Accept() {
+	if (Listener == NET_INVALID_SOCKET)
+		return false;
+
+	Peer = accept(Listener, nullptr, nullptr);
+
+	if (Peer == NET_INVALID_SOCKET) {
+		NERROR(NetErr, L"Failed to accept the producer.", false);
+		return false;
+	}
+
+	RecvCount = RecvPos = 0;
+	return true;
+}
+
+void WinDriver::NetPipe::DropPeer() {
+	if (Peer != NET_INVALID_SOCKET) {
+		NET_CLOSE(Peer);
+		Peer = NET_INVALID_SOCKET;
+	}
+
+	RecvCount = RecvPos = 0;
+}
+
+bool WinDriver::NetPipe::Connect(const char* Address) {
+	if (Listener != NET_INVALID_SOCKET || Peer != NET_INVALID_SOCKET) {
+		LOG(NetErr, L"The pipe is already open.");
+		return false;
+	}
+
+	Peer = OpenSocket(Address, false);
+	if (Peer == NET_INVALID_SOCKET)
+		return false;
+
+	Frame.reserve(sizeof(NetFrameHeader) + NET_MAX_FRAME + sizeof(NetRecord));
+	Frame.resize(sizeof(NetFrameHeader));
+	Sending.reserve(Frame.capacity());
+	FrameCount = 0;
+
+	return true;
+}
+
+bool WinDriver::NetPipe::AppendRecord(unsigned long long Timestamp, DWORD Event, const BYTE* Data, DWORD Len, bool More) {
+	std::unique_lock<std::mutex> Lock(FrameLock);
+	NetRecord Record = { Timestamp ? Timestamp : Now(), Len, Event };
+
+	if (Peer == NET_INVALID_SOCKET)
+		return false;
+
+	// Make room first, a single record is allowed to be bigger than NET_MAX_FRAME.
+	// If the frame is full while the previous one is still on its way, the consumer is slow, wait for it
+	while (FrameCount && Frame.size() - sizeof(NetFrameHeader) + sizeof(NetRecord) + Len > NET_MAX_FRAME) {
+		if (Busy) SendDone.wait(Lock);
+		else if (!SendFrames(Lock)) return false;
+	}
+
+	Frame.insert(Frame.end(), (const BYTE*)&Record, (const BYTE*)&Record + sizeof(Record));
+	if (Len) Frame.insert(Frame.end(), Data, Data + Len);
+	FrameCount++;
+
+	// Another thread is sending, it takes this one too once it's done
+	if (Busy)
+		return true;
+
+	if (More && Frame.size() - sizeof(NetFrameHeader) < NET_MAX_FRAME)
+		return true;
+
+	return SendFrames(Lock);
+}
+
+bool WinDriver::NetPipe::SendFrames(std::unique_lock<std::mutex>& Lock) {
+	bool Sent = true;
+
+	if (!FrameCount)
+		return true;
+
+	Busy = true;
+
+	// Whatever got queued while a frame was on its way goes out right after it
+	while (Sent && FrameCount) {
+		PNetFrameHeader Header = (PNetFrameHeader)Frame.data();
+		Header->Magic = NET_FRAME_MAGIC;
+		Header->Length = (DWORD)(Frame.size() - sizeof(NetFrameHeader));
+		Header->Count = FrameCount;
+		Header->Reserved = 0;
+
+		Sending.swap(Frame);
+		Frame.resize(sizeof(NetFrameHeader));
+		FrameCount = 0;
+
+		// The producers can fill the next frame while this one is on its way
+		Lock.unlock();
+		Sent = SendAll(Sending.data(), Sending.size());
+		Lock.lock();
+	}
+
+	Busy = false;
+	SendDone.notify_all();
+
+	if (!Sent)
+		NERROR(NetErr, L"Failed to send the frame, the consumer might be gone.", false);
+
+	return Sent;
+}
+
+bool WinDriver::NetPipe::SaveShortEvent(unsigned int Event, unsigned long long Timestamp, bool More) {
+	return AppendRecord(Timestamp, Event, nullptr, 0, More);
+}
+
+bool WinDriver::NetPipe::SaveLongEvent(const BYTE* Data, DWORD Len, unsigned long long Timestamp, bool More) {
+	if (!Data || !Len || Len > MAX_LE_SIZE)
+		return false;
+
+	return AppendRecord(Timestamp, 0, Data, Len, More);
+}
+
+bool WinDriver::NetPipe::Flush() {
+	std::unique_lock<std::mutex> Lock(FrameLock);
+
+	// A frame on its way takes everything queued behind it
+	while (Busy)
+		SendDone.wait(Lock);
+
+	return SendFrames(Lock);
+}
+
+unsigned int WinDriver::NetPipe::ParseEvents(PNetEvent Target, unsigned int Max) {
+	unsigned int Count = 0;
+
+	if (Peer == NET_INVALID_SOCKET || !Max)
+		return 0;
+
+	// Wait for the next frame only if the current one is done
+	if (RecvCount == 0) {
+		NetFrameHeader Header;
+
+		if (!RecvAll((BYTE*)&Header, sizeof(Header)) || Header.Magic != NET_FRAME_MAGIC || Header.Length > NET_MAX_PAYLOAD) {
+			LOG(NetErr, L"The producer is gone, or it sent a broken frame.");
+			DropPeer();
+			return 0;
+		}
+
+		RecvFrame.resize(Header.Length);
+		if (!RecvAll(RecvFrame.data(), Header.Length)) {
+			LOG(NetErr, L"The producer is gone in the middle of a frame.");
+			DropPeer();
+			return 0;
+		}
+
+		RecvCount = Header.Count;
+		RecvPos = 0;
+	}
+
+	while (Count < Max && RecvCount > 0) {
+		NetRecord Record;
+
+		// Copied out, the records after a long event aren't aligned anymore
+		if (RecvFrame.size() - RecvPos < sizeof(NetRecord))
+			break;
+
+		memcpy(&Record, RecvFrame.data() + RecvPos, sizeof(NetRecord));
+
+		if (RecvFrame.size() - RecvPos - sizeof(NetRecord) < Record.Length)
+			break;
+
+		RecvPos += sizeof(NetRecord);
+
+		Target[Count].Timestamp = Record.Timestamp;
+		Target[Count].Event = Record.Event;
+		Target[Count].Length = Record.Length;
+		Target[Count].Data = Record.Length ? RecvFrame.data() + RecvPos : nullptr;
+
+		RecvPos += Record.Length;
+		RecvCount--;
+		Count++;
+	}
+
+	// The records don't fit in the frame, the rest of it can't be trusted, drop it.
+	// The next frame starts where the header said, so the stream itself is fine
+	if (RecvCount > 0 && Count < Max) {
+		LOG(NetErr, L"The producer sent a frame with broken records, the rest of it has been dropped.");
+		RecvCount = 0;
+	}
+
+	return Count;
+}
+
+bool WinDriver::NetPipe::ClosePipe() {
+	// Whatever the producer held back with More, the socket can't go away under a send either
+	{
+		std::unique_lock<std::mutex> Lock(FrameLock);
+
+		while (Busy)
+			SendDone.wait(Lock);
+
+		if (Peer != NET_INVALID_SOCKET)
+			SendFrames(Lock);
+
+		Frame.clear();
+		FrameCount = 0;
+	}
+
+	DropPeer();
+
+	if (Listener != NET_INVALID_SOCKET) {
+		NET_CLOSE(Listener);
+		Listener = NET_INVALID_SOCKET;
+
+#ifndef _WIN32
+		if (UnixPath[0])
+			unlink(UnixPath);
+#endif
+		UnixPath[0] = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,148 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+Unlike the other components, the socket transport also builds on Linux, so that render nodes can run there.
+*/
+
+#pragma once
+
+#ifndef WINNETPIPE_H
+
+#define WINNETPIPE_H
+
+// Winsock 2 has to come before windows.h, or the old winsock.h gets pulled in
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include "WinError.hpp"
+#include "WinVars.hpp"
+#include <windows.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+typedef SOCKET NetSocket;
+#define NET_INVALID_SOCKET	INVALID_SOCKET
+#else
+typedef int NetSocket;
+#define NET_INVALID_SOCKET	-1
+#endif
+
+/*
+
+	Same job as SynthPipe, but over a socket, so that the synth can run on
+	another machine (a render node).
+
+	Addresses:
+	- "unix:/path/to/socket" for Unix domain sockets
+	- "tcp:host:port" for TCP, with Nagle turned off
+
+	The events travel in length-framed batches:
+	- NetFrameHeader, with the size of the payload and how many records it holds
+	- A NetRecord per event, with long events followed by their data
+	The timestamps are the ones the events had on the producer's machine.
+
+	The producer never holds an event back on a guess, an event with nothing
+	queued behind it goes out right away. The events only get aggregated when
+	there's a backlog:
+	- While a frame is on its way, whatever comes in meanwhile gets queued, and
+	  the thread that's sending takes it out right after, as a single frame
+	- The caller can pass More when it knows other events are right behind,
+	  like SH_NF draining the pipe, the last one (or Flush()) sends the frame
+	A frame always goes out as soon as it reaches NET_MAX_FRAME bytes.
+
+	The frame being filled and the one being sent are two buffers, swapped under
+	FrameLock, so a send() that blocks on a slow consumer doesn't hold it, and
+	the producers can keep filling the next frame meanwhile. Only one thread
+	sends at a time (Busy), so the frames still go out in order.
+
+	A frame can't be bigger than NET_MAX_PAYLOAD, a single long event of
+	MAX_LE_SIZE bytes included. The consumer drops the connection on anything
+	bigger, or with the wrong magic, since it can't find the next frame anymore.
+
+*/
+
+#define NET_FRAME_MAGIC		0x4E4B4853	// 'SHKN'
+#define NET_MAX_FRAME		65536		// Bytes of payload per frame
+#define NET_MAX_ADDRESS		256
+#define NET_MAX_PAYLOAD		(NET_MAX_FRAME + MAX_LE_SIZE)
+
+typedef struct {
+	DWORD Magic;
+	DWORD Length;		// Payload size, in bytes
+	DWORD Count;		// Records in the payload
+	DWORD Reserved;
+} NetFrameHeader, *PNetFrameHeader;
+
+typedef struct {
+	unsigned long long Timestamp;	// Microseconds, from the producer's clock
+	DWORD Length;					// 0 for short events, else the size of the data following the record
+	DWORD Event;					// The short event, unused for long ones
+} NetRecord, *PNetRecord;
+
+typedef struct {
+	unsigned long long Timestamp;
+	DWORD Event;
+	DWORD Length;					// 0 for short events
+	const BYTE* Data;				// Long events only, valid until the next ParseEvents() call
+} NetEvent, *PNetEvent;
+
+namespace WinDriver {
+	class NetPipe {
+	private:
+		ErrorSystem::WinErr NetErr;
+
+		NetSocket Listener = NET_INVALID_SOCKET;
+		NetSocket Peer = NET_INVALID_SOCKET;
+		char UnixPath[NET_MAX_ADDRESS] = { 0 };
+
+		// Producer side, Sending is only touched by the thread that set Busy
+		std::vector<BYTE> Frame;
+		std::vector<BYTE> Sending;
+		DWORD FrameCount = 0;
+		bool Busy = false;
+		std::mutex FrameLock;
+		std::condition_variable SendDone;
+
+		// Consumer side
+		std::vector<BYTE> RecvFrame;
+		DWORD RecvCount = 0;
+		DWORD RecvPos = 0;
+
+		static bool StartupSockets();
+		static unsigned long long Now();
+
+		NetSocket OpenSocket(const char* Address, bool Server);
+		bool SendAll(const BYTE* Data, size_t Len);
+		bool RecvAll(BYTE* Data, size_t Len);
+		bool AppendRecord(unsigned long long Timestamp, DWORD Event, const BYTE* Data, DWORD Len, bool More);
+		bool SendFrames(std::unique_lock<std::mutex>& Lock);
+		void DropPeer();
+
+	public:
+		~NetPipe();
+
+		// Consumer side, the render node waits for a producer to connect
+		bool Listen(const char* Address);
+		bool Accept();
+
+		// Producer side, the long events can be up to MAX_LE_SIZE bytes.
+		// More holds the frame back for the events right behind, until one without it or Flush()
+		bool Connect(const char* Address);
+		bool SaveShortEvent(unsigned int Event, unsigned long long Timestamp = 0, bool More = false);
+		bool SaveLongEvent(const BYTE* Data, DWORD Len, unsigned long long Timestamp = 0, bool More = false);
+		bool Flush();
+
+		// Consumer side, returns how many events have been read, events are in the order they've been sent
+		unsigned int ParseEvents(PNetEvent Target, unsigned int Max);
+
+		bool IsConnected() { return Peer != NET_INVALID_SOCKET; }
+		bool ClosePipe();
+	};
+}
+
+#endif
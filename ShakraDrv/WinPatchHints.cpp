@@ -0,0 +1,172 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinPatchHints.hpp"
+
+bool WinDriver::PatchHints::OpenHints(const wchar_t* Name, bool Create) {
+	if (Page) {
+		LOG(HintErr, L"The patch hints are already open.");
+		return true;
+	}
+
+	PPage =
+		Create ?
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(PchState), Name) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, Name);
+
+	if (!PPage) {
+		NERROR(HintErr, nullptr, false);
+		return false;
+	}
+
+	if (Create)
+		SetSecurityInfo(PPage, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	// A new page is all zeroes, so nothing is hinted yet
+	Page = (PPchState)MapViewOfFile(PPage, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!Page) {
+		NERROR(HintErr, nullptr, false);
+		CloseHandle(PPage);
+		PPage = nullptr;
+		return false;
+	}
+
+	Reset();
+	return true;
+}
+
+bool WinDriver::PatchHints::CloseHints() {
+	if (Page) {
+		UnmapViewOfFile(Page);
+		Page = nullptr;
+	}
+
+	if (PPage) {
+		CloseHandle(PPage);
+		PPage = nullptr;
+	}
+
+	return true;
+}
+
+void WinDriver::PatchHints::SetHint(DWORD* Set, BYTE Bit) {
+	// Most program changes pick an instrument that's hinted already, that's a plain read
+	if (HasHint(Set, Bit))
+		return;
+
+	InterlockedOr((volatile LONG*)&Set[Bit >> 5], (LONG)(1u << (Bit & 31)));
+	InterlockedIncrement(&Page->Changes);
+}
+
+void WinDriver::PatchHints::ClearHint(DWORD* Set, BYTE Bit) {
+	if (!HasHint(Set, Bit))
+		return;
+
+	InterlockedAnd((volatile LONG*)&Set[Bit >> 5], (LONG)~(1u << (Bit & 31)));
+	InterlockedIncrement(&Page->Changes);
+}
+
+void WinDriver::PatchHints::Update(DWORD Event) {
+	BYTE Status = Event & 0xF0;
+	BYTE Channel = Event & 0x0F;
+
+	if (!Page)
+		return;
+
+	switch (Status) {
+	case 0xB0:
+		// Only the MSB, that's what tells the banks apart in GS and XG
+		if (((Event >> 8) & 0x7F) == 0)
+			Bank[Channel] = (Event >> 16) & 0x7F;
+
+		return;
+
+	case 0xC0: {
+		BYTE Program = (Event >> 8) & 0x7F;
+
+		if (Channel == PCH_DRUM_CHANNEL) SetHint(Page->Kits, Program);
+		else SetHint(Page->Melodic[Bank[Channel]], Program);
+
+		return;
+	}
+	}
+}
+
+void WinDriver::PatchHints::Reset() {
+	// The hints stay, the instruments are still going to be needed after the reset
+	memset(Bank, 0, sizeof(Bank));
+}
+
+unsigned int WinDriver::PatchHints::CacheSet(DWORD* Set, WORD* Array, UINT Flags) {
+	for (int i = 0; i < 128; i++) {
+		switch (Flags) {
+		case MIDI_CACHE_QUERY:
+			Array[i] = HasHint(Set, (BYTE)i) ? 0xFFFF : 0;
+			break;
+
+		case MIDI_UNCACHE:
+			if (Array[i]) ClearHint(Set, (BYTE)i);
+			break;
+
+		// MIDI_CACHE_ALL and MIDI_CACHE_BESTFIT, nothing is ever too big for a hint
+		default:
+			if (Array[i]) SetHint(Set, (BYTE)i);
+			break;
+		}
+	}
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::PatchHints::CachePatches(UINT Bank, WORD* Array, UINT Flags) {
+	if (!Array || Bank >= PCH_BANKS)
+		return MMSYSERR_INVALPARAM;
+
+	// Nobody to hint, but caching is optional for a driver anyway
+	if (!Page)
+		return MMSYSERR_NOERROR;
+
+	return CacheSet(Page->Melodic[Bank], Array, Flags);
+}
+
+unsigned int WinDriver::PatchHints::CacheDrumPatches(UINT Kit, WORD* Array, UINT Flags) {
+	bool Any = false;
+
+	if (!Array || Kit >= 128)
+		return MMSYSERR_INVALPARAM;
+
+	if (!Page)
+		return MMSYSERR_NOERROR;
+
+	for (int i = 0; i < 128 && !Any; i++)
+		Any = (Array[i] != 0);
+
+	// The host has to know about the kit too, to load its keys
+	if (Any && Flags != MIDI_CACHE_QUERY && Flags != MIDI_UNCACHE)
+		SetHint(Page->Kits, (BYTE)Kit);
+
+	return CacheSet(Page->DrumKeys[Kit], Array, Flags);
+}
+
+bool WinDriver::PatchHints::ReadHints(PPchState Target) {
+	if (!Page)
+		return false;
+
+	// Changes first, so a copy that's missing something never looks up to date
+	Target->Changes = Page->Changes;
+	MemoryBarrier();
+	memcpy(Target->Melodic, Page->Melodic, sizeof(Page->Melodic));
+	memcpy(Target->Kits, Page->Kits, sizeof(Page->Kits));
+	memcpy(Target->DrumKeys, Page->DrumKeys, sizeof(Page->DrumKeys));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINPATCHHINTS_H
+
+#define WINPATCHHINTS_H
+
+#include "WinError.hpp"
+#include <windows.h>
+#include <mmddk.h>
+#include <AclAPI.h>
+
+/*
+
+	Patch hints tell the host which instruments the apps are going to need,
+	so that it can load their samples before the first note, instead of
+	stalling on it.
+
+	They come from:
+	- MODM_CACHEPATCHES, the patches of a bank the app asked to cache
+	- MODM_CACHEDRUMPATCHES, the keys of a drum kit the app asked to cache
+	- The program changes the apps send, with the bank select of their channel,
+	  which is what most apps do instead of caching anything
+
+	The apps set the bits with interlocked ORs and bump Changes after every
+	new one, the host only has to copy the page when Changes moved. A hint
+	is a hint, so there's no lock: a copy taken in the middle of an update
+	is missing the newest bits, and Changes makes the host look again.
+	MIDI_UNCACHE clears the bits, the host can unload what's not hinted anymore.
+
+	Melodic = Bank (CC 0) by program, bit N of a bank is program N
+	Kits = Programs sent on the drum channel, and the kits asked for through MODM_CACHEDRUMPATCHES
+	DrumKeys = Kit by key, bit N of a kit is key N
+
+	MIDI_CACHE_QUERY reports the hinted patches as cached on every channel,
+	since the driver can't know what the host actually loaded.
+
+*/
+
+#define PCH_BANKS			128
+#define PCH_DRUM_CHANNEL	9
+
+typedef struct {
+	volatile LONG Changes;
+	DWORD Melodic[PCH_BANKS][4];
+	DWORD Kits[4];
+	DWORD DrumKeys[128][4];
+} PatchHintSet, PchState, *PPchState;
+
+namespace WinDriver {
+	class PatchHints {
+	private:
+		ErrorSystem::WinErr HintErr;
+
+		HANDLE PPage = nullptr;
+		PPchState Page = nullptr;
+
+		// Bank select of every channel, only this app's
+		BYTE Bank[16] = { 0 };
+
+		void SetHint(DWORD* Set, BYTE Bit);
+		void ClearHint(DWORD* Set, BYTE Bit);
+		static bool HasHint(const DWORD* Set, BYTE Bit) { return (Set[Bit >> 5] & (1u << (Bit & 31))) != 0; }
+		unsigned int CacheSet(DWORD* Set, WORD* Array, UINT Flags);
+
+	public:
+		bool OpenHints(const wchar_t* Name, bool Create);
+		bool CloseHints();
+		bool IsOpen() { return Page != nullptr; }
+
+		// Producer side, Event needs its status byte
+		void Update(DWORD Event);
+		void Reset();
+
+		// MODM_CACHEPATCHES and MODM_CACHEDRUMPATCHES, Array is a PATCHARRAY or a KEYARRAY
+		unsigned int CachePatches(UINT Bank, WORD* Array, UINT Flags);
+		unsigned int CacheDrumPatches(UINT Kit, WORD* Array, UINT Flags);
+
+		// Consumer side, Changes alone is enough to know if the copy is needed
+		LONG GetChanges() { return Page ? Page->Changes : 0; }
+		bool ReadHints(PPchState Target);
+	};
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinPipeExecutor.hpp"
+
+bool WinDriver::PipeExecutor::BatchAwaiter::TryFill() {
+	unsigned long long Timestamp;
+
+	Count = Pipe->ParseShortEvents(Target, Max);
+	return Count || Pipe->PeekLongEvent(&Timestamp);
+}
+
+void WinDriver::PipeExecutor::BatchAwaiter::await_suspend(std::coroutine_handle<> Handle) {
+	Owner->Park(this, Handle);
+}
+
+WinDriver::PipeExecutor::~PipeExecutor() {
+	Stop();
+}
+
+bool WinDriver::PipeExecutor::Start(unsigned int Threads) {
+	if (!Workers.empty()) {
+		LOG(ExecutorErr, L"The executor is already running.");
+		return true;
+	}
+
+	if (!Threads)
+		Threads = 1;
+
+	for (unsigned int i = 0; i < Threads; i++) {
+		Worker* Target = new (std::nothrow) Worker;
+
+		if (!Target) {
+			NERROR(ExecutorErr, L"Failed to allocate the executor's threads.", false);
+			Stop();
+			return false;
+		}
+
+		Target->Wake = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+		if (!Target->Wake) {
+			NERROR(ExecutorErr, nullptr, false);
+			delete Target;
+			Stop();
+			return false;
+		}
+
+		Target->Thread = std::thread(&PipeExecutor::WorkerLoop, this, Target);
+		Workers.push_back(Target);
+	}
+
+	return true;
+}
+
+void WinDriver::PipeExecutor::Stop() {
+	if (Workers.empty())
+		return;
+
+	Stopping = true;
+
+	for (Worker* Target : Workers)
+		SetEvent(Target->Wake);
+
+	for (Worker* Target : Workers) {
+		if (Target->Thread.joinable())
+			Target->Thread.join();
+
+		// Parked while the thread was on its way out
+		for (Parked& Entry : Target->Incoming)
+			Entry.Handle.destroy();
+
+		CloseHandle(Target->Wake);
+		delete Target;
+	}
+
+	Workers.clear();
+	Stopping = false;
+}
+
+void WinDriver::PipeExecutor::Park(BatchAwaiter* Awaiter, std::coroutine_handle<> Handle) {
+	Worker* Target = nullptr;
+
+	// The thread with the least pipes gets it
+	for (Worker* Candidate : Workers) {
+		if (!Target || Candidate->Load < Target->Load)
+			Target = Candidate;
+	}
+
+	// Nobody's going to resume it
+	if (!Target || Stopping) {
+		Handle.destroy();
+		return;
+	}
+
+	if (Target->Load >= EXECUTOR_MAX_PIPES)
+		LOG(ExecutorErr, L"Too many pipes for the executor's threads, the ones that don't fit will be polled.");
+
+	InterlockedIncrement(&Target->Load);
+
+	AcquireSRWLockExclusive(&Target->Lock);
+	Target->Incoming.push_back({ Awaiter, Handle });
+	ReleaseSRWLockExclusive(&Target->Lock);
+
+	SetEvent(Target->Wake);
+}
+
+void WinDriver::PipeExecutor::WorkerLoop(Worker* Self) {
+	std::vector<Parked> Active;
+	HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+
+	Handles[0] = Self->Wake;
+
+	while (!Stopping) {
+		DWORD Waits = 1;
+
+		// The new ones get armed and checked below, like the others
+		AcquireSRWLockExclusive(&Self->Lock);
+		Active.insert(Active.end(), Self->Incoming.begin(), Self->Incoming.end());
+		Self->Incoming.clear();
+		ReleaseSRWLockExclusive(&Self->Lock);
+
+		// Arm first, then look, see the doorbell notes in WinPipeExecutor.hpp
+		for (size_t i = 0; i < Active.size();) {
+			Parked Entry = Active[i];
+
+			Entry.Awaiter->Pipe->ArmDoorbell();
+
+			if (!Entry.Awaiter->TryFill()) {
+				i++;
+				continue;
+			}
+
+			// The order of the parked coroutines doesn't matter
+			Active[i] = Active.back();
+			Active.pop_back();
+			InterlockedDecrement(&Self->Load);
+
+			// Runs until its next co_await, which parks it again
+			Entry.Handle.resume();
+		}
+
+		for (Parked& Entry : Active) {
+			HANDLE Bell = Entry.Awaiter->Pipe->GetDoorbell();
+
+			// The same handle can't be in the array twice
+			if (!Bell || Waits == MAXIMUM_WAIT_OBJECTS || std::find(Handles + 1, Handles + Waits, Bell) != Handles + Waits)
+				continue;
+
+			Handles[Waits++] = Bell;
+		}
+
+		// Which one fired doesn't matter, all of them get checked again
+		WaitForMultipleObjects(Waits, Handles, FALSE, EXECUTOR_POLL_INTERVAL);
+	}
+
+	for (Parked& Entry : Active)
+		Entry.Handle.destroy();
+}
+
+#endif
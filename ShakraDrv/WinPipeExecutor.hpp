@@ -0,0 +1,132 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINPIPEEXECUTOR_H
+
+#define WINPIPEEXECUTOR_H
+
+#include "WinError.hpp"
+#include "WinSynthPipe.hpp"
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/*
+
+	Lets a few threads serve lots of pipes, without a polling loop per pipe.
+
+	A consumer is a coroutine that does co_await Executor.NextBatch(Pipe, ...).
+	If the pipe has events, it gets them right away and keeps running.
+	Otherwise it gets parked on the pipe's doorbell, and one of the executor's
+	threads resumes it when the app publishes something.
+
+	Doorbell:
+	The consumer arms it (the Waiting flag in the control page), then looks at
+	the ring one last time, then waits on the event. The producer publishes,
+	then takes the flag, and sets the event only if it was armed. Both sides
+	have a full barrier between their store and their load, so either the
+	consumer sees the events, or the producer sees the flag, never neither.
+	While the consumer keeps up with the app, it never sleeps, so the producer
+	never pays for the SetEvent.
+
+	There's a single flag per pipe, so only one consumer can sleep on it. Taps
+	still work, they get woken up by the EXECUTOR_POLL_INTERVAL timeout instead.
+
+	Every thread waits on up to EXECUTOR_MAX_PIPES doorbells at once, plus its
+	own wake event, used to hand it new coroutines and to stop it.
+	The coroutines run on the executor's threads once they've been parked, so
+	they shouldn't block, or the other pipes of the same thread have to wait.
+
+	NextBatch() also returns when the pipe has a long event, with a count of 0
+	if there are no short events to go with it, so ParseLongEventRef() can be
+	called right after it.
+
+	PipeTask is a fire-and-forget coroutine type, the frame frees itself when the
+	coroutine returns. The ones still parked when the executor stops are destroyed.
+
+*/
+
+#define EXECUTOR_MAX_PIPES		(MAXIMUM_WAIT_OBJECTS - 1)
+#define EXECUTOR_POLL_INTERVAL	10		// ms, for the consumers that can't use the doorbell
+
+namespace WinDriver {
+	class PipeExecutor;
+
+	struct PipeTask {
+		struct promise_type {
+			PipeTask get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	class PipeExecutor {
+	public:
+		class BatchAwaiter {
+		private:
+			PipeExecutor* Owner;
+			SynthPipe* Pipe;
+			DWORD* Target;
+			unsigned int Max;
+			unsigned int Count = 0;
+
+			friend class PipeExecutor;
+
+		public:
+			BatchAwaiter(PipeExecutor* Exec, SynthPipe* Source, DWORD* Events, unsigned int MaxEvents) :
+				Owner(Exec), Pipe(Source), Target(Events), Max(MaxEvents) {}
+
+			// Returns true if the batch is ready, or there's a long event waiting
+			bool TryFill();
+
+			bool await_ready() { return TryFill(); }
+			void await_suspend(std::coroutine_handle<> Handle);
+			unsigned int await_resume() { return Count; }
+		};
+
+	private:
+		typedef struct {
+			BatchAwaiter* Awaiter;
+			std::coroutine_handle<> Handle;
+		} Parked;
+
+		struct Worker {
+			std::thread Thread;
+			HANDLE Wake = nullptr;
+			SRWLOCK Lock = SRWLOCK_INIT;
+			std::vector<Parked> Incoming;		// Protected by Lock
+			volatile LONG Load = 0;				// Coroutines parked on it, incoming ones included
+		};
+
+		ErrorSystem::WinErr ExecutorErr;
+
+		std::vector<Worker*> Workers;
+		std::atomic<bool> Stopping{ false };
+
+		void Park(BatchAwaiter* Awaiter, std::coroutine_handle<> Handle);
+		void WorkerLoop(Worker* Self);
+
+	public:
+		~PipeExecutor();
+
+		bool Start(unsigned int Threads);
+		void Stop();
+
+		// Reads up to Max short events from the pipe, co_await it from a PipeTask
+		BatchAwaiter NextBatch(SynthPipe* Pipe, DWORD* Target, unsigned int Max) { return BatchAwaiter(this, Pipe, Target, Max); }
+	};
+}
+
+#endif
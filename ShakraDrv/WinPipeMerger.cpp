@@ -0,0 +1,189 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinPipeMerger.hpp"
+
+WinDriver::PipeMerger::~PipeMerger() {
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++)
+		RemoveSource(i);
+}
+
+bool WinDriver::PipeMerger::IsLater(const MergeHead& A, const MergeHead& B) {
+	// The STL heap functions build a max-heap, so the comparison is reversed
+	if (A.Timestamp != B.Timestamp)
+		return A.Timestamp > B.Timestamp;
+
+	return A.Order > B.Order;
+}
+
+DWORD WinDriver::PipeMerger::ResolveRunningStatus(int Source, DWORD Event) {
+	BYTE First = Event & 0xFF;
+
+	if (First & 0x80) {
+		if (First < 0xF0) RunningStatus[Source] = First;
+		else if (First < 0xF8) RunningStatus[Source] = 0;
+
+		return Event;
+	}
+
+	// No running status to use, let the consumer skip it
+	if (!RunningStatus[Source])
+		return Event;
+
+	return (Event << 8) | RunningStatus[Source];
+}
+
+int WinDriver::PipeMerger::AddSource(const wchar_t* Pipe, int Size) {
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++) {
+		if (Sources[i])
+			continue;
+
+		Sources[i] = new (std::nothrow) SynthPipe;
+
+		if (!Sources[i]) {
+			NERROR(MergerErr, L"Failed to allocate the new source.", false);
+			return -1;
+		}
+
+		if (!Sources[i]->PrepareFileMappings(Pipe, true, Size)) {
+			NERROR(MergerErr, L"Failed to open the pipe of the new source.", false);
+			delete Sources[i];
+			Sources[i] = nullptr;
+			return -1;
+		}
+
+		RunningStatus[i] = 0;
+		return i;
+	}
+
+	LOG(MergerErr, L"No free sources left.");
+	return -1;
+}
+
+bool WinDriver::PipeMerger::RemoveSource(int Source) {
+	if (Source < 0 || Source >= MAX_MERGE_SOURCES || !Sources[Source])
+		return false;
+
+	// Don't leave a reference to the cache of a pipe that's gone
+	if (LongSource == Source)
+		LongSource = -1;
+
+	Sources[Source]->ClosePipe();
+	delete Sources[Source];
+	Sources[Source] = nullptr;
+
+	return true;
+}
+
+int WinDriver::PipeMerger::GetSourcesCount() {
+	int Count = 0;
+
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++)
+		if (Sources[i]) Count++;
+
+	return Count;
+}
+
+void WinDriver::PipeMerger::SetFairness(unsigned int MaxPerSource) {
+	Quota = MaxPerSource;
+}
+
+bool WinDriver::PipeMerger::SetBackPressure(int Source, DWORD Mode, DWORD MaxPending) {
+	if (Source < 0 || Source >= MAX_MERGE_SOURCES || !Sources[Source])
+		return false;
+
+	Sources[Source]->SetBackPressure(Mode, MaxPending);
+	return true;
+}
+
+unsigned int WinDriver::PipeMerger::Merge(DWORD* Target, unsigned int Max) {
+	unsigned int Count = 0;
+	int Heads = 0;
+
+	// Fill the heap with the first event of each pipe
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++) {
+		int Source = (RoundStart + i) % MAX_MERGE_SOURCES;
+		MergeHead& Head = Heap[Heads];
+
+		Emitted[Source] = 0;
+
+		if (!Sources[Source] || !Sources[Source]->PeekShortEvent(&Head.Event, &Head.Timestamp))
+			continue;
+
+		Head.Order = i;
+		Head.Source = Source;
+		Heads++;
+	}
+
+	std::make_heap(Heap, Heap + Heads, IsLater);
+
+	while (Count < Max && Heads > 0) {
+		std::pop_heap(Heap, Heap + Heads, IsLater);
+
+		MergeHead& Head = Heap[Heads - 1];
+		SynthPipe* Pipe = Sources[Head.Source];
+
+		Target[Count++] = ResolveRunningStatus(Head.Source, Head.Event);
+		Pipe->PopShortEvent();
+
+		// The pipe is empty, or it already got its share for this round
+		if ((Quota && ++Emitted[Head.Source] >= Quota) || !Pipe->PeekShortEvent(&Head.Event, &Head.Timestamp)) {
+			Heads--;
+			continue;
+		}
+
+		std::push_heap(Heap, Heap + Heads, IsLater);
+	}
+
+	// Free the slots of each pipe at once
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++)
+		if (Sources[i]) Sources[i]->FlushShortEvents();
+
+	RoundStart = (RoundStart + 1) % MAX_MERGE_SOURCES;
+
+	return Count;
+}
+
+unsigned int WinDriver::PipeMerger::ParseLongEventRef(const BYTE** PEvent) {
+	unsigned long long Earliest = ~0ULL, Timestamp = 0;
+
+	// The previous one hasn't been freed yet, return it again
+	if (LongSource >= 0)
+		return Sources[LongSource]->ParseLongEventRef(PEvent);
+
+	// SysEx messages are rare, a linear scan is enough
+	for (int i = 0; i < MAX_MERGE_SOURCES; i++) {
+		int Source = (RoundStart + i) % MAX_MERGE_SOURCES;
+
+		if (!Sources[Source] || !Sources[Source]->PeekLongEvent(&Timestamp))
+			continue;
+
+		if (Timestamp < Earliest) {
+			Earliest = Timestamp;
+			LongSource = Source;
+		}
+	}
+
+	if (LongSource < 0)
+		return 0;
+
+	return Sources[LongSource]->ParseLongEventRef(PEvent);
+}
+
+bool WinDriver::PipeMerger::FreeLongEvent() {
+	if (LongSource < 0)
+		return false;
+
+	bool Freed = Sources[LongSource]->FreeLongEvent();
+	LongSource = -1;
+
+	return Freed;
+}
+
+#endif
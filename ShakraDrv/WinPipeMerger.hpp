@@ -0,0 +1,88 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINPIPEMERGER_H
+
+#define WINPIPEMERGER_H
+
+#include "WinError.hpp"
+#include "WinSynthPipe.hpp"
+#include <windows.h>
+#include <algorithm>
+
+/*
+
+	Lets a single host play the events coming from multiple apps, each one
+	with its own pipe, without loading a synth (and its soundfonts) per app.
+
+	Every event is stamped with the QPC time of when the app sent it, so the
+	pipes get merged with a k-way merge: a min-heap holds the next event of
+	each pipe, and the earliest one is taken out every time.
+
+	Fairness: With a quota set, a pipe can't give more than that many events
+	per Merge() call, so an app flooding its pipe can't starve the others.
+	Without a quota, the events come out in strict timestamp order.
+
+	Back-pressure: Each pipe can be told to drop events when it's full, or to
+	make the app wait, and how many events it's allowed to have queued.
+
+	Running status is resolved per pipe before merging, since the status
+	byte an app left out belongs to that app's stream only.
+
+	Events with the same timestamp come out in source order, and the first
+	source moves by one on every call, so ties don't always favor the same app.
+
+*/
+
+#define MAX_MERGE_SOURCES	16
+
+typedef struct {
+	unsigned long long Timestamp;
+	DWORD Order;
+	DWORD Event;
+	int Source;
+} MergeHead, *PMergeHead;
+
+namespace WinDriver {
+	class PipeMerger {
+	private:
+		ErrorSystem::WinErr MergerErr;
+
+		SynthPipe* Sources[MAX_MERGE_SOURCES] = { 0 };
+		DWORD Emitted[MAX_MERGE_SOURCES] = { 0 };
+		BYTE RunningStatus[MAX_MERGE_SOURCES] = { 0 };
+		MergeHead Heap[MAX_MERGE_SOURCES];
+
+		unsigned int Quota = 0;
+		int RoundStart = 0;
+
+		// Source of the long event returned by ParseLongEventRef()
+		int LongSource = -1;
+
+		static bool IsLater(const MergeHead& A, const MergeHead& B);
+		DWORD ResolveRunningStatus(int Source, DWORD Event);
+
+	public:
+		~PipeMerger();
+
+		// Returns the index of the new source, or -1 if it failed
+		int AddSource(const wchar_t* Pipe, int Size);
+		bool RemoveSource(int Source);
+		int GetSourcesCount();
+
+		void SetFairness(unsigned int MaxPerSource);
+		bool SetBackPressure(int Source, DWORD Mode, DWORD MaxPending);
+
+		unsigned int Merge(DWORD* Target, unsigned int Max);
+		unsigned int ParseLongEventRef(const BYTE** PEvent);
+		bool FreeLongEvent();
+	};
+}
+
+#endif
@@ -0,0 +1,717 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINRING_H
+
+#define WINRING_H
+
+#include <windows.h>
+#include <atomic>
+#include <type_traits>
+
+/*
+
+	Single producer/single consumer ring, shared between two processes.
+
+	The storage (RingBuffer) lives in a file mapping, and holds the shared heads
+	followed by the slots themselves. The Ring class is the per-process view of it,
+	and keeps the positions each side has cached locally.
+
+	The capacity is a compile-time power of two, so wrapping an index is just a
+	mask. The heads are free running counters, and they only get masked when
+	they're used as an index, so the mask in use can change at any time without
+	moving them (see below).
+
+	Three algorithms are available:
+	- RingLamport: The classic one, the producer reads the consumer's head to know
+	  if there's room, and the consumer reads the producer's head to know if there's data
+	- RingFastForward: Every slot has a flag telling if it's full, so the two sides
+	  never read each other's heads, and only share the cache lines of the slots
+	- RingBQueue: Same flags as FastForward, but each side probes a whole batch of
+	  slots ahead in one go, and then doesn't touch anything shared until it's used up
+	- RingBroadcast: Every consumer has its own cursor, and sees every event (see below)
+
+	Slot types need a "volatile DWORD Flag" member, which is only used by the
+	flag based algorithms. The shared heads are kept up to date by all of them,
+	so that the pipe can always be inspected from the outside.
+
+	Only one thread per side is allowed to use the ring at a time.
+
+*/
+
+/*
+
+	Staging
+
+	Commit() publishes every slot right away, which means one write to a shared
+	cache line (the write head, or the slot's flag) per event, and the consumer
+	losing that line every time. Stage() fills the slot without publishing it,
+	and Publish() then makes everything staged so far visible at once, so a burst
+	of events costs the consumer a single miss.
+
+	Publish() can be called from another thread of the producer (an idle flush),
+	as long as the calls are serialized with each other and with Commit().
+
+*/
+
+/*
+
+	Resizing (Lamport only, the flag based rings can't tell which slots have been copied)
+
+	The whole capacity is reserved when the file mapping gets created, but only
+	the pages used by the active size are committed. The producer doubles the
+	active size when the ring gets 3/4 full, and halves it when it never went past
+	1/8 for a whole RING_SHRINK_WINDOW.
+
+	Since the heads are free running, an event always lives at (Counter & Mask).
+	To switch to a new mask, the producer:
+	1. Commits the new pages, and copies the unread events to where they belong with the new mask
+	2. Publishes the new mask, then bumps Epoch
+	3. Until the consumer sets AckEpoch to the new epoch, writes every new event with both
+	   masks, and doesn't go past the smallest of the two sizes
+
+	The consumer switches to the new mask as soon as it sees the new epoch, and since the
+	events it hasn't read yet are at the right place with both masks, it doesn't matter
+	if that happens in the middle of a batch. Nobody ever has to wait for the other side.
+
+*/
+
+/*
+
+	Broadcast
+
+	Up to MAX_RING_CONSUMERS consumers can read the same events, each one at
+	its own pace, straight from the ring. Their cursors are stored in the shared
+	header, so they can attach and detach whenever they want.
+
+	The producer only looks at the cursors when it thinks the ring is full, and
+	it caches the slowest one until then. If the ring is really full, Policy
+	decides what happens:
+	- RING_POLICY_BLOCK: The event is dropped, like with the other algorithms,
+	  so the slowest consumer limits everyone
+	- RING_POLICY_EVICT: The consumers that are a whole ring behind get kicked out,
+	  and the others keep going. An evicted consumer finds out on its next Peek()
+	  or Flush(), and has to attach again, starting from the newest event
+
+	The events an evicted consumer was reading when it got kicked out might have
+	been overwritten already, so it's supposed to throw them away (see WasEvicted()).
+
+*/
+
+struct RingLamport {};
+struct RingFastForward {};
+struct RingBQueue {};
+struct RingBroadcast {};
+
+#define MAX_RING_CONSUMERS		8
+
+#define RING_CONSUMER_FREE		0
+#define RING_CONSUMER_JOINING	1
+#define RING_CONSUMER_ACTIVE	2
+#define RING_CONSUMER_EVICTED	3
+
+#define RING_POLICY_BLOCK		0
+#define RING_POLICY_EVICT		1
+
+typedef struct {
+	volatile DWORD Cursor;
+	volatile LONG State;
+	BYTE Pad[56];
+} RingConsumer, *PRingConsumer;
+
+// How many slots B-Queue tries to probe at once
+#define RING_BQUEUE_BATCH	64
+
+// Resize thresholds
+#define RING_SHRINK_WINDOW	2000
+#define RING_CHECK_EVERY	64
+
+template <typename Slot, unsigned int Capacity>
+struct RingBuffer {
+	static_assert(Capacity && !(Capacity & (Capacity - 1)), "The ring capacity has to be a power of two.");
+
+	// Each side writes to its own cache line
+	volatile DWORD ReadHead;
+	BYTE ReadPad[60];
+	volatile DWORD WriteHead;
+	BYTE WritePad[60];
+
+	// Stream state, see SynthPipe::ResetStream()
+	volatile LONG Generation;
+	volatile DWORD ResetHead;
+
+	// Active size - 1, and how many times it changed
+	volatile LONG Mask;
+	volatile LONG Epoch;
+	volatile LONG AckEpoch;
+
+	// What the producer does when a broadcast ring is full
+	volatile LONG Policy;
+	BYTE StatePad[40];
+
+	// Broadcast only, one cursor per consumer
+	RingConsumer Consumers[MAX_RING_CONSUMERS];
+
+	Slot Buf[Capacity];
+};
+
+namespace WinDriver {
+	// ThreadSanitizer doesn't model the fences, so under it they become a MemoryBarrier(),
+	// which the Linux shim turns into something it understands, see LinuxShim.hpp
+	inline void AtomicFence(std::memory_order Order) {
+#ifdef __SANITIZE_THREAD__
+		(void)Order;
+		MemoryBarrier();
+#else
+		std::atomic_thread_fence(Order);
+#endif
+	}
+
+	template <typename Slot, unsigned int Capacity, typename Algo = RingLamport>
+	class Ring {
+	public:
+		typedef RingBuffer<Slot, Capacity> Storage;
+		static constexpr bool CanResize = std::is_same_v<Algo, RingLamport>;
+		static constexpr bool IsBroadcast = std::is_same_v<Algo, RingBroadcast>;
+
+	private:
+		static constexpr bool UsesFlags = std::is_same_v<Algo, RingFastForward> || std::is_same_v<Algo, RingBQueue>;
+
+		Storage* Buffer = nullptr;
+		LONG Mask = Capacity - 1;
+		LONG Epoch = 0;
+
+		// Local positions, and how far each side can go before checking again (B-Queue)
+		DWORD Head = 0;
+		DWORD HeadLimit = 0;
+		DWORD Tail = 0;
+		DWORD TailLimit = 0;
+
+		// Producer side resize state
+		LONG MirrorMask = Capacity - 1;
+		DWORD MinSize = Capacity;
+		DWORD MaxFill = 0;
+		DWORD Pushes = 0;
+		ULONGLONG WindowStart = 0;
+
+		// Producer side, the last staged position and the last published one
+		volatile DWORD StagedHead = 0;
+		volatile DWORD PublishedHead = 0;
+
+		// Broadcast state, the slowest cursor seen by the producer and the consumer's own cursor
+		DWORD MinCursor = 0;
+		int ConsumerIdx = -1;
+		bool Evicted = false;
+
+		bool IsFree(DWORD Pos) {
+			return !Buffer->Buf[Pos & Mask].Flag;
+		}
+
+		bool IsFull(DWORD Pos) {
+			return Buffer->Buf[Pos & Mask].Flag != 0;
+		}
+
+		bool CommitSlots(LONG ActiveMask) {
+			// The header shares the first page, so it gets committed along with the slots
+			SIZE_T Bytes = (SIZE_T)((BYTE*)&Buffer->Buf[ActiveMask + 1] - (BYTE*)Buffer);
+			return VirtualAlloc(Buffer, Bytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+		}
+
+		void DiscardSlots(LONG ActiveMask) {
+			SYSTEM_INFO SI;
+			GetSystemInfo(&SI);
+
+			// Only whole pages can be discarded
+			ULONG_PTR Page = SI.dwPageSize;
+			ULONG_PTR Start = ((ULONG_PTR)&Buffer->Buf[ActiveMask + 1] + Page - 1) & ~(Page - 1);
+			ULONG_PTR End = (ULONG_PTR)&Buffer->Buf[Capacity] & ~(Page - 1);
+
+			if (End > Start)
+				DiscardVirtualMemory((PVOID)Start, End - Start);
+		}
+
+		DWORD FindSlowest() {
+			DWORD Slowest = Head;
+
+			// Nobody's listening, so the whole ring is free
+			for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+				PRingConsumer Consumer = &Buffer->Consumers[i];
+
+				if (Consumer->State != RING_CONSUMER_ACTIVE)
+					continue;
+
+				if (Head - Consumer->Cursor > Head - Slowest)
+					Slowest = Consumer->Cursor;
+			}
+
+			// Only used to show the position in the host
+			Buffer->ReadHead = Slowest;
+			return Slowest;
+		}
+
+		void EvictLaggards() {
+			DWORD Size = (DWORD)Mask + 1;
+
+			for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+				PRingConsumer Consumer = &Buffer->Consumers[i];
+
+				if (Consumer->State == RING_CONSUMER_ACTIVE && Head - Consumer->Cursor >= Size)
+					InterlockedCompareExchange(&Consumer->State, RING_CONSUMER_EVICTED, RING_CONSUMER_ACTIVE);
+			}
+		}
+
+		DWORD GetLimit() {
+			// While switching, only use the room both masks have
+			return ((Mask < MirrorMask) ? Mask : MirrorMask) + 1;
+		}
+
+		bool IsSwitching() {
+			return MirrorMask != Mask;
+		}
+
+		void SwitchMask(LONG NewMask) {
+			if (!CommitSlots(NewMask))
+				return;
+
+			// Move the events that haven't been read yet where the new mask expects them
+			for (DWORD Pos = Buffer->ReadHead; Pos != Head; Pos++) {
+				if ((Pos & NewMask) != (Pos & Mask))
+					Buffer->Buf[Pos & NewMask] = Buffer->Buf[Pos & Mask];
+			}
+
+			MirrorMask = Mask;
+			Mask = NewMask;
+
+			AtomicFence(std::memory_order_release);
+			Buffer->Mask = NewMask;
+			AtomicFence(std::memory_order_release);
+			Epoch = InterlockedIncrement(&Buffer->Epoch);
+		}
+
+		void CheckResize(DWORD Fill) {
+			if constexpr (CanResize) {
+				// Still waiting for the consumer to catch up with the last switch
+				if (IsSwitching()) {
+					if (Buffer->AckEpoch != Epoch)
+						return;
+
+					if (Mask < MirrorMask)
+						DiscardSlots(Mask);
+
+					MirrorMask = Mask;
+				}
+
+				if (Fill > MaxFill)
+					MaxFill = Fill;
+
+				// High watermark
+				if (Mask < (LONG)(Capacity - 1) && Fill >= ((DWORD)(Mask + 1) / 4) * 3) {
+					SwitchMask((Mask << 1) | 1);
+					MaxFill = 0;
+					return;
+				}
+
+				if (++Pushes < RING_CHECK_EVERY)
+					return;
+
+				Pushes = 0;
+
+				ULONGLONG Now = GetTickCount64();
+				if (Now - WindowStart < RING_SHRINK_WINDOW)
+					return;
+
+				// Low load for the whole window
+				if ((DWORD)(Mask + 1) > MinSize && MaxFill < (DWORD)(Mask + 1) / 8 && Fill < (DWORD)(Mask + 1) / 4)
+					SwitchMask(Mask >> 1);
+
+				WindowStart = Now;
+				MaxFill = 0;
+			}
+		}
+
+	public:
+		// Size gets rounded up to a power of two, and clamped to the capacity
+		static LONG SizeToMask(unsigned int Size) {
+			unsigned int Active = 1;
+
+			if (!Size || Size > Capacity)
+				return Capacity - 1;
+
+			while (Active < Size)
+				Active <<= 1;
+
+			return Active - 1;
+		}
+
+		bool Attach(Storage* Target, bool Create, unsigned int Size, unsigned int Min) {
+			Buffer = Target;
+
+			// The creator picks the initial size, only the rings that can be resized start small
+			if (Create) {
+				if (!CommitSlots(CanResize ? SizeToMask(Size) : (LONG)(Capacity - 1))) {
+					Buffer = nullptr;
+					return false;
+				}
+
+				Buffer->Mask = SizeToMask(Size);
+			}
+
+			Epoch = Buffer->Epoch;
+			Mask = MirrorMask = Buffer->Mask;
+
+			if (!Create && !CommitSlots(CanResize ? Mask : (LONG)(Capacity - 1))) {
+				Buffer = nullptr;
+				return false;
+			}
+
+			MinSize = (DWORD)(SizeToMask(Min) + 1);
+			WindowStart = GetTickCount64();
+
+			Head = HeadLimit = Buffer->WriteHead;
+			StagedHead = PublishedHead = Head;
+			Tail = TailLimit = Buffer->ReadHead;
+			MinCursor = Head;
+
+			return true;
+		}
+
+		void Detach() {
+			DetachConsumer();
+			Buffer = nullptr;
+		}
+
+		// Consumer side, takes a cursor on broadcast rings, starting from the newest event
+		bool AttachConsumer() {
+			if constexpr (IsBroadcast) {
+				// An evicted cursor still belongs to its consumer, nobody else can take it
+				DetachConsumer();
+
+				for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+					PRingConsumer Consumer = &Buffer->Consumers[i];
+
+					if (InterlockedCompareExchange(&Consumer->State, RING_CONSUMER_JOINING, RING_CONSUMER_FREE) != RING_CONSUMER_FREE)
+						continue;
+
+					// The producer ignores the cursor until it's active
+					Tail = Buffer->WriteHead;
+					Consumer->Cursor = Tail;
+					AtomicFence(std::memory_order_release);
+					Consumer->State = RING_CONSUMER_ACTIVE;
+
+					ConsumerIdx = i;
+					Evicted = false;
+					return true;
+				}
+
+				return false;
+			}
+
+			return true;
+		}
+
+		void DetachConsumer() {
+			if constexpr (IsBroadcast) {
+				if (ConsumerIdx < 0 || !Buffer)
+					return;
+
+				// Active or evicted, the cursor is ours either way
+				Buffer->Consumers[ConsumerIdx].State = RING_CONSUMER_FREE;
+				ConsumerIdx = -1;
+			}
+		}
+
+		// Consumer side, true if the producer kicked us out, see RING_POLICY_EVICT
+		bool WasEvicted() {
+			return Evicted;
+		}
+
+		void SetPolicy(LONG Policy) {
+			Buffer->Policy = Policy;
+		}
+
+		bool IsAttached() {
+			return Buffer != nullptr;
+		}
+
+		Storage* GetStorage() {
+			return Buffer;
+		}
+
+		LONG GetMask() {
+			return Mask;
+		}
+
+		LONG Distance(DWORD From, DWORD To) {
+			return (LONG)(To - From);
+		}
+
+		// Producer side, returns the slot to fill, or nullptr if the ring is full
+		Slot* Claim() {
+			if constexpr (std::is_same_v<Algo, RingLamport>) {
+				DWORD Fill = Head - Buffer->ReadHead;
+
+				CheckResize(Fill);
+
+				if (Fill >= GetLimit())
+					return nullptr;
+			}
+			else if constexpr (IsBroadcast) {
+				DWORD Size = (DWORD)Mask + 1;
+
+				// The cached cursor is old, so check again before calling the ring full
+				if (Head - MinCursor >= Size) {
+					MinCursor = FindSlowest();
+
+					if (Head - MinCursor >= Size) {
+						if (Buffer->Policy != RING_POLICY_EVICT)
+							return nullptr;
+
+						EvictLaggards();
+						MinCursor = FindSlowest();
+					}
+				}
+			}
+			else if constexpr (std::is_same_v<Algo, RingFastForward>) {
+				// The staged slots still look free, don't lap them
+				if (Head - PublishedHead > (DWORD)Mask || !IsFree(Head))
+					return nullptr;
+			}
+			else {
+				if (Head == HeadLimit) {
+					DWORD Batch = (RING_BQUEUE_BATCH < (DWORD)Mask) ? RING_BQUEUE_BATCH : (DWORD)Mask;
+
+					// If the last slot of the batch is free, all the ones before it are too
+					while (Batch > 0 && !IsFree(Head + Batch - 1))
+						Batch >>= 1;
+
+					if (!Batch)
+						return nullptr;
+
+					HeadLimit = Head + Batch;
+
+					// The staged slots still look free, don't lap them
+					if (HeadLimit - PublishedHead > (DWORD)Mask + 1)
+						HeadLimit = PublishedHead + (DWORD)Mask + 1;
+
+					if (Head == HeadLimit)
+						return nullptr;
+				}
+			}
+
+			return &Buffer->Buf[Head & Mask];
+		}
+
+		// Producer side, publishes the slot returned by Claim()
+		void Commit() {
+			Stage();
+			Publish();
+		}
+
+		// Producer side, keeps the slot returned by Claim() for the next Publish()
+		void Stage() {
+			if constexpr (!UsesFlags) {
+				// The consumer might still be using the old mask
+				if (IsSwitching() && (Head & Mask) != (Head & MirrorMask))
+					Buffer->Buf[Head & MirrorMask] = Buffer->Buf[Head & Mask];
+			}
+
+			Head++;
+
+			// The slot has to be filled before Publish() can see it
+			AtomicFence(std::memory_order_release);
+			StagedHead = Head;
+		}
+
+		// Producer side, makes all the staged slots visible to the consumer, returns how many there were
+		DWORD Publish() {
+			DWORD Target = StagedHead;
+			DWORD From = PublishedHead;
+
+			if (Target == From)
+				return 0;
+
+			AtomicFence(std::memory_order_acquire);
+
+			// In order, B-Queue expects a full slot to have only full slots before it
+			if constexpr (UsesFlags) {
+				for (DWORD Pos = From; Pos != Target; Pos++) {
+					AtomicFence(std::memory_order_release);
+					Buffer->Buf[Pos & Mask].Flag = 1;
+				}
+			}
+
+			AtomicFence(std::memory_order_release);
+			Buffer->WriteHead = Target;
+			PublishedHead = Target;
+
+			return Target - From;
+		}
+
+		// Producer side, how many slots are waiting for Publish()
+		DWORD GetStaged() {
+			return StagedHead - PublishedHead;
+		}
+
+		DWORD GetPublishedPos() {
+			return PublishedHead;
+		}
+
+		// Consumer side, returns the next slot to read, or nullptr if the ring is empty
+		Slot* Peek() {
+			if constexpr (std::is_same_v<Algo, RingLamport>) {
+				// The producer switched to a new mask, follow it right away
+				if (Buffer->Epoch != Epoch) {
+					Epoch = Buffer->Epoch;
+					AtomicFence(std::memory_order_acquire);
+
+					CommitSlots(Buffer->Mask);
+					Mask = Buffer->Mask;
+					Buffer->AckEpoch = Epoch;
+				}
+
+				if (Tail == Buffer->WriteHead)
+					return nullptr;
+			}
+			else if constexpr (IsBroadcast) {
+				if (ConsumerIdx < 0)
+					return nullptr;
+
+				if (Buffer->Consumers[ConsumerIdx].State != RING_CONSUMER_ACTIVE) {
+					Evicted = true;
+					return nullptr;
+				}
+
+				if (Tail == Buffer->WriteHead)
+					return nullptr;
+			}
+			else if constexpr (std::is_same_v<Algo, RingFastForward>) {
+				if (!IsFull(Tail))
+					return nullptr;
+			}
+			else {
+				if (Tail == TailLimit) {
+					DWORD Batch = (RING_BQUEUE_BATCH < (DWORD)Mask) ? RING_BQUEUE_BATCH : (DWORD)Mask;
+
+					// Backtrack until we find a batch that's been filled completely
+					while (Batch > 0 && !IsFull(Tail + Batch - 1))
+						Batch >>= 1;
+
+					if (!Batch)
+						return nullptr;
+
+					TailLimit = Tail + Batch;
+				}
+			}
+
+			AtomicFence(std::memory_order_acquire);
+			return &Buffer->Buf[Tail & Mask];
+		}
+
+		// Consumer side, frees the slot returned by Peek()
+		void Advance() {
+			if constexpr (UsesFlags) {
+				AtomicFence(std::memory_order_release);
+				Buffer->Buf[Tail & Mask].Flag = 0;
+			}
+
+			Tail++;
+		}
+
+		// Consumer side, makes all the Advance() calls visible to the producer at once
+		void Flush() {
+			AtomicFence(std::memory_order_release);
+
+			if constexpr (IsBroadcast) {
+				if (ConsumerIdx < 0)
+					return;
+
+				Buffer->Consumers[ConsumerIdx].Cursor = Tail;
+
+				// The producer only evicts before overwriting, so if we're still active,
+				// nothing we copied since the last Peek() got overwritten
+				AtomicFence(std::memory_order_acquire);
+
+				if (Buffer->Consumers[ConsumerIdx].State != RING_CONSUMER_ACTIVE)
+					Evicted = true;
+			}
+			else Buffer->ReadHead = Tail;
+		}
+
+		// Consumer side, drops everything up to Target
+		void SkipTo(DWORD Target) {
+			// The flags have to be cleared one by one, or the producer would see the slots as full
+			if constexpr (UsesFlags) {
+				while (Tail != Target && IsFull(Tail))
+					Advance();
+
+				TailLimit = Tail;
+			}
+			else Tail = Target;
+
+			Flush();
+		}
+
+		// Producer side, how many events are waiting for the consumer
+		DWORD GetFill() {
+			if constexpr (IsBroadcast)
+				return Head - MinCursor;
+
+			return Head - Buffer->ReadHead;
+		}
+
+		DWORD GetReadPos() {
+			return Tail;
+		}
+
+		// Consumer side, the broadcast cursor we're reading with, -1 on the other rings
+		int GetConsumerSlot() {
+			return ConsumerIdx;
+		}
+
+		// Consumer side, picks up where another consumer stopped, from the last position it committed
+		void TakeOverConsumer(int ConsumerSlot) {
+			Epoch = Buffer->Epoch;
+			Mask = Buffer->Mask;
+
+			if constexpr (IsBroadcast) {
+				if (ConsumerSlot < 0 || ConsumerSlot >= MAX_RING_CONSUMERS) {
+					AttachConsumer();
+					return;
+				}
+
+				ConsumerIdx = ConsumerSlot;
+				Tail = Buffer->Consumers[ConsumerSlot].Cursor;
+				Evicted = (Buffer->Consumers[ConsumerSlot].State != RING_CONSUMER_ACTIVE);
+			}
+			else {
+				Tail = TailLimit = Buffer->ReadHead;
+
+				// The old consumer might have freed some slots without committing its position,
+				// a slot that's a whole ring behind the write head has been freed and filled again
+				if constexpr (UsesFlags) {
+					DWORD Written = Buffer->WriteHead;
+
+					while (Tail != Written && (Written - Tail > (DWORD)Mask || !IsFull(Tail)))
+						Tail++;
+
+					TailLimit = Tail;
+				}
+
+				if constexpr (std::is_same_v<Algo, RingLamport>)
+					Buffer->AckEpoch = Epoch;
+			}
+		}
+
+		DWORD GetWritePos() {
+			return Head;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinRouting.hpp"
+#include "WinControl.hpp"
+
+bool WinDriver::RouteTable::OpenRoutes(const wchar_t* Name, bool Create) {
+	if (Page) {
+		LOG(RouteErr, L"The routing table is already open.");
+		return true;
+	}
+
+	PPage =
+		Create ?
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(RtePage), Name) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, Name);
+
+	if (!PPage) {
+		NERROR(RouteErr, nullptr, false);
+		return false;
+	}
+
+	if (Create)
+		SetSecurityInfo(PPage, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	Page = (PRtePage)MapViewOfFile(PPage, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!Page) {
+		NERROR(RouteErr, nullptr, false);
+		CloseHandle(PPage);
+		PPage = nullptr;
+		return false;
+	}
+
+	// Nothing is routed until the owner says otherwise
+	if (Create) {
+		LONG Locked = LockPage();
+		GetIdentity(&Page->Map);
+		UnlockPage(Locked);
+	}
+
+	return true;
+}
+
+bool WinDriver::RouteTable::CloseRoutes() {
+	if (Page) {
+		UnmapViewOfFile(Page);
+		Page = nullptr;
+	}
+
+	if (PPage) {
+		CloseHandle(PPage);
+		PPage = nullptr;
+	}
+
+	return true;
+}
+
+LONG WinDriver::RouteTable::LockPage() {
+	// Same as the control page, the CAS keeps the writers apart
+	return SeqLock::Lock(&Page->Seq);
+}
+
+void WinDriver::RouteTable::UnlockPage(LONG Locked) {
+	if (!SeqLock::Unlock(&Page->Seq, Locked))
+		LOG(RouteErr, L"The routing table got taken over by another writer while this one was stalled.");
+}
+
+void WinDriver::RouteTable::GetIdentity(PRouteMap Map) {
+	memset(Map->Keys, ROUTE_OWNER, sizeof(Map->Keys));
+	memset(Map->Channels, 1 << ROUTE_OWNER, sizeof(Map->Channels));
+}
+
+bool WinDriver::RouteTable::SetRoutes(const RouteRules* Rules) {
+	RouteMap Map;
+
+	if (!Page)
+		return false;
+
+	if (!Rules || Rules->Count > MAX_ROUTE_RANGES) {
+		NERROR(RouteErr, L"The routing rules are missing, or they have too many ranges.", false);
+		return false;
+	}
+
+	GetIdentity(&Map);
+
+	for (DWORD i = 0; i < Rules->Count; i++) {
+		const RouteRange* Range = &Rules->Ranges[i];
+
+		if (Range->Route >= MAX_ROUTES || Range->LastChannel > 15 || Range->LastKey > 127 ||
+			Range->FirstChannel > Range->LastChannel || Range->FirstKey > Range->LastKey) {
+			NERROR(RouteErr, L"One of the routing ranges is invalid, the table has been left as it was.", false);
+			return false;
+		}
+
+		for (BYTE Channel = Range->FirstChannel; Channel <= Range->LastChannel; Channel++)
+			memset(&Map.Keys[Channel][Range->FirstKey], Range->Route, Range->LastKey - Range->FirstKey + 1);
+	}
+
+	// A route gets the controllers of every channel it has a key on
+	for (int Channel = 0; Channel < 16; Channel++) {
+		Map.Channels[Channel] = 0;
+
+		for (int Key = 0; Key < 128; Key++)
+			Map.Channels[Channel] |= 1 << Map.Keys[Channel][Key];
+	}
+
+	LONG Locked = LockPage();
+	memcpy(&Page->Map, &Map, sizeof(RouteMap));
+	UnlockPage(Locked);
+
+	return true;
+}
+
+bool WinDriver::RouteTable::SetClock(DWORD SampleRate, DWORD LatencyMs) {
+	LARGE_INTEGER Now;
+
+	if (!Page)
+		return false;
+
+	QueryPerformanceCounter(&Now);
+
+	LONG Locked = LockPage();
+	Page->Clock.Anchor = Now.QuadPart;
+	Page->Clock.SampleRate = SampleRate;
+	Page->Clock.LatencyMs = LatencyMs;
+	UnlockPage(Locked);
+
+	return true;
+}
+
+bool WinDriver::RouteTable::HasChanged(LONG* LastSeq) {
+	if (!Page)
+		return false;
+
+	LONG Seq = Page->Seq;
+
+	// Keep the old value while a writer is busy, it gets picked up next time
+	if ((Seq & 1) || Seq == *LastSeq)
+		return false;
+
+	*LastSeq = Seq;
+	return true;
+}
+
+bool WinDriver::RouteTable::ReadMap(PRouteMap Target) {
+	if (!Page)
+		return false;
+
+	return SeqLock::Read(&Page->Seq, &Page->Map, Target);
+}
+
+void WinDriver::RouteTable::Resolve(const RouteMap* Map, BYTE Live, PRouteMap Target) {
+	for (int Channel = 0; Channel < 16; Channel++) {
+		BYTE Mask = Map->Channels[Channel];
+
+		for (int Key = 0; Key < 128; Key++) {
+			BYTE Route = Map->Keys[Channel][Key];
+			Target->Keys[Channel][Key] = (Live & (1 << Route)) ? Route : ROUTE_OWNER;
+		}
+
+		// The owner takes over the controllers of the missing routes too
+		Target->Channels[Channel] = (Mask & Live) | ((Mask & ~Live) ? (1 << ROUTE_OWNER) : 0);
+	}
+}
+
+bool WinDriver::RouteTable::ReadClock(PRouteClock Target) {
+	if (!Page)
+		return false;
+
+	return SeqLock::Read(&Page->Seq, &Page->Clock, Target);
+}
+
+bool WinDriver::RouteTable::Join(BYTE Route) {
+	LONG Self = (LONG)GetCurrentProcessId();
+
+	if (!Page || Route == ROUTE_OWNER || Route >= MAX_ROUTES)
+		return false;
+
+	RouteConsumer* Consumer = &Page->Consumers[Route];
+	LONG Current = Consumer->PID;
+
+	// A host that died without leaving doesn't keep the route forever
+	if (Current && Current != Self && IsAlive(Route))
+		return false;
+
+	// The heartbeat goes first, so that the producer doesn't think the new host is dead already
+	InterlockedExchange64(&Consumer->Heartbeat, (LONG64)GetTickCount64());
+	return InterlockedCompareExchange(&Consumer->PID, Self, Current) == Current;
+}
+
+void WinDriver::RouteTable::SetReady(BYTE Route) {
+	if (!Page || Route == ROUTE_OWNER || Route >= MAX_ROUTES)
+		return;
+
+	InterlockedExchange(&Page->Consumers[Route].Ready, (LONG)GetCurrentProcessId());
+}
+
+void WinDriver::RouteTable::Leave(BYTE Route) {
+	LONG Self = (LONG)GetCurrentProcessId();
+
+	if (!Page || Route == ROUTE_OWNER || Route >= MAX_ROUTES)
+		return;
+
+	InterlockedCompareExchange(&Page->Consumers[Route].Ready, 0, Self);
+	InterlockedCompareExchange(&Page->Consumers[Route].PID, 0, Self);
+}
+
+bool WinDriver::RouteTable::Beat(BYTE Route) {
+	if (!Page || Route >= MAX_ROUTES)
+		return false;
+
+	// Someone else took the route over, it isn't ours anymore
+	if (Page->Consumers[Route].PID != (LONG)GetCurrentProcessId())
+		return false;
+
+	InterlockedExchange64(&Page->Consumers[Route].Heartbeat, (LONG64)GetTickCount64());
+	return true;
+}
+
+bool WinDriver::RouteTable::IsAlive(BYTE Route) {
+	if (!Page || Route >= MAX_ROUTES || !Page->Consumers[Route].PID)
+		return false;
+
+	return (LONG64)GetTickCount64() - Page->Consumers[Route].Heartbeat < HOST_HEARTBEAT_TIMEOUT;
+}
+
+LONG WinDriver::RouteTable::GetPID(BYTE Route) {
+	if (!Page || Route >= MAX_ROUTES)
+		return 0;
+
+	// A host that just took the route over might still be setting up its ring
+	LONG PID = Page->Consumers[Route].PID;
+	return (PID == Page->Consumers[Route].Ready) ? PID : 0;
+}
+
+void WinDriver::RouteTable::ArmDoorbell(BYTE Route) {
+	if (!Page || Route >= MAX_ROUTES)
+		return;
+
+	InterlockedExchange(&Page->Consumers[Route].Waiting, 1);
+}
+
+bool WinDriver::RouteTable::TakeWaiter(BYTE Route) {
+	if (!Page || Route >= MAX_ROUTES)
+		return false;
+
+	volatile LONG* Waiting = &Page->Consumers[Route].Waiting;
+	return *Waiting && InterlockedExchange(Waiting, 0);
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINROUTING_H
+
+#define WINROUTING_H
+
+#include "WinError.hpp"
+#include "WinSeqLock.hpp"
+#include <windows.h>
+#include <AclAPI.h>
+
+/*
+
+	Channel and key routing, so that a pipe can be rendered by more than one
+	host process at once, when a single synth can't keep up with it.
+
+	The owner of the pipe (the host that created it) is route 0. The other hosts
+	open the pipe through SynthPipe::OpenRoute() as route 1 to MAX_ROUTES - 1,
+	and each one of them creates a ring of its own next to the pipe's, laid out
+	like the short events buffer. The producer writes the events of a route
+	straight into its ring while it saves them, so they get split in a single pass,
+	and the routed hosts read them with the usual consumer functions.
+
+	The owner sets the ranges with SetRoutes(), they get compiled into a map:
+	Keys = Route of every note, by channel and key, used by the note on,
+	       note off and polyphonic aftertouch events
+	Channels = Routes that get the other events of the channel, bit N is route N,
+	           which are all the routes that have at least one of its keys
+
+	The ranges are applied in order, so a later one overrides an earlier one,
+	and whatever no range covers stays with the owner.
+	System messages go to every route.
+
+	What stays with the owner:
+	- The long events, SysEx is usually meant for the whole synth
+	- The priority lane, the routed events are always published right away,
+	  without batching, and in the order the app sent them
+	- UMP pipes, they don't get a routing table at all
+
+	A route nobody joined, or whose host stopped beating for HOST_HEARTBEAT_TIMEOUT ms,
+	falls back to the owner. When the map changes, the routes that lose notes get
+	All Notes Off (or All Sound Off, if they lose the whole channel) on the channels
+	that changed, so that nothing hangs.
+
+	Resets apply to every ring, so each host skips its own stale events.
+
+	Clock = Shared audio clock, so that the hosts play the same event at the same time:
+	Anchor = QPC ticks of frame 0, set by the owner through SetClock()
+	SampleRate = Rate every host has to render at
+	LatencyMs = Fixed delay every host plays the events with
+	The hosts start their jitter buffers on it, see JitterBuffer::StartShared().
+
+	The map and the clock are protected by a sequence lock, like the control page,
+	see WinSeqLock.hpp.
+	The consumer slots live outside of it, the heartbeats would keep waking up
+	HasChanged() for nothing.
+
+*/
+
+#define MAX_ROUTES			8		// Including the owner, the masks are a BYTE
+#define MAX_ROUTE_RANGES	64
+#define ROUTE_OWNER			0
+
+typedef struct {
+	BYTE Route;
+	BYTE FirstChannel;
+	BYTE LastChannel;
+	BYTE FirstKey;		// The keys only matter to the note events
+	BYTE LastKey;
+	BYTE Reserved[3];
+} RouteRange, *PRouteRange;
+
+typedef struct {
+	DWORD Count;
+	RouteRange Ranges[MAX_ROUTE_RANGES];
+} RouteRules, *PRouteRules;
+
+typedef struct {
+	BYTE Keys[16][128];
+	BYTE Channels[16];
+} RouteMap, *PRouteMap;
+
+typedef struct {
+	LONG64 Anchor;		// 0 if the owner didn't start the clock
+	DWORD SampleRate;
+	DWORD LatencyMs;
+} RouteClock, *PRouteClock;
+
+typedef struct {
+	volatile LONG PID;			// 0 if nobody joined the route
+	volatile LONG Ready;		// PID of the host once its ring is ready, the producer waits for it
+	volatile LONG Waiting;		// Same as the control page's, for the route's doorbell
+	volatile LONG64 Heartbeat;	// GetTickCount64() of the last beat
+} RouteConsumer;
+
+typedef struct {
+	volatile LONG Seq;
+	RouteMap Map;
+	RouteClock Clock;
+	RouteConsumer Consumers[MAX_ROUTES];
+} RoutePageData, RtePage, *PRtePage;
+
+namespace WinDriver {
+	class RouteTable {
+	private:
+		ErrorSystem::WinErr RouteErr;
+
+		HANDLE PPage = nullptr;
+		PRtePage Page = nullptr;
+
+		LONG LockPage();
+		void UnlockPage(LONG Locked);
+
+	public:
+		bool OpenRoutes(const wchar_t* Name, bool Create);
+		bool CloseRoutes();
+		bool IsOpen() { return Page != nullptr; }
+
+		// Everything to the owner
+		static void GetIdentity(PRouteMap Map);
+
+		// Owner side
+		bool SetRoutes(const RouteRules* Rules);
+		bool SetClock(DWORD SampleRate, DWORD LatencyMs);
+
+		// Producer side, the map with the routes missing from Live folded into the owner
+		bool HasChanged(LONG* LastSeq);
+		bool ReadMap(PRouteMap Target);
+		static void Resolve(const RouteMap* Map, BYTE Live, PRouteMap Target);
+
+		bool ReadClock(PRouteClock Target);
+
+		// Routed hosts, Join() fails if someone else is beating on the route,
+		// SetReady() tells the producer that the ring can be mapped
+		bool Join(BYTE Route);
+		void SetReady(BYTE Route);
+		void Leave(BYTE Route);
+		bool Beat(BYTE Route);
+		bool IsAlive(BYTE Route);
+
+		// The host of the route, 0 until its ring is ready
+		LONG GetPID(BYTE Route);
+
+		// Same as the control page's, one per route
+		void ArmDoorbell(BYTE Route);
+		bool TakeWaiter(BYTE Route);
+	};
+}
+
+#endif
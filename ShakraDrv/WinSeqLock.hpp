@@ -0,0 +1,128 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINSEQLOCK_H
+
+#define WINSEQLOCK_H
+
+#include <windows.h>
+#include <string.h>
+
+/*
+
+	Sequence lock for the pages shared between processes (control page,
+	channel shadow, routing table):
+	- Writers take the odd value through a CAS, change the fields, then make it even again
+	- Readers copy the fields, and retry if Seq was odd or changed meanwhile
+
+	Any process with the page open can be a writer, and a process can die while
+	it holds the lock, which would leave Seq odd forever. So nobody waits for
+	more than SEQLOCK_TIMEOUT ms:
+	- A writer that sees the same odd value for that long takes the lock over,
+	  by moving Seq to the next odd value. If the old writer was only stalled,
+	  its Unlock() finds out and leaves Seq alone
+	- A reader gives up and returns false, so the caller keeps the copy it had,
+	  the next writer will take the lock over anyway
+
+	A writer holds the lock for a few hundred ns, so the timeout only ever
+	matters when something went wrong.
+
+*/
+
+#define SEQLOCK_TIMEOUT		100		// ms
+#define SEQLOCK_SPINS		64		// Spins before checking the clock, and yielding the CPU
+
+namespace WinDriver {
+	class SeqLock {
+	private:
+		// False once the lock has been stuck for SEQLOCK_TIMEOUT ms, Since starts at 0
+		static bool KeepWaiting(ULONGLONG* Since, unsigned int Spins) {
+			if (Spins < SEQLOCK_SPINS) {
+				YieldProcessor();
+				return true;
+			}
+
+			ULONGLONG Now = GetTickCount64();
+
+			if (!*Since)
+				*Since = Now;
+			else if (Now - *Since >= SEQLOCK_TIMEOUT)
+				return false;
+
+			Sleep(0);
+			return true;
+		}
+
+	public:
+		// Returns the odd value the lock got taken with, for Unlock()
+		static LONG Lock(volatile LONG* Seq) {
+			ULONGLONG Since = 0;
+			LONG Stuck = 0;
+
+			for (unsigned int Spins = 0;; Spins++) {
+				LONG Value = *Seq;
+
+				if (!(Value & 1)) {
+					if (InterlockedCompareExchange(Seq, Value + 1, Value) == Value)
+						return Value + 1;
+
+					continue;
+				}
+
+				// Another writer, start counting again
+				if (Value != Stuck) {
+					Stuck = Value;
+					Since = 0;
+					Spins = 0;
+				}
+
+				if (KeepWaiting(&Since, Spins))
+					continue;
+
+				// The writer died with the lock, or it's stuck, take it over
+				if (InterlockedCompareExchange(Seq, Value + 2, Value) == Value)
+					return Value + 2;
+			}
+		}
+
+		// False if the lock got taken over in the meantime
+		static bool Unlock(volatile LONG* Seq, LONG Locked) {
+			// Interlocked, so that the fields are visible before the new value
+			return InterlockedCompareExchange(Seq, Locked + 1, Locked) == Locked;
+		}
+
+		// Target is left as it was if the lock stays busy for too long
+		template <typename T>
+		static bool Read(volatile LONG* Seq, const T* Source, T* Target) {
+			ULONGLONG Since = 0;
+			LONG Value;
+			T Copy;
+
+			for (unsigned int Spins = 0;; Spins++) {
+				Value = *Seq;
+				MemoryBarrier();
+
+				memcpy(&Copy, (const void*)Source, sizeof(T));
+
+				MemoryBarrier();
+
+				if (!(Value & 1) && Value == *Seq)
+					break;
+
+				if (!KeepWaiting(&Since, Spins))
+					return false;
+			}
+
+			memcpy(Target, &Copy, sizeof(T));
+			return true;
+		}
+	};
+}
+
+#endif
@@ -8,6 +8,7 @@ This file is useful only if you want to compile the driver under Windows, it's n
 #ifdef _WIN32
 
 #include "WinSynthPipe.hpp"
+#include "WinEvCapture.hpp"
 
 bool WinDriver::SynthPipe::OpenSynthHost(const wchar_t* Target) {
 	const wchar_t* AppName = L"ShakraHost.exe";
@@ -94,199 +95,1890 @@ std::wstring WinDriver::SynthPipe::GenerateID() {
 	return str;
 }
 
-bool WinDriver::SynthPipe::PrepareArrays() {
-	// If the pipes haven't been initialized, do it now
+bool WinDriver::SynthPipe::PrepareFileMappings(const wchar_t* Pipe, bool Create, int Size, DWORD Mode) {
+	std::wstring TempID = GenerateID();
+	const wchar_t* Name = !Pipe ? TempID.c_str() : Pipe;
+
+	if (!OpenMappings(Name, Create, Size, Mode))
+		return false;
+
+	// The creator is the host, it reads the events until it dies or a standby takes over
+	if (Create) {
+		ControlSys.ClaimOwner(ShortRing.GetConsumerSlot(), PriorityRing.GetConsumerSlot());
+		ClaimedConsumer = true;
+	}
+
+	if (!Create) 
+	{
+		if (!OpenSynthHost(Name))
+		{
+			NERROR(SynthErr, nullptr, false);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::OpenMappings(const wchar_t* Name, bool Create, int Size, DWORD Mode) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+
+	// Initialize short buffer
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SEvLabel, Name);
+	MessageBox(NULL, FMName, Name, MB_OK);
+	PDrvShortEvBuf =
+		Create ?
+		// If "Create" is true, create the file mapping, only reserving the memory since the ring commits it as it grows
+		CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, 0, sizeof(ShortEvBuf), FMName) :
+		// Else, open the already existing (if it exists ofc) file mapping
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (PDrvShortEvBuf) {
+		if (Create)
+			SetSecurityInfo(PDrvShortEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+		PVOID MOVF = MapViewOfFile(PDrvShortEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+		if (MOVF != nullptr) DrvShortEvBuf = (PShortEvBuf)MOVF;
+		else
+		{
+			NERROR(SynthErr, nullptr, false);
+			return false;
+		}
+
+		// The size is rounded up to a power of two, an invalid one gets the default one
+		if (!ShortRing.Attach(DrvShortEvBuf, Create, (Size > 0) ? (unsigned int)Size : DEF_SE_BUF, MIN_SE_BUF)) {
+			NERROR(SynthErr, L"Failed to commit the memory for the short events buffer.", false);
+			return false;
+		}
+
+		// The host is a consumer like any other on broadcast rings
+		if (Create && !ShortRing.AttachConsumer()) {
+			NERROR(SynthErr, L"No free consumer slots left in the short events buffer.", false);
+			return false;
+		}
+	}
+
+	// Initialize long buffer
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, LEvLabel, Name);
+	MessageBox(NULL, FMName, Name, MB_OK);
+	PDrvLongEvBuf =
+		Create ?
+		// If "Create" is true, create the file mapping, only reserving the memory since the slots get committed as they're used
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, 0, sizeof(LongEvBuf), FMName) :
+		// Else, open the already existing (if it exists ofc) file mapping
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (PDrvLongEvBuf) {
+		if (Create)
+			SetSecurityInfo(PDrvLongEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+		PVOID MOVF = MapViewOfFile(PDrvLongEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+		if (MOVF != nullptr) DrvLongEvBuf = (PLongEvBuf)MOVF;
+		else
+		{
+			NERROR(SynthErr, nullptr, false);
+			return false;
+		}
+
+		// Only the heads for now, see CommitLongSlot()
+		memset(LongCommitted, 0, sizeof(LongCommitted));
+
+		if (!VirtualAlloc(DrvLongEvBuf, offsetof(LongEvBuf, Buf), MEM_COMMIT, PAGE_READWRITE)) {
+			NERROR(SynthErr, L"Failed to commit the memory for the long events buffer.", false);
+			return false;
+		}
+	}
+
+	if (!DrvShortEvBuf || !DrvLongEvBuf) {
+		NERROR(SynthErr, nullptr, false);
+		return false;
+	}
+
+	// Start from the current generation, so that a fresh consumer doesn't panic for no reason
+	ConsumerGeneration = DrvShortEvBuf->Generation;
+	PanicLeft = 0;
+
+	// Initialize SysEx cache, the pipe still works without it
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SXCLabel, Name);
+	if (!SysExSys.OpenCache(FMName, Create))
+		LOG(SynthErr, L"Failed to open the SysEx cache, long events will be copied in full.");
+
+	// Initialize control page, same as above
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, CtlLabel, Name);
+	if (!ControlSys.OpenControl(FMName, Create))
+		LOG(SynthErr, L"Failed to open the control page, volume changes will be ignored.");
+
+	// Initialize doorbell, the consumers can still poll without it
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, DblLabel, Name);
+	Doorbell =
+		Create ?
+		CreateEventW(NULL, FALSE, FALSE, FMName) :
+		OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, FMName);
+
+	if (Doorbell && Create)
+		SetSecurityInfo(Doorbell, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+	else if (!Doorbell)
+		LOG(SynthErr, L"Failed to open the doorbell, the consumers will have to poll the pipe.");
+
+	// Initialize channel state shadow, same as above
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, ChsLabel, Name);
+	if (!ChannelSys.OpenShadow(FMName, Create))
+		LOG(SynthErr, L"Failed to open the channel state shadow, late hosts won't be able to catch up.");
+
+	// Initialize patch hints, same as above
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, PchLabel, Name);
+	if (!HintSys.OpenHints(FMName, Create))
+		LOG(SynthErr, L"Failed to open the patch hints, the host will load the instruments when they're played.");
+
+	// The host picks the UMP mode, the apps find out by looking for the ring
+	if (Create && Mode != PIPE_MODE_LEGACY) {
+		if (!OpenUMPRing(Name, true)) {
+			NERROR(SynthErr, L"Failed to create the UMP ring.", false);
+			return false;
+		}
+
+		ControlSys.SetUMPProtocol((Mode == PIPE_MODE_UMP_MIDI2) ? UMP_PROTOCOL_MIDI2 : UMP_PROTOCOL_MIDI1);
+	}
+	else if (!Create)
+		OpenUMPRing(Name, false);
+
+	// Initialize priority lane, same as above. UMP pipes have a single ring, so they don't use it
+	if (!UMPRing.IsAttached() && !OpenPriorityLane(Name, Create))
+		LOG(SynthErr, L"Failed to open the priority lane, all the events will go through the normal one.");
+
+	// Initialize routing table, same as above. UMP pipes aren't routed, see WinRouting.hpp
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, RteLabel, Name);
+	if (!UMPRing.IsAttached() && !RouteSys.OpenRoutes(FMName, Create))
+		LOG(SynthErr, L"Failed to open the routing table, the owner will get all the events.");
+
+	// The producer maps the rings of the routes when their hosts show up
+	PipeName = Name;
+	RouteTable::GetIdentity(&ProducerRoutes);
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::OpenUMPRing(const wchar_t* Name, bool Create) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, UMPLabel, Name);
+	PDrvUMPEvBuf =
+		Create ?
+		CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, 0, sizeof(UMPEvBuf), FMName) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (!PDrvUMPEvBuf)
+		return false;
+
+	if (Create)
+		SetSecurityInfo(PDrvUMPEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	DrvUMPEvBuf = (PUMPEvBuf)MapViewOfFile(PDrvUMPEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	// Same sizes as the short events buffer, it takes its place
+	if (DrvUMPEvBuf && UMPRing.Attach(DrvUMPEvBuf, Create, DEF_SE_BUF, MIN_SE_BUF)) {
+		if (!Create || UMPRing.AttachConsumer()) {
+			ResetUMPConsumer();
+			return true;
+		}
+
+		UMPRing.Detach();
+	}
+
+	if (DrvUMPEvBuf)
+		UnmapViewOfFile(DrvUMPEvBuf);
+
+	CloseHandle(PDrvUMPEvBuf);
+	PDrvUMPEvBuf = nullptr;
+	DrvUMPEvBuf = nullptr;
+
+	return false;
+}
+
+void WinDriver::SynthPipe::ResetUMPConsumer() {
+	UMPPendingCount = UMPPendingIdx = 0;
+	UMPSysEx.clear();
+	UMPInSysEx = false;
+	UMPSysExReady = false;
+}
+
+bool WinDriver::SynthPipe::OpenPriorityLane(const wchar_t* Name, bool Create) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SPrLabel, Name);
+	PDrvPriorityEvBuf =
+		Create ?
+		CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, 0, sizeof(PriorityEvBuf), FMName) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (!PDrvPriorityEvBuf)
+		return false;
+
+	if (Create)
+		SetSecurityInfo(PDrvPriorityEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	DrvPriorityEvBuf = (PPriorityEvBuf)MapViewOfFile(PDrvPriorityEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	// It's small enough already, so it never gets resized
+	if (DrvPriorityEvBuf && PriorityRing.Attach(DrvPriorityEvBuf, Create, MAX_PR_BUF, MAX_PR_BUF)) {
+		if (!Create || PriorityRing.AttachConsumer())
+			return true;
+
+		PriorityRing.Detach();
+	}
+
+	if (DrvPriorityEvBuf)
+		UnmapViewOfFile(DrvPriorityEvBuf);
+
+	CloseHandle(PDrvPriorityEvBuf);
+	PDrvPriorityEvBuf = nullptr;
+	DrvPriorityEvBuf = nullptr;
+
+	return false;
+}
+
+bool WinDriver::SynthPipe::OpenTap(const wchar_t* Pipe) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+
+	// On the other rings, a tap would steal the events from the host
+	if (!ShortEvRing::IsBroadcast) {
+		NERROR(SynthErr, L"Taps need the driver to be built with a broadcast ring.", false);
+		return false;
+	}
+
+	// Only the short events are broadcasted, the long ones stay with the host
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SEvLabel, Pipe);
+	PDrvShortEvBuf = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (!PDrvShortEvBuf) {
+		NERROR(SynthErr, nullptr, false);
+		return false;
+	}
+
+	DrvShortEvBuf = (PShortEvBuf)MapViewOfFile(PDrvShortEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!DrvShortEvBuf || !ShortRing.Attach(DrvShortEvBuf, false, 0, MIN_SE_BUF) || !ShortRing.AttachConsumer()) {
+		NERROR(SynthErr, L"Failed to attach to the short events buffer.", false);
+		ClosePipe();
+		return false;
+	}
+
+	// The tap still works without the priority events
+	if (OpenPriorityLane(Pipe, false) && !PriorityRing.AttachConsumer())
+		LOG(SynthErr, L"No free consumer slots left in the priority lane.");
+
+	// On UMP pipes, that's where all the events are
+	if (OpenUMPRing(Pipe, false) && !UMPRing.AttachConsumer())
+		LOG(SynthErr, L"No free consumer slots left in the UMP ring.");
+
+	ConsumerGeneration = DrvShortEvBuf->Generation;
+	PanicLeft = 0;
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::ConnectPipe(const wchar_t* Pipe) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+	HANDLE Probe;
+
+	// Looked up first, so that waiting for a pipe that isn't there yet stays quiet
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SEvLabel, Pipe);
+
+	if (!(Probe = OpenFileMapping(FILE_MAP_READ, FALSE, FMName)))
+		return false;
+
+	CloseHandle(Probe);
+
+	// Same as an app, but nobody gets started if the pipe isn't there
+	if (!OpenMappings(Pipe, false, 0, PIPE_MODE_LEGACY)) {
+		ClosePipe();
+		return false;
+	}
+
+	// Whatever was known about the previous owner doesn't apply to this one
+	LastHostCheck = 0;
+	HostGone = false;
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::OpenStandby(const wchar_t* Pipe) {
+	// Everything gets mapped now, so that the takeover doesn't have to wait for it
+	if (!OpenMappings(Pipe, false, 0, PIPE_MODE_LEGACY)) {
+		ClosePipe();
+		return false;
+	}
+
+	if (!ControlSys.RegisterStandby()) {
+		NERROR(SynthErr, L"The pipe already has a standby host, or it has no control page.", false);
+		ClosePipe();
+		return false;
+	}
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::OpenRoute(const wchar_t* Pipe, BYTE Route, int Size) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+
+	if (Route == ROUTE_OWNER || Route >= MAX_ROUTES) {
+		NERROR(SynthErr, L"Route 0 is the owner of the pipe, the other hosts have to pick one from 1 to MAX_ROUTES - 1.", false);
+		return false;
+	}
+
+	// The owner creates the table, nothing gets routed without it
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, RteLabel, Pipe);
+	if (!RouteSys.OpenRoutes(FMName, false)) {
+		NERROR(SynthErr, L"The pipe has no routing table, its owner might not be running yet.", false);
+		return false;
+	}
+
+	if (!RouteSys.Join(Route)) {
+		NERROR(SynthErr, L"Another host is already reading this route.", false);
+		RouteSys.CloseRoutes();
+		return false;
+	}
+
+	// The ring of the route becomes the short events buffer, so that the consumer functions work as they are
+	if (!MapRouteRing(Pipe, Route, true, Size, ShortRing, DrvShortEvBuf, PDrvShortEvBuf, Doorbell)) {
+		NERROR(SynthErr, L"Failed to create the ring of the route.", false);
+		RouteSys.Leave(Route);
+		RouteSys.CloseRoutes();
+		return false;
+	}
+
+	// Volume and mute still come from the owner's control page
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, CtlLabel, Pipe);
+	if (!ControlSys.OpenControl(FMName, false))
+		LOG(SynthErr, L"Failed to open the control page, volume changes will be ignored.");
+
+	ConsumerRoute = Route;
+	ConsumerGeneration = DrvShortEvBuf->Generation;
+	PanicLeft = 0;
+
+	// The producer maps the ring the next time it looks at the routes
+	RouteSys.SetReady(Route);
+	ClaimedConsumer = true;
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::MapRouteRing(const wchar_t* Name, BYTE Route, bool Create, int Size, ShortEvRing& Ring, PShortEvBuf& Buf, HANDLE& Mapping, HANDLE& Bell) {
+	wchar_t FMName[MAX_PATH] = { 0 };
+	wchar_t Label[8] = { 0 };
+
+	swprintf_s(Label, 8, L"%s%u", RtLabel, (unsigned int)Route);
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, Label, Name);
+	Mapping =
+		Create ?
+		CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, 0, sizeof(ShortEvBuf), FMName) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+
+	if (!Mapping)
+		return false;
+
+	if (Create)
+		SetSecurityInfo(Mapping, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	Buf = (PShortEvBuf)MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	// Same as the short events buffer, the host reading it picks the size
+	if (!Buf || !Ring.Attach(Buf, Create, (Size > 0) ? (unsigned int)Size : DEF_SE_BUF, MIN_SE_BUF) || (Create && !Ring.AttachConsumer())) {
+		UnmapRouteRing(Ring, Buf, Mapping, Bell);
+		return false;
+	}
+
+	// The host can still poll without it
+	swprintf_s(Label, 8, L"%s%u", RdbLabel, (unsigned int)Route);
+	swprintf_s(FMName, MAX_PATH, FileMappingTemplate, Label, Name);
+	Bell =
+		Create ?
+		CreateEventW(NULL, FALSE, FALSE, FMName) :
+		OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, FMName);
+
+	if (Bell && Create)
+		SetSecurityInfo(Bell, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	return true;
+}
+
+void WinDriver::SynthPipe::UnmapRouteRing(ShortEvRing& Ring, PShortEvBuf& Buf, HANDLE& Mapping, HANDLE& Bell) {
+	if (Ring.IsAttached())
+		Ring.Detach();
+
+	if (Buf) {
+		UnmapViewOfFile(Buf);
+		Buf = nullptr;
+	}
+
+	if (Mapping) {
+		CloseHandle(Mapping);
+		Mapping = nullptr;
+	}
+
+	if (Bell) {
+		CloseHandle(Bell);
+		Bell = nullptr;
+	}
+}
+
+void WinDriver::SynthPipe::CheckRoutes() {
+	for (BYTE Route = 1; Route < MAX_ROUTES; Route++) {
+		bool Gone = !RouteSys.IsAlive(Route);
+
+		if (Gone && !RouteGone[Route] && RoutePID[Route])
+			LOG(SynthErr, L"A routed host stopped beating, the owner gets its events back.");
+
+		// RefreshRoutes() does the rest with the next event, this only stops the back-pressure from waiting on a dead host
+		if (Gone != RouteGone[Route] || RouteSys.GetPID(Route) != RoutePID[Route])
+			RoutesDirty = true;
+
+		if (Gone)
+			RouteGone[Route] = true;
+	}
+}
+
+void WinDriver::SynthPipe::RefreshRoutes() {
+	RouteMap Map, Resolved;
+	LARGE_INTEGER Now;
+	BYTE Live = 1 << ROUTE_OWNER;
+
+	if (!RouteSys.HasChanged(&RouteSeq) && !RoutesDirty)
+		return;
+
+	// Keep the old routes, and try again on the next event
+	if (!RouteSys.ReadMap(&Map)) {
+		RoutesDirty = true;
+		return;
+	}
+
+	RoutesDirty = false;
+
+	for (BYTE Route = 1; Route < MAX_ROUTES; Route++) {
+		LONG PID = RouteSys.GetPID(Route);
+
+		// A new host comes with a new ring
+		if (PID != RoutePID[Route]) {
+			UnmapRouteRing(RouteRings[Route], DrvRouteEvBuf[Route], PDrvRouteEvBuf[Route], RouteDoorbells[Route]);
+			RoutePID[Route] = 0;
+
+			if (PID && MapRouteRing(PipeName.c_str(), Route, false, 0, RouteRings[Route], DrvRouteEvBuf[Route], PDrvRouteEvBuf[Route], RouteDoorbells[Route]))
+				RoutePID[Route] = PID;
+		}
+
+		RouteGone[Route] = !RouteSys.IsAlive(Route);
+
+		if (RoutePID[Route] && !RouteGone[Route])
+			Live |= 1 << Route;
+	}
+
+	RouteTable::Resolve(&Map, Live, &Resolved);
+
+	QueryPerformanceCounter(&Now);
+
+	// The notes that moved would never get their note off. The routes that keep the channel
+	// still get its pedal, so All Notes Off is enough, the others have to cut everything
+	for (int Channel = 0; Channel < 16; Channel++) {
+		BYTE Old = ProducerRoutes.Channels[Channel];
+		BYTE New = Resolved.Channels[Channel];
+
+		if (!memcmp(ProducerRoutes.Keys[Channel], Resolved.Keys[Channel], sizeof(Resolved.Keys[Channel])))
+			continue;
+
+		SaveRoutedEvent(0xB0 | Channel | (123 << 8), Old & New, Now.QuadPart);
+		SaveRoutedEvent(0xB0 | Channel | (120 << 8), Old & ~New, Now.QuadPart);
+	}
+
+	ProducerRoutes = Resolved;
+	RouteLive = Live;
+}
+
+BYTE WinDriver::SynthPipe::GetRouteTargets(DWORD Event) {
+	BYTE Status = Event & 0xFF;
+
+	// Stray data bytes have no channel, they stay with the owner
+	if (!(Status & 0x80))
+		return 1 << ROUTE_OWNER;
+
+	if (Status >= 0xF0)
+		return RouteLive;
+
+	switch (Status & 0xF0) {
+	case 0x80:
+	case 0x90:
+	case 0xA0:
+		return 1 << ProducerRoutes.Keys[Status & 0x0F][(Event >> 8) & 0x7F];
+
+	default:
+		return ProducerRoutes.Channels[Status & 0x0F];
+	}
+}
+
+bool WinDriver::SynthPipe::SaveRoutedEvent(DWORD Event, BYTE Targets, unsigned long long Timestamp) {
+	bool Saved = true;
+
+	for (BYTE Route = 0; Route < MAX_ROUTES; Route++) {
+		if (!(Targets & (1 << Route)))
+			continue;
+
+		ShortEvRing& Ring = (Route == ROUTE_OWNER) ? ShortRing : RouteRings[Route];
+		PShortEvBuf Buf = (Route == ROUTE_OWNER) ? DrvShortEvBuf : DrvRouteEvBuf[Route];
+
+		// The host left, and took its ring with it
+		if (!Buf)
+			continue;
+
+		// Whatever the app staged on the owner's ring goes first
+		if (Route == ROUTE_OWNER)
+			PublishShortEvents();
+
+		PSE Slot = ClaimSlot(Ring, (Route == ROUTE_OWNER) ? HostGone : RouteGone[Route]);
+
+		if (!Slot) {
+			Saved = false;
+			continue;
+		}
+
+		Slot->Event = Event;
+		Slot->Generation = Buf->Generation;
+		Slot->Timestamp = Timestamp;
+
+		Ring.Commit();
+
+		if (Route == ROUTE_OWNER) RingDoorbell();
+		else RingRouteDoorbell(Route);
+	}
+
+	return Saved;
+}
+
+void WinDriver::SynthPipe::RingRouteDoorbell(BYTE Route) {
+	if (!RouteDoorbells[Route])
+		return;
+
+	// Same as RingDoorbell()
+	MemoryBarrier();
+
+	if (RouteSys.TakeWaiter(Route))
+		SetEvent(RouteDoorbells[Route]);
+}
+
+bool WinDriver::SynthPipe::SetRoutes(const RouteRules* Rules) {
+	return RouteSys.SetRoutes(Rules);
+}
+
+bool WinDriver::SynthPipe::SetRouteClock(DWORD SampleRate, DWORD LatencyMs) {
+	return RouteSys.SetClock(SampleRate, LatencyMs);
+}
+
+bool WinDriver::SynthPipe::ReadRouteClock(PRouteClock Target) {
+	return RouteSys.ReadClock(Target);
+}
+
+bool WinDriver::SynthPipe::WaitForTakeOver(DWORD Timeout) {
+	ULONGLONG Start = GetTickCount64();
+	HANDLE OwnerProc = nullptr;
+	LONG Owner = 0, Cursor = -1, PriorityCursor = -1;
+
+	for (;;) {
+		LONG Current = ControlSys.GetOwnerPID();
+		bool Dead = false;
+
+		// Keep a handle to the owner, so that its crash wakes us up right away
+		if (Current != Owner) {
+			if (OwnerProc) CloseHandle(OwnerProc);
+
+			Owner = Current;
+			OwnerProc = Owner ? OpenProcess(SYNCHRONIZE, FALSE, (DWORD)Owner) : nullptr;
+		}
+
+		if (!Owner)
+			Sleep(HOST_CHECK_INTERVAL);
+		else if (OwnerProc)
+			Dead = WaitForSingleObject(OwnerProc, HOST_CHECK_INTERVAL) == WAIT_OBJECT_0 || !ControlSys.IsOwnerAlive();
+		else {
+			// Can't open the process, the heartbeat is all we have
+			Sleep(HOST_CHECK_INTERVAL);
+			Dead = !ControlSys.IsOwnerAlive();
+		}
+
+		if (Dead && ControlSys.TakeOver(Owner, &Cursor, &PriorityCursor))
+			break;
+
+		if (Timeout != INFINITE && GetTickCount64() - Start >= Timeout) {
+			if (OwnerProc) CloseHandle(OwnerProc);
+			return false;
+		}
+	}
+
+	if (OwnerProc)
+		CloseHandle(OwnerProc);
+
+	// Start from what the old owner committed, the events after it are still in the buffers
+	ShortRing.TakeOverConsumer(Cursor);
+	if (PriorityRing.IsAttached())
+		PriorityRing.TakeOverConsumer(PriorityCursor);
+
+	// The control page has no room for the UMP cursor, broadcast rings start again from the newest packet
+	if (UMPRing.IsAttached()) {
+		UMPRing.TakeOverConsumer(-1);
+		ResetUMPConsumer();
+	}
+
+	ConsumerGeneration = DrvShortEvBuf->Generation;
+	PanicLeft = 0;
+	ClaimedConsumer = true;
+
+	LOG(SynthErr, L"The standby host took over the pipe.");
+	return true;
+}
+
+bool WinDriver::SynthPipe::Heartbeat() {
+	// The routed hosts beat on their route, the owner is still the owner's business
+	if (ConsumerRoute)
+		return RouteSys.Beat(ConsumerRoute);
+
+	return ControlSys.Beat();
+}
+
+bool WinDriver::SynthPipe::ReadLiveness(PHostLiveness Target) {
+	return ControlSys.ReadLiveness(Target);
+}
+
+void WinDriver::SynthPipe::CheckHost() {
+	HostLiveness Host;
+
+	LastHostCheck = GetTickCount64();
+
+	if (RouteSys.IsOpen())
+		CheckRoutes();
+
+	if (!ControlSys.ReadLiveness(&Host))
+		return;
+
+	bool Alive = ControlSys.IsOwnerAlive();
+
+	// Let the standby and the UI know, the events stay in the buffers for whoever comes next
+	if (!Alive && ProducerCtl.HostStatus == HOST_STATUS_RUNNING) {
+		LOG(SynthErr, L"The host stopped beating, it might have crashed.");
+		ControlSys.SetHostStatus(HOST_STATUS_DEAD);
+	}
+
+	HostGone = !Alive && !Host.StandbyPID;
+}
+
+bool WinDriver::SynthPipe::ClosePipe() {
+	if (!PDrvShortEvBuf && !PDrvLongEvBuf) {
+		LOG(SynthErr, L"ClosePipe() called with no pipes allocated.");
+		return true;
+	}
+
+	// Whatever the app sent last still has to reach the host
+	StopBatching();
+
+	if (PDrvShortEvBuf) {
+		ShortRing.Detach();
+
+		if (DrvShortEvBuf)
+			UnmapViewOfFile(DrvShortEvBuf);
+
+		CloseHandle(PDrvShortEvBuf);
+		PDrvShortEvBuf = nullptr;
+		DrvShortEvBuf = nullptr;
+	}
+
+	if (PDrvLongEvBuf) {
+		if (DrvLongEvBuf)
+			UnmapViewOfFile(DrvLongEvBuf);
+
+		CloseHandle(PDrvLongEvBuf);
+		PDrvLongEvBuf = nullptr;
+		DrvLongEvBuf = nullptr;
+	}
+
+	if (PDrvPriorityEvBuf) {
+		PriorityRing.Detach();
+
+		if (DrvPriorityEvBuf)
+			UnmapViewOfFile(DrvPriorityEvBuf);
+
+		CloseHandle(PDrvPriorityEvBuf);
+		PDrvPriorityEvBuf = nullptr;
+		DrvPriorityEvBuf = nullptr;
+	}
+
+	if (PDrvUMPEvBuf) {
+		UMPRing.Detach();
+
+		if (DrvUMPEvBuf)
+			UnmapViewOfFile(DrvUMPEvBuf);
+
+		CloseHandle(PDrvUMPEvBuf);
+		PDrvUMPEvBuf = nullptr;
+		DrvUMPEvBuf = nullptr;
+	}
+
+	for (BYTE Route = 1; Route < MAX_ROUTES; Route++) {
+		UnmapRouteRing(RouteRings[Route], DrvRouteEvBuf[Route], PDrvRouteEvBuf[Route], RouteDoorbells[Route]);
+		RoutePID[Route] = 0;
+		RouteGone[Route] = false;
+	}
+
+	// The route is free for another host right away, instead of after its heartbeat times out
+	if (ConsumerRoute) {
+		RouteSys.Leave(ConsumerRoute);
+		ConsumerRoute = ROUTE_OWNER;
+	}
+
+	ClaimedConsumer = false;
+
+	RouteLive = 1 << ROUTE_OWNER;
+	RouteSeq = 0;
+	RoutesDirty = false;
+
+	SysExSys.CloseCache();
+	ControlSys.CloseControl();
+	ChannelSys.CloseShadow();
+	HintSys.CloseHints();
+	RouteSys.CloseRoutes();
+
+	if (Doorbell) {
+		CloseHandle(Doorbell);
+		Doorbell = nullptr;
+	}
+
+	return true;
+}
+
+bool WinDriver::SynthPipe::IsResetSysEx(const BYTE* Data, DWORD Len) {
+	// GM System On (01), GM System Off (02), GM2 System On (03)
+	if (Len == 6 && Data[0] == 0xF0 && Data[1] == 0x7E && Data[3] == 0x09 && Data[4] >= 0x01 && Data[4] <= 0x03 && Data[5] == 0xF7)
+		return true;
+
+	// GS Reset (40 00 7F) and System Mode Set (00 00 7F)
+	if (Len == 11 && Data[0] == 0xF0 && Data[1] == 0x41 && Data[3] == 0x42 && Data[4] == 0x12 &&
+		(Data[5] == 0x40 || Data[5] == 0x00) && Data[6] == 0x00 && Data[7] == 0x7F && Data[10] == 0xF7)
+		return true;
+
+	// XG System On (7E) and XG All Parameter Reset (7F)
+	if (Len == 9 && Data[0] == 0xF0 && Data[1] == 0x43 && (Data[2] & 0xF0) == 0x10 && Data[3] == 0x4C &&
+		Data[4] == 0x00 && Data[5] == 0x00 && (Data[6] == 0x7E || Data[6] == 0x7F) && Data[7] == 0x00 && Data[8] == 0xF7)
+		return true;
+
+	return false;
+}
+
+void WinDriver::SynthPipe::ResetStream() {
 	if (!DrvShortEvBuf)
-	{
-		DrvShortEvBuf = new (std::nothrow) ShortEvBuf;
+		return;
+
+	PublishShortEvents();
+
+	// ResetHead goes first, the consumer only looks at it after seeing the new generation
+	DrvShortEvBuf->ResetHead = DrvShortEvBuf->WriteHead;
+	if (DrvUMPEvBuf)
+		DrvUMPEvBuf->ResetHead = DrvUMPEvBuf->WriteHead;
+	InterlockedIncrement(&DrvShortEvBuf->Generation);
+
+	// Every route has its own generation, each host skips its own stale events
+	for (BYTE Route = 1; Route < MAX_ROUTES; Route++) {
+		if (!DrvRouteEvBuf[Route])
+			continue;
+
+		DrvRouteEvBuf[Route]->ResetHead = DrvRouteEvBuf[Route]->WriteHead;
+		InterlockedIncrement(&DrvRouteEvBuf[Route]->Generation);
+	}
+
+	RunningStatus = 0;
+}
+
+bool WinDriver::SynthPipe::CheckGeneration() {
+	LONG Generation = DrvShortEvBuf->Generation;
+
+	if (Generation == ConsumerGeneration)
+		return false;
+
+	// Jump straight to where the stream got reset, but never backwards,
+	// the consumer might already be past it if it caught up on its own
+	DWORD ReadHead = ShortRing.GetReadPos();
+	LONG ToReset = ShortRing.Distance(ReadHead, DrvShortEvBuf->ResetHead);
+	LONG ToWrite = ShortRing.Distance(ReadHead, DrvShortEvBuf->WriteHead);
+
+	if (ToReset <= ToWrite)
+		ShortRing.SkipTo(DrvShortEvBuf->ResetHead);
+
+	if (UMPRing.IsAttached()) {
+		ReadHead = UMPRing.GetReadPos();
+
+		if (UMPRing.Distance(ReadHead, DrvUMPEvBuf->ResetHead) <= UMPRing.Distance(ReadHead, DrvUMPEvBuf->WriteHead))
+			UMPRing.SkipTo(DrvUMPEvBuf->ResetHead);
+
+		// Whatever was half converted belongs to the old stream
+		ResetUMPConsumer();
+	}
+
+	ConsumerGeneration = Generation;
+
+	// Drop the stale SysEx messages too
+	while (DrvLongEvBuf) {
+		PLE Slot = PeekLongSlot();
+
+		if (!Slot || (LONG)(Slot->Generation - Generation) >= 0)
+			break;
+
+		ReleaseLongEvent();
+	}
+
+	// The synth might still have notes hanging from the old stream
+	PanicLeft = 32;
+	return true;
+}
+
+unsigned int WinDriver::SynthPipe::ParsePanicEvent() {
+	// All Sound Off (CC 120) and All Notes Off (CC 123) on all the channels
+	int Idx = 32 - PanicLeft;
+	return (0xB0 | (Idx & 0x0F)) | ((Idx < 16 ? 120 : 123) << 8);
+}
+
+bool WinDriver::SynthPipe::PerformBufferCheck() {
+	DWORD Event;
+
+	if (!IsStillConsumer())
+		return false;
+
+	CheckGeneration();
+	return PeekShortEvent(&Event, nullptr);
+}
+
+void WinDriver::SynthPipe::ResetReadHeadsIfNeeded() {
+	if (!IsStillConsumer())
+		return;
+
+	// The synthesized panic events don't take any slot
+	if (PanicLeft > 0) {
+		PanicLeft--;
+		return;
+	}
+
+	if (UMPRing.IsAttached()) {
+		PopShortEvent();
+		UMPRing.Flush();
+		return;
+	}
+
+	// The long events buffer has its own read head, which is moved by ParseLongEvent
+	if (PeekedPriority) {
+		if (PriorityRing.Peek()) {
+			SHAKRA_TRACE(TRACE_DEQUEUE, TRACE_ID(PriorityRing.GetReadPos(), true));
+			PriorityRing.Advance();
+			PriorityRing.Flush();
+		}
+	}
+	else if (ShortRing.Peek()) {
+		SHAKRA_TRACE(TRACE_DEQUEUE, TRACE_ID(ShortRing.GetReadPos(), false));
+		ShortRing.Advance();
+		ShortRing.Flush();
+	}
+}
+
+int WinDriver::SynthPipe::GetReadHeadPos() {
+	// The heads are free running, so mask them to get the actual position
+	if (DrvUMPEvBuf)
+		return DrvUMPEvBuf->ReadHead & DrvUMPEvBuf->Mask;
+
+	return DrvShortEvBuf->ReadHead & DrvShortEvBuf->Mask;
+}
+
+int WinDriver::SynthPipe::GetWriteHeadPos() {
+	if (DrvUMPEvBuf)
+		return DrvUMPEvBuf->WriteHead & DrvUMPEvBuf->Mask;
+
+	return DrvShortEvBuf->WriteHead & DrvShortEvBuf->Mask;
+}
+
+unsigned int WinDriver::SynthPipe::ParseShortEvent() {
+	DWORD Event = 0;
+
+	if (PanicLeft > 0)
+		return ParsePanicEvent();
+
+	if (!PeekShortEvent(&Event, nullptr))
+		return 0;
+
+	// PeekShortEvent() might have found a reset, the panic events aren't recorded here
+	if (Recorder && !PanicLeft)
+		Recorder->RecordShortEvent(Event);
+
+	return Event;
+}
+
+unsigned int WinDriver::SynthPipe::ParseShortEvents(DWORD* Target, unsigned int Max) {
+	unsigned int Count = 0;
+
+	SHAKRA_TRACE(TRACE_WAKE, 0);
+
+	// The flag based rings free the slots as they go, so this has to be checked before reading them
+	if (!IsStillConsumer())
+		return 0;
+
+	CheckGeneration();
+
+	while (Count < Max && PeekShortEvent(&Target[Count], nullptr)) {
+		PopShortEvent();
+		Count++;
+	}
+
+	// Free all the slots at once, instead of once per event.
+	// Some of the events might have been overwritten while we were reading them
+	return FlushShortEvents() ? 0 : Count;
+}
+
+unsigned int WinDriver::SynthPipe::ParseUMPPackets(DWORD* Words, unsigned int MaxWords) {
+	DWORD Packet[UMP_MAX_WORDS];
+	unsigned int Count = 0;
+
+	SHAKRA_TRACE(TRACE_WAKE, 0);
+
+	if (!IsStillConsumer())
+		return 0;
+
+	CheckGeneration();
+
+	if (!UMPRing.IsAttached())
+		return 0;
+
+	while (Count < MaxWords) {
+		// The panic events are MIDI 1.0 CCs, any UMP consumer can take them as they are
+		if (PanicLeft > 0) {
+			unsigned int Len = UMP::FromMidi1(ParsePanicEvent(), 0, UMP_PROTOCOL_MIDI1, Packet);
+
+			if (Count + Len > MaxWords)
+				break;
+
+			memcpy(&Words[Count], Packet, Len * sizeof(DWORD));
+			Count += Len;
+
+			PopShortEvent();
+			continue;
+		}
+
+		PUMPSlot Slot = PeekLane(UMPRing);
+
+		// The ring had packets from a newer stream, start over from the panic events
+		if (PanicLeft > 0)
+			continue;
+
+		if (!Slot)
+			break;
+
+		// Packets never get split between two calls
+		unsigned int Len = UMP::GetWords(Slot->Words[0]);
+		if (Count + Len > MaxWords)
+			break;
+
+		memcpy(&Words[Count], Slot->Words, Len * sizeof(DWORD));
+		Count += Len;
+
+		SHAKRA_TRACE(TRACE_DEQUEUE, TRACE_ID(UMPRing.GetReadPos(), false));
+		UMPRing.Advance();
+	}
+
+	return FlushShortEvents() ? 0 : Count;
+}
+
+bool WinDriver::SynthPipe::PeekShortEvent(DWORD* Event, unsigned long long* Timestamp) {
+	PSE Slot = nullptr;
+
+	// The panic events go before anything else
+	if (PanicLeft > 0) {
+		*Event = ParsePanicEvent();
+		if (Timestamp) *Timestamp = 0;
+		return true;
+	}
+
+	if (UMPRing.IsAttached())
+		return PeekUMPEvent(Event, Timestamp);
+
+	// The priority lane always goes first, see the ordering notes in WinSynthPipe.hpp
+	Slot = PeekLane(PriorityRing);
+	PeekedPriority = (Slot != nullptr);
+
+	if (Slot)
+		SetBarrier(Slot->Event, Slot->Barrier);
+	else if (!PanicLeft) {
+		// What a channel mode message from the priority lane already cut off
+		while ((Slot = PeekLane(ShortRing)) != nullptr && IsBehindBarrier(Slot->Event))
+			ShortRing.Advance();
+	}
+
+	// One of the lanes had events from a newer stream, start over from the panic events
+	if (PanicLeft > 0)
+		return PeekShortEvent(Event, Timestamp);
+
+	if (!Slot)
+		return false;
+
+	*Event = Slot->Event;
+	if (Timestamp) *Timestamp = Slot->Timestamp;
+	return true;
+}
+
+template <typename LaneRing>
+auto WinDriver::SynthPipe::PeekLane(LaneRing& Lane) -> decltype(Lane.Peek()) {
+	decltype(Lane.Peek()) Slot = nullptr;
+
+	if (!Lane.IsAttached())
+		return nullptr;
+
+	while ((Slot = Lane.Peek()) != nullptr) {
+		LONG Stamp = (LONG)(Slot->Generation - ConsumerGeneration);
+
+		if (!Stamp)
+			return Slot;
+
+		// Events from a newer stream, the reset has to be handled first
+		if (Stamp > 0) {
+			CheckGeneration();
+			return nullptr;
+		}
+
+		// Events from an older stream got past the reset head, skip them
+		Lane.Advance();
+	}
+
+	return nullptr;
+}
+
+bool WinDriver::SynthPipe::PeekUMPEvent(DWORD* Event, unsigned long long* Timestamp) {
+	for (;;) {
+		// What's left of the last packet, an RPN gives four events
+		if (UMPPendingIdx < UMPPendingCount) {
+			*Event = UMPPending[UMPPendingIdx];
+			if (Timestamp) *Timestamp = UMPPendingTime;
+			return true;
+		}
+
+		// The SysEx message has to be read first, or the events after it would get ahead of it
+		if (UMPSysExReady)
+			return false;
+
+		PUMPSlot Slot = PeekLane(UMPRing);
+
+		// The ring had packets from a newer stream, start over from the panic events
+		if (PanicLeft > 0)
+			return PeekShortEvent(Event, Timestamp);
+
+		if (!Slot)
+			return false;
+
+		UMPPendingCount = UMP::ToMidi1(Slot->Words, UMPPending);
+		UMPPendingIdx = 0;
+		UMPPendingTime = Slot->Timestamp;
+
+		// SysEx, or something with no MIDI 1.0 equivalent, it's done with right away
+		if (!UMPPendingCount) {
+			CollectSysEx(Slot);
+			UMPRing.Advance();
+		}
+	}
+}
+
+void WinDriver::SynthPipe::CollectSysEx(PUMPSlot Slot) {
+	BYTE Data[UMP_SYSEX8_BYTES];
+	BYTE Status;
+
+	int Len = UMP::SysExPayload(Slot->Words, Data, &Status);
+	if (Len < 0)
+		return;
+
+	if (Status == UMP_SYSEX_START || Status == UMP_SYSEX_COMPLETE) {
+		UMPSysEx.assign(1, 0xF0);
+		UMPSysExTime = Slot->Timestamp;
+		UMPInSysEx = true;
+	}
+	// The start got lost to a reset or an eviction, the rest is useless
+	else if (!UMPInSysEx)
+		return;
+
+	// Room for the F7 too
+	if (UMPSysEx.size() + Len + 1 > MAX_LE_SIZE) {
+		LOG(SynthErr, L"The SysEx message from the UMP ring is too big, it got dropped.");
+		UMPSysEx.clear();
+		UMPInSysEx = false;
+		return;
+	}
+
+	UMPSysEx.insert(UMPSysEx.end(), Data, Data + Len);
+
+	if (Status == UMP_SYSEX_END || Status == UMP_SYSEX_COMPLETE) {
+		UMPSysEx.push_back(0xF7);
+		UMPInSysEx = false;
+		UMPSysExReady = true;
+	}
+}
+
+void WinDriver::SynthPipe::PopShortEvent() {
+	if (PanicLeft > 0) {
+		if (Recorder)
+			Recorder->RecordShortEvent(ParsePanicEvent());
+
+		PanicLeft--;
+		return;
+	}
+
+	if (UMPRing.IsAttached()) {
+		if (UMPPendingIdx >= UMPPendingCount)
+			return;
+
+		if (Recorder)
+			Recorder->RecordShortEvent(UMPPending[UMPPendingIdx]);
+
+		// The packet stays in the ring until all of its events are gone
+		if (++UMPPendingIdx == UMPPendingCount) {
+			SHAKRA_TRACE(TRACE_DEQUEUE, TRACE_ID(UMPRing.GetReadPos(), false));
+			UMPRing.Advance();
+			UMPPendingIdx = UMPPendingCount = 0;
+		}
+
+		return;
+	}
+
+	PSE Slot = PeekedPriority ? PriorityRing.Peek() : ShortRing.Peek();
+
+	if (!Slot)
+		return;
+
+	if (Recorder)
+		Recorder->RecordShortEvent(Slot->Event);
+
+	SHAKRA_TRACE(TRACE_DEQUEUE, TRACE_ID(PeekedPriority ? PriorityRing.GetReadPos() : ShortRing.GetReadPos(), PeekedPriority));
+
+	if (PeekedPriority) PriorityRing.Advance();
+	else ShortRing.Advance();
+}
+
+bool WinDriver::SynthPipe::FlushShortEvents() {
+	// A standby took over while the batch was being read, the read heads are its own now
+	if (!IsStillConsumer())
+		return true;
+
+	ShortRing.Flush();
+
+	if (PriorityRing.IsAttached())
+		PriorityRing.Flush();
+
+	if (UMPRing.IsAttached())
+		UMPRing.Flush();
+
+	// Checked after the flush, the producer might have evicted us while the events were being copied
+	bool Evicted = ShortRing.WasEvicted() || PriorityRing.WasEvicted() || UMPRing.WasEvicted();
+
+	// Too slow for a broadcast ring, start again from the newest event
+	if (ShortRing.WasEvicted()) {
+		LOG(SynthErr, L"The consumer got evicted from the short events buffer, attaching again.");
+		ShortRing.AttachConsumer();
+	}
+
+	if (PriorityRing.WasEvicted()) {
+		LOG(SynthErr, L"The consumer got evicted from the priority lane, attaching again.");
+		PriorityRing.AttachConsumer();
+	}
+
+	if (UMPRing.WasEvicted()) {
+		LOG(SynthErr, L"The consumer got evicted from the UMP ring, attaching again.");
+		UMPRing.AttachConsumer();
+		ResetUMPConsumer();
+	}
+
+	return Evicted;
+}
+
+bool WinDriver::SynthPipe::PeekLongEvent(unsigned long long* Timestamp) {
+	CheckGeneration();
+
+	if (UMPRing.IsAttached()) {
+		DWORD Pending;
+
+		// The SysEx packets only get collected while looking for the next event
+		if (!UMPSysExReady && !PanicLeft)
+			PeekUMPEvent(&Pending, nullptr);
+
+		if (!UMPSysExReady)
+			return false;
+
+		*Timestamp = UMPSysExTime;
+		return true;
+	}
+
+	// Taps and routed hosts don't get the long events
+	if (!DrvLongEvBuf)
+		return false;
+
+	PLE Slot = PeekLongSlot();
+
+	if (!Slot)
+		return false;
+
+	*Timestamp = Slot->Timestamp;
+	return true;
+}
+
+unsigned int WinDriver::SynthPipe::ParseLongEvent(BYTE* PEvent) {
+	const BYTE* Event = nullptr;
+	unsigned int Len = ParseLongEventRef(&Event);
+
+	if (!Len)
+		return 0;
+
+	// Copy new buffer
+	memcpy(PEvent, Event, Len);
+	FreeLongEvent();
+
+	return Len;
+}
+
+unsigned int WinDriver::SynthPipe::ParseLongEventRef(const BYTE** PEvent) {
+	CheckGeneration();
+
+	if (UMPRing.IsAttached()) {
+		unsigned long long Timestamp;
+
+		if (!PeekLongEvent(&Timestamp))
+			return 0;
+
+		*PEvent = UMPSysEx.data();
+		return (unsigned int)UMPSysEx.size();
+	}
+
+	if (!DrvLongEvBuf)
+		return 0;
+
+	PLE Slot = PeekLongSlot();
+	DWORD Len = 0;
+
+	if (!Slot)
+		return 0;
+
+	// The data is either in the slot, or in the SysEx cache
+	if (Slot->CacheRef) {
+		*PEvent = SysExSys.ResolveSysEx(Slot->CacheRef, &Len);
+		return Len;
+	}
+
+	*PEvent = (const BYTE*)Slot->Event;
+	return Slot->EventLength;
+}
+
+bool WinDriver::SynthPipe::FreeLongEvent() {
+	if (UMPRing.IsAttached()) {
+		if (!UMPSysExReady)
+			return false;
+
+		if (Recorder)
+			Recorder->RecordLongEvent(UMPSysEx.data(), (unsigned int)UMPSysEx.size());
+
+		UMPSysEx.clear();
+		UMPSysExReady = false;
+		return true;
+	}
+
+	if (!DrvLongEvBuf)
+		return false;
+
+	if (!PeekLongSlot())
+		return false;
+
+	if (Recorder) {
+		const BYTE* Event = nullptr;
+		unsigned int Len = ParseLongEventRef(&Event);
+		Recorder->RecordLongEvent(Event, Len);
+	}
+
+	ReleaseLongEvent();
+	return true;
+}
+
+void WinDriver::SynthPipe::ReleaseLongEvent() {
+	PLE Slot = &DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead];
+
+	if (Slot->CacheRef) {
+		SysExSys.ReleaseSysEx(Slot->CacheRef);
+		Slot->CacheRef = 0;
+	}
+
+	// Clearing the length is enough to free the slot, no need to wipe the data,
+	// but the reads above have to be done before the producer can reuse it
+	AtomicFence(std::memory_order_release);
+	Slot->EventLength = 0;
+
+	// Move to the next slot
+	DrvLongEvBuf->ReadHead = (DrvLongEvBuf->ReadHead + 1) & (MAX_LE_BUF - 1);
+}
+
+bool WinDriver::SynthPipe::CommitLongSlot(int Index, DWORD Length) {
+	DWORD Needed = (DWORD)offsetof(LE, Event) + Length;
 
-		if (!DrvShortEvBuf) {
-			NERROR(SynthErr, L"Failed to allocate pipe handles for the short events buffer.", false);
+	if (LongCommitted[Index] >= Needed)
+		return true;
+
+	// Committing pages that are already committed is fine, the other process might have done it
+	if (!VirtualAlloc(&DrvLongEvBuf->Buf[Index], Needed, MEM_COMMIT, PAGE_READWRITE)) {
+		NERROR(SynthErr, L"Failed to commit the memory for a long events slot.", false);
+		return false;
+	}
+
+	LongCommitted[Index] = Needed;
+	return true;
+}
+
+PLE WinDriver::SynthPipe::PeekLongSlot() {
+	int Index = DrvLongEvBuf->ReadHead;
+	PLE Slot = &DrvLongEvBuf->Buf[Index];
+
+	if (!CommitLongSlot(Index, 0) || Slot->EventLength < 1)
+		return nullptr;
+
+	// Same as the short events, the rest of the slot is only read once the length says it's there
+	AtomicFence(std::memory_order_acquire);
+
+	// Inline data only, a cache reference has its data in the SysEx cache
+	if (!Slot->CacheRef && !CommitLongSlot(Index, Slot->EventLength))
+		return nullptr;
+
+	return Slot;
+}
+
+template <typename LaneRing>
+auto WinDriver::SynthPipe::ClaimSlot(LaneRing& Lane) -> decltype(Lane.Claim()) {
+	return ClaimSlot(Lane, HostGone);
+}
+
+template <typename LaneRing>
+auto WinDriver::SynthPipe::ClaimSlot(LaneRing& Lane, const bool& Gone) -> decltype(Lane.Claim()) {
+	ULONGLONG Start = 0;
+
+	for (;;) {
+		// The host can ask for less events to be queued than what the ring can hold
+		auto Slot = (!ProducerCtl.MaxPending || Lane.GetFill() < ProducerCtl.MaxPending) ? Lane.Claim() : nullptr;
+
+		// The host can't free anything it can't see
+		if (!Slot && Lane.GetStaged()) {
+			if constexpr (std::is_same_v<LaneRing, ShortEvRing>) PublishShortEvents();
+			else {
+				Lane.Publish();
+				RingDoorbell();
+			}
+		}
+
+		// Nobody's going to free up the slots if the host is dead and there's no standby,
+		// Gone is updated by CheckHost() below
+		if (Slot || ProducerCtl.BackPressure != BACKPRESSURE_BLOCK || Gone)
+			return Slot;
+
+		// Give the host some time to catch up, but don't hang the app forever
+		if (!Start) Start = GetTickCount64();
+		else if (GetTickCount64() - Start > BACKPRESSURE_TIMEOUT)
+			return nullptr;
+
+		Sleep(1);
+
+		if (GetTickCount64() - LastHostCheck >= HOST_CHECK_INTERVAL)
+			CheckHost();
+	}
+}
+
+bool WinDriver::SynthPipe::SaveShortEvent(unsigned int Event) {
+	LARGE_INTEGER Now;
+	PSE Slot = nullptr;
+	bool Priority = false, Eligible = false;
+
+	SHAKRA_TRACE_START(EntryTsc);
+
+	if (!ShortRing.IsAttached())
+		return false;
+
+	// The host might have changed the back-pressure, batching or transform settings
+	RefreshControl();
+
+	if (GetTickCount64() - LastHostCheck >= HOST_CHECK_INTERVAL)
+		CheckHost();
+
+	// Same for the routes, and their hosts might have come or gone
+	if (RouteSys.IsOpen())
+		RefreshRoutes();
+
+	if (PriorityRing.IsAttached() || UMPRing.IsAttached() || ChannelSys.IsOpen() || HintSys.IsOpen() || TransformSys.IsActive() || Profile.ShedAbove || RouteLive != (1 << ROUTE_OWNER)) {
+		// Realtime leaves the running status alone, system common clears it
+		if (Event & 0x80) {
+			BYTE Status = Event & 0xFF;
+
+			if (Status < 0xF0) RunningStatus = Status;
+			else if (Status < 0xF8) RunningStatus = 0;
+		}
+		// The lanes get mixed by the consumer, and packets have no running status,
+		// so the status has to be in the event itself
+		else if (RunningStatus)
+			Event = ((Event << 8) | RunningStatus) & 0xFFFFFF;
+
+		// Filtered out by the host's rules, that's not a failure
+		if (!Pretransformed && TransformSys.IsActive() && !TransformSys.Apply(&Event))
+			return true;
+
+		// Under load, the app's new notes go first, the note offs and the controllers still get through
+		if (Profile.ShedAbove && (Event & 0xF0) == 0x90 && (Event & 0x7F0000) && ShortRing.GetFill() >= Profile.ShedAbove)
 			return false;
+
+		// Before the event gets published, see WinChannelState.hpp
+		ChannelSys.Update(Event);
+		HintSys.Update(Event);
+
+		if (UMPRing.IsAttached()) {
+			DWORD Words[UMP_MAX_WORDS] = { 0 };
+
+			// Stray data bytes and SysEx status bytes have no packet, nothing to send
+			if (!UMP::FromMidi1(Event, 0, ProducerCtl.UMPProtocol, Words))
+				return true;
+
+			return SaveUMPPacket(Words);
+		}
+
+		// The routed events go straight to the rings of their hosts, and skip the owner's if it's not one of them
+		if (RouteLive != (1 << ROUTE_OWNER)) {
+			BYTE Targets = GetRouteTargets(Event);
+
+			if (Targets != (1 << ROUTE_OWNER)) {
+				QueryPerformanceCounter(&Now);
+
+				bool Saved = SaveRoutedEvent(Event, Targets & ~(1 << ROUTE_OWNER), Now.QuadPart);
+
+				if (!(Targets & (1 << ROUTE_OWNER)))
+					return Saved;
+			}
 		}
+
+		Eligible = !(Profile.Flags & PROFILE_NO_PRIORITY) && IsPriorityEvent(Event);
+
+		// An earlier priority event went through the normal lane, wait until the host read it
+		if (Eligible && PriorityBlocked)
+			PriorityBlocked = ShortRing.Distance(PriorityFallback, ShortRing.GetWritePos() - ShortRing.GetFill()) < 0;
+
+		// If the priority lane is full, the normal one is still better than nothing
+		if (Eligible && !PriorityBlocked)
+			Slot = PriorityRing.Claim();
+
+		Priority = (Slot != nullptr);
 	}
 
-	if (!DrvLongEvBuf)
-	{
-		DrvLongEvBuf = new (std::nothrow) LongEvBuf;
+	if (!Slot) {
+		Slot = ClaimSlot(ShortRing);
 
-		if (!DrvLongEvBuf) {
-			NERROR(SynthErr, L"Failed to allocate pipe handles for the long events buffer.", false);
+		// The buffer is full, the event has to be dropped
+		if (!Slot)
 			return false;
+
+		// Until the host reads this one, the priority events have to queue behind it
+		if (Eligible) {
+			PriorityFallback = ShortRing.GetWritePos() + 1;
+			PriorityBlocked = true;
+		}
+	}
+
+	QueryPerformanceCounter(&Now);
+
+	Slot->Event = Event;
+	Slot->Generation = DrvShortEvBuf->Generation;
+	Slot->Barrier = ShortRing.GetWritePos();
+	Slot->Timestamp = Now.QuadPart;
+
+	SHAKRA_TRACE_AT(TRACE_ENQUEUE, TRACE_ID(Priority ? PriorityRing.GetWritePos() : ShortRing.GetWritePos(), Priority), EntryTsc);
+
+	if (!Priority && (PublishBatch || StagingBatch)) {
+		ShortRing.Stage();
+
+		// SaveShortEvents() publishes the whole batch once it's done
+		if (StagingBatch)
+			return true;
+
+		DWORD Staged = ShortRing.GetStaged();
+
+		// The first event of a batch arms the idle flush, the next ones check if the batch is done.
+		// The idle flush might have published everything already, then there's nothing to do
+		if (Staged == 1) {
+			LONGLONG Due = -(LONGLONG)PublishDelayUs * 10;
+			FILETIME DueTime = { (DWORD)Due, (DWORD)(Due >> 32) };
+
+			BatchStart = Now.QuadPart;
+			SetThreadpoolTimer(IdleFlush, &DueTime, 0, 0);
 		}
+		else if (Staged >= PublishBatch || Now.QuadPart - BatchStart >= PublishDelay)
+			PublishShortEvents();
+
+		return true;
 	}
 
+	if (Priority) PriorityRing.Commit();
+	else ShortRing.Commit();
+
+	RingDoorbell();
+
+	SHAKRA_TRACE(TRACE_PUBLISH, TRACE_ID((Priority ? PriorityRing.GetWritePos() : ShortRing.GetWritePos()) - 1, Priority));
+
 	return true;
 }
 
-bool WinDriver::SynthPipe::PrepareFileMappings(const wchar_t* Pipe, bool Create, int Size) {
-	std::wstring TempID = GenerateID();
-	wchar_t FMName[MAX_PATH] = { 0 };
+bool WinDriver::SynthPipe::SaveUMPPacket(const DWORD* Words) {
+	LARGE_INTEGER Now;
 
-	// Prepare arrays if they're not allocated yet
-	if (PrepareArrays()) {
-		// Check if size is valid
-		if (Create) {
-			if (Size < 0 || Size > 2147483647) {
-				EvBufSize = 4096;
-			}
-			else EvBufSize = 32768;
-		}
-
-		// Initialize short buffer
-		swprintf_s(FMName, MAX_PATH, FileMappingTemplate, SEvLabel, (!Pipe ? TempID.c_str() : Pipe));
-		MessageBox(NULL, FMName, (!Pipe ? TempID.c_str() : Pipe), MB_OK);
-		PDrvShortEvBuf =
-			Create ?
-			// If "Create" is true, create the file mapping
-			CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(ShortEvBuf) + (sizeof(DWORD) * 32768), FMName) :
-			// Else, open the already existing (if it exists ofc) file mapping
-			OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
-
-		if (PDrvShortEvBuf) {
-			if (Create)
-				SetSecurityInfo(PDrvShortEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
-
-			PVOID MOVF = MapViewOfFile(PDrvShortEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
-
-			if (MOVF != nullptr) DrvShortEvBuf = (PShortEvBuf)MOVF;
-			else
-			{
-				NERROR(SynthErr, nullptr, false);
-				return false;
-			}
+	SHAKRA_TRACE_START(EntryTsc);
 
-			DrvShortEvBuf->Buf = (PSE)calloc(MAX_SE_BUF, sizeof(SE));
+	if (!UMPRing.IsAttached())
+		return false;
 
-			if (!DrvShortEvBuf->Buf) {
-				NERROR(SynthErr, nullptr, false);
-				return false;
-			}
-		}
+	PUMPSlot Slot = ClaimSlot(UMPRing);
 
-		// Initialize long buffer
-		swprintf_s(FMName, MAX_PATH, FileMappingTemplate, LEvLabel, (!Pipe ? TempID.c_str() : Pipe));
-		MessageBox(NULL, FMName, (!Pipe ? TempID.c_str() : Pipe), MB_OK);
-		PDrvLongEvBuf =
-			Create ?
-			// If "Create" is true, create the file mapping
-			CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(LongEvBuf), FMName) :
-			// Else, open the already existing (if it exists ofc) file mapping
-			OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, FMName);
+	// The buffer is full, the packet has to be dropped
+	if (!Slot)
+		return false;
 
-		if (PDrvLongEvBuf) {
-			if (Create)
-				SetSecurityInfo(PDrvLongEvBuf, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+	QueryPerformanceCounter(&Now);
 
-			PVOID MOVF = MapViewOfFile(PDrvLongEvBuf, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	memcpy(Slot->Words, Words, UMP::GetWords(Words[0]) * sizeof(DWORD));
+	Slot->Generation = DrvShortEvBuf->Generation;
+	Slot->Timestamp = Now.QuadPart;
 
-			if (MOVF != nullptr) DrvLongEvBuf = (PLongEvBuf)MOVF;
-			else
-			{
-				NERROR(SynthErr, nullptr, false);
-				return false;
-			}
+	SHAKRA_TRACE_AT(TRACE_ENQUEUE, TRACE_ID(UMPRing.GetWritePos(), false), EntryTsc);
 
-			DrvLongEvBuf->Buf = (PLE)calloc(MAX_LE_BUF, sizeof(LE));
+	UMPRing.Commit();
+	RingDoorbell();
 
-			if (!DrvLongEvBuf->Buf) {
-				NERROR(SynthErr, nullptr, false);
-				return false;
-			}
+	SHAKRA_TRACE(TRACE_PUBLISH, TRACE_ID(UMPRing.GetWritePos() - 1, false));
+
+	return true;
+}
+
+unsigned int WinDriver::SynthPipe::SaveUMPSysEx(LPMIDIHDR Event) {
+	const BYTE* Data = (const BYTE*)Event->lpData;
+	DWORD Len = Event->dwBufferLength;
+	LARGE_INTEGER Now;
+
+	// The packets carry the data only, the framing is implied
+	if (!Len || Data[0] != 0xF0) {
+		LOG(SynthErr, L"The long event is not a SysEx message, it can't be sent as UMP.");
+		Event->dwFlags |= MHDR_DONE;
+		return MMSYSERR_NOERROR;
+	}
+
+	Data++;
+	Len--;
+
+	if (Len && Data[Len - 1] == 0xF7)
+		Len--;
+
+	// The host might have changed the back-pressure since the last short event
+	RefreshControl();
+
+	unsigned int Count = UMP::GetSysEx7Packets(Len);
+	DWORD Room = (DWORD)UMPRing.GetMask() + 1;
+
+	if (ProducerCtl.MaxPending && ProducerCtl.MaxPending < Room)
+		Room = ProducerCtl.MaxPending;
+
+	// Nothing is going to wait for the host, so a message that doesn't fit gets dropped whole,
+	// instead of leaving the host with the first half of it
+	if (ProducerCtl.BackPressure != BACKPRESSURE_BLOCK && UMPRing.GetFill() + Count > Room) {
+		LOG(SynthErr, L"The UMP ring has no room for the SysEx message, it got dropped.");
+		Event->dwFlags |= MHDR_DONE;
+		return MMSYSERR_NOERROR;
+	}
+
+	Event->dwFlags &= ~MHDR_DONE;
+	Event->dwFlags |= MHDR_INQUEUE;
+
+	QueryPerformanceCounter(&Now);
+
+	// The packets of a message get staged, and published together once they're all there.
+	// If the ring fills up halfway through, ClaimSlot() publishes what's staged so that the
+	// host can make room, the consumer puts the message back together either way
+	for (unsigned int i = 0; i < Count; i++) {
+		PUMPSlot Slot = ClaimSlot(UMPRing);
+
+		// Same rules as the short events, BACKPRESSURE_TIMEOUT or a host that's gone,
+		// the consumer drops the half it got once the next message starts
+		if (!Slot) {
+			LOG(SynthErr, L"The host didn't make room in time, the rest of the SysEx message got dropped.");
+			break;
 		}
 
-		if (!Create) 
-		{
-			if (!OpenSynthHost(!Pipe ? TempID.c_str() : Pipe))
-			{
-				NERROR(SynthErr, nullptr, false);
-				return false;
+		UMP::SysEx7Packet(Data, Len, i, 0, Slot->Words);
+		Slot->Generation = DrvShortEvBuf->Generation;
+		Slot->Timestamp = Now.QuadPart;
+
+		UMPRing.Stage();
+	}
+
+	UMPRing.Publish();
+	RingDoorbell();
+
+	Event->dwFlags &= ~MHDR_INQUEUE;
+	Event->dwFlags |= MHDR_DONE;
+
+	return MMSYSERR_NOERROR;
+}
+
+unsigned int WinDriver::SynthPipe::SaveShortEvents(const DWORD* Events, unsigned int Count) {
+	DWORD Chunk[XFORM_CHUNK];
+	unsigned int Saved = 0;
+
+	RefreshControl();
+
+	// The host sees the whole batch at once, instead of once per event
+	StagingBatch = true;
+
+	if (TransformSys.IsActive()) {
+		Pretransformed = true;
+
+		for (unsigned int i = 0; i < Count; i += XFORM_CHUNK) {
+			unsigned int Len = min(Count - i, (unsigned int)XFORM_CHUNK);
+
+			memcpy(Chunk, &Events[i], Len * sizeof(DWORD));
+
+			// The events that got dropped still count, they went where the host wanted them to
+			unsigned int Left = TransformSys.ApplyBatch(Chunk, Len, &RunningStatus);
+			BYTE LastStatus = RunningStatus;
+			Saved += Len - Left;
+
+			for (unsigned int j = 0; j < Left; j++) {
+				if (SaveShortEvent(Chunk[j]))
+					Saved++;
 			}
+
+			// The last status might have been on one of the dropped events
+			RunningStatus = LastStatus;
 		}
 
-		return true;
+		Pretransformed = false;
+	}
+	else {
+		for (unsigned int i = 0; i < Count; i++) {
+			if (SaveShortEvent(Events[i]))
+				Saved++;
+		}
 	}
 
-	NERROR(SynthErr, nullptr, false);
-	return false;
+	StagingBatch = false;
+	PublishShortEvents();
+
+	return Saved;
 }
 
-bool WinDriver::SynthPipe::ClosePipe() {
-	if (!PDrvShortEvBuf && !PDrvLongEvBuf) {
-		LOG(SynthErr, L"ClosePipe() called with no pipes allocated.");
-		return true;
+void WinDriver::SynthPipe::RefreshControl() {
+	if (!ControlSys.HasChanged(&ControlSeq))
+		return;
+
+	// Keep the old settings, and try again on the next event
+	if (!ControlSys.ReadState(&ProducerCtl)) {
+		ControlSeq = -1;
+		return;
 	}
+	ApplyProfile();
+	UpdateBatching();
+	TransformSys.Compile(&ProducerCtl.Transform);
+}
 
-	if (PDrvShortEvBuf) {
-		if (DrvShortEvBuf->Buf)
-			free(DrvShortEvBuf->Buf);
+void WinDriver::SynthPipe::ApplyProfile() {
+	if (Profile.MaxPending)
+		ProducerCtl.MaxPending = Profile.MaxPending;
 
-		UnmapViewOfFile(DrvShortEvBuf);
-		CloseHandle(PDrvShortEvBuf);
-		PDrvShortEvBuf = nullptr;
-	}
+	if (Profile.BackPressure != PROFILE_DEFAULT)
+		ProducerCtl.BackPressure = Profile.BackPressure;
 
-	if (PDrvLongEvBuf) {
-		UnmapViewOfFile(DrvLongEvBuf);
-		CloseHandle(PDrvLongEvBuf);
-		PDrvShortEvBuf = nullptr;
-	}
+	if (Profile.PublishBatch != PROFILE_DEFAULT)
+		ProducerCtl.PublishBatch = Profile.PublishBatch;
 
-	return true;
+	if (Profile.PublishDelay != PROFILE_DEFAULT)
+		ProducerCtl.PublishDelay = Profile.PublishDelay;
 }
 
-bool WinDriver::SynthPipe::PerformBufferCheck() {
-	return ((DrvShortEvBuf->ReadHead != DrvShortEvBuf->WriteHead));
+void WinDriver::SynthPipe::SetProfile(const AppProfile* Source) {
+	Profile = *Source;
+
+	// No stable sequence is odd, so the control page gets read again with the overrides on top
+	ControlSeq = -1;
+	RefreshControl();
 }
 
-void WinDriver::SynthPipe::ResetReadHeadsIfNeeded() {
-	if (++DrvShortEvBuf->ReadHead >= EvBufSize)
-		DrvShortEvBuf->ReadHead = 0;
+void WinDriver::SynthPipe::PublishShortEvents() {
+	if (!ShortRing.IsAttached() || !ShortRing.GetStaged())
+		return;
+
+	// The idle flush runs on a thread pool thread
+	AcquireSRWLockExclusive(&PublishLock);
 
-	if (++DrvLongEvBuf->ReadHead >= MAX_MIDIHDR_BUF)
-		DrvLongEvBuf->ReadHead = 0;
+	DWORD Count = ShortRing.Publish();
+
+#ifdef SHAKRA_TRACING
+	for (DWORD Pos = ShortRing.GetPublishedPos() - Count; Pos != ShortRing.GetPublishedPos(); Pos++)
+		SHAKRA_TRACE(TRACE_PUBLISH, TRACE_ID(Pos, false));
+#else
+	(void)Count;
+#endif
+
+	ReleaseSRWLockExclusive(&PublishLock);
+
+	RingDoorbell();
 }
 
-int WinDriver::SynthPipe::GetReadHeadPos() {
-	return DrvShortEvBuf->ReadHead;
+void WinDriver::SynthPipe::RingDoorbell() {
+	if (!Doorbell)
+		return;
+
+	// The events have to be visible before looking for a sleeping consumer, or it could sleep through them
+	MemoryBarrier();
+
+	if (ControlSys.TakeWaiter())
+		SetEvent(Doorbell);
 }
 
-int WinDriver::SynthPipe::GetWriteHeadPos() {
-	return DrvShortEvBuf->WriteHead;
+VOID CALLBACK WinDriver::SynthPipe::IdleFlushProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer) {
+	((SynthPipe*)Context)->PublishShortEvents();
 }
 
-unsigned int WinDriver::SynthPipe::ParseShortEvent() {
-	return DrvShortEvBuf->Buf[DrvShortEvBuf->ReadHead].Event;
+void WinDriver::SynthPipe::UpdateBatching() {
+	LARGE_INTEGER Freq;
+
+	// A batch of one is no batch at all
+	if (ProducerCtl.PublishBatch < 2) {
+		StopBatching();
+		return;
+	}
+
+	if (!IdleFlush) {
+		IdleFlush = CreateThreadpoolTimer(IdleFlushProc, this, nullptr);
+
+		if (!IdleFlush) {
+			NERROR(SynthErr, L"Failed to create the idle flush timer, every event will be published right away.", false);
+			return;
+		}
+	}
+
+	QueryPerformanceFrequency(&Freq);
+
+	PublishDelayUs = ProducerCtl.PublishDelay ? ProducerCtl.PublishDelay : PUBLISH_DEF_DELAY;
+	PublishDelay = (long long)PublishDelayUs * Freq.QuadPart / 1000000;
+	PublishBatch = ProducerCtl.PublishBatch;
 }
 
-unsigned int WinDriver::SynthPipe::ParseLongEvent(BYTE* PEvent) {
-	unsigned int Len = 0;
+void WinDriver::SynthPipe::StopBatching() {
+	if (!IdleFlush)
+		return;
 
-	if (DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].EventLength < 1)
-		return 0;
+	// Once the timer is gone, Commit() can't race with the idle flush anymore
+	SetThreadpoolTimer(IdleFlush, nullptr, 0, 0);
+	WaitForThreadpoolTimerCallbacks(IdleFlush, TRUE);
+	CloseThreadpoolTimer(IdleFlush);
 
-	// Copy new buffer
-	Len = DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].EventLength;
-	memcpy(PEvent, DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].Event, Len);
+	IdleFlush = nullptr;
+	PublishBatch = 0;
+
+	PublishShortEvents();
+}
 
-	// Clear buffer
-	memset(DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].Event, 0, sizeof(BYTE) * 65536);
-	DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].EventLength = 0;
+bool WinDriver::SynthPipe::IsPriorityEvent(DWORD Event) {
+	BYTE Status = Event & 0xFF;
 
-	return Len;
+	// System realtime
+	if (Status >= 0xF8)
+		return true;
+
+	if ((Status & 0xF0) != 0xB0)
+		return false;
+
+	// Channel mode messages, then the CCs picked by the host
+	BYTE CC = (Event >> 8) & 0x7F;
+	return CC >= 120 || (ProducerCtl.PriorityCCs[CC >> 5] & (1 << (CC & 31)));
 }
 
-void WinDriver::SynthPipe::SaveShortEvent(unsigned int Event) {
-	if (!DrvShortEvBuf)
+bool WinDriver::SynthPipe::IsStillConsumer() {
+	LONG Self = (LONG)GetCurrentProcessId();
+
+	// Taps, and pipes that never read as a host, have nobody to lose the ring to
+	if (!ClaimedConsumer)
+		return true;
+
+	if (ConsumerRoute)
+		return RouteSys.GetPID(ConsumerRoute) == Self;
+
+	return ControlSys.GetOwnerPID() == Self;
+}
+
+void WinDriver::SynthPipe::SetBarrier(DWORD Event, DWORD Pos) {
+	BYTE Status = Event & 0xFF;
+	BYTE CC = (Event >> 8) & 0x7F;
+
+	if ((Status & 0xF0) != 0xB0 || CC < 120 || CC == 122)
 		return;
 
-	auto NextWriteHead = DrvShortEvBuf->ReadHead + 1;
-	if (NextWriteHead >= EvBufSize) NextWriteHead = 0;
+	WORD Channel = 1 << (Status & 0x0F);
+	WORD Active = NoteBarriers | ControlBarriers;
+
+	if (CC == 121) {
+		ControlBarrier[Status & 0x0F] = Pos;
+		ControlBarriers |= Channel;
+	}
+	else {
+		NoteBarrier[Status & 0x0F] = Pos;
+		NoteBarriers |= Channel;
+	}
+
+	// The write head only moves forward, so the newest barrier is the furthest one
+	if (!Active || ShortRing.Distance(LastBarrier, Pos) > 0)
+		LastBarrier = Pos;
+}
+
+bool WinDriver::SynthPipe::IsBehindBarrier(DWORD Event) {
+	if (!(NoteBarriers | ControlBarriers))
+		return false;
+
+	DWORD Pos = ShortRing.GetReadPos();
+
+	// Past all of them, nothing left to drop
+	if (ShortRing.Distance(Pos, LastBarrier) <= 0) {
+		NoteBarriers = ControlBarriers = 0;
+		return false;
+	}
+
+	BYTE Status = Event & 0xFF;
+	BYTE Channel = Status & 0x0F;
+
+	switch (Status & 0xF0) {
+	case 0x80:
+	case 0x90:
+	case 0xA0:
+		return (NoteBarriers & (1 << Channel)) && ShortRing.Distance(Pos, NoteBarrier[Channel]) > 0;
 
-	DrvShortEvBuf->Buf[DrvShortEvBuf->ReadHead].Event = Event;
+	case 0xB0:
+		// A mode message that went through the normal lane is in order already
+		if (((Event >> 8) & 0x7F) >= 120)
+			return false;
+
+		[[fallthrough]];
+
+	case 0xD0:
+	case 0xE0:
+		return (ControlBarriers & (1 << Channel)) && ShortRing.Distance(Pos, ControlBarrier[Channel]) > 0;
+
+	default:
+		return false;
+	}
+}
 
-	if (NextWriteHead != DrvShortEvBuf->ReadHead)
-		DrvShortEvBuf->WriteHead = NextWriteHead;
+bool WinDriver::SynthPipe::CanSaveLongEvent() {
+	if (!DrvLongEvBuf || !CommitLongSlot(DrvLongEvBuf->WriteHead, 0))
+		return false;
+
+	return (DrvLongEvBuf->Buf[DrvLongEvBuf->WriteHead].EventLength == 0);
 }
 
 unsigned int WinDriver::SynthPipe::SaveLongEvent(LPMIDIHDR Event) {
@@ -295,15 +1987,66 @@ unsigned int WinDriver::SynthPipe::SaveLongEvent(LPMIDIHDR Event) {
 		return MIDIERR_UNPREPARED;
 	}
 
-	while (DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].EventLength != 0)
+	// The short events sent before this have to get there first
+	PublishShortEvents();
+
+	// A reset message makes everything queued before it pointless
+	if (IsResetSysEx((const BYTE*)Event->lpData, Event->dwBufferLength)) {
+		ResetStream();
+		ChannelSys.Reset();
+		HintSys.Reset();
+	}
+
+	// Same ring as the short events, so the order is kept for free
+	if (UMPRing.IsAttached())
+		return SaveUMPSysEx(Event);
+
+	// The pipe got closed, or it was never opened, there's no slot to wait for
+	if (!DrvLongEvBuf) {
+		NERROR(SynthErr, L"The long events buffer isn't open.", false);
+		return MIDIERR_NOTREADY;
+	}
+
+	// CanSaveLongEvent() would never be true without the slot's page
+	if (!CommitLongSlot(DrvLongEvBuf->WriteHead, 0))
+		return MMSYSERR_NOMEM;
+
+	// Wait for the host to free the slot
+	while (!CanSaveLongEvent())
 		Sleep(1);
 
+	// The host is done reading the slot once its length is 0
+	AtomicFence(std::memory_order_acquire);
+
 	Event->dwFlags &= ~MHDR_DONE;
 	Event->dwFlags |= MHDR_INQUEUE;
 
-	// Copy new buffer
-	DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].EventLength = Event->dwBufferLength;
-	memcpy(DrvLongEvBuf->Buf[DrvLongEvBuf->ReadHead].Event, Event->lpData, Event->dwBufferLength);
+	// Repeated messages only send a reference to the SysEx cache, the others are copied in full
+	PLE Slot = &DrvLongEvBuf->Buf[DrvLongEvBuf->WriteHead];
+	Slot->CacheRef = SysExSys.StoreSysEx((const BYTE*)Event->lpData, Event->dwBufferLength);
+
+	if (!Slot->CacheRef) {
+		if (!CommitLongSlot(DrvLongEvBuf->WriteHead, Event->dwBufferLength)) {
+			Event->dwFlags &= ~MHDR_INQUEUE;
+			return MMSYSERR_NOMEM;
+		}
+
+		memcpy(Slot->Event, Event->lpData, Event->dwBufferLength);
+	}
+
+	Slot->Generation = DrvShortEvBuf ? DrvShortEvBuf->Generation : 0;
+
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+	Slot->Timestamp = Now.QuadPart;
+
+	// The length goes last, since it's what marks the slot as used,
+	// and the fence keeps the data, the cache entry and the timestamp ahead of it
+	AtomicFence(std::memory_order_release);
+	Slot->EventLength = Event->dwBufferLength;
+
+	DrvLongEvBuf->WriteHead = (DrvLongEvBuf->WriteHead + 1) & (MAX_LE_BUF - 1);
+	RingDoorbell();
 
 	Event->dwFlags &= ~MHDR_INQUEUE;
 	Event->dwFlags |= MHDR_DONE;
@@ -347,4 +2090,87 @@ unsigned int WinDriver::SynthPipe::UnprepareLongEvent(LPMIDIHDR Event) {
 	return MMSYSERR_NOERROR;
 }
 
+void WinDriver::SynthPipe::SetRecorder(EventCapture* Target) {
+	Recorder = Target;
+}
+
+void WinDriver::SynthPipe::SetVolume(DWORD Volume) {
+	ControlSys.SetVolume(Volume);
+}
+
+DWORD WinDriver::SynthPipe::GetVolume() {
+	CtlState State;
+
+	// No control page, no volume control
+	if (!ControlSys.ReadState(&State))
+		return 0xFFFFFFFF;
+
+	return State.Volume;
+}
+
+void WinDriver::SynthPipe::SetMute(bool Mute) {
+	ControlSys.SetMute(Mute);
+}
+
+void WinDriver::SynthPipe::RequestReset() {
+	ControlSys.RequestReset();
+}
+
+void WinDriver::SynthPipe::SetHostStatus(DWORD Status) {
+	ControlSys.SetHostStatus(Status);
+}
+
+void WinDriver::SynthPipe::SetBackPressure(DWORD Mode, DWORD MaxPending) {
+	ControlSys.SetBackPressure(Mode, MaxPending);
+}
+
+void WinDriver::SynthPipe::SetBroadcastPolicy(LONG Policy) {
+	if (ShortRing.IsAttached())
+		ShortRing.SetPolicy(Policy);
+
+	if (PriorityRing.IsAttached())
+		PriorityRing.SetPolicy(Policy);
+}
+
+void WinDriver::SynthPipe::SetPriorityCCs(const DWORD* Mask) {
+	ControlSys.SetPriorityCCs(Mask);
+}
+
+void WinDriver::SynthPipe::SetPublishBatching(DWORD Batch, DWORD Delay) {
+	ControlSys.SetPublishBatching(Batch, Delay);
+}
+
+bool WinDriver::SynthPipe::ReadChannelState(PChsState Target) {
+	return ChannelSys.ReadSnapshot(Target);
+}
+
+unsigned int WinDriver::SynthPipe::BuildSyncEvents(DWORD* Events, unsigned int Max) {
+	ChsState Snapshot;
+
+	if (!ChannelSys.ReadSnapshot(&Snapshot))
+		return 0;
+
+	return ChannelShadow::BuildSyncEvents(&Snapshot, Events, Max);
+}
+
+unsigned int WinDriver::SynthPipe::CachePatches(UINT Bank, WORD* Patches, UINT Flags) {
+	return HintSys.CachePatches(Bank, Patches, Flags);
+}
+
+unsigned int WinDriver::SynthPipe::CacheDrumPatches(UINT Kit, WORD* Keys, UINT Flags) {
+	return HintSys.CacheDrumPatches(Kit, Keys, Flags);
+}
+
+bool WinDriver::SynthPipe::ReadPatchHints(PPchState Target) {
+	return HintSys.ReadHints(Target);
+}
+
+void WinDriver::SynthPipe::SetTransform(const TransformRules* Rules) {
+	ControlSys.SetTransform(Rules);
+}
+
+bool WinDriver::SynthPipe::ReadControl(PCtlState Target) {
+	return ControlSys.ReadState(Target);
+}
+
 #endif
\ No newline at end of file
@@ -14,6 +14,15 @@ This file is useful only if you want to compile the driver under Windows, it's n
 
 #include "WinError.hpp"
 #include "WinVars.hpp"
+#include "WinSysExCache.hpp"
+#include "WinControl.hpp"
+#include "WinChannelState.hpp"
+#include "WinPatchHints.hpp"
+#include "WinAppProfiles.hpp"
+#include "WinRouting.hpp"
+#include "WinRing.hpp"
+#include "WinTrace.hpp"
+#include "WinUMP.hpp"
 #include <windows.h>
 #include <ShlObj_core.h>
 #include <tlhelp32.h>
@@ -30,6 +39,7 @@ This file is useful only if you want to compile the driver under Windows, it's n
 #include <iterator>
 #include <algorithm>
 #include <functional>
+#include <type_traits>
 
 /*
 
@@ -43,37 +53,177 @@ This file is useful only if you want to compile the driver under Windows, it's n
 
 typedef struct {
 	DWORD Event;		// The actual event
-	DWORD Align[15];	// Dummy data needed to align the event to 32-bit registers
+	DWORD Generation;	// The stream generation the event belongs to, see ResetStream()
+	volatile DWORD Flag;	// Non-zero if the slot is full, only used by the flag based rings
+	DWORD Barrier;		// Priority lane only, the write head of the normal lane when the event was saved
+	unsigned long long Timestamp;	// QPC ticks of when the app sent the event, used to merge multiple pipes
+	DWORD Align[10];	// Dummy data needed to align the event to 32-bit registers
 } ShortEvent, ShortEv, *PShortEv, SE, *PSE;
 
+/*
+
+	The long events buffer is only reserved, like the short one, since a slot
+	has to fit a MAX_LE_SIZE message and most apps never send one. Each side
+	commits the part of a slot it touches before touching it: the fields up
+	front, and the data up to the length of the message. LongCommitted keeps
+	how much of each slot this process already committed, so that a slot costs
+	a VirtualAlloc() only the first time it gets a bigger message.
+
+*/
+
 typedef struct {
-	char Event[MAX_MIDIHDR_BUF];	// The long data buffer
-	int EventLength;				// The length of the data that needs to be used (can be less than the data stored)
+	volatile int EventLength;		// The length of the data that needs to be used (can be less than the data stored), written last
+	int CacheRef;					// Reference to the SysEx cache entry holding the data, 0 if it's stored in Event
+	DWORD Generation;				// The stream generation the event belongs to, see ResetStream()
+	unsigned long long Timestamp;	// QPC ticks of when the app sent the event
+	char Event[MAX_LE_SIZE];		// The long data buffer, after the fields so that a short message only needs their page
 } LongEvent, LongEv, *PLongEv, LE, *PLE;
 
 /*
 	
 	ReadHead = The current position of the read head in the buffer
 	WriteHead = The current position of the write head in the buffer
-	Buf = THe actual buffer
+	Buf = THe actual buffer, stored right after the heads in the file mapping
 
 	We use volatile integers as read/write heads, to avoid deadlocks.
 
+	The short events buffer is a Ring (see WinRing.hpp), and the algorithm it uses
+	can be picked at build time through SE_RING_ALGO. With RingBroadcast, other
+	tools can tap the short events through OpenTap() without slowing down the host.
+
+	Generation = Bumped every time the stream gets reset (MODM_RESET, or a GM/GS/XG reset SysEx)
+	ResetHead = Position of the write head when Generation got bumped
+
+	Every event is stamped with the generation it has been queued in, so that
+	the host can jump over all the stale events at once, instead of playing them.
+
+*/
+
+/*
+
+	Priority lane
+
+	Next to the short events buffer there's a much smaller one (MAX_PR_BUF slots),
+	for the events that can't wait behind a backlog of notes:
+	- System realtime (0xF8 to 0xFF), like the clock and start/stop
+	- Channel mode messages (CC 120 to 127), like All Notes Off
+	- The CCs set in the PriorityCCs mask of the control page, none by default
+
+	The producer resolves running status itself, so that an event never depends
+	on a status byte that went through the other lane.
+
+	If the priority lane is full, the event goes through the normal one, and so
+	do the priority events after it, until the host read it. Otherwise they could
+	get ahead of it, which would break the first guarantee below.
+
+	Channel mode messages are a barrier for their channel: the normal events the
+	app sent before them get dropped, instead of reaching the host after them.
+	- All Sound Off, All Notes Off and the mode changes (CC 120, 123 to 127)
+	  drop the older note ons, note offs and polyphonic aftertouch
+	- Reset All Controllers (CC 121) drops the older controllers, channel
+	  aftertouch and pitch bends
+	Program changes are never dropped. Without the barrier, a note on that was
+	still queued would start after All Notes Off, and hang.
+
+	The CCs in PriorityCCs get no barrier, they just get ahead of the queue.
+	Think twice before picking the pedals: a sustain that overtakes the note offs
+	still queued before it holds those notes too.
+
+	Ordering guarantees:
+	- Each lane is FIFO, so two priority events (or two normal ones) always reach
+	  the host in the order the app sent them
+	- A priority event can get ahead of any normal event that's still queued,
+	  that's the whole point of it
+	- A priority event is never delivered after a normal event the app sent
+	  after it, since the consumer checks the priority lane before every event
+	- Resets apply to both lanes, stale priority events get skipped too
+
+	The merger (see WinPipeMerger.hpp) keeps the per-pipe order above, but
+	events from different pipes are still merged by timestamp.
+
 */
 
+/*
+
+	Publish batching
+
+	By default every short event is published to the host as soon as it's saved.
+	When the host sets PublishBatch in the control page, the events of the normal
+	lane are staged instead (see Ring::Stage()), and published together once:
+	- PublishBatch events are waiting, or
+	- The oldest one waited PublishDelay microseconds, checked on every event, or
+	- The app went quiet, a thread pool timer armed by the first staged event
+	  publishes them after PublishDelay microseconds
+
+	Everything staged is also published before a long event, a reset, a close,
+	and before the producer decides that the ring is full.
+	The priority lane is never batched.
+
+	It trades up to PublishDelay of latency for far less cache traffic between
+	the app and the host, which is what offline rendering wants.
+
+*/
+
+#ifndef SE_RING_ALGO
+#define SE_RING_ALGO RingLamport
+#endif
+
+typedef WinDriver::Ring<SE, MAX_SE_BUF, SE_RING_ALGO> ShortEventsRing, ShortEvRing;
+typedef ShortEvRing::Storage ShortEventsBuffer, ShortEvBuf, *PShortEvBuf, SEB, *PSEB;
+
+typedef WinDriver::Ring<SE, MAX_PR_BUF, SE_RING_ALGO> PriorityEventsRing, PriorityEvRing;
+typedef PriorityEvRing::Storage PriorityEventsBuffer, PriorityEvBuf, *PPriorityEvBuf;
+
+/*
+
+	UMP mode
+
+	A pipe created with one of the PIPE_MODE_UMP_* modes carries everything
+	(short events and SysEx) as Universal MIDI Packets, through a single ring
+	of fixed size slots (see WinUMP.hpp). The apps find out by looking for the
+	ring when they open the pipe, and the short events buffer, the long events
+	buffer and the priority lane stay empty.
+
+	- The driver converts the short events to MIDI 1.0 or MIDI 2.0 channel voice
+	  packets, depending on the UMPProtocol the host put in the control page
+	- SysEx is split in SysEx7 packets, which are all published at once, so the
+	  host never sees half a message unless it's bigger than the ring
+	- Resets work like on the other rings, through ResetHead and the generations
+
+	Consumers that speak UMP read the packets as they are with ParseUMPPackets().
+	The other consumer functions keep working, and convert back to MIDI 1.0:
+	the short events come out of ParseShortEvents() and friends, and every SysEx
+	gets put back together and comes out of ParseLongEvent() and friends.
+	The short events stop at each SysEx until the host took it, so that the order
+	the app sent them in is kept.
+
+*/
+
+#define PIPE_MODE_LEGACY		0
+#define PIPE_MODE_UMP_MIDI1		1
+#define PIPE_MODE_UMP_MIDI2		2
+
 typedef struct {
-	volatile int ReadHead;		
-	volatile int WriteHead;		
-	PSE Buf;
-} ShortEventsBuffer, ShortEvBuf, *PShortEvBuf, SEB, *PSEB;
+	DWORD Words[UMP_MAX_WORDS];		// The packet, only the first UMP::GetWords() are used
+	DWORD Generation;				// The stream generation the packet belongs to
+	volatile DWORD Flag;			// Non-zero if the slot is full, only used by the flag based rings
+	unsigned long long Timestamp;	// QPC ticks of when the app sent the event
+} UMPSlot, *PUMPSlot;
+
+typedef WinDriver::Ring<UMPSlot, MAX_UMP_BUF, SE_RING_ALGO> UMPEventsRing, UMPEvRing;
+typedef UMPEvRing::Storage UMPEventsBuffer, UMPEvBuf, *PUMPEvBuf;
+
+static_assert(!(MAX_LE_BUF & (MAX_LE_BUF - 1)), "MAX_LE_BUF has to be a power of two.");
 
 typedef struct {
 	volatile int ReadHead;
 	volatile int WriteHead;
-	PLE Buf;
+	LE Buf[MAX_LE_BUF];
 } LongEventsBuffer, LongEvBuf, *PLongEvBuf, LEB, *PLEB;
 
 namespace WinDriver {
+	class EventCapture;
+
 	class SynthPipe {
 	private:
 		ErrorSystem::WinErr SynthErr;
@@ -82,32 +232,251 @@ namespace WinDriver {
 		const wchar_t* FileMappingTemplate = L"Local\\Shakra%s%s\0";
 		const wchar_t* SEvLabel = L"SEv";
 		const wchar_t* LEvLabel = L"LEv";
-
-		int EvBufSize = 32768;
+		const wchar_t* SXCLabel = L"SXC";
+		const wchar_t* CtlLabel = L"Ctl";
+		const wchar_t* SPrLabel = L"SPr";
+		const wchar_t* UMPLabel = L"UMP";
+		const wchar_t* ChsLabel = L"Chs";
+		const wchar_t* DblLabel = L"Dbl";
+		const wchar_t* PchLabel = L"Pch";
+		const wchar_t* RteLabel = L"Rte";
+		const wchar_t* RtLabel = L"Rt";		// Followed by the route, for its ring
+		const wchar_t* RdbLabel = L"Rdb";	// Same as above, for its doorbell
 
 		// R/W heads
+		ShortEvRing ShortRing;
 		PShortEvBuf DrvShortEvBuf = nullptr;
 		PLongEvBuf DrvLongEvBuf = nullptr;
 		HANDLE PDrvShortEvBuf = nullptr;
 		HANDLE PDrvLongEvBuf = nullptr;
+		DWORD LongCommitted[MAX_LE_BUF] = { 0 };
+
+		// Priority lane, and which lane the last peeked event came from
+		PriorityEvRing PriorityRing;
+		PPriorityEvBuf DrvPriorityEvBuf = nullptr;
+		HANDLE PDrvPriorityEvBuf = nullptr;
+		bool PeekedPriority = false;
+
+		// Consumer side channel mode barriers, positions in the normal lane, see above
+		DWORD NoteBarrier[16];
+		DWORD ControlBarrier[16];
+		DWORD LastBarrier = 0;
+		WORD NoteBarriers = 0;
+		WORD ControlBarriers = 0;
+
+		// Producer side, set while a priority event that went through the normal lane is still queued
+		DWORD PriorityFallback = 0;
+		bool PriorityBlocked = false;
+
+		// Producer side running status, resolved before picking the lane
+		BYTE RunningStatus = 0;
+
+		// UMP mode, see above
+		UMPEvRing UMPRing;
+		PUMPEvBuf DrvUMPEvBuf = nullptr;
+		HANDLE PDrvUMPEvBuf = nullptr;
+
+		// Consumer side down-conversion, the events of the packet being read, and the SysEx being put back together
+		DWORD UMPPending[UMP_MAX_MIDI1];
+		unsigned int UMPPendingCount = 0;
+		unsigned int UMPPendingIdx = 0;
+		unsigned long long UMPPendingTime = 0;
+		std::vector<BYTE> UMPSysEx;
+		unsigned long long UMPSysExTime = 0;
+		bool UMPInSysEx = false;
+		bool UMPSysExReady = false;
+
+		// Deduplicates repeated SysEx messages
+		SysExCache SysExSys;
+
+		// Volume and device state, kept out of the event buffers
+		ControlPage ControlSys;
+
+		// What every channel is set to, for the hosts that attach late
+		ChannelShadow ChannelSys;
+
+		// Instruments the apps are going to need, so the host can load them early
+		PatchHints HintSys;
+
+		// Signaled by the producer when it publishes while a consumer is waiting, see WinPipeExecutor.hpp
+		HANDLE Doorbell = nullptr;
+
+		// Channel and key routing to other hosts, see WinRouting.hpp
+		RouteTable RouteSys;
+		std::wstring PipeName;
+
+		// Producer side, the rings of the routes, 0 is the owner's so it's never used
+		ShortEvRing RouteRings[MAX_ROUTES];
+		PShortEvBuf DrvRouteEvBuf[MAX_ROUTES] = { nullptr };
+		HANDLE PDrvRouteEvBuf[MAX_ROUTES] = { nullptr };
+		HANDLE RouteDoorbells[MAX_ROUTES] = { nullptr };
+		LONG RoutePID[MAX_ROUTES] = { 0 };		// Host the ring got mapped for
+		bool RouteGone[MAX_ROUTES] = { false };
+
+		// Producer side, the map with the missing routes folded into the owner, and the routes that get events
+		RouteMap ProducerRoutes;
+		BYTE RouteLive = 1 << ROUTE_OWNER;
+		LONG RouteSeq = 0;
+		bool RoutesDirty = false;
+
+		// Consumer side, the route this pipe reads, 0 for the owner
+		BYTE ConsumerRoute = ROUTE_OWNER;
+
+		// Consumer side, set once the pipe reads as the owner or as the host of a route, see IsStillConsumer()
+		bool ClaimedConsumer = false;
+
+		// Generation the consumer is at, and how many panic events it still has to send
+		LONG ConsumerGeneration = 0;
+		int PanicLeft = 0;
+
+		// Back-pressure settings, cached by the producer until the control page changes
+		CtlState ProducerCtl = { 0 };
+		LONG ControlSeq = 0;
+
+		// Producer side host liveness, checked every HOST_CHECK_INTERVAL ms
+		ULONGLONG LastHostCheck = 0;
+		bool HostGone = false;
+
+		// Producer side publish batching, the timer only exists while it's on
+		PTP_TIMER IdleFlush = nullptr;
+		SRWLOCK PublishLock = SRWLOCK_INIT;
+		DWORD PublishBatch = 0;
+		long long PublishDelay = 0;		// QPC ticks
+		DWORD PublishDelayUs = 0;
+		long long BatchStart = 0;
+
+		// Set by SaveShortEvents(), stages the events without arming the idle flush
+		bool StagingBatch = false;
+
+		// Overrides of the control page for this app, see WinAppProfiles.hpp
+		AppProfile Profile = APP_PROFILE_DEFAULT;
+
+		// Producer side transforms, compiled from the control page, see WinTransform.hpp
+		EventTransform TransformSys;
+		bool Pretransformed = false;
+
+		// Optional recorder, fed by the consumer
+		EventCapture* Recorder = nullptr;
 
 		std::wstring GenerateID();
-		bool PrepareArrays();
+		bool CheckGeneration();
+		void ReleaseLongEvent();
+		PLE PeekLongSlot();
+		bool CommitLongSlot(int Index, DWORD Length);
+		unsigned int ParsePanicEvent();
+		template <typename LaneRing> auto ClaimSlot(LaneRing& Lane) -> decltype(Lane.Claim());
+		template <typename LaneRing> auto ClaimSlot(LaneRing& Lane, const bool& Gone) -> decltype(Lane.Claim());
+		bool IsPriorityEvent(DWORD Event);
+		bool IsStillConsumer();
+		void SetBarrier(DWORD Event, DWORD Pos);
+		bool IsBehindBarrier(DWORD Event);
+		bool OpenPriorityLane(const wchar_t* Name, bool Create);
+		template <typename LaneRing> auto PeekLane(LaneRing& Lane) -> decltype(Lane.Peek());
+		bool OpenUMPRing(const wchar_t* Name, bool Create);
+		bool PeekUMPEvent(DWORD* Event, unsigned long long* Timestamp);
+		void CollectSysEx(PUMPSlot Slot);
+		unsigned int SaveUMPSysEx(LPMIDIHDR Event);
+		void ResetUMPConsumer();
+		void RingDoorbell();
+		void RefreshControl();
+		void ApplyProfile();
+		void CheckHost();
+		bool MapRouteRing(const wchar_t* Name, BYTE Route, bool Create, int Size, ShortEvRing& Ring, PShortEvBuf& Buf, HANDLE& Mapping, HANDLE& Bell);
+		void UnmapRouteRing(ShortEvRing& Ring, PShortEvBuf& Buf, HANDLE& Mapping, HANDLE& Bell);
+		void RefreshRoutes();
+		void CheckRoutes();
+		BYTE GetRouteTargets(DWORD Event);
+		bool SaveRoutedEvent(DWORD Event, BYTE Targets, unsigned long long Timestamp);
+		void RingRouteDoorbell(BYTE Route);
+		bool OpenMappings(const wchar_t* Name, bool Create, int Size, DWORD Mode);
+		void UpdateBatching();
+		void StopBatching();
+		static VOID CALLBACK IdleFlushProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer);
+		static bool IsResetSysEx(const BYTE* Data, DWORD Len);
 
 	public:
 		bool OpenSynthHost(const wchar_t* Target);
-		bool PrepareFileMappings(const wchar_t* Pipe, bool Create, int Size);
+		bool PrepareFileMappings(const wchar_t* Pipe, bool Create, int Size, DWORD Mode = PIPE_MODE_LEGACY);
+		bool OpenTap(const wchar_t* Pipe);
+
+		// Producer side, opens a pipe created by someone else without starting ShakraHost, used by the loopback cable
+		bool ConnectPipe(const wchar_t* Pipe);
+		bool IsOpen() { return ShortRing.IsAttached(); }
+		bool IsHostGone() { return HostGone; }
+
+		// Warm standby, maps the pipe without reading from it, then waits for the owner to die
+		bool OpenStandby(const wchar_t* Pipe);
+		bool WaitForTakeOver(DWORD Timeout);
+		bool Heartbeat();
+		bool ReadLiveness(PHostLiveness Target);
+
+		// Channel and key routing, OpenRoute() reads a route of a pipe instead of the whole pipe, see WinRouting.hpp
+		bool OpenRoute(const wchar_t* Pipe, BYTE Route, int Size);
+		bool SetRoutes(const RouteRules* Rules);
+		bool SetRouteClock(DWORD SampleRate, DWORD LatencyMs);
+		bool ReadRouteClock(PRouteClock Target);
+
 		bool ClosePipe();
 		bool PerformBufferCheck();
 		void ResetReadHeadsIfNeeded();
 		int GetReadHeadPos();
 		int GetWriteHeadPos();
 		unsigned int ParseShortEvent();
+		unsigned int ParseShortEvents(DWORD* Target, unsigned int Max);
+
+		// Step by step consumer functions, used when merging multiple pipes
+		bool PeekShortEvent(DWORD* Event, unsigned long long* Timestamp);
+		void PopShortEvent();
+		bool FlushShortEvents();	// True if the events read since the last flush have to be thrown away
+		bool PeekLongEvent(unsigned long long* Timestamp);
+
+		// UMP mode, the packets as they are, returns how many words got written
+		unsigned int ParseUMPPackets(DWORD* Words, unsigned int MaxWords);
+		bool SaveUMPPacket(const DWORD* Words);
+		bool IsUMP() { return UMPRing.IsAttached(); }
+
+		// Consumer side doorbell, arm it, look at the pipe one last time, then wait on the handle
+		HANDLE GetDoorbell() { return Doorbell; }
+		void ArmDoorbell() { if (ConsumerRoute) RouteSys.ArmDoorbell(ConsumerRoute); else ControlSys.ArmDoorbell(); }
+
 		unsigned int ParseLongEvent(BYTE* PEvent);
-		void SaveShortEvent(unsigned int Event);
+		unsigned int ParseLongEventRef(const BYTE** PEvent);
+		bool FreeLongEvent();
+		bool SaveShortEvent(unsigned int Event);
+		unsigned int SaveShortEvents(const DWORD* Events, unsigned int Count);
+		void PublishShortEvents();
+		bool CanSaveLongEvent();
 		unsigned int SaveLongEvent(LPMIDIHDR Event);
 		unsigned int PrepareLongEvent(LPMIDIHDR Event);
 		unsigned int UnprepareLongEvent(LPMIDIHDR Event);
+		void SetRecorder(EventCapture* Target);
+		void ResetStream();
+
+		// Control page
+		void SetVolume(DWORD Volume);
+		DWORD GetVolume();
+		void SetMute(bool Mute);
+		void RequestReset();
+		void SetHostStatus(DWORD Status);
+		void SetBackPressure(DWORD Mode, DWORD MaxPending);
+		void SetBroadcastPolicy(LONG Policy);
+		void SetPriorityCCs(const DWORD* Mask);
+		void SetPublishBatching(DWORD Batch, DWORD Delay);
+		void SetTransform(const TransformRules* Rules);
+
+		// Producer side, resolved by MODM_OPEN once the pipe is open
+		void SetProfile(const AppProfile* Source);
+		bool ReadControl(PCtlState Target);
+
+		// Channel state shadow, BuildSyncEvents() returns 0 if it's not open
+		bool ReadChannelState(PChsState Target);
+		unsigned int BuildSyncEvents(DWORD* Events, unsigned int Max);
+
+		// Patch hints, see WinPatchHints.hpp
+		unsigned int CachePatches(UINT Bank, WORD* Patches, UINT Flags);
+		unsigned int CacheDrumPatches(UINT Kit, WORD* Keys, UINT Flags);
+		LONG GetPatchHintChanges() { return HintSys.GetChanges(); }
+		bool ReadPatchHints(PPchState Target);
 	};
 }
 
@@ -0,0 +1,137 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinSysExCache.hpp"
+#include "WinRing.hpp"
+
+unsigned long long WinDriver::SysExCache::Hash(const BYTE* Data, DWORD Length) {
+	unsigned long long H = 0xCBF29CE484222325ULL;
+
+	for (DWORD i = 0; i < Length; i++) {
+		H ^= Data[i];
+		H *= 0x100000001B3ULL;
+	}
+
+	return H;
+}
+
+bool WinDriver::SysExCache::OpenCache(const wchar_t* Name, bool Create) {
+	if (Cache) {
+		LOG(CacheErr, L"The SysEx cache is already open.");
+		return true;
+	}
+
+	PCache =
+		Create ?
+		CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT, 0, sizeof(SXCTable), Name) :
+		OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, Name);
+
+	if (!PCache) {
+		NERROR(CacheErr, nullptr, false);
+		return false;
+	}
+
+	if (Create)
+		SetSecurityInfo(PCache, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION, 0, 0, 0, 0);
+
+	Cache = (PSXCTable)MapViewOfFile(PCache, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	if (!Cache) {
+		NERROR(CacheErr, nullptr, false);
+		CloseHandle(PCache);
+		PCache = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+bool WinDriver::SysExCache::CloseCache() {
+	if (Cache) {
+		UnmapViewOfFile(Cache);
+		Cache = nullptr;
+	}
+
+	if (PCache) {
+		CloseHandle(PCache);
+		PCache = nullptr;
+	}
+
+	return true;
+}
+
+int WinDriver::SysExCache::StoreSysEx(const BYTE* Data, DWORD Length) {
+	int Empty = -1, Idle = -1, Target = -1;
+
+	// Big messages aren't worth it, they're usually one-shot sample dumps
+	if (!Cache || !Length || Length > MAX_SYSEX_CACHE_SIZE)
+		return 0;
+
+	unsigned long long H = Hash(Data, Length);
+
+	for (int i = 0; i < MAX_SYSEX_CACHE_PROBE; i++) {
+		int Idx = (int)((H + i) & (MAX_SYSEX_CACHE_ENTRIES - 1));
+		PSXCEntry Entry = &Cache->Entries[Idx];
+
+		// We already have it, just queue another reference
+		if (Entry->Length == Length && Entry->Hash == H && !memcmp(Entry->Data, Data, Length)) {
+			InterlockedIncrement(&Entry->Pending);
+			return Idx + 1;
+		}
+
+		if (!Entry->Length) {
+			if (Empty < 0) Empty = Idx;
+		}
+		else if (!Entry->Pending) {
+			if (Idle < 0) Idle = Idx;
+		}
+	}
+
+	// Use an empty entry if possible, then evict one that the host is done with
+	Target = (Empty >= 0) ? Empty : Idle;
+	if (Target < 0)
+		return 0;
+
+	PSXCEntry Entry = &Cache->Entries[Target];
+
+	// The host dropped its last reference, its reads are done once Pending says so
+	AtomicFence(std::memory_order_acquire);
+
+	Entry->Length = 0;
+	memcpy(Entry->Data, Data, Length);
+	Entry->Hash = H;
+	Entry->Pending = 1;
+
+	// Published like the long events slot, the host has to see the data before the length
+	AtomicFence(std::memory_order_release);
+	Entry->Length = Length;
+
+	return Target + 1;
+}
+
+const BYTE* WinDriver::SysExCache::ResolveSysEx(int Ref, DWORD* Length) {
+	if (!Cache || Ref < 1 || Ref > MAX_SYSEX_CACHE_ENTRIES) {
+		*Length = 0;
+		return nullptr;
+	}
+
+	*Length = Cache->Entries[Ref - 1].Length;
+	AtomicFence(std::memory_order_acquire);
+
+	return Cache->Entries[Ref - 1].Data;
+}
+
+void WinDriver::SysExCache::ReleaseSysEx(int Ref) {
+	if (!Cache || Ref < 1 || Ref > MAX_SYSEX_CACHE_ENTRIES)
+		return;
+
+	InterlockedDecrement(&Cache->Entries[Ref - 1].Pending);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINSYSEXCACHE_H
+
+#define WINSYSEXCACHE_H
+
+#include "WinError.hpp"
+#include "WinVars.hpp"
+#include <windows.h>
+#include <AclAPI.h>
+
+/*
+
+	Apps love to send the same GS/XG resets and parameter changes over and over,
+	so small SysEx messages are stored in a shared dictionary, keyed by their hash.
+
+	The long events buffer then only carries a reference to the entry, and the
+	host reads the message straight from the dictionary.
+
+	Entries are never touched while a reference to them is still queued:
+	the driver bumps Pending when it queues a reference, the host drops it
+	once it's done with the message, and only entries with no pending
+	references can be replaced.
+
+*/
+
+typedef struct {
+	unsigned long long Hash;				// FNV-1a hash of the message
+	volatile LONG Pending;					// References queued and not consumed yet
+	volatile DWORD Length;					// 0 if the entry is unused, written after the data
+	BYTE Data[MAX_SYSEX_CACHE_SIZE];		// The message
+} SysExCacheEntry, SXCEntry, *PSXCEntry;
+
+typedef struct {
+	SXCEntry Entries[MAX_SYSEX_CACHE_ENTRIES];
+} SysExCacheTable, SXCTable, *PSXCTable;
+
+namespace WinDriver {
+	class SysExCache {
+	private:
+		ErrorSystem::WinErr CacheErr;
+
+		HANDLE PCache = nullptr;
+		PSXCTable Cache = nullptr;
+
+		static unsigned long long Hash(const BYTE* Data, DWORD Length);
+
+	public:
+		bool OpenCache(const wchar_t* Name, bool Create);
+		bool CloseCache();
+
+		// Returns a reference to the stored message, or 0 if it has to be sent inline
+		int StoreSysEx(const BYTE* Data, DWORD Length);
+		const BYTE* ResolveSysEx(int Ref, DWORD* Length);
+		void ReleaseSysEx(int Ref);
+	};
+}
+
+#endif
@@ -0,0 +1,353 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinTrace.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+static_assert(!(TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)), "TRACE_BUFFER_SIZE has to be a power of two.");
+
+static ErrorSystem::WinErr TraceErr;
+static const char* StageNames[TRACE_STAGES] = { "enqueue", "publish", "wake", "dequeue", "dispatch" };
+
+thread_local PTraceBuffer WinDriver::Trace::Local = nullptr;
+thread_local DWORD WinDriver::Trace::LastDequeued = 0;
+PTraceBuffer volatile WinDriver::Trace::Buffers = nullptr;
+volatile bool WinDriver::Trace::Running = false;
+std::thread WinDriver::Trace::Flusher;
+volatile bool WinDriver::Trace::StopFlusher = false;
+FILE* WinDriver::Trace::File = nullptr;
+DWORD WinDriver::Trace::Format = TRACE_FORMAT_JSON;
+bool WinDriver::Trace::FirstEvent = true;
+unsigned long long WinDriver::Trace::TscFrequency = 0;
+
+PTraceBuffer WinDriver::Trace::Register() {
+	PTraceBuffer Buf = new (std::nothrow) TraceBuffer;
+
+	if (!Buf)
+		return nullptr;
+
+	Buf->Head = Buf->Tail = 0;
+	Buf->Dropped = 0;
+	Buf->ThreadId = GetCurrentThreadId();
+
+	// The buffers are never freed, the flush thread could still be reading
+	// from the buffer of a thread that just quit
+	do Buf->Next = Buffers;
+	while (InterlockedCompareExchangePointer((PVOID volatile*)&Buffers, Buf, Buf->Next) != Buf->Next);
+
+	Local = Buf;
+	return Buf;
+}
+
+unsigned long long WinDriver::Trace::MeasureTsc() {
+	LARGE_INTEGER Freq, Start, End;
+
+	// The TSC is invariant on anything that can run Windows 8.1 decently,
+	// so timing it against QPC once is enough
+	QueryPerformanceFrequency(&Freq);
+	QueryPerformanceCounter(&Start);
+	unsigned long long TscStart = __rdtsc();
+
+	Sleep(20);
+
+	QueryPerformanceCounter(&End);
+	unsigned long long TscEnd = __rdtsc();
+
+	return (unsigned long long)((double)(TscEnd - TscStart) * Freq.QuadPart / (End.QuadPart - Start.QuadPart));
+}
+
+bool WinDriver::Trace::Start(const wchar_t* Path, DWORD TargetFormat) {
+#ifndef SHAKRA_TRACING
+	NERROR(TraceErr, L"This build of the driver has no trace points, it has to be built with SHAKRA_TRACING.", false);
+	return false;
+#else
+	if (Running) {
+		LOG(TraceErr, L"The trace is already running.");
+		return false;
+	}
+
+	if (!Path || TargetFormat > TRACE_FORMAT_BINARY) {
+		NERROR(TraceErr, L"Invalid trace file or format.", false);
+		return false;
+	}
+
+	if (_wfopen_s(&File, Path, L"wb") || !File) {
+		NERROR(TraceErr, L"Failed to create the trace file.", false);
+		File = nullptr;
+		return false;
+	}
+
+	Format = TargetFormat;
+	FirstEvent = true;
+	TscFrequency = MeasureTsc();
+
+	if (Format == TRACE_FORMAT_BINARY) {
+		TraceFileHeader Header = { TRACE_MAGIC, TRACE_VERSION, GetCurrentProcessId(), 0, TscFrequency };
+		fwrite(&Header, sizeof(Header), 1, File);
+	}
+	else fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", File);
+
+	// Forget whatever got recorded after the last trace stopped
+	for (PTraceBuffer Buf = Buffers; Buf; Buf = Buf->Next) {
+		Buf->Tail = Buf->Head;
+		Buf->Dropped = 0;
+	}
+
+	StopFlusher = false;
+
+	try {
+		Flusher = std::thread(FlushLoop);
+	}
+	catch (std::system_error&) {
+		NERROR(TraceErr, L"Failed to start the trace flush thread.", false);
+		fclose(File);
+		File = nullptr;
+		return false;
+	}
+
+	Running = true;
+	return true;
+#endif
+}
+
+bool WinDriver::Trace::StartFromEnvironment() {
+#ifndef SHAKRA_TRACING
+	return false;
+#else
+	static DWORD Session = 0;
+	wchar_t Base[MAX_PATH];
+	wchar_t Path[MAX_PATH];
+
+	if (Running)
+		return true;
+
+	DWORD Len = GetEnvironmentVariableW(L"SHAKRA_TRACE_FILE", Base, MAX_PATH);
+	if (!Len || Len >= MAX_PATH)
+		return false;
+
+	// Every app, and every time it opens the device, gets its own file, and a .json one gets JSON
+	bool Json = (Len > 5 && !_wcsicmp(Base + Len - 5, L".json"));
+	swprintf_s(Path, MAX_PATH, L"%s.%lu.%lu%s", Base, (unsigned long)GetCurrentProcessId(), (unsigned long)Session++, Json ? L".json" : L".shkt");
+
+	return Start(Path, Json ? TRACE_FORMAT_JSON : TRACE_FORMAT_BINARY);
+#endif
+}
+
+void WinDriver::Trace::Stop() {
+	DWORD Dropped = 0;
+
+	if (!Running)
+		return;
+
+	Running = false;
+	StopFlusher = true;
+
+	if (Flusher.joinable())
+		Flusher.join();
+
+	for (PTraceBuffer Buf = Buffers; Buf; Buf = Buf->Next)
+		Dropped += Buf->Dropped;
+
+	if (Format == TRACE_FORMAT_JSON)
+		fprintf(File, "%s{\"name\":\"dropped\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"records\":%lu}}\n]}\n",
+			FirstEvent ? "" : ",", (unsigned long)GetCurrentProcessId(), (unsigned long)Dropped);
+
+	if (Dropped)
+		LOG(TraceErr, L"Some trace records got dropped, the flush thread couldn't keep up.");
+
+	fclose(File);
+	File = nullptr;
+}
+
+void WinDriver::Trace::FlushLoop() {
+	while (!StopFlusher) {
+		Sleep(TRACE_FLUSH_INTERVAL);
+		Drain();
+	}
+
+	// Whatever got recorded while we were asleep
+	Drain();
+}
+
+void WinDriver::Trace::Drain() {
+	for (PTraceBuffer Buf = Buffers; Buf; Buf = Buf->Next) {
+		DWORD Head = Buf->Head;
+		DWORD Tail = Buf->Tail;
+
+		AtomicFence(std::memory_order_acquire);
+
+		for (; Tail != Head; Tail++)
+			WriteRecord(Buf->ThreadId, &Buf->Records[Tail & (TRACE_BUFFER_SIZE - 1)]);
+
+		// Hand the records back to the owner thread
+		AtomicFence(std::memory_order_release);
+		Buf->Tail = Tail;
+	}
+
+	fflush(File);
+}
+
+void WinDriver::Trace::WriteRecord(DWORD ThreadId, PTraceRecord Rec) {
+	if (Format == TRACE_FORMAT_BINARY) {
+		TraceFileRecord Out = { Rec->Tsc, ThreadId, Rec->Id, Rec->Stage, 0 };
+		fwrite(&Out, sizeof(Out), 1, File);
+		return;
+	}
+
+	if (Rec->Stage >= TRACE_STAGES)
+		return;
+
+	// Absolute time, so that the files of the app and the host line up in the viewer
+	fprintf(File, "%s{\"name\":\"%s\",\"cat\":\"shakra\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu,\"args\":{\"id\":%lu}}",
+		FirstEvent ? "" : ",\n", StageNames[Rec->Stage], (double)Rec->Tsc * 1000000.0 / TscFrequency,
+		(unsigned long)GetCurrentProcessId(), (unsigned long)ThreadId, (unsigned long)Rec->Id);
+
+	FirstEvent = false;
+}
+
+//
+// SUMMARY, USED THROUGH RUNDLL32
+//
+
+typedef struct {
+	unsigned long long Time;	// ns
+	DWORD ThreadId;
+	DWORD Id;
+} TraceMark, *PTraceMark;
+
+static bool LoadTrace(const char* Path, std::vector<TraceMark>* Stages) {
+	TraceFileHeader Header;
+	TraceFileRecord Rec;
+	FILE* In = nullptr;
+
+	if (fopen_s(&In, Path, "rb") || !In) {
+		printf("Can't open %s.\n", Path);
+		return false;
+	}
+
+	if (fread(&Header, sizeof(Header), 1, In) != 1 || Header.Magic != TRACE_MAGIC || Header.Version != TRACE_VERSION || !Header.TscFrequency) {
+		printf("%s isn't a binary Shakra trace.\n", Path);
+		fclose(In);
+		return false;
+	}
+
+	while (fread(&Rec, sizeof(Rec), 1, In) == 1) {
+		if (Rec.Stage >= TRACE_STAGES)
+			continue;
+
+		// Split, so that it doesn't overflow
+		unsigned long long Time = (Rec.Tsc / Header.TscFrequency) * 1000000000ULL + (Rec.Tsc % Header.TscFrequency) * 1000000000ULL / Header.TscFrequency;
+		Stages[Rec.Stage].push_back({ Time, Rec.ThreadId, Rec.Id });
+	}
+
+	fclose(In);
+	return true;
+}
+
+static void PrintPercentiles(const char* Name, std::vector<unsigned long long>& Lat) {
+	if (Lat.empty()) {
+		printf("%-22s %10s\n", Name, "no data");
+		return;
+	}
+
+	std::sort(Lat.begin(), Lat.end());
+
+	auto At = [&Lat](unsigned int PerMille) { return Lat[(Lat.size() - 1) * PerMille / 1000] / 1000.0; };
+
+	printf("%-22s %10zu %10.2f %10.2f %10.2f %10.2f %10.2f\n", Name, Lat.size(),
+		At(500), At(900), At(990), At(999), Lat.back() / 1000.0);
+}
+
+void TraceSummary(HWND HWND, HINSTANCE hInst, LPSTR CommandLine, bool CmdShow) {
+	std::vector<TraceMark> Stages[TRACE_STAGES];
+	std::unordered_map<DWORD, unsigned long long> Enqueued, Published;
+	std::unordered_map<DWORD, std::vector<unsigned long long>> Wakes, Dispatches;
+	std::vector<unsigned long long> Lat[5];
+	FILE* Con = nullptr;
+	FILE* ConIn = nullptr;
+
+	// Same signature as the other RunDLL32 entry points, only the command line matters here
+	(void)HWND; (void)hInst; (void)CmdShow;
+
+	// RunDLL32 has no console, borrow the one it got started from
+	bool OwnConsole = !AttachConsole(ATTACH_PARENT_PROCESS);
+	if (OwnConsole && !AllocConsole())
+		return;
+
+	freopen_s(&Con, "CONOUT$", "w", stdout);
+
+	std::string Args = CommandLine ? CommandLine : "";
+	size_t Pos = 0;
+
+	while ((Pos = Args.find_first_not_of(' ', Pos)) != std::string::npos) {
+		size_t End = Args.find(' ', Pos);
+		LoadTrace(Args.substr(Pos, End - Pos).c_str(), Stages);
+		Pos = End;
+	}
+
+	// The per event stages are matched by ring position,
+	// the batch ones by time on the consumer's thread
+	for (auto& M : Stages[TRACE_ENQUEUE]) Enqueued[M.Id] = M.Time;
+	for (auto& M : Stages[TRACE_PUBLISH]) Published[M.Id] = M.Time;
+	for (auto& M : Stages[TRACE_WAKE]) Wakes[M.ThreadId].push_back(M.Time);
+	for (auto& M : Stages[TRACE_DISPATCH]) Dispatches[M.ThreadId].push_back(M.Time);
+	for (auto& W : Wakes) std::sort(W.second.begin(), W.second.end());
+	for (auto& D : Dispatches) std::sort(D.second.begin(), D.second.end());
+
+	for (auto& M : Stages[TRACE_DEQUEUE]) {
+		auto E = Enqueued.find(M.Id);
+		auto P = Published.find(M.Id);
+		unsigned long long Wake = 0, Dispatch = 0;
+
+		auto& W = Wakes[M.ThreadId];
+		auto WIt = std::upper_bound(W.begin(), W.end(), M.Time);
+		if (WIt != W.begin()) Wake = *(WIt - 1);
+
+		auto& D = Dispatches[M.ThreadId];
+		auto DIt = std::lower_bound(D.begin(), D.end(), M.Time);
+		if (DIt != D.end()) Dispatch = *DIt;
+
+		if (E != Enqueued.end() && P != Published.end() && P->second >= E->second)
+			Lat[0].push_back(P->second - E->second);
+
+		// An event published while the host was already awake didn't wait for it
+		if (P != Published.end() && Wake)
+			Lat[1].push_back(Wake > P->second ? Wake - P->second : 0);
+
+		if (Wake)
+			Lat[2].push_back(M.Time - Wake);
+
+		if (Dispatch)
+			Lat[3].push_back(Dispatch - M.Time);
+
+		if (E != Enqueued.end() && Dispatch && Dispatch >= E->second)
+			Lat[4].push_back(Dispatch - E->second);
+	}
+
+	printf("%zu events dequeued, latencies in us\n\n", Stages[TRACE_DEQUEUE].size());
+	printf("%-22s %10s %10s %10s %10s %10s %10s\n", "Stage", "Count", "p50", "p90", "p99", "p99.9", "Max");
+	PrintPercentiles("enqueue -> publish", Lat[0]);
+	PrintPercentiles("publish -> wake", Lat[1]);
+	PrintPercentiles("wake -> dequeue", Lat[2]);
+	PrintPercentiles("dequeue -> dispatch", Lat[3]);
+	PrintPercentiles("enqueue -> dispatch", Lat[4]);
+	fflush(stdout);
+
+	if (OwnConsole) {
+		freopen_s(&ConIn, "CONIN$", "r", stdin);
+		printf("\nPress Enter to close this window.");
+		fflush(stdout);
+		(void)getchar();
+	}
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINTRACE_H
+
+#define WINTRACE_H
+
+#include "WinError.hpp"
+#include "WinRing.hpp"
+#include <windows.h>
+#include <intrin.h>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+
+/*
+
+	Hot path tracing, only built when SHAKRA_TRACING is defined.
+	Without it, the SHAKRA_TRACE macros expand to nothing at all.
+
+	Every trace point stores the TSC, a stage and an id in a buffer owned by
+	the thread that hit it, so recording is a RDTSC and a few stores, with
+	no locks and no shared cache lines. A background thread moves the records
+	to the trace file every TRACE_FLUSH_INTERVAL ms. If a buffer fills up before
+	that, the new records are dropped and counted, the hot path never waits.
+
+	Stages:
+	- TRACE_ENQUEUE: The app handed the event to the driver (SaveShortEvent)
+	- TRACE_PUBLISH: The event is visible to the host (the ring's Commit)
+	- TRACE_WAKE: The host started reading a batch
+	- TRACE_DEQUEUE: The host took the event out of the ring
+	- TRACE_DISPATCH: The host handed the batch to the synth (SH_TRD)
+
+	The id of the per-event stages is the event's position in its ring, with
+	TRACE_PRIORITY_LANE set for the priority lane, so the records of the app
+	and the host can be matched even though they're written by two processes.
+	The batch stages are matched by time, on the host's thread.
+
+	Formats:
+	- TRACE_FORMAT_JSON: Chrome trace events, for chrome://tracing or Perfetto
+	- TRACE_FORMAT_BINARY: TraceFileHeader, followed by TraceFileRecords
+
+	The app side traces from MODM_OPEN to MODM_CLOSE if SHAKRA_TRACE_FILE is set,
+	with the PID and the session added to the file name. The summary works on binary files only:
+	rundll32 shakra.dll,TraceSummary app.shkt host.shkt
+
+*/
+
+#define TRACE_ENQUEUE		0
+#define TRACE_PUBLISH		1
+#define TRACE_WAKE			2
+#define TRACE_DEQUEUE		3
+#define TRACE_DISPATCH		4
+#define TRACE_STAGES		5
+
+#define TRACE_FORMAT_JSON	0
+#define TRACE_FORMAT_BINARY	1
+
+#define TRACE_PRIORITY_LANE		0x80000000
+#define TRACE_BUFFER_SIZE		65536		// Records per thread, has to be a power of two
+#define TRACE_FLUSH_INTERVAL	10
+#define TRACE_MAGIC				0x544B4853	// 'SHKT'
+#define TRACE_VERSION			1
+
+// Id of the event at ring position Pos
+#define TRACE_ID(Pos, Priority)				(((Pos) & ~TRACE_PRIORITY_LANE) | ((Priority) ? TRACE_PRIORITY_LANE : 0))
+
+#ifdef SHAKRA_TRACING
+#define SHAKRA_TRACE(Stage, Id)				WinDriver::Trace::Record(Stage, Id, __rdtsc())
+#define SHAKRA_TRACE_START(Var)				unsigned long long Var = __rdtsc()
+#define SHAKRA_TRACE_AT(Stage, Id, Var)		WinDriver::Trace::Record(Stage, Id, Var)
+#else
+#define SHAKRA_TRACE(Stage, Id)				((void)0)
+#define SHAKRA_TRACE_START(Var)				((void)0)
+#define SHAKRA_TRACE_AT(Stage, Id, Var)		((void)0)
+#endif
+
+typedef struct {
+	unsigned long long Tsc;
+	DWORD Id;
+	DWORD Stage;
+} TraceRecord, *PTraceRecord;
+
+typedef struct TraceBuffer {
+	volatile DWORD Head;		// Written by the owner thread only
+	BYTE HeadPad[60];
+	volatile DWORD Tail;		// Written by the flush thread only
+	BYTE TailPad[60];
+	DWORD ThreadId;
+	volatile DWORD Dropped;
+	TraceBuffer* volatile Next;
+	TraceRecord Records[TRACE_BUFFER_SIZE];
+} TraceBuffer, *PTraceBuffer;
+
+typedef struct {
+	DWORD Magic;
+	DWORD Version;
+	DWORD ProcessId;
+	DWORD Reserved;
+	unsigned long long TscFrequency;	// Ticks per second
+} TraceFileHeader, *PTraceFileHeader;
+
+typedef struct {
+	unsigned long long Tsc;
+	DWORD ThreadId;
+	DWORD Id;
+	DWORD Stage;
+	DWORD Reserved;
+} TraceFileRecord, *PTraceFileRecord;
+
+namespace WinDriver {
+	class Trace {
+	private:
+		static thread_local PTraceBuffer Local;
+		static thread_local DWORD LastDequeued;
+		static PTraceBuffer volatile Buffers;
+		static volatile bool Running;
+
+		// Flush thread and the file it writes to
+		static std::thread Flusher;
+		static volatile bool StopFlusher;
+		static FILE* File;
+		static DWORD Format;
+		static bool FirstEvent;
+		static unsigned long long TscFrequency;
+
+		static PTraceBuffer Register();
+		static unsigned long long MeasureTsc();
+		static void FlushLoop();
+		static void Drain();
+		static void WriteRecord(DWORD ThreadId, PTraceRecord Rec);
+
+	public:
+		static bool Start(const wchar_t* Path, DWORD TargetFormat);
+		static bool StartFromEnvironment();
+		static void Stop();
+
+		// Id of the last event dequeued by this thread, used for TRACE_DISPATCH
+		static DWORD GetLastDequeued() { return LastDequeued; }
+
+		static void Record(DWORD Stage, DWORD Id, unsigned long long Tsc) {
+			if (!Running)
+				return;
+
+			PTraceBuffer Buf = Local ? Local : Register();
+			if (!Buf)
+				return;
+
+			DWORD Head = Buf->Head;
+
+			// The flush thread is behind, losing a record is better than waiting for it
+			if (Head - Buf->Tail >= TRACE_BUFFER_SIZE) {
+				Buf->Dropped++;
+				return;
+			}
+
+			PTraceRecord Rec = &Buf->Records[Head & (TRACE_BUFFER_SIZE - 1)];
+			Rec->Tsc = Tsc;
+			Rec->Id = Id;
+			Rec->Stage = Stage;
+
+			if (Stage == TRACE_DEQUEUE)
+				LastDequeued = Id;
+
+			AtomicFence(std::memory_order_release);
+			Buf->Head = Head + 1;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,228 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinTransform.hpp"
+
+void WinDriver::EventTransform::GetIdentity(PTransformRules Rules) {
+	memset(Rules, 0, sizeof(TransformRules));
+
+	Rules->ChannelMask = 0xFFFF;
+	Rules->NoteHigh = 127;
+
+	for (int i = 0; i < 128; i++) {
+		Rules->VelocityCurve[i] = (BYTE)i;
+		Rules->CCMap[i] = (BYTE)i;
+	}
+}
+
+void WinDriver::EventTransform::Compile(const TransformRules* Rules) {
+	TouchNotes = false;
+	TouchCCs = false;
+	ChannelMask = (WORD)Rules->ChannelMask;
+
+	for (int Ch = 0; Ch < 16; Ch++) {
+		for (int Note = 0; Note < 128; Note++) {
+			int Out = Note + Rules->Transpose[Ch];
+
+			if (Note < Rules->NoteLow || Note > Rules->NoteHigh) Out = XFORM_DROP;
+			else if (Out < 0) Out = 0;
+			else if (Out > 127) Out = 127;
+
+			NoteMap[Ch][Note] = (BYTE)Out;
+			TouchNotes |= (Out != Note);
+		}
+	}
+
+	for (int i = 0; i < 128; i++) {
+		BYTE Velocity = Rules->VelocityCurve[i] & 0x7F;
+
+		// Zero is a note off, and a note on has to stay one
+		VelocityMap[i] = i ? (Velocity ? Velocity : 1) : 0;
+		TouchNotes |= (VelocityMap[i] != i);
+
+		CCMap[i] = (Rules->CCMap[i] == XFORM_DROP) ? XFORM_DROP : (Rules->CCMap[i] & 0x7F);
+		TouchCCs |= (CCMap[i] != i);
+	}
+
+	for (int Ch = 0; Ch < 16; Ch++) {
+		DWORD Through = ((ChannelMask >> Ch) & 1) << 16;
+
+		for (int i = 0; i < 128; i++)
+			LaneMap[Ch][i] = NoteMap[Ch][i] | (CCMap[i] << 8) | Through;
+	}
+
+	Active = Rules->Enabled && (TouchNotes || TouchCCs || ChannelMask != 0xFFFF);
+}
+
+bool WinDriver::EventTransform::Apply(DWORD* Event) {
+	DWORD Ev = *Event;
+	BYTE Status = Ev & 0xFF;
+	BYTE Channel = Status & 0x0F;
+
+	// System messages, and data bytes with no status to go with them
+	if (Status < 0x80 || Status >= 0xF0)
+		return true;
+
+	if (!(ChannelMask & (1 << Channel)))
+		return false;
+
+	switch (Status & 0xF0) {
+	case 0x80:
+	case 0x90:
+	case 0xA0: {
+		BYTE Note = NoteMap[Channel][(Ev >> 8) & 0x7F];
+		DWORD Velocity = (Ev >> 16) & 0x7F;
+
+		if (Note == XFORM_DROP)
+			return false;
+
+		if ((Status & 0xF0) == 0x90)
+			Velocity = VelocityMap[Velocity];
+
+		*Event = Status | (Note << 8) | (Velocity << 16);
+		return true;
+	}
+
+	case 0xB0: {
+		BYTE CC = CCMap[(Ev >> 8) & 0x7F];
+
+		if (CC == XFORM_DROP)
+			return false;
+
+		*Event = (Ev & 0xFF00FF) | (CC << 8);
+		return true;
+	}
+	}
+
+	return true;
+}
+
+unsigned int WinDriver::EventTransform::ApplyBatch(DWORD* Events, unsigned int Count, BYTE* RunningStatus) {
+	unsigned int Out = 0;
+	unsigned int i = 0;
+
+	auto ApplyOne = [&](DWORD Event) {
+		BYTE Status = Event & 0xFF;
+
+		// Same rules as SaveShortEvent(), realtime leaves the running status alone, system common clears it
+		if (Status & 0x80) {
+			if (Status < 0xF0) *RunningStatus = Status;
+			else if (Status < 0xF8) *RunningStatus = 0;
+		}
+		else if (*RunningStatus)
+			Event = ((Event << 8) | *RunningStatus) & 0xFFFFFF;
+
+		if (Apply(&Event))
+			Events[Out++] = Event;
+	};
+
+#ifdef XFORM_SSE2
+	const __m128i StatusMask = _mm_set1_epi32(0xFF);
+	const __m128i TypeMask = _mm_set1_epi32(0xF0);
+	const __m128i DataMask = _mm_set1_epi32(0x7F);
+	const __m128i NoStatusLimit = _mm_set1_epi32(0x80);
+	const __m128i SystemLimit = _mm_set1_epi32(0xF0);
+	const __m128i Drop = _mm_set1_epi32(XFORM_DROP);
+	const __m128i AllOnes = _mm_set1_epi32(-1);
+
+	// What the rules touch, as lane masks, so the loop has no branches on them
+	const __m128i AllVoice = (ChannelMask != 0xFFFF) ? AllOnes : _mm_setzero_si128();
+	const __m128i Notes = TouchNotes ? AllOnes : _mm_setzero_si128();
+	const __m128i CCs = TouchCCs ? AllOnes : _mm_setzero_si128();
+
+	auto Select = [](__m128i Mask, __m128i A, __m128i B) {
+		return _mm_or_si128(_mm_and_si128(Mask, A), _mm_andnot_si128(Mask, B));
+	};
+
+	for (; i + 4 <= Count; i += 4) {
+		__m128i Ev = _mm_loadu_si128((const __m128i*)&Events[i]);
+		__m128i Status = _mm_and_si128(Ev, StatusMask);
+		__m128i Type = _mm_and_si128(Ev, TypeMask);
+
+		__m128i NoStatus = _mm_cmplt_epi32(Status, NoStatusLimit);
+
+		// Running status is rare enough, those groups go through the tables one event at a time
+		if (_mm_movemask_ps(_mm_castsi128_ps(NoStatus))) {
+			for (unsigned int j = 0; j < 4; j++)
+				ApplyOne(Events[i + j]);
+
+			continue;
+		}
+
+		__m128i Voice = _mm_cmplt_epi32(Status, SystemLimit);
+		__m128i NoteOn = _mm_cmpeq_epi32(Type, _mm_set1_epi32(0x90));
+		__m128i NoteType = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi32(Type, _mm_set1_epi32(0x80)), NoteOn),
+			_mm_cmpeq_epi32(Type, _mm_set1_epi32(0xA0)));
+		__m128i CCType = _mm_cmpeq_epi32(Type, _mm_set1_epi32(0xB0));
+
+		__m128i Touched = _mm_or_si128(_mm_and_si128(NoteType, Notes), _mm_and_si128(CCType, CCs));
+		__m128i Work = _mm_and_si128(Voice, _mm_or_si128(AllVoice, Touched));
+
+		// The running status still follows the last event that has a status
+		for (int j = 3; j >= 0; j--) {
+			BYTE S = Events[i + j] & 0xFF;
+
+			if (S >= 0xF8)
+				continue;
+
+			*RunningStatus = (S < 0xF0) ? S : 0;
+			break;
+		}
+
+		// Nothing to change, they only have to be packed, Out is never ahead of i
+		if (!_mm_movemask_ps(_mm_castsi128_ps(Work))) {
+			_mm_storeu_si128((__m128i*)&Events[Out], Ev);
+			Out += 4;
+			continue;
+		}
+
+		// SSE2 has no gather, so only the two table reads are done a lane at a time
+		DWORD E0 = Events[i], E1 = Events[i + 1], E2 = Events[i + 2], E3 = Events[i + 3];
+
+		auto LaneOf = [this](DWORD E) { return (int)LaneMap[E & 0x0F][(E >> 8) & 0x7F]; };
+		auto VelocityOf = [this](DWORD E) { return (int)VelocityMap[(E >> 16) & 0x7F]; };
+
+		__m128i Lane = _mm_set_epi32(LaneOf(E3), LaneOf(E2), LaneOf(E1), LaneOf(E0));
+		__m128i Note = _mm_and_si128(Lane, StatusMask);
+		__m128i CC = _mm_and_si128(_mm_srli_epi32(Lane, 8), StatusMask);
+		__m128i Muted = _mm_cmpeq_epi32(_mm_srli_epi32(Lane, 16), _mm_setzero_si128());
+
+		__m128i Dropped = _mm_and_si128(Voice, _mm_or_si128(Muted, _mm_or_si128(
+			_mm_and_si128(NoteType, _mm_cmpeq_epi32(Note, Drop)),
+			_mm_and_si128(CCType, _mm_cmpeq_epi32(CC, Drop)))));
+
+		// Same fields Apply() writes, the notes get their velocity masked, the CCs keep it as it was
+		__m128i Velocity = _mm_and_si128(_mm_srli_epi32(Ev, 16), DataMask);
+		Velocity = Select(NoteOn, _mm_set_epi32(VelocityOf(E3), VelocityOf(E2), VelocityOf(E1), VelocityOf(E0)), Velocity);
+
+		__m128i NoteEv = _mm_or_si128(Status, _mm_or_si128(_mm_slli_epi32(Note, 8), _mm_slli_epi32(Velocity, 16)));
+		__m128i CCEv = _mm_or_si128(_mm_and_si128(Ev, _mm_set1_epi32(0xFF00FF)), _mm_slli_epi32(CC, 8));
+		__m128i Result = Select(NoteType, NoteEv, Select(CCType, CCEv, Ev));
+
+		// Packed without branches, every lane gets written and Out only moves past the kept ones.
+		// The group is already in registers, so writing over it is fine
+		int Dropped4 = _mm_movemask_ps(_mm_castsi128_ps(Dropped));
+		alignas(16) DWORD Kept[4];
+		_mm_store_si128((__m128i*)Kept, Result);
+
+		for (unsigned int j = 0; j < 4; j++) {
+			Events[Out] = Kept[j];
+			Out += !((Dropped4 >> j) & 1);
+		}
+	}
+#endif
+
+	for (; i < Count; i++)
+		ApplyOne(Events[i]);
+
+	return Out;
+}
+
+#endif
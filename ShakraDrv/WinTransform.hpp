@@ -0,0 +1,98 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINTRANSFORM_H
+
+#define WINTRANSFORM_H
+
+#include <windows.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define XFORM_SSE2
+#endif
+
+/*
+
+	Event transforms, set by the host in the control page and applied by the
+	apps in SaveShortEvent(), so the events that get filtered out never take
+	a slot in the ring.
+
+	The rules get compiled into lookup tables every time the control page
+	changes, so applying them costs a couple of table reads per event:
+	- NoteMap: Per channel, note in, note out, with the range check and the
+	  clamped transposition already done, XFORM_DROP for the notes to drop
+	- VelocityMap: Note on velocity in, velocity out
+	- CCMap: CC in, CC out, XFORM_DROP for the CCs to drop
+
+	ApplyBatch() is used by SaveShortEvents(). It looks at four events at a time
+	with SSE2, and the groups nothing touches only get packed. The others get
+	transformed four at a time too: SSE2 has no gather, so the table reads are
+	done a lane at a time, but there are only two of them, LaneMap and
+	VelocityMap, and the drops, the new fields and the packing are done on
+	the four lanes at once, without branches.
+	- LaneMap: Per channel and first data byte, the NoteMap and CCMap entries
+	  and whether the channel is let through, packed in a DWORD
+	Only the groups with running status go through Apply() one event at a time.
+
+	Rules:
+	Enabled = Zero turns the whole stage off, the other fields are ignored
+	ChannelMask = Bit N set lets channel N through
+	NoteLow, NoteHigh = Notes outside of the range get dropped, checked before transposing
+	Transpose = Semitones per channel, the result is clamped to 0-127
+	VelocityCurve = Note on velocity in, velocity out, a non-zero velocity never becomes 0
+	CCMap = CC in, CC out, XFORM_DROP drops it
+
+	Poly pressure gets the same note mapping as the notes, so it still goes to the right key.
+	System messages are never touched.
+
+*/
+
+#define XFORM_DROP			0xFF
+#define XFORM_CHUNK			256		// Events SaveShortEvents() transforms at once, on the stack
+
+typedef struct {
+	DWORD Enabled;
+	DWORD ChannelMask;
+	BYTE NoteLow;
+	BYTE NoteHigh;
+	signed char Transpose[16];
+	BYTE VelocityCurve[128];
+	BYTE CCMap[128];
+	BYTE Reserved[2];
+} TransformRules, *PTransformRules;
+
+namespace WinDriver {
+	class EventTransform {
+	private:
+		bool Active = false;
+		bool TouchNotes = false;
+		bool TouchCCs = false;
+		WORD ChannelMask = 0xFFFF;
+
+		BYTE NoteMap[16][128];
+		BYTE VelocityMap[128];
+		BYTE CCMap[128];
+		DWORD LaneMap[16][128];		// Note | CC << 8 | Channel let through << 16
+
+	public:
+		// Rules that change nothing leave the stage off
+		static void GetIdentity(PTransformRules Rules);
+		void Compile(const TransformRules* Rules);
+		bool IsActive() { return Active; }
+
+		// Returns false if the event has to be dropped, it needs its status byte
+		bool Apply(DWORD* Event);
+
+		// Resolves the running status, transforms the events and packs the ones left, returns how many there are
+		unsigned int ApplyBatch(DWORD* Events, unsigned int Count, BYTE* RunningStatus);
+	};
+}
+
+#endif
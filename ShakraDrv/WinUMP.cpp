@@ -0,0 +1,257 @@
+/*
+Shakra Driver component for Windows
+This .cpp file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#ifdef _WIN32
+
+#include "WinUMP.hpp"
+
+unsigned int WinDriver::UMP::GetWords(DWORD Word0) {
+	// Straight from the message type table of the spec
+	static const BYTE Words[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+	return Words[Word0 >> 28];
+}
+
+DWORD WinDriver::UMP::Upscale(DWORD Value, unsigned int SrcBits, unsigned int DstBits) {
+	unsigned int ScaleBits = DstBits - SrcBits;
+	DWORD Shifted = Value << ScaleBits;
+
+	// Up to the center, a plain shift
+	if (Value <= (1u << (SrcBits - 1)))
+		return Shifted;
+
+	// Above it, the bits under the top one get repeated to fill the gap, so that the max stays the max
+	unsigned int RepeatBits = SrcBits - 1;
+	DWORD Repeat = Value & ((1u << RepeatBits) - 1);
+
+	if (ScaleBits > RepeatBits) Repeat <<= ScaleBits - RepeatBits;
+	else Repeat >>= RepeatBits - ScaleBits;
+
+	while (Repeat) {
+		Shifted |= Repeat;
+		Repeat >>= RepeatBits;
+	}
+
+	return Shifted;
+}
+
+DWORD WinDriver::UMP::Downscale(DWORD Value, unsigned int SrcBits, unsigned int DstBits) {
+	return Value >> (SrcBits - DstBits);
+}
+
+unsigned int WinDriver::UMP::FromMidi1(DWORD Event, BYTE Group, DWORD Protocol, DWORD* Words) {
+	BYTE Status = Event & 0xFF;
+	DWORD D1 = (Event >> 8) & 0x7F;
+	DWORD D2 = (Event >> 16) & 0x7F;
+	DWORD Head = ((DWORD)(Group & 0x0F) << 24) | ((DWORD)Status << 16);
+
+	if (!(Status & 0x80))
+		return 0;
+
+	if (Status >= 0xF0) {
+		// SysEx goes through SysEx7Packet()
+		if (Status == 0xF0 || Status == 0xF7)
+			return 0;
+
+		// Only keep the data bytes the message actually has
+		if (Status == 0xF2) Words[0] = Head | (D1 << 8) | D2;
+		else if (Status == 0xF1 || Status == 0xF3) Words[0] = Head | (D1 << 8);
+		else Words[0] = Head;
+
+		Words[0] |= (DWORD)UMP_MT_SYSTEM << 28;
+		return 1;
+	}
+
+	BYTE Type = Status & 0xF0;
+
+	if (Protocol != UMP_PROTOCOL_MIDI2) {
+		bool OneByte = (Type == 0xC0 || Type == 0xD0);
+		Words[0] = ((DWORD)UMP_MT_MIDI1 << 28) | Head | (D1 << 8) | (OneByte ? 0 : D2);
+		return 1;
+	}
+
+	Head |= (DWORD)UMP_MT_MIDI2 << 28;
+
+	switch (Type) {
+	case 0x90:
+		// Velocity 0 is a real note on in MIDI 2.0
+		if (!D2) {
+			Words[0] = (Head & 0xFF00FFFF) | ((DWORD)(0x80 | (Status & 0x0F)) << 16) | (D1 << 8);
+			Words[1] = 0x8000 << 16;
+			return 2;
+		}
+		// Fall through
+	case 0x80:
+		Words[0] = Head | (D1 << 8);
+		Words[1] = Upscale(D2, 7, 16) << 16;
+		return 2;
+
+	case 0xA0:
+	case 0xB0:
+		Words[0] = Head | (D1 << 8);
+		Words[1] = Upscale(D2, 7, 32);
+		return 2;
+
+	case 0xC0:
+		Words[0] = Head;
+		Words[1] = D1 << 24;
+		return 2;
+
+	case 0xD0:
+		Words[0] = Head;
+		Words[1] = Upscale(D1, 7, 32);
+		return 2;
+
+	case 0xE0:
+		Words[0] = Head;
+		Words[1] = Upscale(D1 | (D2 << 7), 14, 32);
+		return 2;
+	}
+
+	return 0;
+}
+
+unsigned int WinDriver::UMP::ToMidi1(const DWORD* Words, DWORD* Events) {
+	DWORD W0 = Words[0];
+	DWORD Status = (W0 >> 16) & 0xFF;
+	DWORD Index = (W0 >> 8) & 0x7F;
+
+	switch (W0 >> 28) {
+	case UMP_MT_SYSTEM:
+	case UMP_MT_MIDI1:
+		Events[0] = Status | (Index << 8) | ((W0 & 0x7F) << 16);
+		return 1;
+
+	case UMP_MT_MIDI2:
+		break;
+
+	default:
+		return 0;
+	}
+
+	DWORD W1 = Words[1];
+	DWORD Channel = Status & 0x0F;
+	DWORD CC = 0xB0 | Channel;
+
+	switch (Status & 0xF0) {
+	case 0x80:
+		Events[0] = Status | (Index << 8) | (Downscale(W1 >> 16, 16, 7) << 16);
+		return 1;
+
+	case 0x90: {
+		// A MIDI 2.0 note on can't have velocity 0, and in MIDI 1.0 it would be a note off
+		DWORD Velocity = Downscale(W1 >> 16, 16, 7);
+		Events[0] = Status | (Index << 8) | ((Velocity ? Velocity : 1) << 16);
+		return 1;
+	}
+
+	case 0xA0:
+	case 0xB0:
+		Events[0] = Status | (Index << 8) | (Downscale(W1, 32, 7) << 16);
+		return 1;
+
+	case 0xC0: {
+		unsigned int Count = 0;
+
+		// Bank valid, the bank select goes first
+		if (W0 & 1) {
+			Events[Count++] = CC | (0x00 << 8) | (((W1 >> 8) & 0x7F) << 16);
+			Events[Count++] = CC | (0x20 << 8) | ((W1 & 0x7F) << 16);
+		}
+
+		Events[Count++] = Status | (((W1 >> 24) & 0x7F) << 8);
+		return Count;
+	}
+
+	case 0xD0:
+		Events[0] = Status | (Downscale(W1, 32, 7) << 8);
+		return 1;
+
+	case 0xE0: {
+		DWORD Bend = Downscale(W1, 32, 14);
+		Events[0] = Status | ((Bend & 0x7F) << 8) | ((Bend >> 7) << 16);
+		return 1;
+	}
+
+	case UMP_MIDI2_RPN:
+	case UMP_MIDI2_NRPN: {
+		bool Registered = (Status & 0xF0) == UMP_MIDI2_RPN;
+		DWORD Value = Downscale(W1, 32, 14);
+
+		// Bank is the MSB of the parameter, index its LSB
+		Events[0] = CC | ((Registered ? 101 : 99) << 8) | (Index << 16);
+		Events[1] = CC | ((Registered ? 100 : 98) << 8) | ((W0 & 0x7F) << 16);
+		Events[2] = CC | (6 << 8) | ((Value >> 7) << 16);
+		Events[3] = CC | (38 << 8) | ((Value & 0x7F) << 16);
+		return 4;
+	}
+	}
+
+	return 0;
+}
+
+unsigned int WinDriver::UMP::GetSysEx7Packets(DWORD Len) {
+	// Even an empty message needs a packet
+	return Len ? (Len + UMP_SYSEX7_BYTES - 1) / UMP_SYSEX7_BYTES : 1;
+}
+
+void WinDriver::UMP::SysEx7Packet(const BYTE* Data, DWORD Len, unsigned int Index, BYTE Group, DWORD* Words) {
+	unsigned int Count = GetSysEx7Packets(Len);
+	DWORD Offset = Index * UMP_SYSEX7_BYTES;
+	DWORD Size = (Len - Offset < UMP_SYSEX7_BYTES) ? Len - Offset : UMP_SYSEX7_BYTES;
+	BYTE Bytes[UMP_SYSEX7_BYTES] = { 0 };
+	DWORD Status;
+
+	if (Count == 1) Status = UMP_SYSEX_COMPLETE;
+	else if (!Index) Status = UMP_SYSEX_START;
+	else if (Index == Count - 1) Status = UMP_SYSEX_END;
+	else Status = UMP_SYSEX_CONTINUE;
+
+	for (DWORD i = 0; i < Size; i++)
+		Bytes[i] = Data[Offset + i] & 0x7F;
+
+	Words[0] = ((DWORD)UMP_MT_SYSEX7 << 28) | ((DWORD)(Group & 0x0F) << 24) | (Status << 20) | (Size << 16) | ((DWORD)Bytes[0] << 8) | Bytes[1];
+	Words[1] = ((DWORD)Bytes[2] << 24) | ((DWORD)Bytes[3] << 16) | ((DWORD)Bytes[4] << 8) | Bytes[5];
+}
+
+int WinDriver::UMP::SysExPayload(const DWORD* Words, BYTE* Data, BYTE* Status) {
+	DWORD W0 = Words[0];
+	DWORD Size = (W0 >> 16) & 0x0F;
+
+	*Status = (W0 >> 20) & 0x0F;
+
+	if ((W0 >> 28) == UMP_MT_SYSEX7) {
+		if (Size > UMP_SYSEX7_BYTES)
+			return -1;
+
+		BYTE Bytes[UMP_SYSEX7_BYTES] = { (BYTE)(W0 >> 8), (BYTE)W0, (BYTE)(Words[1] >> 24), (BYTE)(Words[1] >> 16), (BYTE)(Words[1] >> 8), (BYTE)Words[1] };
+		memcpy(Data, Bytes, Size);
+		return (int)Size;
+	}
+
+	if ((W0 >> 28) == UMP_MT_SYSEX8) {
+		// The count includes the stream ID, which sits right before the data
+		if (!Size || Size - 1 > UMP_SYSEX8_BYTES)
+			return -1;
+
+		BYTE Bytes[UMP_SYSEX8_BYTES] = { (BYTE)W0 };
+		for (int i = 0; i < 12; i++)
+			Bytes[1 + i] = (BYTE)(Words[1 + i / 4] >> (24 - (i % 4) * 8));
+
+		for (DWORD i = 0; i < Size - 1; i++) {
+			if (Bytes[i] & 0x80)
+				return -1;
+
+			Data[i] = Bytes[i];
+		}
+
+		return (int)(Size - 1);
+	}
+
+	return -1;
+}
+
+#endif
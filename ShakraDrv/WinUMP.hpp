@@ -0,0 +1,94 @@
+/*
+Shakra Driver component for Windows
+This .h file contains the required code to run the driver under Windows 8.1 and later.
+
+This file is useful only if you want to compile the driver under Windows, it's not needed for Linux/macOS porting.
+*/
+
+#pragma once
+
+#ifndef WINUMP_H
+
+#define WINUMP_H
+
+#include <windows.h>
+
+/*
+
+	Universal MIDI Packets, from the MIDI 2.0 spec.
+
+	A packet is 1, 2 or 4 words long, and its message type (the top nibble of
+	the first word) tells which. Every slot of the UMP ring holds a whole
+	packet, so the consumer never has to stitch one together.
+
+	The apps still talk MIDI 1.0, so the driver converts on the way in
+	(FromMidi1, SysEx7Packet), and the consumer can convert back on the way out
+	(ToMidi1, SysExPayload) if its synth doesn't speak MIDI 2.0.
+
+	Up-conversion follows the default translation of the spec:
+	- Velocities, controllers and pressure get scaled with the Min-Center-Max
+	  algorithm, so that 0, the center and the max stay where they are, and the
+	  down-conversion (a plain shift) gives the original value back
+	- A Note On with velocity 0 becomes a Note Off with velocity 0x8000, which
+	  comes back as a Note Off with velocity 64
+	- Bank Select, RPN and NRPN stay plain CCs, so nothing has to be tracked
+
+	Down-conversion also handles the MIDI 2.0 only messages that have a MIDI 1.0
+	equivalent: program changes with a bank, RPNs and NRPNs.
+	The per-note controllers have none, so they're dropped.
+
+	SysEx data goes without the F0/F7 framing, 6 bytes per SysEx7 packet.
+	SysEx8 packets can only be turned back into MIDI 1.0 if all their bytes fit in 7 bits.
+
+*/
+
+#define UMP_MT_UTILITY			0x0
+#define UMP_MT_SYSTEM			0x1
+#define UMP_MT_MIDI1			0x2		// MIDI 1.0 channel voice, 32-bit
+#define UMP_MT_SYSEX7			0x3		// 64-bit
+#define UMP_MT_MIDI2			0x4		// MIDI 2.0 channel voice, 64-bit
+#define UMP_MT_SYSEX8			0x5		// 128-bit
+
+#define UMP_SYSEX_COMPLETE		0x0
+#define UMP_SYSEX_START			0x1
+#define UMP_SYSEX_CONTINUE		0x2
+#define UMP_SYSEX_END			0x3
+
+#define UMP_MIDI2_RPN			0x20
+#define UMP_MIDI2_NRPN			0x30
+
+#define UMP_MAX_WORDS			4
+#define UMP_MAX_MIDI1			4		// An RPN takes four CCs in MIDI 1.0
+#define UMP_SYSEX7_BYTES		6
+#define UMP_SYSEX8_BYTES		13
+
+#define UMP_PROTOCOL_MIDI1		0		// The driver sends MIDI 1.0 channel voice packets, bit for bit
+#define UMP_PROTOCOL_MIDI2		1		// The driver up-converts to MIDI 2.0 channel voice packets
+
+namespace WinDriver {
+	class UMP {
+	public:
+		// Words in the packet that starts with Word0
+		static unsigned int GetWords(DWORD Word0);
+
+		// Min-Center-Max scaling from the spec, and its inverse
+		static DWORD Upscale(DWORD Value, unsigned int SrcBits, unsigned int DstBits);
+		static DWORD Downscale(DWORD Value, unsigned int SrcBits, unsigned int DstBits);
+
+		// A short event (with its status byte) to a packet, returns the words written, 0 if it has no packet
+		static unsigned int FromMidi1(DWORD Event, BYTE Group, DWORD Protocol, DWORD* Words);
+
+		// A packet to short events, returns how many there are (up to UMP_MAX_MIDI1), 0 for SysEx and anything with no equivalent
+		static unsigned int ToMidi1(const DWORD* Words, DWORD* Events);
+
+		// SysEx data, without F0 and F7, split in SysEx7 packets
+		static unsigned int GetSysEx7Packets(DWORD Len);
+		static void SysEx7Packet(const BYTE* Data, DWORD Len, unsigned int Index, BYTE Group, DWORD* Words);
+
+		// Data bytes of a SysEx7/SysEx8 packet, and its UMP_SYSEX_* status.
+		// Returns -1 if it's not a SysEx packet, or it has 8-bit data
+		static int SysExPayload(const DWORD* Words, BYTE* Data, BYTE* Status);
+	};
+}
+
+#endif
@@ -11,8 +11,21 @@ This file is useful only if you want to compile the driver under Windows, it's n
 
 #define MAX_DRIVERS		4
 
-#define MAX_SE_BUF 32768
+// Output port 0 is the synth, port 1 is the loopback cable to the input device, see WinLoopback.hpp
+#define LOOPBACK_PORT	1
+
+// The short events buffer starts at DEF_SE_BUF, and grows/shrinks between the two limits
+#define MAX_SE_BUF 262144
+#define DEF_SE_BUF 32768
+#define MIN_SE_BUF 1024
+#define MAX_PR_BUF 512
+#define MAX_UMP_BUF 262144
 #define MAX_LE_BUF 256
+#define MAX_LE_SIZE 65536
+
+#define MAX_SYSEX_CACHE_ENTRIES	256
+#define MAX_SYSEX_CACHE_SIZE	512
+#define MAX_SYSEX_CACHE_PROBE	8
 
 #define MAX_MIDIHDR_BUF	256
 #define MIDIHDR_WRITTEN	29
\ No newline at end of file
@@ -3,6 +3,7 @@ using System.Collections.Generic;
 using System.Configuration;
 using System.Data;
 using System.Linq;
+using System.Runtime.InteropServices;
 using System.Threading.Tasks;
 using System.Windows;
 
@@ -13,5 +14,21 @@ namespace ShakraHost
     /// </summary>
     public partial class App : Application
     {
+        [DllImport("kernel32.dll", SetLastError = true)]
+        [return: MarshalAs(UnmanagedType.Bool)]
+        static extern bool AllocConsole();
+
+        protected override void OnStartup(StartupEventArgs e)
+        {
+            // Offline rendering doesn't need the UI, render and quit
+            if (e.Args.Length > 0 && e.Args[0] == "--render")
+            {
+                AllocConsole();
+                Shutdown(OfflineRender.Run(e.Args));
+                return;
+            }
+
+            base.OnStartup(e);
+        }
     }
 }
@@ -0,0 +1,251 @@
+﻿using System;
+using System.Diagnostics;
+using System.IO;
+using System.Runtime.InteropServices;
+using System.Threading.Tasks;
+using Un4seen.Bass;
+using Un4seen.Bass.AddOn.Midi;
+
+namespace ShakraHost
+{
+    /// <summary>
+    /// Renders a capture (or a MIDI file) to a WAV file as fast as the CPU allows.
+    /// Events go through the same SynthPipe consumer functions used by the live host,
+    /// and they're applied at fixed block boundaries, so the output is bit-identical between runs.
+    /// </summary>
+    public class OfflineRender
+    {
+        // Events are quantized to blocks of this size (2.9ms at 44.1kHz)
+        private const int BlockFrames = 128;
+
+        // Stop rendering the tail after this many seconds, even if the synth is still playing
+        private const int MaxTailSeconds = 10;
+
+        private int Rate = 44100;
+        private int Threads = 1;
+        private int[] Streams = null;
+        private int Font = 0;
+
+        // Usage: --render <capture or .mid> <output.wav> <soundfont> [--threads N] [--rate N]
+        public static int Run(string[] Args)
+        {
+            OfflineRender Renderer = new OfflineRender();
+
+            if (Args.Length < 4)
+            {
+                Console.WriteLine("Usage: ShakraHost --render <capture or .mid> <output.wav> <soundfont> [--threads N] [--rate N]");
+                return 1;
+            }
+
+            for (int i = 4; i + 1 < Args.Length; i += 2)
+            {
+                if (Args[i] == "--threads")
+                    Renderer.Threads = Math.Clamp(int.Parse(Args[i + 1]), 1, 16);
+                else if (Args[i] == "--rate")
+                    Renderer.Rate = int.Parse(Args[i + 1]);
+            }
+
+            return Renderer.Render(Args[1], Args[2], Args[3]) ? 0 : 1;
+        }
+
+        private bool Render(string Input, string Output, string SoundFont)
+        {
+            string Capture = Input;
+
+            if (Input.EndsWith(".mid", StringComparison.OrdinalIgnoreCase) || Input.EndsWith(".midi", StringComparison.OrdinalIgnoreCase))
+            {
+                Capture = Path.ChangeExtension(Path.GetTempFileName(), ".shkc");
+
+                if (!ShakraDLL.ConvertSMF(Input, Capture))
+                {
+                    Console.WriteLine("Failed to convert {0}.", Input);
+                    return false;
+                }
+            }
+
+            if (!ShakraDLL.CreateNamedPipe(String.Format("Offline{0}", Environment.ProcessId), 32768) || !ShakraDLL.OpenCaptureFile(Capture))
+            {
+                Console.WriteLine("Failed to open {0}.", Capture);
+                return false;
+            }
+
+            if (!InitSynth(SoundFont))
+            {
+                Console.WriteLine("Failed to initialize BASSMIDI ({0}).", Bass.BASS_ErrorGetCode());
+                return false;
+            }
+
+            Stopwatch Watch = Stopwatch.StartNew();
+            long Frames = RenderToFile(Output);
+            Watch.Stop();
+
+            double Seconds = (double)Frames / Rate;
+            Console.WriteLine("Rendered {0:F2}s of audio in {1:F2}s ({2:F2}x realtime, {3} thread(s)).",
+                Seconds, Watch.Elapsed.TotalSeconds, Seconds / Math.Max(Watch.Elapsed.TotalSeconds, 0.000001), Threads);
+
+            FreeSynth();
+            ShakraDLL.CloseCaptureFile();
+
+            if (Capture != Input)
+                File.Delete(Capture);
+
+            return true;
+        }
+
+        private bool InitSynth(string SoundFont)
+        {
+            // Device 0 is the "no sound" device, we only need decoding channels
+            if (!Bass.BASS_Init(0, Rate, BASSInit.BASS_DEVICE_DEFAULT, IntPtr.Zero))
+                return false;
+
+            Font = BassMidi.BASS_MIDI_FontInit(SoundFont, BASSFlag.BASS_DEFAULT);
+            if (Font == 0)
+                return false;
+
+            BASS_MIDI_FONT[] Fonts = { new BASS_MIDI_FONT(Font, -1, 0) };
+
+            // One stream per thread, each one owns a range of MIDI channels
+            Streams = new int[Threads];
+            for (int i = 0; i < Threads; i++)
+            {
+                Streams[i] = BassMidi.BASS_MIDI_StreamCreate(16, BASSFlag.BASS_STREAM_DECODE | BASSFlag.BASS_SAMPLE_FLOAT, Rate);
+                if (Streams[i] == 0)
+                    return false;
+
+                BassMidi.BASS_MIDI_StreamSetFonts(Streams[i], Fonts, Fonts.Length);
+            }
+
+            return true;
+        }
+
+        private void FreeSynth()
+        {
+            foreach (int Stream in Streams)
+                Bass.BASS_StreamFree(Stream);
+
+            BassMidi.BASS_MIDI_FontFree(Font);
+            Bass.BASS_Free();
+        }
+
+        private void DrainPipe()
+        {
+            byte[] ShortBuf = new byte[3];
+            IntPtr PEvent = IntPtr.Zero;
+            uint PEventS = 0;
+
+            while ((PEventS = ShakraDLL.ParseLongEventRef(out PEvent)) != 0)
+            {
+                // SysEx messages apply to all the channels, so every stream gets them
+                byte[] SysEx = new byte[PEventS];
+                Marshal.Copy(PEvent, SysEx, 0, (int)PEventS);
+                ShakraDLL.FreeLongEvent();
+
+                foreach (int Stream in Streams)
+                    BassMidi.BASS_MIDI_StreamEvents(Stream, BASSMIDIEventMode.MIDI_EVENTS_RAW, SysEx);
+            }
+
+            while (ShakraDLL.PerformBufferCheck())
+            {
+                uint Event = ShakraDLL.ParseShortEvent();
+                ShakraDLL.ResetReadHeadsIfNeeded(0);
+
+                byte Status = (byte)(Event & 0xFF);
+                int Length = ((Status & 0xE0) == 0xC0) ? 2 : 3;
+                byte[] Raw = (Length == 2) ? new byte[2] : ShortBuf;
+
+                Raw[0] = Status;
+                Raw[1] = (byte)(Event >> 8);
+                if (Length == 3) Raw[2] = (byte)(Event >> 16);
+
+                if (Status >= 0xF0)
+                {
+                    foreach (int Stream in Streams)
+                        BassMidi.BASS_MIDI_StreamEvents(Stream, BASSMIDIEventMode.MIDI_EVENTS_RAW, Raw);
+                }
+                else BassMidi.BASS_MIDI_StreamEvents(Streams[(Status & 0x0F) * Streams.Length / 16], BASSMIDIEventMode.MIDI_EVENTS_RAW, Raw);
+            }
+        }
+
+        private long RenderToFile(string Output)
+        {
+            float[][] Buffers = new float[Streams.Length][];
+            long Frames = 0, TailFrames = 0;
+            float Gain = 1.0f;
+
+            for (int i = 0; i < Streams.Length; i++)
+                Buffers[i] = new float[BlockFrames * 2];
+
+            using (BinaryWriter Writer = new BinaryWriter(File.Create(Output)))
+            {
+                WriteWAVHeader(Writer, 0);
+
+                while (true)
+                {
+                    // Integer math only, so that the blocks always get the same events
+                    ulong BlockEnd = (ulong)(Frames + BlockFrames) * 1000000UL / (ulong)Rate;
+
+                    while (ShakraDLL.FeedCaptureEvents(BlockEnd) != 0)
+                        DrainPipe();
+                    DrainPipe();
+
+                    // The control page is only read at block boundaries, like the events
+                    if (ShakraDLL.ReadControlState(out ControlState Control) && Control.GetGain() != Gain)
+                    {
+                        Gain = Control.GetGain();
+
+                        foreach (int Stream in Streams)
+                            Bass.BASS_ChannelSetAttribute(Stream, BASSAttribute.BASS_ATTRIB_VOL, Gain);
+                    }
+
+                    Parallel.For(0, Streams.Length, new ParallelOptions { MaxDegreeOfParallelism = Threads },
+                        i => Bass.BASS_ChannelGetData(Streams[i], Buffers[i], BlockFrames * 2 * sizeof(float)));
+
+                    // Always mix in the same order, float addition isn't associative
+                    bool Silent = true;
+                    for (int s = 0; s < BlockFrames * 2; s++)
+                    {
+                        float Sample = 0.0f;
+
+                        for (int i = 0; i < Buffers.Length; i++)
+                            Sample += Buffers[i][s];
+
+                        Silent &= (Sample == 0.0f);
+                        Writer.Write(Sample);
+                    }
+
+                    Frames += BlockFrames;
+
+                    if (ShakraDLL.IsCaptureDone())
+                    {
+                        TailFrames += BlockFrames;
+
+                        if (Silent || TailFrames >= (long)Rate * MaxTailSeconds)
+                            break;
+                    }
+                }
+
+                Writer.Seek(0, SeekOrigin.Begin);
+                WriteWAVHeader(Writer, Frames * 2 * sizeof(float));
+            }
+
+            return Frames;
+        }
+
+        private void WriteWAVHeader(BinaryWriter Writer, long DataSize)
+        {
+            // 32-bit float stereo, WAVE_FORMAT_IEEE_FLOAT
+            Writer.Write(new char[] { 'R', 'I', 'F', 'F' });
+            Writer.Write((uint)(36 + DataSize));
+            Writer.Write(new char[] { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+            Writer.Write(16);
+            Writer.Write((short)3);
+            Writer.Write((short)2);
+            Writer.Write(Rate);
+            Writer.Write(Rate * 2 * sizeof(float));
+            Writer.Write((short)(2 * sizeof(float)));
+            Writer.Write((short)32);
+            Writer.Write(new char[] { 'd', 'a', 't', 'a' });
+            Writer.Write((uint)DataSize);
+        }
+    }
+}
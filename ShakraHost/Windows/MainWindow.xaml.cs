@@ -65,12 +65,24 @@ namespace ShakraHost
         [return: MarshalAs(UnmanagedType.I1)]
         public static extern bool CreatePipe(out string Pipe, int Size);
 
+        // Mode is one of the PIPE_MODE_* values, the UMP ones carry everything as MIDI 2.0 packets
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_CPM", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool CreatePipeMode(string Pipe, int Size, uint Mode);
+
+        public const uint PIPE_MODE_LEGACY = 0;
+        public const uint PIPE_MODE_UMP_MIDI1 = 1;
+        public const uint PIPE_MODE_UMP_MIDI2 = 2;
+
         [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PSE")]
         public static extern uint ParseShortEvent();
 
         [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PLE")]
         public static extern unsafe uint ParseLongEvent(IntPtr PEvent);
 
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PLER")]
+        public static extern uint ParseLongEventRef(out IntPtr PEvent);
+
         [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_FLE")]
         [return: MarshalAs(UnmanagedType.I1)]
         public static extern bool FreeLongEvent();
@@ -87,6 +99,355 @@ namespace ShakraHost
         [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_BC")]
         [return: MarshalAs(UnmanagedType.I1)]
         public static extern bool PerformBufferCheck();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PSEB")]
+        public static extern uint ParseShortEventsBatch(byte[] Status, byte[] Channel, byte[] Data1, byte[] Data2, uint Max);
+
+        // UMP pipes only, the packets as they are, returns how many words got written
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PUP")]
+        public static extern uint ParseUMPPackets(uint[] Words, uint MaxWords);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBS")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool StartJitterBuffer(uint SampleRate, uint MinLatencyMs, uint MaxLatencyMs);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBX")]
+        public static extern void StopJitterBuffer();
+
+        // Offsets are the frames, inside the block, each event has to be played at
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBP")]
+        public static extern uint PullJitterBuffer(byte[] Status, byte[] Channel, byte[] Data1, byte[] Data2, uint[] Offsets, uint Max, uint Frames);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBL")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool IsLongEventDue(uint Frames);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBG")]
+        public static extern void GetJitterStats(out JitterStats Stats);
+
+        // Only works with the builds of the driver that have the trace points (SHAKRA_TRACING)
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_TRS", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool StartTrace(string Path, uint Format);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_TRX")]
+        public static extern void StopTrace();
+
+        // Call it right after handing a batch of events to the synth
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_TRD")]
+        public static extern void TraceDispatched();
+
+        public const uint TRACE_FORMAT_JSON = 0;
+        public const uint TRACE_FORMAT_BINARY = 1;
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_RCS")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool ReadControlState(out ControlState State);
+
+        // The events that bring a freshly reset synth to the state the apps left the channels in
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_CSE")]
+        public static extern uint BuildSyncEvents(uint[] Events, uint Max);
+
+        public const uint CHS_MAX_SYNC_EVENTS = 4096;
+
+        // Bumped every time the apps hint a new instrument, or uncache one
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_PHC")]
+        public static extern int GetPatchHintChanges();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_RPH")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool ReadPatchHints(out PatchHints Hints);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SHS")]
+        public static extern void SetHostStatus(uint Status);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SMU")]
+        public static extern void SetMute([MarshalAs(UnmanagedType.I1)] bool Mute);
+
+        // Four uints, bit N is CC N, none by default
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SPC")]
+        public static extern void SetPriorityCCs(uint[] Mask);
+
+        // Batch is in events, Delay in microseconds, a batch of 0 or 1 publishes every event right away
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SPB")]
+        public static extern void SetPublishBatching(uint Batch, uint Delay);
+
+        // Applied by the apps before queueing the events, the rules get copied
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_STR")]
+        public static extern void SetTransform(ref TransformRules Rules);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_CP", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool CreateNamedPipe(string Pipe, int Size);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_OSB", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool OpenStandby(string Pipe);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_WFT")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool WaitForTakeOver(uint Timeout);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_HB")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool Heartbeat();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_RHL")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool ReadHostLiveness(out HostLiveness Liveness);
+
+        // Owner side, the ranges are applied in order, whatever they don't cover stays with the owner
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SRT")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool SetRoutes(ref RouteRules Rules);
+
+        // Reads route 1 to 7 of the pipe instead of the whole pipe, the long events stay with the owner
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_ORT", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool OpenRoute(string Pipe, byte Route, int Size);
+
+        // Owner side, starts the clock the hosts of the pipe share
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SRK")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool SetRouteClock(uint SampleRate, uint LatencyMs);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_RRK")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool ReadRouteClock(out RouteClock Clock);
+
+        // Same as SH_JBS, on the shared clock, every host of the pipe has to use it
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_JBC")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool StartSharedJitterBuffer();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MA", CharSet = CharSet.Unicode)]
+        public static extern int MergerAddSource(string Pipe, int Size);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MD")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool MergerRemoveSource(int Source);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MF")]
+        public static extern void MergerSetFairness(uint MaxPerSource);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MBP")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool MergerSetBackPressure(int Source, uint Mode, uint MaxPending);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MB")]
+        public static extern uint MergeShortEventsBatch(byte[] Status, byte[] Channel, byte[] Data1, byte[] Data2, uint Max);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MLR")]
+        public static extern uint MergerParseLongEventRef(out IntPtr PEvent);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_MLF")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool MergerFreeLongEvent();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_OCF", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool OpenCaptureFile(string Path);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_CCF")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool CloseCaptureFile();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_FCE")]
+        public static extern uint FeedCaptureEvents(ulong Timestamp);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_GCL")]
+        public static extern ulong GetCaptureLength();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_ICD")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool IsCaptureDone();
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_CSMF", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool ConvertSMF(string SMFPath, string Path);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_SCR", CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool StartCaptureRecording(string Path);
+
+        [DllImport("shakra.dll", SetLastError = true, EntryPoint = "SH_ECR")]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool StopCaptureRecording();
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ControlState
+    {
+        public const uint HOST_STATUS_OFFLINE = 0;
+        public const uint HOST_STATUS_RUNNING = 1;
+        public const uint HOST_STATUS_STOPPING = 2;
+        public const uint HOST_STATUS_DEAD = 3;
+
+        // Low word is left, high word is right, like MODM_SETVOLUME
+        public uint Volume;
+        public uint Mute;
+        public uint ResetRequests;
+        public uint HostStatus;
+        public uint BackPressure;
+        public uint MaxPending;
+
+        // CCs that go through the priority lane, bit N is CC N
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 4)]
+        public uint[] PriorityCCs;
+
+        // Events the apps publish at once, and how long one can wait for the others, in microseconds
+        public uint PublishBatch;
+        public uint PublishDelay;
+
+        // What the apps send on UMP pipes, 0 for MIDI 1.0 packets, 1 for MIDI 2.0 ones
+        public uint UMPProtocol;
+
+        public TransformRules Transform;
+
+        public float GetGain()
+        {
+            if (Mute != 0)
+                return 0.0f;
+
+            return ((Volume & 0xFFFF) + (Volume >> 16)) / 131070.0f;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct TransformRules
+    {
+        public const byte XFORM_DROP = 0xFF;
+
+        public uint Enabled;
+        // Bit N set lets channel N through
+        public uint ChannelMask;
+        public byte NoteLow;
+        public byte NoteHigh;
+        // Semitones per channel
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 16)]
+        public sbyte[] Transpose;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 128)]
+        public byte[] VelocityCurve;
+        // XFORM_DROP drops the CC
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 128)]
+        public byte[] CCMap;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 2)]
+        public byte[] Reserved;
+
+        public static TransformRules Identity()
+        {
+            TransformRules Rules = new TransformRules
+            {
+                Enabled = 1,
+                ChannelMask = 0xFFFF,
+                NoteLow = 0,
+                NoteHigh = 127,
+                Transpose = new sbyte[16],
+                VelocityCurve = new byte[128],
+                CCMap = new byte[128],
+                Reserved = new byte[2]
+            };
+
+            for (int i = 0; i < 128; i++)
+            {
+                Rules.VelocityCurve[i] = (byte)i;
+                Rules.CCMap[i] = (byte)i;
+            }
+
+            return Rules;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PatchHints
+    {
+        public int Changes;
+        // Bank by program, four uints per bank
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 128 * 4)]
+        public uint[] Melodic;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 4)]
+        public uint[] Kits;
+        // Kit by key, four uints per kit
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 128 * 4)]
+        public uint[] DrumKeys;
+
+        public static bool IsHinted(uint[] Set, int Row, int Bit)
+        {
+            return (Set[Row * 4 + (Bit >> 5)] & (1u << (Bit & 31))) != 0;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct JitterStats
+    {
+        // Microseconds
+        public uint Delay;
+        public uint Jitter;
+        public uint LateEvents;
+        public uint Queued;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct HostLiveness
+    {
+        public int OwnerPID;
+        public int StandbyPID;
+        public int OwnerCursor;
+        public int OwnerPriorityCursor;
+        public int Takeovers;
+        public long Heartbeat;
+        // Microseconds between the last beat of the dead host and the standby taking over
+        public long HandoverTime;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RouteRange
+    {
+        public byte Route;
+        public byte FirstChannel;
+        public byte LastChannel;
+        // Only the note events look at the keys
+        public byte FirstKey;
+        public byte LastKey;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 3)]
+        public byte[] Reserved;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RouteRules
+    {
+        public const int MAX_ROUTES = 8;
+        public const int MAX_ROUTE_RANGES = 64;
+
+        public uint Count;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = MAX_ROUTE_RANGES)]
+        public RouteRange[] Ranges;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RouteClock
+    {
+        // QPC ticks of frame 0, 0 if the owner didn't start the clock
+        public long Anchor;
+        public uint SampleRate;
+        public uint LatencyMs;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct MIDIHDR
+    {
+        public const uint MHDR_PREPARED = 0x00000002;
+
+        public IntPtr lpData;
+        public uint dwBufferLength;
+        public uint dwBytesRecorded;
+        public IntPtr dwUser;
+        public uint dwFlags;
+        public IntPtr lpNext;
+        public IntPtr reserved;
+        public uint dwOffset;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 8)]
+        public IntPtr[] dwReserved;
     }
 
     class KDMAPI
@@ -182,6 +543,21 @@ namespace ShakraHost
         public Thread RenderThread = null;
         public string PipeID = "";
         public bool KillSwitch = false;
+
+        // Started with --standby <pipe>, waits for the host of that pipe to die before playing anything
+        public bool Standby = false;
+
+        // Started with --trace <file>, traces the hot path to it, as JSON if it ends with .json
+        public string TraceFile = null;
+
+        // Started with --batch <events>, lets the apps publish their events in batches, for offline rendering
+        public uint PublishBatch = 0;
+
+        // Started with --ump, creates a UMP pipe, the driver converts the packets back for KDMAPI
+        public bool UMP = false;
+
+        // Started with --transpose <semitones>, transposes every channel but the drums
+        public int Transpose = 0;
     }
 
     public partial class MainWindow : Window
@@ -221,18 +597,73 @@ namespace ShakraHost
             RH.Content = String.Format("SRH/SWH: {0:D6}/{1:D6}",
                 ShakraDLL.GetReadHeadPos(), ShakraDLL.GetWriteHeadPos());
 
-            WH.Content = String.Format("pre-alpha");
+            if (ShakraDLL.ReadHostLiveness(out HostLiveness Liveness) && Liveness.Takeovers > 0)
+                WH.Content = String.Format("Handovers: {0} (last one took {1:F2}ms)", Liveness.Takeovers, Liveness.HandoverTime / 1000.0);
+            else
+                WH.Content = String.Format("pre-alpha");
+
+            // Only copied when the apps hinted something new
+            int HintChanges = ShakraDLL.GetPatchHintChanges();
+            if (HintChanges != LastHintChanges && ShakraDLL.ReadPatchHints(out PatchHints Hints))
+            {
+                LastHintChanges = Hints.Changes;
+                PreloadPatches(Hints);
+            }
 
-            CurBuf.Content = "N/A";
+            CurBuf.Content = HintedPatches > 0 ? String.Format("Hinted: {0} instruments", HintedPatches) : "N/A";
+        }
+
+        private int LastHintChanges = 0;
+        private int HintedPatches = 0;
+
+        private void PreloadPatches(PatchHints Hints)
+        {
+            int Count = 0;
+
+            for (int Bank = 0; Bank < 128; Bank++)
+                for (int Program = 0; Program < 128; Program++)
+                    if (PatchHints.IsHinted(Hints.Melodic, Bank, Program))
+                        Count++;
+
+            for (int Kit = 0; Kit < 128; Kit++)
+                if (PatchHints.IsHinted(Hints.Kits, 0, Kit))
+                    Count++;
+
+            // KDMAPI has no call to load a single preset, OmniMIDI loads its soundfonts when the stream
+            // gets initialized, so for now the hints are only shown. A synth that can preload goes here
+            HintedPatches = Count;
         }
 
         private void StartThreads()
         {
             if (KDMAPI.InitializeKDMAPIStream() == 1)
             {
+                string[] Args = Environment.GetCommandLineArgs();
+
                 Pipe.PipeID = "0";
                 Pipe.RenderThread = new Thread(BASSThread);
 
+                // The synth is already up, so the standby only has to start reading when it takes over
+                if (Args.Length > 2 && Args[1] == "--standby")
+                {
+                    Pipe.PipeID = Args[2];
+                    Pipe.Standby = true;
+                }
+
+                int Trace = Array.IndexOf(Args, "--trace");
+                if (Trace > 0 && Trace + 1 < Args.Length)
+                    Pipe.TraceFile = Args[Trace + 1];
+
+                int Batch = Array.IndexOf(Args, "--batch");
+                if (Batch > 0 && Batch + 1 < Args.Length)
+                    UInt32.TryParse(Args[Batch + 1], out Pipe.PublishBatch);
+
+                Pipe.UMP = Array.IndexOf(Args, "--ump") > 0;
+
+                int Transpose = Array.IndexOf(Args, "--transpose");
+                if (Transpose > 0 && Transpose + 1 < Args.Length)
+                    Int32.TryParse(Args[Transpose + 1], out Pipe.Transpose);
+
                 DTimer.Tick += DTimerTick;
                 DTimer.Interval = new TimeSpan(0, 0, 0, 0, 10);
 
@@ -254,44 +685,150 @@ namespace ShakraHost
             // Pipe
             ShakraPipe TPipe;
 
-            // Short
-            MIDIEvent SEvent = new MIDIEvent(0x00000000);
+            // Short, decoded in batches by the driver
+            const uint BatchSize = 4096;
+            byte[] Status = new byte[BatchSize];
+            byte[] Channel = new byte[BatchSize];
+            byte[] Data1 = new byte[BatchSize];
+            byte[] Data2 = new byte[BatchSize];
+            uint Count = 0;
 
-            // Long
-            IntPtr PEvent;
+            // Long, read in place from the driver
+            IntPtr PEvent = IntPtr.Zero;
             uint PEventS = 0;
+            MIDIHDR LongHdr = new MIDIHDR { dwReserved = new IntPtr[8] };
+            IntPtr PLongHdr = IntPtr.Zero;
+
+            // Control page, checked once per loop
+            ControlState Control;
+            uint LastVolume = 0xFFFFFFFF, LastResets = 0;
+            bool LastMute = false;
+            IntPtr PVolumeSysEx = IntPtr.Zero;
 
             try
             {
                 TPipe = (ShakraPipe)Pipe;
-                PEvent = Marshal.AllocHGlobal(65536);
+                PLongHdr = Marshal.AllocHGlobal(Marshal.SizeOf(typeof(MIDIHDR)));
+                PVolumeSysEx = Marshal.AllocHGlobal(8);
+
+                if (TPipe.Standby)
+                {
+                    if (!ShakraDLL.OpenStandby(TPipe.PipeID))
+                        throw new Exception(String.Format("Failed to open pipe {0} as a standby.", TPipe.PipeID));
+
+                    // Short timeouts, so that the window can still be closed while waiting
+                    while (!TPipe.KillSwitch && !ShakraDLL.WaitForTakeOver(100)) ;
+                }
+                else if (TPipe.UMP)
+                {
+                    if (!ShakraDLL.CreatePipeMode(TPipe.PipeID, 16384, ShakraDLL.PIPE_MODE_UMP_MIDI2))
+                        throw new Exception(String.Format("Failed to create UMP pipe {0}.", TPipe.PipeID));
+
+                    ShakraDLL.SetHostStatus(ControlState.HOST_STATUS_RUNNING);
+                }
+                else
+                {
+                    ShakraDLL.CreatePipe(out TPipe.PipeID, 16384);
+                    ShakraDLL.SetHostStatus(ControlState.HOST_STATUS_RUNNING);
+                }
+
+                // Whatever the apps played before we got here, the synth has to catch up with it
+                uint[] SyncEvents = new uint[ShakraDLL.CHS_MAX_SYNC_EVENTS];
+                uint SyncCount = ShakraDLL.BuildSyncEvents(SyncEvents, ShakraDLL.CHS_MAX_SYNC_EVENTS);
+                for (uint i = 0; i < SyncCount; i++)
+                    KDMAPI.SendDirectData(SyncEvents[i]);
+
+                if (TPipe.PublishBatch > 1)
+                    ShakraDLL.SetPublishBatching(TPipe.PublishBatch, 0);
+
+                if (TPipe.Transpose != 0)
+                {
+                    TransformRules Rules = TransformRules.Identity();
+
+                    for (int i = 0; i < 16; i++)
+                        Rules.Transpose[i] = (i == 9) ? (sbyte)0 : (sbyte)Math.Max(-127, Math.Min(127, TPipe.Transpose));
+
+                    ShakraDLL.SetTransform(ref Rules);
+                }
+
+                if (TPipe.TraceFile != null)
+                    ShakraDLL.StartTrace(TPipe.TraceFile, TPipe.TraceFile.EndsWith(".json", StringComparison.OrdinalIgnoreCase) ? ShakraDLL.TRACE_FORMAT_JSON : ShakraDLL.TRACE_FORMAT_BINARY);
 
-                ShakraDLL.CreatePipe(out TPipe.PipeID, 16384);
                 DTimer.Start();
 
+                if (ShakraDLL.ReadControlState(out Control))
+                    LastResets = Control.ResetRequests;
+
                 while (!TPipe.KillSwitch)
                 {
-                    PEventS = ShakraDLL.ParseLongEvent(PEvent);
+                    // Another host took over the pipe while we were stuck, let it play
+                    if (!ShakraDLL.Heartbeat())
+                        break;
+
+                    if (ShakraDLL.ReadControlState(out Control))
+                    {
+                        if (Control.ResetRequests != LastResets)
+                        {
+                            LastResets = Control.ResetRequests;
+                            KDMAPI.ResetKDMAPIStream();
+
+                            // The reset brings the synth back to full volume
+                            LastVolume = 0xFFFFFFFF;
+                            LastMute = false;
+                        }
+
+                        if (Control.Volume != LastVolume || (Control.Mute != 0) != LastMute)
+                        {
+                            LastVolume = Control.Volume;
+                            LastMute = Control.Mute != 0;
+
+                            // KDMAPI has no volume control of its own, so use the Master Volume universal SysEx
+                            int Level = (int)(Control.GetGain() * 16383.0f);
+                            byte[] MasterVolume = { 0xF0, 0x7F, 0x7F, 0x04, 0x01, (byte)(Level & 0x7F), (byte)(Level >> 7), 0xF7 };
+                            Marshal.Copy(MasterVolume, 0, PVolumeSysEx, MasterVolume.Length);
+
+                            LongHdr.lpData = PVolumeSysEx;
+                            LongHdr.dwBufferLength = (uint)MasterVolume.Length;
+                            LongHdr.dwBytesRecorded = (uint)MasterVolume.Length;
+                            LongHdr.dwFlags = MIDIHDR.MHDR_PREPARED;
+                            Marshal.StructureToPtr(LongHdr, PLongHdr, false);
+
+                            KDMAPI.SendDirectLongData(PLongHdr);
+                        }
+                    }
+
+                    PEventS = ShakraDLL.ParseLongEventRef(out PEvent);
                     if (PEventS != 0)
-                        KDMAPI.SendDirectLongData(PEvent);
+                    {
+                        LongHdr.lpData = PEvent;
+                        LongHdr.dwBufferLength = PEventS;
+                        LongHdr.dwBytesRecorded = PEventS;
+                        LongHdr.dwFlags = MIDIHDR.MHDR_PREPARED;
+                        Marshal.StructureToPtr(LongHdr, PLongHdr, false);
 
-                    NtDelayExecution(false, -1);
+                        KDMAPI.SendDirectLongData(PLongHdr);
+                        ShakraDLL.FreeLongEvent();
+                    }
 
-                    if (!ShakraDLL.PerformBufferCheck())
-                        continue;
+                    NtDelayExecution(false, -1);
 
-                    int TempWH = ShakraDLL.GetWriteHeadPos();
-                    do
+                    while ((Count = ShakraDLL.ParseShortEventsBatch(Status, Channel, Data1, Data2, BatchSize)) != 0)
                     {
-                        SEvent.SetNewEvent(ShakraDLL.ParseShortEvent());
-                        uint dwParam1 = SEvent.GetWholeEvent();
-                        ShakraDLL.ResetReadHeadsIfNeeded(0);
+                        for (uint i = 0; i < Count; i++)
+                        {
+                            // No status byte and no running status, nothing to play
+                            if (Status[i] == 0)
+                                continue;
+
+                            KDMAPI.SendCustomEvent((uint)(Status[i] & 0xF0), Channel[i], (uint)(Data1[i] | Data2[i] << 8));
+                        }
 
-                        // KDMAPI.SendDirectDataNoBuf(dwParam1);
-                        KDMAPI.SendCustomEvent(SEvent.GetEventType(), SEvent.GetChannel(), (uint)SEvent.GetParams());
-                    } while (ShakraDLL.GetReadHeadPos() != TempWH);
+                        ShakraDLL.TraceDispatched();
+                    }
                 }
 
+                ShakraDLL.SetHostStatus(ControlState.HOST_STATUS_STOPPING);
+                ShakraDLL.StopTrace();
                 TPipe.KillSwitch = false;
             }
             catch (Exception ex)